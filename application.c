@@ -35,13 +35,22 @@
 #include "nrf_delay.h"
 #include "nrf_gpio.h"
 #include "softdevice_handler.h"
+#include "app_fifo.h"
+#include "app_timer.h"
 #include "bootloader.h"
 
 #include "config.h"
 #include "ble_manager.h"
 #include "dimmer_service.h"
 #include "led_strip.h"
+#include "easing.h"
 #include "memory.h"
+#include "whitelist.h"
+#include "presets.h"
+#include "light_state.h"
+#include "controllers.h"
+#include "scheduler.h"
+#include "vtimer.h"
 
 #include "application.h"
 
@@ -53,31 +62,127 @@
 /* Password for starting DFU Upgrade on char write */
 #define DFU_UPGRADE_CHAR_PASSWORD				0xA9
 
+/* Password for starting controllers learn mode on char write */
+#define LEARN_CONTROLLERS_CHAR_PASSWORD		0xB1
+
+/* Password for forgetting all trusted controllers on char write */
+#define FORGET_CONTROLLERS_CHAR_PASSWORD		0xB2
+
+/* Password for committing uploaded presets on char write */
+#define COMMIT_PRESETS_CHAR_PASSWORD			0xB3
+
+/* Period in ms of the check of flash writes before the reset to DFU mode */
+#define DFU_RESET_POLL_MS							10
+
 /* Default fade percentage value */
 #define DEF_FADE_PWM_PERCENT						10		/* 10 % */
 
-/* Number of PWM values groups */
-#define NUM_OF_PWM_VALUES_GROUPS					12
+/* Default fade easing curve */
+#define DEF_FADE_CURVE								EASING_CURVE_LINEAR
+
+/* Number of default presets */
+#define NUM_OF_DEFAULT_PRESETS					12
+
+/* Gesture state of the first preset. States from this one select presets by index */
+#define PRESET_FIRST_STATE							0x10
+
+/* Positions of payload v1 fields: gesture state, sequence number, gesture rate and phase */
+#define PAYLOAD_V1_STATE_POS						0
+#define PAYLOAD_V1_RATE_POS						2
+#define PAYLOAD_V1_PHASE_POS						3
+
+/* Gestures driving relative commands, as index of the lower nibble of the gesture state */
+#define GESTURE_X_ROT_R								0x02		/* brightness up */
+#define GESTURE_X_ROT_L								0x03		/* brightness down */
+#define GESTURE_Y_ROT_R								0x06		/* cooler colour temperature */
+#define GESTURE_Y_ROT_L								0x07		/* warmer colour temperature */
+
+/* Gesture rate unit in levels (0 - LED_LEVEL_MAX) per second and rate used if none is given */
+#define GESTURE_RATE_UNIT_LPS						16
+#define GESTURE_RATE_DEFAULT						32			/* 512 levels/s: full range in 8 s */
+
+/* Ramp duration of a single gesture and maximum ramp duration of a held gesture */
+#define GESTURE_NUDGE_MS							250
+#define GESTURE_HOLD_MAX_MS						10000
+
+/* Length of a command record in the commands ring: command type and payload */
+#define CMD_RECORD_LENGTH							(1 + CTRL_CMD_PAYLOAD_MAX_LENGTH)
+
+/* Number of command records of the commands ring. Must be a power of 2 */
+#define CMD_RING_RECORDS							8
+
+/* Size of the commands ring in bytes */
+#define CMD_RING_SIZE_BYTES						(CMD_RING_RECORDS * CMD_RECORD_LENGTH)
+
+#if (CMD_RING_SIZE_BYTES & (CMD_RING_SIZE_BYTES - 1)) != 0
+#error Commands ring size must be a power of 2 as required by app_fifo
+#endif
+
+/* Positions of command record fields */
+#define CMD_RECORD_TYPE_POS						0
+#define CMD_RECORD_PAYLOAD_POS					1
+
+/* Fade time codes of payload v2 up to this value are in units of FADE_CODE_SHORT_UNIT_MS, 
+   above it they are in units of FADE_CODE_LONG_UNIT_MS */
+#define FADE_CODE_SHORT_MAX							0x7F
+#define FADE_CODE_SHORT_UNIT_MS						20		/* 20 ms, up to 2.54 s */
+#define FADE_CODE_LONG_UNIT_MS						500		/* 500 ms, up to 63.5 s */
+
+/* TIMER0 prescaler timing boot phases: 16 MHz / 2^4 = 1 MHz */
+#define BOOT_TIMER_PRESCALER						4
 
 
 
 
 /* -------------- Local macros ---------------- */
 
+/* Macros to get a 12 bits channel level from payload v2. Levels are packed in little endian: 
+   2 levels every 3 bytes, the first one in the lower 12 bits */
+#define PAYLOAD_V2_LEVEL_LOW(p)					((uint16_t)((p)[0] | (((p)[1] & 0x0F) << 8)))
+#define PAYLOAD_V2_LEVEL_HIGH(p)					((uint16_t)(((p)[1] >> 4) | ((p)[2] << 4)))
+
+/* Macro to get the signed ramp rate in levels per second of a gesture rate byte */
+#define GESTURE_RATE_TO_LPS(x)						((int16_t)((((x) != 0) ? (x) : GESTURE_RATE_DEFAULT) * GESTURE_RATE_UNIT_LPS))
+
+/* Macro to convert a percentage to a channel level */
+#define PERCENT_TO_LED_LEVEL(x)					((((uint32_t)(x) * LED_LEVEL_MAX) + 50) / 100)
+
+/* Macro to define a default preset in percentages with the configured fade */
+#define DEFAULT_PRESET(r, g, b, w, curve)		PRESETS_ENTRY(PERCENT_TO_LED_LEVEL(r), PERCENT_TO_LED_LEVEL(g), PERCENT_TO_LED_LEVEL(b), PERCENT_TO_LED_LEVEL(w), PRESETS_FADE_CODE_DEFAULT, (curve))
+
+/* Macro to convert a fade time code of payload v2 to ms */
+#define FADE_CODE_TO_MS(x)							(((x) <= FADE_CODE_SHORT_MAX) ? ((uint32_t)(x) * FADE_CODE_SHORT_UNIT_MS) : ((uint32_t)((x) - FADE_CODE_SHORT_MAX - 1) * FADE_CODE_LONG_UNIT_MS))
+
+/* Macro to convert RTC ticks (32768 Hz) to us */
+#define RTC_TICKS_TO_US(x)							((uint32_t)(((uint64_t)(x) * 1000000) >> 15))
+
 /* Macro to set spacial value on GPREGRET register to start bootloader after reset */
 #define SET_REG_VALUE_TO_START_BOOTLOADER()  		(NRF_POWER->GPREGRET = BOOTLOADER_DFU_START)
  
 
 
 
+/* -------------- Local typedefs ---------------- */
+
+/* Gesture phases of payload v1 */
+typedef enum
+{
+	GESTURE_PHASE_SINGLE,		/* single gesture: nudge light */
+	GESTURE_PHASE_HOLD,			/* gesture is held: ramp light until release */
+	GESTURE_PHASE_RELEASE		/* held gesture is released: stop ramp */
+} gesture_phase_e;
+
+
+
+
 /* -------------- Local variables ---------------- */
 
 /* Default characteristic values */
 const uint8_t default_values[MEM_BUFFER_DATA_LENGTH] = 
 {
 	DEF_FADE_PWM_PERCENT,		/* Light - Fade */
-	0xFF,
-	0xFF,
+	DEF_FADE_CURVE,				/* Light - Fade curve */
+	DEF_LEARN_WINDOW_S,			/* Scan - Controllers learn window */
 	0xFF,
 	0xFF,
 	0xFF,
@@ -89,56 +194,96 @@ const uint8_t default_values[MEM_BUFFER_DATA_LENGTH] =
 /* Flag to indicate that adv timeout is elapsed */
 static volatile bool adv_timeout = false;
 
+/* Commands ring buffer and related FIFO. Commands are written from the scan path in interrupt 
+   context only and read from the main loop only */
+static uint8_t cmd_ring_buffer[CMD_RING_SIZE_BYTES];
+static app_fifo_t cmd_ring;
+
+/* Number of commands lost because the commands ring was full */
+static volatile uint32_t cmd_ring_overflows = 0;
+
+/* Task processing the commands ring */
+static uint8_t cmd_task = SCHED_INVALID_TASK;
+
+/* Task storing changed characteristic values at disconnection */
+static uint8_t disconn_flush_task = SCHED_INVALID_TASK;
+
+/* Task starting the bootloader once changed values are stored */
+static uint8_t dfu_reset_task = SCHED_INVALID_TASK;
+
+/* Flag indicating that changed values are being stored before the reset to DFU mode */
+static bool dfu_flush_started = false;
+
+/* Flag indicating that the last light state is stored or being written before the reset to DFU 
+   mode */
+static bool dfu_light_state_flushed = false;
+
+/* Timer posting the DFU reset task again while flash writes are in progress */
+static vtimer_st dfu_reset_timer;
+
+/* Time in us from the start of main() to each boot phase, 0 if not reached yet */
+static uint32_t boot_phase_us[NUM_OF_BOOT_PHASES];
+
+/* Flag indicating that boot phases are timed by TIMER0 */
+static bool boot_timer_running = false;
+
+/* RTC counter value and time in us when TIMER0 is handed over to the SoftDevice. Next boot 
+   phases are timed by RTC from them */
+static uint32_t boot_rtc_ref_ticks = 0;
+static uint32_t boot_rtc_ref_us = 0;
+
 
 /* Advertising data value and meaning */
 /*
 	0x10 -> "X UP"			
 	0x11 -> "X DOWN"
-	0x12 -> "X ROT R"
-	0x13 -> "X ROT L"
+	0x12 -> "X ROT R"		(relative: brightness up)
+	0x13 -> "X ROT L"		(relative: brightness down)
 	0x14 -> "Y UP"
 	0x15 -> "Y DOWN"
-	0x16 -> "Y ROT R"
-	0x17 -> "Y ROT L"
+	0x16 -> "Y ROT R"		(relative: cooler)
+	0x17 -> "Y ROT L"		(relative: warmer)
 	0x18 -> "Z UP"
 	0x19 -> "Z DOWN"
 	0x1A -> "Z ROT R"
 	0x1B -> "Z ROT L"	
+	0x1C - 0x4F -> uploaded presets only
 */
-/* PWM values associated to advertising value */
-static const uint8_t pwm_values[NUM_OF_PWM_VALUES_GROUPS][4] =
+/* Default presets associated to advertising value. They are used until presets are uploaded */
+static const uint8_t default_presets[NUM_OF_DEFAULT_PRESETS * PRESETS_ENTRY_LENGTH] =
 {
-/*
-	{100, 100, 100, 100},
-	{20, 20, 20, 20},
-	{0, 0, 0, 0},
-	{0, 0, 0, 0},
-	{0, 0, 100, 100},
-	{0, 0, 20, 20},
-	{0, 0, 0, 0},
-	{0, 0, 0, 0},
-	{20, 20, 0, 0},
-	{0, 0, 0, 0},
-	{0, 0, 0, 0},
-	{0, 0, 0, 0},
-*/
-	{ 10, 10, 10, 10},	/* good night */
-	{ 25, 25, 25, 25},	/* low */
-	{  0, 0, 0, 0},
-	{  0, 0, 0, 0},
-	{ 50, 50, 50, 50},	/* mid-low */
-	{ 75, 75, 75, 75},	/* mid-high */
-	{  0, 0, 0, 0},
-	{  0, 0, 0, 0},
-	{100, 100, 100, 100},	/* high */
-	{  0, 0, 0, 0},	/* OFF */ 
-	{  0, 0, 0, 0},
-	{  0, 0, 0, 0},
+	DEFAULT_PRESET( 10, 10, 10, 10, EASING_CURVE_OUT),			/* good night */
+	DEFAULT_PRESET( 25, 25, 25, 25, EASING_CURVE_DEFAULT),		/* low */
+	DEFAULT_PRESET(  0, 0, 0, 0, EASING_CURVE_DEFAULT),			/* relative */
+	DEFAULT_PRESET(  0, 0, 0, 0, EASING_CURVE_DEFAULT),			/* relative */
+	DEFAULT_PRESET( 50, 50, 50, 50, EASING_CURVE_DEFAULT),		/* mid-low */
+	DEFAULT_PRESET( 75, 75, 75, 75, EASING_CURVE_DEFAULT),		/* mid-high */
+	DEFAULT_PRESET(  0, 0, 0, 0, EASING_CURVE_DEFAULT),			/* relative */
+	DEFAULT_PRESET(  0, 0, 0, 0, EASING_CURVE_DEFAULT),			/* relative */
+	DEFAULT_PRESET(100, 100, 100, 100, EASING_CURVE_DEFAULT),	/* high */
+	DEFAULT_PRESET(  0, 0, 0, 0, EASING_CURVE_OUT),				/* OFF */ 
+	DEFAULT_PRESET(  0, 0, 0, 0, EASING_CURVE_DEFAULT),
+	DEFAULT_PRESET(  0, 0, 0, 0, EASING_CURVE_DEFAULT),
 };
 
 
 
 
+/* ---------------- Local functions prototypes --------------------- */
+
+static void cmd_post				(uint8_t, const uint8_t *);
+static void cmd_ring_process	(void);
+static void state_cmd_process	(const uint8_t *);
+static void levels_cmd_process	(const uint8_t *);
+static void gesture_ramp		(int16_t, int16_t, int16_t, int16_t, uint8_t);
+static void memory_evt_handler	(uint8_t);
+static void disconn_flush		(void);
+static void dfu_reset				(void);
+static void dfu_reset_timeout_handler	(void *);
+
+
+
+
 /* ---------------- Exported functions --------------------- */   
 
 /* indicate that advertising timeout is elapsed */
@@ -155,11 +300,23 @@ void app_on_special_op( uint8_t special_op_byte )
 	/* if received data is the password for DFU Upgrade */
 	if(special_op_byte == DFU_UPGRADE_CHAR_PASSWORD)
 	{
-		/* set special register value to start bootloader */
-		SET_REG_VALUE_TO_START_BOOTLOADER();
-
-		/* perform a system reset */
-		NVIC_SystemReset();
+		/* reset from the main loop: flash operations can not be waited here */
+		sched_task_post(dfu_reset_task);
+	}
+	else if(special_op_byte == LEARN_CONTROLLERS_CHAR_PASSWORD)
+	{
+		/* scan openly and trust found controllers */
+		ble_man_learn_start();
+	}
+	else if(special_op_byte == FORGET_CONTROLLERS_CHAR_PASSWORD)
+	{
+		/* remove all trusted controllers */
+		ble_man_whitelist_clear();
+	}
+	else if(special_op_byte == COMMIT_PRESETS_CHAR_PASSWORD)
+	{
+		/* use and store uploaded presets */
+		presets_commit();
 	}
 	else
 	{
@@ -168,34 +325,24 @@ void app_on_special_op( uint8_t special_op_byte )
 }
 
 
-/* callback on new adv scan */
-void application_on_new_scan( uint8_t new_adv_data )
+/* callback on new adv scan (payload v1). The command is processed in the main loop */
+void application_on_new_scan( const uint8_t *p_payload )
 {
-	uint8_t pwm_index;
-	/* if the upper nibble is as expected */
-	if(0x10 == (new_adv_data & 0xF0))
-	{
-		/* get PWM index */
-		pwm_index = (new_adv_data & 0x0F);
+	cmd_post(CTRL_CMD_STATE, p_payload);
+}
 
-		/* check data validity */
-		if(pwm_index < NUM_OF_PWM_VALUES_GROUPS)
-		{
-			/* update RGBW PWM values */
-			led_update_light(pwm_values[pwm_index][0],
-					 			  pwm_values[pwm_index][1],
-					 			  pwm_values[pwm_index][2],
-					 			  pwm_values[pwm_index][3]);
-		}
-		else
-		{
-			/* invalid data: do nothing */
-		}
-	}
-	else
-	{
-		/* wrong data: do nothing */
-	}
+
+/* callback on new absolute levels command (payload v2). The command is processed in the main loop */
+void application_on_new_levels( const uint8_t *p_payload )
+{
+	cmd_post(CTRL_CMD_LEVELS, p_payload);
+}
+
+
+/* Function to get the number of commands lost because the commands ring was full */
+uint32_t application_cmd_overflows_get( void )
+{
+	return cmd_ring_overflows;
 }
 
 
@@ -209,28 +356,59 @@ void application_on_conn( void )
 /* callback on disconnection event */
 void application_on_disconn( void )
 {
+	/* store changed characteristic values without waiting for the debounce. They are written 
+	   from the main loop */
+	sched_task_post(disconn_flush_task);
+
 	/* start avertising */
 	ble_man_adv_start();
 }
 
 
-/* init application */
+/* init application. Flash operations are not waited: stored values are read directly from flash 
+   by memory_init(), or defaults are used if none */
 void application_init( void )
 {
+	/* init commands ring and the task processing it */
+	APP_ERROR_CHECK(app_fifo_init(&cmd_ring, cmd_ring_buffer, CMD_RING_SIZE_BYTES));
+	cmd_task = sched_task_create(cmd_ring_process, SCHED_PRIO_HIGH);
+	APP_ERROR_CHECK_BOOL(cmd_task != SCHED_INVALID_TASK);
+	disconn_flush_task = sched_task_create(disconn_flush, SCHED_PRIO_NORMAL);
+	APP_ERROR_CHECK_BOOL(disconn_flush_task != SCHED_INVALID_TASK);
+	dfu_reset_task = sched_task_create(dfu_reset, SCHED_PRIO_HIGH);
+	APP_ERROR_CHECK_BOOL(dfu_reset_task != SCHED_INVALID_TASK);
+	vtimer_create(&dfu_reset_timer, VTIMER_MODE_SINGLE_SHOT, dfu_reset_timeout_handler);
+
 	/* init peripheral connection */
+	application_boot_phase_mark(BOOT_PHASE_STACK_START);
 	ble_man_init();
 
-	/* if persistent memory is initialised successfully */
-	if(true == memory_init(default_values))
+	/* init persistent memory. Completion is notified to memory_evt_handler() */
+	if(true == memory_init(default_values, memory_evt_handler))
 	{
-		/* wait for completion */
-		while(false != memory_is_busy());
+		/* stored values or defaults are published */
 	}
 	else
 	{
 		/* very bad, use default setting as recovery */
 	}
 
+	/* get trusted controllers */
+	if(true == whitelist_init())
+	{
+		/* scanning is filtered */
+	}
+	else
+	{
+		/* none stored: scanning is not filtered */
+	}
+
+	/* get stored presets. Default ones are used if none */
+	presets_init(default_presets, NUM_OF_DEFAULT_PRESETS);
+
+	/* init light state storage. Last light state is restored at the start of main() */
+	APP_ERROR_CHECK_BOOL(light_state_init());
+
 	/* init LED module */
 	led_light_init();
 
@@ -239,6 +417,7 @@ void application_init( void )
 
 	/* start scanning */
 	ble_man_scan_start();
+	application_boot_phase_mark(BOOT_PHASE_SCANNING);
 }
 
 
@@ -260,9 +439,331 @@ void application_run( void )
 	{
 		/* wait for adv timeout */
 	}
-	
-	/* manage light */
-	//led_manage_light();
+}
+
+
+
+
+/* Function to start timing boot phases. It must be called at the start of main(). Until the BLE 
+   stack is enabled the LF clock is not running, so TIMER0, reserved to the SoftDevice later, 
+   counts us */
+void application_boot_trace_start( void )
+{
+	NRF_TIMER0->MODE = TIMER_MODE_MODE_Timer;
+	NRF_TIMER0->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+	NRF_TIMER0->PRESCALER = BOOT_TIMER_PRESCALER;
+	NRF_TIMER0->TASKS_CLEAR = 1;
+	NRF_TIMER0->TASKS_START = 1;
+
+	boot_timer_running = true;
+}
+
+
+/* Function to record the time of a boot phase and report it to the boot timing hook. 
+   BOOT_PHASE_STACK_START hands TIMER0 over to the SoftDevice: next phases are timed by RTC1, 
+   which is started there and counts once the LF clock is started by the BLE stack */
+void application_boot_phase_mark( uint8_t phase )
+{
+	uint32_t now_ticks;
+	uint32_t elapsed_ticks;
+	uint32_t elapsed_us;
+
+	if(phase < NUM_OF_BOOT_PHASES)
+	{
+		if(true == boot_timer_running)
+		{
+			NRF_TIMER0->TASKS_CAPTURE[0] = 1;
+			elapsed_us = NRF_TIMER0->CC[0];
+
+			if(phase == BOOT_PHASE_STACK_START)
+			{
+				/* release TIMER0 before the SoftDevice is enabled */
+				NRF_TIMER0->TASKS_STOP = 1;
+				NRF_TIMER0->TASKS_SHUTDOWN = 1;
+				boot_timer_running = false;
+
+				/* RTC1 is otherwise started by the first app_timer start only, at the end of 
+				   the BLE manager init: start it now, so it counts from this value as soon as 
+				   the LF clock is started by the SoftDevice, and it is the base count of next 
+				   phases. TIMER0 cannot be kept until then, since the SoftDevice takes it when 
+				   enabled, so the LF clock start-up is the only time not counted. app_timer 
+				   takes the running counter as it is */
+				NRF_RTC1->TASKS_START = 1;
+				app_timer_cnt_get(&boot_rtc_ref_ticks);
+				boot_rtc_ref_us = elapsed_us;
+			}
+			else
+			{
+				/* do nothing */
+			}
+		}
+		else
+		{
+			app_timer_cnt_get(&now_ticks);
+			app_timer_cnt_diff_compute(now_ticks, boot_rtc_ref_ticks, &elapsed_ticks);
+			elapsed_us = boot_rtc_ref_us + RTC_TICKS_TO_US(elapsed_ticks);
+		}
+
+		boot_phase_us[phase] = elapsed_us;
+		BOOT_TIMING_HOOK(phase, elapsed_us);
+	}
+	else
+	{
+		/* invalid phase */
+	}
+}
+
+
+/* Function to get the time in us from the start of main() to a boot phase. It returns 0 if the 
+   phase is not reached yet */
+uint32_t application_boot_phase_us_get( uint8_t phase )
+{
+	uint32_t us = 0;
+
+	if(phase < NUM_OF_BOOT_PHASES)
+	{
+		us = boot_phase_us[phase];
+	}
+	else
+	{
+		/* invalid phase */
+	}
+
+	return us;
+}
+
+
+
+
+/* ---------------- Local functions --------------------- */
+
+/* Function to write a command in the commands ring and post the task processing it. The payload 
+   is CTRL_CMD_PAYLOAD_MAX_LENGTH bytes long. It runs in the scan path interrupt context, the only 
+   writer of the ring. A command is written entirely or it is counted as lost */
+static void cmd_post( uint8_t type, const uint8_t *p_payload )
+{
+	uint8_t record[CMD_RECORD_LENGTH];
+	uint32_t size = 0;
+
+	/* get free space */
+	app_fifo_write(&cmd_ring, NULL, &size);
+	if(size >= CMD_RECORD_LENGTH)
+	{
+		record[CMD_RECORD_TYPE_POS] = type;
+		memcpy(&record[CMD_RECORD_PAYLOAD_POS], p_payload, CTRL_CMD_PAYLOAD_MAX_LENGTH);
+
+		size = CMD_RECORD_LENGTH;
+		app_fifo_write(&cmd_ring, record, &size);
+
+		sched_task_post(cmd_task);
+	}
+	else
+	{
+		/* ring is full: command is lost */
+		cmd_ring_overflows++;
+	}
+}
+
+
+/* Task to process all commands in the commands ring. It runs in the main loop, the only reader 
+   of the ring */
+static void cmd_ring_process( void )
+{
+	uint8_t record[CMD_RECORD_LENGTH];
+	uint32_t size = CMD_RECORD_LENGTH;
+
+	/* records are always written entirely */
+	while(NRF_SUCCESS == app_fifo_read(&cmd_ring, record, &size))
+	{
+		if(record[CMD_RECORD_TYPE_POS] == CTRL_CMD_LEVELS)
+		{
+			levels_cmd_process(&record[CMD_RECORD_PAYLOAD_POS]);
+		}
+		else
+		{
+			state_cmd_process(&record[CMD_RECORD_PAYLOAD_POS]);
+		}
+
+		size = CMD_RECORD_LENGTH;
+	}
+}
+
+
+/* Function to process a controller state command (payload v1): gesture state, sequence number, 
+   gesture rate and phase */
+static void state_cmd_process( const uint8_t *p_payload )
+{
+	uint8_t preset_index;
+	int16_t rate;
+	preset_st preset;
+
+	/* if the state selects a preset */
+	if((p_payload[PAYLOAD_V1_STATE_POS] >= PRESET_FIRST_STATE)
+	&& (p_payload[PAYLOAD_V1_STATE_POS] < (PRESET_FIRST_STATE + PRESETS_MAX_NUM)))
+	{
+		/* get preset index */
+		preset_index = (uint8_t)(p_payload[PAYLOAD_V1_STATE_POS] - PRESET_FIRST_STATE);
+		rate = GESTURE_RATE_TO_LPS(p_payload[PAYLOAD_V1_RATE_POS]);
+
+		/* relative gestures ramp light, the others recall a preset */
+		if(preset_index == GESTURE_X_ROT_R)
+		{
+			gesture_ramp(rate, rate, rate, rate, p_payload[PAYLOAD_V1_PHASE_POS]);
+		}
+		else if(preset_index == GESTURE_X_ROT_L)
+		{
+			gesture_ramp(-rate, -rate, -rate, -rate, p_payload[PAYLOAD_V1_PHASE_POS]);
+		}
+		else if(preset_index == GESTURE_Y_ROT_R)
+		{
+			gesture_ramp(-rate, 0, rate, 0, p_payload[PAYLOAD_V1_PHASE_POS]);
+		}
+		else if(preset_index == GESTURE_Y_ROT_L)
+		{
+			gesture_ramp(rate, 0, -rate, 0, p_payload[PAYLOAD_V1_PHASE_POS]);
+		}
+		else if(true == presets_get(preset_index, &preset))
+		{
+			/* update RGBW levels */
+			led_update_levels(preset.levels[0],
+									preset.levels[1],
+									preset.levels[2],
+									preset.levels[3],
+									(preset.fade_code == PRESETS_FADE_CODE_DEFAULT) ? LED_FADE_DEFAULT : FADE_CODE_TO_MS(preset.fade_code),
+									preset.curve_id);
+		}
+		else
+		{
+			/* preset not defined: do nothing */
+		}
+	}
+	else
+	{
+		/* wrong data: do nothing */
+	}
+}
+
+
+/* Function to process an absolute levels command (payload v2): 4 channel levels of 12 bits 
+   packed in 6 bytes and a fade time code */
+static void levels_cmd_process( const uint8_t *p_payload )
+{
+	led_update_levels(PAYLOAD_V2_LEVEL_LOW(&p_payload[0]),
+							PAYLOAD_V2_LEVEL_HIGH(&p_payload[0]),
+							PAYLOAD_V2_LEVEL_LOW(&p_payload[3]),
+							PAYLOAD_V2_LEVEL_HIGH(&p_payload[3]),
+							FADE_CODE_TO_MS(p_payload[6]),
+							EASING_CURVE_DEFAULT);
+}
+
+
+/* Function to ramp light channels at the given rates according to the gesture phase */
+static void gesture_ramp( int16_t red_rate, int16_t green_rate, int16_t blue_rate, int16_t white_rate, uint8_t phase )
+{
+	if(phase == GESTURE_PHASE_SINGLE)
+	{
+		/* nudge light */
+		led_ramp_start(red_rate, green_rate, blue_rate, white_rate, GESTURE_NUDGE_MS);
+	}
+	else if(phase == GESTURE_PHASE_HOLD)
+	{
+		/* ramp until release, limited in time in case release is lost */
+		led_ramp_start(red_rate, green_rate, blue_rate, white_rate, GESTURE_HOLD_MAX_MS);
+	}
+	else if(phase == GESTURE_PHASE_RELEASE)
+	{
+		/* stop ramp */
+		led_ramp_stop();
+	}
+	else
+	{
+		/* unknown phase: do nothing */
+	}
+}
+
+
+/* Handler of persistent memory init events. It runs in the main loop */
+static void memory_evt_handler( uint8_t evt )
+{
+	switch(evt)
+	{
+		case MEM_EVT_CONFIG_AVAILABLE:
+		{
+			/* stored values are applied by config observers */
+			application_boot_phase_mark(BOOT_PHASE_CONFIG_AVAILABLE);
+			break;
+		}
+		case MEM_EVT_INIT_DONE:
+		{
+			application_boot_phase_mark(BOOT_PHASE_MEMORY_READY);
+			break;
+		}
+		default:
+		{
+			/* persistent storage failure: defaults are used */
+			break;
+		}
+	}
+}
+
+
+/* Task to store changed characteristic values at disconnection */
+static void disconn_flush( void )
+{
+	memory_flush();
+}
+
+
+/* Task to start the bootloader. Changed characteristic values and the last light state, which 
+   is otherwise stored at the end of its rate limit, are written at the first run. Then the task 
+   runs again every DFU_RESET_POLL_MS until flash writes are completed, so the main loop is never 
+   blocked meanwhile. A light state not accepted by memory is written again at each run */
+static void dfu_reset( void )
+{
+	if(false == dfu_flush_started)
+	{
+		/* write changed values. Pending writes of other records are completed as well */
+		memory_flush();
+		dfu_flush_started = true;
+	}
+	else
+	{
+		/* flush already started */
+	}
+
+	if(false == dfu_light_state_flushed)
+	{
+		dfu_light_state_flushed = light_state_flush();
+	}
+	else
+	{
+		/* light state stored or being written */
+	}
+
+	if((false == dfu_light_state_flushed)
+	|| (true == memory_is_busy())
+	|| (true == light_state_is_busy()))
+	{
+		/* check again later */
+		vtimer_start(&dfu_reset_timer, DFU_RESET_POLL_MS, NULL);
+	}
+	else
+	{
+		/* set special register value to start bootloader */
+		SET_REG_VALUE_TO_START_BOOTLOADER();
+
+		/* perform a system reset */
+		NVIC_SystemReset();
+	}
+}
+
+
+/* DFU reset timeout handler. Flash writes are checked again by the DFU reset task */
+static void dfu_reset_timeout_handler(void *p_context)
+{
+	UNUSED_PARAMETER(p_context);
+
+	sched_task_post(dfu_reset_task);
 }
 
 
@@ -30,15 +30,36 @@
 
 
 
+/* ---------------- Exported typedefs --------------------- */   
+
+/* Boot phases enum. Each phase is timed in us from the start of main() */
+typedef enum
+{
+	BOOT_PHASE_FIRST_LIGHT,			/* last light state restored on PWM */
+	BOOT_PHASE_STACK_START,			/* BLE stack init started */
+	BOOT_PHASE_SCANNING,				/* advertising and scanning started */
+	BOOT_PHASE_CONFIG_AVAILABLE,	/* effective CONFIG values published */
+	BOOT_PHASE_MEMORY_READY,		/* persistent memory init completed */
+	NUM_OF_BOOT_PHASES
+} boot_phase_e;
+
+
+
+
 /* ---------------- Exported functions prototypes --------------------- */   
 
 extern void app_on_adv_timeout		(void);
 extern void app_on_special_op			(uint8_t);
-extern void application_on_new_scan	(uint8_t);
+extern void application_on_new_scan	(const uint8_t *);
+extern void application_on_new_levels	(const uint8_t *);
+extern uint32_t application_cmd_overflows_get	(void);
 extern void application_on_conn		(void);
 extern void application_on_disconn	(void);
 extern void application_init			(void);
 extern void application_run			(void);
+extern void application_boot_trace_start	(void);
+extern void application_boot_phase_mark	(uint8_t);
+extern uint32_t application_boot_phase_us_get	(uint8_t);
 
 
 
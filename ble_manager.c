@@ -48,6 +48,11 @@
 #include "config.h"
 #include "ble_manager.h"
 #include "dimmer_service.h"
+#include "memory.h"
+#include "whitelist.h"
+#include "controllers.h"
+#include "scheduler.h"
+#include "vtimer.h"
 #include "application.h"
 
 
@@ -73,10 +78,6 @@
 /* The advertising timeout (in units of seconds). */
 #define APP_ADV_TIMEOUT_IN_SECONDS      	ADV_TIMEOUT_TO_START_SCAN_S                                        
 
-//TODO: consider to unify these two defines
-/* Value of the RTC1 PRESCALER register */
-#define APP_TIMER_PRESCALER              	0                                                                                                               
-
 /* Minimum acceptable connection interval (0.1 seconds) */
 #define MIN_CONN_INTERVAL                	MSEC_TO_UNITS(100, UNIT_1_25_MS)           
 
@@ -101,13 +102,24 @@
 /* TX Power Level value. This will be set both in the TX Power service, in the advertising data, and also used to set the radio transmit power */
 #define TX_POWER_LEVEL                     	TX_POWER_MEASURED_RSSI                                                                    
 
-/* Adv fixed fields values to scan and match */
-#define ADV_FLAGS_TYPE						BLE_GAP_AD_TYPE_FLAGS
-#define BR_EDR_NOT_SUPPORTED				BLE_GAP_ADV_FLAG_BR_EDR_NOT_SUPPORTED
+/* Adv fields values to scan and match */
 #define MANUF_DATA_TYPE						BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA
 #define MANUFACTURER_ID						TEMP_COMPANY_ID
-#define MANUF_DATA_LENGTH					11
 #define MANUF_SERVICE_ID					0x0110	
+#define MANUF_SERVICE_ID_V2					0x0111
+
+/* Length of payload v1: gesture state, sequence number, gesture rate and phase */
+#define PAYLOAD_V1_LENGTH					4
+
+/* Length of payload v2: 4 levels of 12 bits and fade time. Sequence number is the last data byte */
+#define PAYLOAD_V2_LENGTH					7
+
+/* Position of the AD structure length and type fields */
+#define AD_LENGTH_POS						0
+#define AD_TYPE_POS							1
+
+/* Length of AD structure length and type fields */
+#define AD_HEADER_LENGTH					2
 
 /* Scanning parameters */    
 /* TODO: consider to move the first 2 following defines to config.h */
@@ -117,11 +129,18 @@
 #define SCAN_WINDOW             			400		/* 250 ms */
 /* If 1, performe active scanning (scan requests) */                    
 #define SCAN_ACTIVE             			1 
-/* If 1, ignore unknown devices (non whitelisted) */                              
-#define SCAN_SELECTIVE          			0 
 /* Scan timeout. 0 means Disabled */                              
 #define SCAN_TIMEOUT            			0x0000     
 
+/* Position of controllers learn window in config values */
+#define LEARN_WINDOW_MEM_POSITION			(BLE_DIMMER_CONFIG_CHAR_POS + 2)
+
+/* Adv reports statistics period in ms */
+#define ADV_STATS_PERIOD_MS					60000	/* 1 minute */
+
+/* Delay before storing the whitelist again when the memory module does not accept it, in ms */
+#define WL_STORE_RETRY_MS						1000	/* 1 s */
+
 
 
 
@@ -133,14 +152,9 @@ typedef uint32_t serial_num_int;
 /* Device serial number string type */
 typedef char serial_num_string[12];
 
-/* Adv packet format to scan */
+/* Manufacturer specific data field format to scan. Positions are from first byte after AD type */
 typedef enum
 {
-	FIRST_LENGTH_POS,					/* first length */
-	ADV_TYPE_FLAGS_POS,					/* adv flags type */
-	BR_EDR_NOT_SUPPORTED_POS,			/* BR/EDR not supported */
-	SECOND_LENGTH_POS,					/* second length */
-	MANUF_DATA_TYPE_POS,				/* manufacturer data type */
 	MANUF_ID_BYTE_0_POS,				/* manufacturer ID lower byte */
 	MANUF_ID_BYTE_1_POS,				/* manufacturer ID higher byte */
 	MANUF_DATA_LENGTH_POS,				/* data length */
@@ -154,21 +168,51 @@ typedef enum
 	DATA_BYTE_5_POS,					/* data byte 5 */
 	DATA_BYTE_6_POS,					/* data byte 6 */
 	DATA_BYTE_7_POS,					/* data byte 7 */
-	CALIB_RSSI_POS,						/* calibrated RSSI */
-	ADV_DATA_PACKET_LENGTH				/* Adv packet length. This is not included. It is for fw purpose only */
-} adv_data_packet_e;
+	MANUF_FIELD_MIN_LENGTH				/* Minimum field length. Calibrated RSSI is not required */
+} manuf_field_e;
 
 
 
 
 /* ----------------------- Local variables ---------------------- */
 
-/* Store the last received data flag from adv packet */
-static uint8_t last_data = 0xFF;	/* ATTENTION: be sure that there is not a valid data as 0xFF */
-
 /* Structure to store advertising parameters */
 static ble_gap_adv_params_t adv_params;
 
+/* Controllers learn window timer */
+static vtimer_st learn_timer;
+
+/* Adv reports statistics timer */
+static vtimer_st adv_stats_timer;
+
+/* Whitelist store retry timer */
+static vtimer_st wl_store_timer;
+
+/* Flag indicating that controllers learn mode is active: scanning is not filtered and valid 
+   controllers are added to the whitelist */
+static volatile bool learn_mode = false;
+
+/* Controllers learn window in s */
+static volatile uint8_t learn_window_s = DEF_LEARN_WINDOW_S;
+
+/* Flag indicating that scanning is running */
+static bool scanning = false;
+
+/* Number of adv reports received in current statistics period */
+static volatile uint32_t adv_reports_count = 0;
+
+/* Number of adv reports received in last statistics period */
+static volatile uint32_t adv_reports_per_min = 0;
+
+/* Task updating adv reports statistics */
+static uint8_t adv_stats_task = SCHED_INVALID_TASK;
+
+/* Task ending the controllers learn window */
+static uint8_t learn_end_task = SCHED_INVALID_TASK;
+
+/* Task storing trusted controllers again after a failed store */
+static uint8_t wl_store_task = SCHED_INVALID_TASK;
+
 /* Structure to identify the DIMMER Service */
 static ble_dimmer_st m_dimmer;                                                                             
 
@@ -181,35 +225,17 @@ static ble_uuid_t adv_uuids[] =
     {BLE_UUID_DIMMER_SERVICE, DIMMER_SERVICE_UUID_TYPE},
 };
 
-/* Parameters used when scanning. */
-static const ble_gap_scan_params_t m_scan_params = 
+/* Parameters used when scanning. Whitelist is set at scan start */
+static ble_gap_scan_params_t m_scan_params = 
 {
 	.active      = SCAN_ACTIVE,
-	.selective   = SCAN_SELECTIVE,
+	.selective   = 0,
 	.p_whitelist = NULL,
 	.interval    = SCAN_INTERVAL,
 	.window      = SCAN_WINDOW,
 	.timeout     = SCAN_TIMEOUT
 };
 
-/* Preamble of the Adv packet. This string represent a fixed part of the adv packet */
-static const uint8_t preamble_adv[DATA_BYTE_0_POS] = 
-{
-	0x02,								/* first length */
-	ADV_FLAGS_TYPE,						/* adv flags type */
-	BR_EDR_NOT_SUPPORTED,				/* BR/EDR not supported */
-	(uint8_t)(MANUF_DATA_LENGTH + 4),	/* second length */
-	MANUF_DATA_TYPE,					/* manufacturer data type */
-	(uint8_t)MANUFACTURER_ID,			/* manufacturer ID lower byte */
-	(uint8_t)(MANUFACTURER_ID >> 8),	/* manufacturer ID higher byte */
-	MANUF_DATA_LENGTH,					/* manufacturer specific data length */
-	(uint8_t)MANUF_SERVICE_ID,			/* service ID lower byte */
-	(uint8_t)(MANUF_SERVICE_ID >> 8)	/* service ID higher byte */
-};
-
-
-
-
 /* ---------------------- Local macros ----------------------- */
 
 /* Define a pointer type to the device serial number stored in the UICR */
@@ -226,7 +252,17 @@ static void services_init(void);
 static void on_conn_params_evt(ble_conn_params_evt_t *);
 static void conn_params_error_handler(uint32_t);
 static void conn_params_init(void);
-static void get_advertising_fields(uint8_t *, uint8_t);
+static void get_advertising_fields(const ble_gap_evt_adv_report_t *);
+static bool manuf_data_handler(const ble_gap_evt_adv_report_t *, const uint8_t *, uint8_t);
+static void scan_params_set(void);
+static void scan_restart(void);
+static void learn_timeout_handler(void *);
+static void learn_end(void);
+static void wl_store(void);
+static void wl_store_timeout_handler(void *);
+static void adv_stats_timeout_handler(void *);
+static void adv_stats_update(void);
+static void learn_config_observer(void);
 static void on_ble_evt(ble_evt_t *);
 static void ble_evt_dispatch(ble_evt_t *);
 static void ble_stack_init(void);
@@ -375,46 +411,246 @@ static void conn_params_init(void)
 }
 
 
-/* Function to get advertising fields */
-static void get_advertising_fields(uint8_t *p_data, uint8_t data_length)
+/* Function to get advertising fields. AD structures are walked in a single pass without 
+   copying them, the dimmer manufacturer specific data field is found wherever it is in the 
+   packet, also after fields of other manufacturers */
+static void get_advertising_fields(const ble_gap_evt_adv_report_t *p_adv_report)
 {
-	/* consider only packets with a specific expected length */
-	if(data_length == ADV_DATA_PACKET_LENGTH)
+	const uint8_t *p_data = p_adv_report->data;
+	uint8_t data_length = (uint8_t)p_adv_report->dlen;
+	uint8_t index = 0;
+	uint8_t field_length;
+	bool walking = true;
+
+	/* walk AD structures: length, type and (length - 1) data bytes */
+	while((walking == true)
+	   && ((index + AD_HEADER_LENGTH) <= data_length))
 	{
-		/* if adv preamble is as expected */
-		if(0 == memcmp(p_data, &preamble_adv, DATA_BYTE_0_POS))
+		field_length = p_data[index + AD_LENGTH_POS];
+
+		/* if field is empty (early termination) or exceeds packet length */
+		if((field_length == 0)
+		|| ((index + field_length) >= data_length))
 		{
-			/* preamble is valid. Device found */
-			/* get new data byte */
-			uint8_t new_data = p_data[DATA_BYTE_0_POS];
-			/* ATTENTION: everything else is not considered at the moment */
-	
-			/* if new data byte is different than the last one */
-			if(new_data != last_data)
+			/* malformed or terminated packet: stop here */
+			walking = false;
+		}
+		/* if dimmer manufacturer specific data field */
+		else if((p_data[index + AD_TYPE_POS] == MANUF_DATA_TYPE)
+			 && (true == manuf_data_handler(p_adv_report, &p_data[index + AD_HEADER_LENGTH], (uint8_t)(field_length - 1))))
+		{
+			/* managed: stop walking, only one is expected */
+			walking = false;
+		}
+		else
+		{
+			/* go to next field */
+			index = (uint8_t)(index + field_length + 1);
+		}
+	}
+}
+
+
+/* Function to manage a manufacturer specific data field. The field is rejected at the first 
+   byte not matching the expected format, then it is dispatched by service ID. It returns true 
+   if the field is a dimmer command, false if it belongs to another manufacturer or service */
+static bool manuf_data_handler(const ble_gap_evt_adv_report_t *p_adv_report, const uint8_t *p_field, uint8_t field_length)
+{
+	uint16_t service_id;
+	uint8_t cmd_type;
+	uint8_t cmd_seq;
+	uint8_t cmd_length;
+	bool valid = false;
+
+	/* check field length, manufacturer ID and data length in sequence */
+	if((field_length >= MANUF_FIELD_MIN_LENGTH)
+	&& (p_field[MANUF_ID_BYTE_0_POS] == (uint8_t)MANUFACTURER_ID)
+	&& (p_field[MANUF_ID_BYTE_1_POS] == (uint8_t)(MANUFACTURER_ID >> 8))
+	&& (p_field[MANUF_DATA_LENGTH_POS] >= (MANUF_FIELD_MIN_LENGTH - SERVICE_ID_BYTE_0_POS)))
+	{
+		valid = true;
+		service_id = (uint16_t)(p_field[SERVICE_ID_BYTE_0_POS] | (p_field[SERVICE_ID_BYTE_1_POS] << 8));
+		switch(service_id)
+		{
+			case MANUF_SERVICE_ID:
+			{
+				/* gesture state, sequence number, gesture rate and phase */
+				cmd_type = CTRL_CMD_STATE;
+				cmd_seq = p_field[DATA_BYTE_1_POS];
+				cmd_length = PAYLOAD_V1_LENGTH;
+				break;
+			}
+			case MANUF_SERVICE_ID_V2:
+			{
+				/* channel levels, fade time and sequence number */
+				cmd_type = CTRL_CMD_LEVELS;
+				cmd_seq = p_field[DATA_BYTE_7_POS];
+				cmd_length = PAYLOAD_V2_LENGTH;
+				break;
+			}
+			default:
 			{
-				/* store last data byte */
-				last_data = new_data;
+				/* unknown service */
+				valid = false;
+				break;
+			}
+		}
 
-				/* send to application related data */
-				application_on_new_scan(new_data);
+		if(valid == true)
+		{
+			/* field is valid. Device found */
+			/* trust it if learning controllers */
+			if(learn_mode == true)
+			{
+				whitelist_add(&p_adv_report->peer_addr);
+			}
+			else
+			{
+				/* do nothing */
+			}
 
+			/* send command to controllers table */
+			if(true == ctrl_cmd_receive(&p_adv_report->peer_addr, 
+												 p_adv_report->rssi, 
+												 cmd_type,
+												 cmd_seq, 
+												 &p_field[DATA_BYTE_0_POS],
+												 cmd_length))
+			{
 #ifdef LED_DEBUG
 				nrf_gpio_pin_toggle(7);
 #endif
 			}
 			else
 			{
-				/* invalid preset index: do nothing */
-			}			
+				/* repeated or old command: do nothing */
+			}
 		}
 		else
 		{
-			/* wrong preamble. discard it */
+			/* discard it */
 		}
 	}
 	else
 	{
-		/* discard it */
+		/* not a dimmer field: discard it */
+	}
+
+	return valid;
+}
+
+
+/* Function to set scan parameters. Scanning is filtered by the SoftDevice whitelist if 
+   there are trusted controllers and learn mode is not active */
+static void scan_params_set(void)
+{
+	if((learn_mode == false)
+	&& (whitelist_count_get() > 0))
+	{
+		m_scan_params.selective = 1;
+		m_scan_params.p_whitelist = whitelist_get();
+	}
+	else
+	{
+		m_scan_params.selective = 0;
+		m_scan_params.p_whitelist = NULL;
+	}
+}
+
+
+/* Function to restart scanning with updated parameters */
+static void scan_restart(void)
+{
+	/* if scanning */
+	if(scanning == true)
+	{
+		sd_ble_gap_scan_stop();
+		ble_man_scan_start();
+	}
+	else
+	{
+		/* parameters are updated at next start */
+	}
+}
+
+
+/* Controllers learn window timeout handler. The window is ended by the related task */
+static void learn_timeout_handler(void *p_context)
+{
+	UNUSED_PARAMETER(p_context);
+
+	sched_task_post(learn_end_task);
+}
+
+
+/* Task to end the controllers learn window */
+static void learn_end(void)
+{
+	/* store learned controllers and go back to filtered scanning */
+	learn_mode = false;
+	wl_store();
+	scan_restart();
+}
+
+
+/* Function to store trusted controllers. If the memory module does not accept the record, 
+   e.g. while all its write callbacks are in use, the store is retried later */
+static void wl_store(void)
+{
+	if(false == whitelist_store())
+	{
+		vtimer_start(&wl_store_timer, WL_STORE_RETRY_MS, NULL);
+	}
+	else
+	{
+		/* addresses are written in background */
+	}
+}
+
+
+/* Whitelist store retry timeout handler. The current addresses are stored by the related task */
+static void wl_store_timeout_handler(void *p_context)
+{
+	UNUSED_PARAMETER(p_context);
+
+	sched_task_post(wl_store_task);
+}
+
+
+/* Adv reports statistics timeout handler. Statistics are updated by the related task */
+static void adv_stats_timeout_handler(void *p_context)
+{
+	UNUSED_PARAMETER(p_context);
+
+	sched_task_post(adv_stats_task);
+}
+
+
+/* Task to update adv reports statistics */
+static void adv_stats_update(void)
+{
+	/* adv reports are counted in interrupt context */
+	CRITICAL_REGION_ENTER();
+	adv_reports_per_min = adv_reports_count;
+	adv_reports_count = 0;
+	CRITICAL_REGION_EXIT();
+}
+
+
+/* Config observer function to get controllers learn window */
+static void learn_config_observer(void)
+{
+	uint8_t config_values[MEM_BUFFER_DATA_LENGTH];
+
+	memory_config_get(config_values);
+	if((config_values[LEARN_WINDOW_MEM_POSITION] != 0)
+	&& (config_values[LEARN_WINDOW_MEM_POSITION] != 0xFF))
+	{
+		learn_window_s = config_values[LEARN_WINDOW_MEM_POSITION];
+	}
+	else
+	{
+		learn_window_s = DEF_LEARN_WINDOW_S;
 	}
 }
 
@@ -432,14 +668,15 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
 		case BLE_GAP_EVT_ADV_REPORT:
         {
             const ble_gap_evt_adv_report_t *p_adv_report = &p_gap_evt->params.adv_report;
-			
-			//TODO: consider to check a specific addess (p_adv_report->peer_addr)
+
+			/* count it for statistics */
+			adv_reports_count++;
 			
 			/* if advertising packet and no scan response */
 			if(p_adv_report->scan_rsp == 0)
  			{
 				/* get advertising fields */
-				get_advertising_fields((uint8_t *)p_adv_report->data, (uint8_t)p_adv_report->dlen);
+				get_advertising_fields(p_adv_report);
 			}
 			else
 			{
@@ -631,6 +868,28 @@ void ble_man_init(void)
 	services_init();
 	/* init connection params */
 	conn_params_init();
+
+	/* init controllers table */
+	ctrl_init();
+
+	/* get controllers learn window from config values */
+	APP_ERROR_CHECK_BOOL(memory_config_observer_register(learn_config_observer));
+
+	/* create controllers learn window task, then init its timer */
+	learn_end_task = sched_task_create(learn_end, SCHED_PRIO_NORMAL);
+	APP_ERROR_CHECK_BOOL(learn_end_task != SCHED_INVALID_TASK);
+	vtimer_create(&learn_timer, VTIMER_MODE_SINGLE_SHOT, learn_timeout_handler);
+
+	/* create whitelist store retry task, then init its timer */
+	wl_store_task = sched_task_create(wl_store, SCHED_PRIO_NORMAL);
+	APP_ERROR_CHECK_BOOL(wl_store_task != SCHED_INVALID_TASK);
+	vtimer_create(&wl_store_timer, VTIMER_MODE_SINGLE_SHOT, wl_store_timeout_handler);
+
+	/* create adv reports statistics task, then init and start its timer */
+	adv_stats_task = sched_task_create(adv_stats_update, SCHED_PRIO_LOW);
+	APP_ERROR_CHECK_BOOL(adv_stats_task != SCHED_INVALID_TASK);
+	vtimer_create(&adv_stats_timer, VTIMER_MODE_REPEATED, adv_stats_timeout_handler);
+	vtimer_start(&adv_stats_timer, ADV_STATS_PERIOD_MS, NULL);
 }
 
 
@@ -639,9 +898,13 @@ void ble_man_scan_start(void)
 {
 	uint32_t err_code;
 
+	/* set whitelist */
+	scan_params_set();
+
 	/* start scanning */
 	err_code = sd_ble_gap_scan_start(&m_scan_params);
 	APP_ERROR_CHECK(err_code);
+	scanning = true;
 }
 
 
@@ -650,6 +913,36 @@ void ble_man_scan_stop(void)
 {
 	/* stop scanning */
 	sd_ble_gap_scan_stop();
+	scanning = false;
+}
+
+
+/* Function to start learning controllers. Scanning is not filtered for the configured learn 
+   window and valid controllers found are added to the whitelist and stored at the end */
+void ble_man_learn_start(void)
+{
+	learn_mode = true;
+	scan_restart();
+
+	/* (re)start learn window */
+	vtimer_start(&learn_timer, (uint32_t)learn_window_s * 1000, NULL);
+}
+
+
+/* Function to forget all trusted controllers. Scanning is not filtered until new controllers 
+   are learned */
+void ble_man_whitelist_clear(void)
+{
+	whitelist_clear();
+	wl_store();
+	scan_restart();
+}
+
+
+/* Function to get the number of adv reports received in last minute */
+uint32_t ble_man_adv_reports_per_min_get(void)
+{
+	return adv_reports_per_min;
 }
 
 
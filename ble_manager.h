@@ -31,6 +31,9 @@ extern void ble_man_scan_start	(void);
 extern void ble_man_scan_stop	(void);
 extern void ble_man_adv_start	(void);
 extern void ble_man_adv_stop	(void);
+extern void ble_man_learn_start	(void);
+extern void ble_man_whitelist_clear	(void);
+extern uint32_t ble_man_adv_reports_per_min_get	(void);
 
 
 
@@ -27,6 +27,25 @@
 /* Uncomment following define to enable LED debug feature */
 #define LED_DEBUG
 
+/* Comment following define to restart a linear fade on a new light request during a running fade.
+   When defined the running fade is smoothly retargeted keeping the current velocity */
+#define FADE_SMOOTH_RETARGET
+
+/* Comment following define to round fractional PWM ticks to the nearest tick. When defined the 
+   fractional part is dithered over consecutive PWM periods, giving finer average levels */
+#define LED_PWM_DITHERING
+
+
+/* Value of the RTC1 PRESCALER register, shared by app_timer users. All software timers are 
+   virtual timers on a single app_timer (see vtimer.c) */
+#define APP_TIMER_PRESCALER								0
+
+/* Boot timing hook, called with a boot phase (see application.h) and the time in us elapsed 
+   since the start of main(). Define it to trace boot timings, e.g. by app_trace_log() */
+#define BOOT_TIMING_HOOK(phase, us)
+
+/* Default controllers learn mode window in s. Used when CONFIG byte 2 is 0 or 0xFF */
+#define DEF_LEARN_WINDOW_S								30		/* 30s */
 
 /* Advertising timeout in s after than scanning is kicked */
 #define ADV_TIMEOUT_TO_START_SCAN_S					10		/* 10s */
@@ -0,0 +1,351 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* ------------- Inclusions --------------- */
+
+#include <string.h>
+#include "nordic_common.h"
+#include "nrf.h"
+#include "app_error.h"
+#include "app_timer.h"
+
+#include "config.h"
+#include "vtimer.h"
+#include "application.h"
+#include "controllers.h"
+
+
+
+
+/* ------------- Local defines --------------- */
+
+/* Maximum number of probed entries for an address, starting from its hash position */
+#define CTRL_TABLE_MAX_PROBES					4
+
+/* Mask to get a table index from a hash value */
+#define CTRL_TABLE_INDEX_MASK					(CTRL_TABLE_SIZE - 1)
+
+/* Number of sequence numbers after the last one which are accepted as new */
+#define CTRL_SEQ_WINDOW							64
+
+/* Time in ms after which a controller is considered restarted and any sequence number is 
+   accepted */
+#define CTRL_RESYNC_TIMEOUT_MS				10000	/* 10 s */
+
+/* Time in ms during which commands from the same controller are coalesced. It is the fade tick */
+#define CTRL_COALESCE_TIME_MS					20		/* 20 ms */
+
+/* RTC counter mask (24 bits) */
+#define RTC_COUNTER_MASK						0x00FFFFFF
+
+/* FNV-1a 32 bits hash parameters */
+#define FNV_OFFSET_BASIS						0x811C9DC5
+#define FNV_PRIME									0x01000193
+
+#if (CTRL_TABLE_SIZE & CTRL_TABLE_INDEX_MASK) != 0
+#error CTRL_TABLE_SIZE must be a power of 2
+#endif
+
+
+
+
+/* ------------- Local typedefs --------------- */
+
+/* Controller entry structure */
+typedef struct
+{
+	ble_gap_addr_t addr;		/* peer address */
+	uint32_t last_seen;		/* RTC counter value at last valid command */
+	int8_t last_rssi;			/* RSSI of last valid command */
+	uint8_t last_seq;			/* sequence number of last accepted command */
+	uint8_t last_type;		/* type of last accepted command */
+	uint8_t last_length;		/* payload length of last accepted command */
+	uint8_t last_payload[CTRL_CMD_PAYLOAD_MAX_LENGTH];	/* payload of last accepted command */
+	bool used;					/* entry in use */
+	bool synced;				/* a command has been accepted */
+	bool pending;				/* last accepted command is waiting to be sent to application */
+} ctrl_entry_st;
+
+
+
+
+/* ------------- Local variables --------------- */
+
+/* Controllers table */
+static ctrl_entry_st ctrl_table[CTRL_TABLE_SIZE];
+
+/* Commands coalescing timer */
+static vtimer_st coalesce_timer;
+
+/* Flag indicating that coalescing timer is running */
+static bool coalesce_timer_running = false;
+
+
+
+
+/* ------------- Local functions prototypes --------------- */
+
+static uint32_t addr_hash					(const ble_gap_addr_t *);
+static ctrl_entry_st * entry_get			(const ble_gap_addr_t *, uint32_t);
+static bool cmd_is_new						(const ctrl_entry_st *, uint8_t, uint8_t, const uint8_t *, uint8_t, uint32_t);
+static void coalesce_timeout_handler	(void *);
+
+
+
+
+/* ------------- Exported functions --------------- */
+
+/* Function to init controllers table */
+void ctrl_init(void)
+{
+	memset(ctrl_table, 0, sizeof(ctrl_table));
+
+	/* init commands coalescing timer */
+	vtimer_create(&coalesce_timer, VTIMER_MODE_SINGLE_SHOT, coalesce_timeout_handler);
+}
+
+
+/* Function to receive a valid command from a controller. The command is accepted if its 
+   sequence number is in the window after the last one, or if it has the same sequence number 
+   and different content (controllers not managing sequence numbers). Accepted commands of the 
+   same controller are coalesced for one fade tick and only the newest one is sent to 
+   application. It returns true if the command has been accepted */
+bool ctrl_cmd_receive(const ble_gap_addr_t *p_addr, int8_t rssi, uint8_t type, uint8_t seq, const uint8_t *p_payload, uint8_t length)
+{
+	uint32_t now_ticks;
+	ctrl_entry_st *p_entry;
+	bool accepted = false;
+
+	app_timer_cnt_get(&now_ticks);
+
+	if(length > CTRL_CMD_PAYLOAD_MAX_LENGTH)
+	{
+		length = CTRL_CMD_PAYLOAD_MAX_LENGTH;
+	}
+	else
+	{
+		/* valid length */
+	}
+
+	p_entry = entry_get(p_addr, now_ticks);
+	if(true == cmd_is_new(p_entry, type, seq, p_payload, length, now_ticks))
+	{
+		p_entry->last_seq = seq;
+		p_entry->last_type = type;
+		p_entry->last_length = length;
+		memcpy(p_entry->last_payload, p_payload, length);
+		p_entry->synced = true;
+		/* overwrite any older command not sent yet */
+		p_entry->pending = true;
+		accepted = true;
+
+		/* start coalescing if not already running */
+		if(coalesce_timer_running == false)
+		{
+			coalesce_timer_running = true;
+			vtimer_start(&coalesce_timer, CTRL_COALESCE_TIME_MS, NULL);
+		}
+		else
+		{
+			/* command is sent at coalescing timeout */
+		}
+	}
+	else
+	{
+		/* repeated or old command: discard it */
+	}
+
+	/* controller is alive anyway */
+	p_entry->last_seen = now_ticks;
+	p_entry->last_rssi = rssi;
+
+	return accepted;
+}
+
+
+
+
+/* ------------- Local functions --------------- */
+
+/* Function to calculate the FNV-1a hash of an address */
+static uint32_t addr_hash(const ble_gap_addr_t *p_addr)
+{
+	uint32_t hash = FNV_OFFSET_BASIS;
+
+	hash = (hash ^ p_addr->addr_type) * FNV_PRIME;
+	for(uint8_t i=0; i<BLE_GAP_ADDR_LEN; i++)
+	{
+		hash = (hash ^ p_addr->addr[i]) * FNV_PRIME;
+	}
+
+	return hash;
+}
+
+
+/* Function to get the table entry of an address. Only CTRL_TABLE_MAX_PROBES entries from 
+   the hash position are probed: if the address is not found it takes the first free one or, 
+   if all of them are used, the least recently seen one */
+static ctrl_entry_st * entry_get(const ble_gap_addr_t *p_addr, uint32_t now_ticks)
+{
+	ctrl_entry_st *p_entry;
+	ctrl_entry_st *p_found = NULL;
+	ctrl_entry_st *p_free = NULL;
+	uint32_t age;
+	uint32_t oldest_age = 0;
+	uint32_t index = addr_hash(p_addr);
+
+	for(uint8_t i=0; i<CTRL_TABLE_MAX_PROBES; i++)
+	{
+		p_entry = &ctrl_table[(index + i) & CTRL_TABLE_INDEX_MASK];
+
+		/* if free entry: address is not in the table */
+		if(p_entry->used == false)
+		{
+			p_free = p_entry;
+			break;
+		}
+		/* if address found */
+		else if((p_entry->addr.addr_type == p_addr->addr_type)
+			  && (0 == memcmp(p_entry->addr.addr, p_addr->addr, BLE_GAP_ADDR_LEN)))
+		{
+			p_found = p_entry;
+			break;
+		}
+		else
+		{
+			/* keep the least recently seen entry without pending commands */
+			age = (now_ticks - p_entry->last_seen) & RTC_COUNTER_MASK;
+			if((p_entry->pending == false)
+			&& ((p_free == NULL) || (age > oldest_age)))
+			{
+				p_free = p_entry;
+				oldest_age = age;
+			}
+		}
+	}
+
+	/* if new controller */
+	if(p_found == NULL)
+	{
+		/* if all probed entries have pending commands */
+		if(p_free == NULL)
+		{
+			/* overwrite the home entry: its command is lost */
+			p_free = &ctrl_table[index & CTRL_TABLE_INDEX_MASK];
+		}
+		else
+		{
+			/* use free or least recently seen entry */
+		}
+
+		memset(p_free, 0, sizeof(ctrl_entry_st));
+		p_free->addr = *p_addr;
+		p_free->last_seen = now_ticks;
+		p_free->used = true;
+		/* any command is new until the first one is accepted */
+		p_free->synced = false;
+
+		p_found = p_free;
+	}
+	else
+	{
+		/* known controller */
+	}
+
+	return p_found;
+}
+
+
+/* Function to check if a command is new for a controller */
+static bool cmd_is_new(const ctrl_entry_st *p_entry, uint8_t type, uint8_t seq, const uint8_t *p_payload, uint8_t length, uint32_t now_ticks)
+{
+	bool is_new;
+	bool is_same = ((type == p_entry->last_type)
+					 && (length == p_entry->last_length)
+					 && (0 == memcmp(p_payload, p_entry->last_payload, length)));
+	uint8_t seq_delta = (uint8_t)(seq - p_entry->last_seq);
+	uint32_t age = (now_ticks - p_entry->last_seen) & RTC_COUNTER_MASK;
+
+	/* if new controller */
+	if(p_entry->synced == false)
+	{
+		is_new = true;
+	}
+	/* if controller has been silent for a long time */
+	else if(age > APP_TIMER_TICKS(CTRL_RESYNC_TIMEOUT_MS, APP_TIMER_PRESCALER))
+	{
+		/* it could have been restarted: accept new content or sequence number */
+		is_new = ((seq != p_entry->last_seq) || (is_same == false));
+	}
+	/* if same sequence number */
+	else if(seq_delta == 0)
+	{
+		/* new only if content is different */
+		is_new = (is_same == false);
+	}
+	else
+	{
+		/* new only if in the window */
+		is_new = (seq_delta <= CTRL_SEQ_WINDOW);
+	}
+
+	return is_new;
+}
+
+
+/* Commands coalescing timeout handler. It sends the newest command of each controller to 
+   application */
+static void coalesce_timeout_handler(void *p_context)
+{
+	UNUSED_PARAMETER(p_context);
+
+	coalesce_timer_running = false;
+
+	for(uint8_t i=0; i<CTRL_TABLE_SIZE; i++)
+	{
+		if(ctrl_table[i].pending == true)
+		{
+			ctrl_table[i].pending = false;
+			if(ctrl_table[i].last_type == CTRL_CMD_LEVELS)
+			{
+				application_on_new_levels(ctrl_table[i].last_payload);
+			}
+			else
+			{
+				application_on_new_scan(ctrl_table[i].last_payload);
+			}
+		}
+		else
+		{
+			/* nothing to send */
+		}
+	}
+}
+
+
+
+
+/* End of file */
+
+
@@ -0,0 +1,68 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+
+
+/* ------------- Inclusions --------------- */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble_gap.h"
+
+
+
+
+/* ------------- Exported defines --------------- */
+
+/* Number of entries of the controllers table. Must be a power of 2 */
+#define CTRL_TABLE_SIZE							16
+
+/* Maximum length of a command payload in bytes */
+#define CTRL_CMD_PAYLOAD_MAX_LENGTH			7
+
+
+
+
+/* ------------- Exported typedefs --------------- */
+
+/* Controller command types */
+typedef enum
+{
+	CTRL_CMD_STATE,			/* controller state (service ID v1) */
+	CTRL_CMD_LEVELS			/* absolute channel levels and fade time (service ID v2) */
+} ctrl_cmd_type_e;
+
+
+
+
+/* ------------- Exported functions --------------- */
+
+extern void ctrl_init				(void);
+extern bool ctrl_cmd_receive		(const ble_gap_addr_t *, int8_t, uint8_t, uint8_t, const uint8_t *, uint8_t);
+
+
+
+
+/* End of file */
+
@@ -46,6 +46,7 @@
 #include "config.h"
 #include "dimmer_service.h"
 #include "memory.h"
+#include "presets.h"
 #include "application.h"
 
 
@@ -56,6 +57,9 @@
 /* The UUID of the CONFIG Characteristic */
 #define BLE_UUID_DIMMER_CONFIG_CHAR				0x0009   
 
+/* The UUID of the PRESETS Characteristic */
+#define BLE_UUID_DIMMER_PRESETS_CHAR				0x000A   
+
 /* The UUID of the SPECIAL OP Characteristic */
 #define BLE_UUID_DIMMER_SPECIAL_OP_CHAR			0x000F   
 
@@ -66,6 +70,10 @@
 #error Memory buffer data is not big enough for containing CFG service chars data
 #endif
 
+#if BLE_DIMMER_PRESETS_CHAR_MAX_LENGTH > PRESETS_UPLOAD_MAX_LENGTH
+#error PRESETS characteristic is longer than a presets upload
+#endif
+
 
 
 
@@ -74,7 +82,7 @@
 static void 		on_connect		(ble_dimmer_st *, ble_evt_t *);
 static void 		on_disconnect	(ble_dimmer_st *, ble_evt_t *);
 static void 		on_write			(ble_dimmer_st *, ble_evt_t *);
-static uint32_t	char_add			(ble_dimmer_st *, ble_gatts_char_handles_t *, bool, uint8_t, uint16_t, uint8_t *);
+static uint32_t	char_add			(ble_dimmer_st *, ble_gatts_char_handles_t *, bool, bool, uint8_t, uint16_t, uint8_t *);
 
 
 
@@ -110,9 +118,13 @@ static void on_write(ble_dimmer_st * p_dimmer, ble_evt_t * p_ble_evt)
 		if(p_evt_write->handle == p_dimmer->cfg_char_handles.value_handle)
 		{
 			/* TODO: consider to send memory result to upper layers */
-			/* update field in the persistent memory */
+			/* update field in the persistent memory. New data is sent to config observers */
 			memory_update_field(BLE_DIMMER_CONFIG_CHAR_POS, p_evt_write->data, p_evt_write->len);
-			/* ATTENTION: the new data is not sent to application or to any other module */
+		}
+		else if(p_evt_write->handle == p_dimmer->presets_char_handles.value_handle)
+		{
+			/* upload presets. They are used and stored on commit by SPECIAL_OP */
+			presets_upload(p_evt_write->data, (uint8_t)p_evt_write->len);
 		}
 		else if(p_evt_write->handle == p_dimmer->spec_op_char_handles.value_handle)
 		{
@@ -143,6 +155,7 @@ static void on_write(ble_dimmer_st * p_dimmer, ble_evt_t * p_ble_evt)
 static uint32_t char_add(	ble_dimmer_st * p_dimmer, 
 									ble_gatts_char_handles_t * p_char_handle, 
 									bool read_enabled, 
+									bool var_length, 
 									uint8_t char_value_length, 
 									uint16_t char_uuid,
 									uint8_t *p_value)
@@ -183,7 +196,7 @@ static uint32_t char_add(	ble_dimmer_st * p_dimmer,
 	attr_md.vloc    = BLE_GATTS_VLOC_STACK;	/* ATTENTION: Attribute Value is located in stack memory, no user memory is required */
 	attr_md.rd_auth = 0;
 	attr_md.wr_auth = 0;
-	attr_md.vlen    = 0;
+	attr_md.vlen    = (var_length == true) ? 1 : 0;
 
 	memset(&attr_char_value, 0, sizeof(attr_char_value));
 
@@ -273,6 +286,7 @@ uint32_t ble_dimmer_init(ble_dimmer_st * p_dimmer, const ble_dimmer_init_st * p_
 	err_code = char_add(	p_dimmer, 
 								&p_dimmer->cfg_char_handles, 
 								true, 
+								false, 
 								BLE_DIMMER_CONFIG_CHAR_LENGTH, 
 								BLE_UUID_DIMMER_CONFIG_CHAR, 
 								NULL);
@@ -281,12 +295,26 @@ uint32_t ble_dimmer_init(ble_dimmer_st * p_dimmer, const ble_dimmer_init_st * p_
   		return err_code;
 	}
 
+	/* Add the PRESETS Characteristic - Write, variable length */
+	err_code = char_add(	p_dimmer, 
+								&p_dimmer->presets_char_handles, 
+								false, 
+								true, 
+								BLE_DIMMER_PRESETS_CHAR_MAX_LENGTH, 
+								BLE_UUID_DIMMER_PRESETS_CHAR, 
+								NULL);
+	if (err_code != NRF_SUCCESS)
+	{
+  		return err_code;
+	}
+
 	/* Add the SPECIAL_OP Characteristic - Write */
 	/* ATTENTION: consider to use a stack location for this characteristic.
 	 	The same user buffer of preset chars is used at the moment. */
 	err_code = char_add(	p_dimmer, 
 								&p_dimmer->spec_op_char_handles, 
 								false, 
+								false, 
 								BLE_DIMMER_SPECIAL_OP_CHAR_LENGTH, 
 								BLE_UUID_DIMMER_SPECIAL_OP_CHAR, 
 								NULL);
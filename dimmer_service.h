@@ -46,6 +46,9 @@
 /* Length of SPECIAL_OP characteristic in bytes */
 #define BLE_DIMMER_SPECIAL_OP_CHAR_LENGTH			1	
 
+/* Maximum length of PRESETS characteristic in bytes: first preset index and 2 presets */
+#define BLE_DIMMER_PRESETS_CHAR_MAX_LENGTH		17
+
 /* Total characteristics length in bytes */
 #define BLE_DIMMER_SERVICE_CHARS_LENGTH 			(BLE_DIMMER_CONFIG_CHAR_LENGTH + BLE_DIMMER_SPECIAL_OP_CHAR_LENGTH)
 
@@ -83,6 +86,7 @@ struct ble_dimmer_s
 	uint16_t                 	service_handle;		/* Handle of DIMMER Service. */
 	ble_gatts_char_handles_t	cfg_char_handles;		/* Handle for storing CONFIG values */
 	ble_gatts_char_handles_t	spec_op_char_handles;/* Handle for rebooting into DFU Upgrade */
+	ble_gatts_char_handles_t	presets_char_handles;/* Handle for uploading presets */
 	uint16_t                 	conn_handle;			/* Handle of the current connection. BLE_CONN_HANDLE_INVALID if not in a connection. */
 	ble_dimmer_data_handler_st	data_handler;			/* Event handler to be called for handling received data. */
 };
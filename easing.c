@@ -0,0 +1,129 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* ---------------- Inclusions --------------------- */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "easing.h"
+
+
+
+
+/* ------------- Local defines --------------- */
+
+/* Number of bits of the table step. The progress range is divided in 16 segments */
+#define EASING_TABLE_STEP_BITS						(EASING_PROGRESS_FRAC_BITS - 4)
+
+/* Number of entries of an easing table */
+#define EASING_TABLE_LENGTH							17
+
+
+
+
+/* ---------------- Local variables --------------------- */   
+
+/* Easing tables in Q16. Linear curve does not need a table */
+static const uint16_t easing_tables[NUM_OF_EASING_CURVES - 1][EASING_TABLE_LENGTH] =
+{
+	/* ease-in: x^3 */
+	{0, 16, 128, 432, 1024, 2000, 3456, 5488, 8192, 11664, 16000, 21296, 27648, 35151, 43903, 53999, 65535},
+	/* ease-out: 1 - (1 - x)^3 */
+	{0, 11536, 21632, 30384, 37887, 44239, 49535, 53871, 57343, 60047, 62079, 63535, 64511, 65103, 65407, 65519, 65535},
+	/* ease-in-out (S-curve): 3x^2 - 2x^3 */
+	{0, 736, 2816, 6048, 10240, 15200, 20736, 26656, 32768, 38879, 44799, 50335, 55295, 59487, 62719, 64799, 65535},
+	/* exponential: (2^(10x) - 1) / 1023 */
+	{0, 35, 88, 171, 298, 495, 798, 1265, 1986, 3097, 4812, 7455, 11532, 17820, 27517, 42472, 65535}
+};
+
+
+
+
+/* ------------- Exported functions implementations --------------- */
+
+/* Function to apply an easing curve to a progress value in Q16 (0 - 65535). 
+   The curve is linearly interpolated between table entries. Linear curve is used 
+   for any invalid curve ID */
+uint32_t easing_apply(uint8_t curve_id, uint32_t progress)
+{
+	const uint16_t *p_table;
+	uint32_t index;
+	uint32_t frac;
+	uint32_t result;
+
+	if((curve_id > EASING_CURVE_LINEAR)
+	&& (curve_id < NUM_OF_EASING_CURVES)
+	&& (progress < ((uint32_t)1 << EASING_PROGRESS_FRAC_BITS)))
+	{
+		p_table = easing_tables[curve_id - 1];
+		index = progress >> EASING_TABLE_STEP_BITS;
+		frac = progress & (((uint32_t)1 << EASING_TABLE_STEP_BITS) - 1);
+
+		/* tables are monotonic increasing */
+		result = p_table[index] + (((uint32_t)(p_table[index + 1] - p_table[index]) * frac) >> EASING_TABLE_STEP_BITS);
+	}
+	else
+	{
+		/* linear curve */
+		result = progress;
+	}
+
+	return result;
+}
+
+
+/* Function to get the slope of an easing curve at a progress value in Q16. The slope is 
+   constant within each table segment. Linear curve slope is 1 */
+uint32_t easing_slope(uint8_t curve_id, uint32_t progress)
+{
+	const uint16_t *p_table;
+	uint32_t index;
+	uint32_t result;
+
+	if((curve_id > EASING_CURVE_LINEAR)
+	&& (curve_id < NUM_OF_EASING_CURVES)
+	&& (progress < ((uint32_t)1 << EASING_PROGRESS_FRAC_BITS)))
+	{
+		p_table = easing_tables[curve_id - 1];
+		index = progress >> EASING_TABLE_STEP_BITS;
+
+		/* segment variation multiplied by number of segments */
+		result = (uint32_t)(p_table[index + 1] - p_table[index]) << (EASING_PROGRESS_FRAC_BITS - EASING_TABLE_STEP_BITS);
+	}
+	else
+	{
+		/* linear curve */
+		result = ((uint32_t)1 << EASING_PROGRESS_FRAC_BITS);
+	}
+
+	return result;
+}
+
+
+
+
+/* End of file */
+
+
@@ -0,0 +1,72 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+
+
+/* ------------ Inclusions --------------- */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+
+
+/* ------------- Exported defines --------------- */
+
+/* Number of fractional bits of a progress value (Q16) */
+#define EASING_PROGRESS_FRAC_BITS					16
+
+/* Curve ID meaning "use the default curve" */
+#define EASING_CURVE_DEFAULT						0xFF
+
+
+
+
+/* ------------- Exported typedefs --------------- */
+
+/* Easing curves enum */
+typedef enum
+{
+	EASING_CURVE_LINEAR,
+	EASING_CURVE_IN,
+	EASING_CURVE_OUT,
+	EASING_CURVE_IN_OUT,
+	EASING_CURVE_EXPONENTIAL,
+	NUM_OF_EASING_CURVES
+} easing_curve_e;
+
+
+
+
+/* -------------- Exported functions prototypes --------------- */
+
+extern uint32_t easing_apply	(uint8_t, uint32_t);
+extern uint32_t easing_slope	(uint8_t, uint32_t);
+
+
+
+
+/* End of file */
+
+
@@ -0,0 +1,90 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+
+
+/* ------------ Inclusions --------------- */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+
+
+/* ------------- Exported defines --------------- */
+
+/* PWM channel for RED */   
+#define PWM_CH_R          							28
+
+/* PWM channel for GREEN */   
+#define PWM_CH_G          							23
+
+/* PWM channel for BLUE */   
+#define PWM_CH_B          							22
+
+/* PWM channel for WHITE */   
+#define PWM_CH_W         							17
+
+/* PWM period in us of the app backend (2000 Hz). The timer backend period is fixed by the QDEC 
+   sample period to 512 us */
+#define PWM_PERIOD_US								500
+
+/* Number of fractional bits of the frame ticks. The backend rounds them or, if LED_PWM_DITHERING 
+   is defined, dithers them over consecutive periods. ATTENTION: the PWM period in ticks shifted 
+   by these bits must fit 16 bits */
+#define PWM_TICKS_FRAC_BITS							3
+
+
+
+
+/* ------------- Exported typedefs --------------- */
+
+/* Light channels enum */
+typedef enum
+{
+	RED_CHANNEL,
+	GREEN_CHANNEL,
+	BLUE_CHANNEL,
+	WHITE_CHANNEL,
+	NUM_OF_LIGHT_CHANNELS
+} light_channel_e;
+
+
+
+
+/* -------------- Exported functions prototypes --------------- */
+
+/* ATTENTION: these functions are implemented by the PWM backend selected at build time 
+   through the LED_PWM_BACKEND variable in the Makefile */
+extern void 		led_pwm_init				(void);
+extern uint16_t 	led_pwm_period_ticks_get	(void);
+extern void 		led_pwm_frame_set			(const uint16_t *);
+extern uint32_t 	led_pwm_dropped_frames_get	(void);
+
+
+
+
+/* End of file */
+
+
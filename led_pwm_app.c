@@ -0,0 +1,372 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* 
+	ATTENTION:
+	This PWM backend drives the 4 light channels by two app_pwm instances, each one using a 
+	TIMER. A nrf51 TIMER has 4 CC registers only, so app_pwm can not generate 4 independent 
+	duty cycles plus the period by a single TIMER: the timer backend (led_pwm_timer.c) does it 
+	taking the period from the QDEC and leaves TIMER2 free. 
+*/
+
+
+/* ---------------- Inclusions --------------------- */
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "nordic_common.h"
+#include "nrf.h"
+#include "app_error.h"
+#include "app_util_platform.h"
+#include "app_pwm.h"
+
+#include "config.h"
+#include "led_pwm.h"
+
+
+
+
+/* ---------------- Local macros --------------------- */   
+
+/* Create the instance "PWM1" using TIMER1. */
+APP_PWM_INSTANCE(PWM1,1);  
+
+/* Create the instance "PWM2" using TIMER2. */                 
+APP_PWM_INSTANCE(PWM2,2); 
+
+/* Half of a PWM tick in fractional ticks */
+#define PWM_TICKS_HALF								((uint16_t)1 << (PWM_TICKS_FRAC_BITS - 1))
+
+/* Mask of the fractional part of frame ticks */
+#define PWM_TICKS_FRAC_MASK							(((uint16_t)1 << PWM_TICKS_FRAC_BITS) - 1)
+
+/* Macro to round fractional frame ticks to the nearest PWM tick */
+#define PWM_TICKS_ROUND(x)							((uint16_t)(((x) + PWM_TICKS_HALF) >> PWM_TICKS_FRAC_BITS))
+
+
+
+
+/* ---------------- Local variables --------------------- */   
+
+/* Next frame of PWM ticks to commit, with PWM_TICKS_FRAC_BITS fractional bits */
+static uint16_t next_frame[NUM_OF_LIGHT_CHANNELS];
+
+/* Last committed PWM ticks */
+static uint16_t curr_frame[NUM_OF_LIGHT_CHANNELS];
+
+/* Bitmask of next frame channels still to commit */
+static volatile uint8_t pending_channels = 0;
+
+/* Number of frames overwritten before being completely committed */
+static volatile uint32_t dropped_frames = 0;
+
+#ifdef LED_PWM_DITHERING
+/* PWM period in ticks */
+static uint16_t period_ticks;
+
+/* Bitmask of channels whose fractional ticks are dithered */
+static volatile uint8_t dither_channels = 0;
+
+/* Dithering error accumulators in fractional ticks */
+static int16_t dither_error[NUM_OF_LIGHT_CHANNELS];
+
+/* Index of the next channel to serve for each PWM instance */
+static uint8_t next_served[2];
+#endif
+
+
+
+
+/* ------------- Local functions prototypes --------------- */
+
+static void pwm_commit			(uint32_t);
+#ifdef LED_PWM_DITHERING
+static uint16_t dither_ticks_get	(uint8_t);
+#endif
+static void pwm_ready_callback	(uint32_t);
+
+
+
+
+/* ------------- Exported functions implementations --------------- */
+
+/* Function to init PWM backend */
+void led_pwm_init(void)
+{
+	uint32_t err_code;
+
+	/* 2-channel PWM1, 2000Hz, output on DK LED pins. */
+	app_pwm_config_t pwm1_cfg = APP_PWM_DEFAULT_CONFIG_2CH(PWM_PERIOD_US, PWM_CH_R, PWM_CH_G);
+	/* 2-channel PWM2, 2000Hz, output on DK LED pins. */
+	app_pwm_config_t pwm2_cfg = APP_PWM_DEFAULT_CONFIG_2CH(PWM_PERIOD_US, PWM_CH_B, PWM_CH_W);
+
+	/* Set PWM R channel polarity */
+	pwm1_cfg.pin_polarity[0] = APP_PWM_POLARITY_ACTIVE_HIGH;
+	/* Set PWM G channel polarity */
+	pwm1_cfg.pin_polarity[1] = APP_PWM_POLARITY_ACTIVE_HIGH;
+	/* Set PWM B channel polarity */
+	pwm2_cfg.pin_polarity[0] = APP_PWM_POLARITY_ACTIVE_HIGH;
+	/* Set PWM W channel polarity */
+	pwm2_cfg.pin_polarity[1] = APP_PWM_POLARITY_ACTIVE_HIGH;
+
+	/* Initialize PWM1 */
+	err_code = app_pwm_init(&PWM1, &pwm1_cfg, pwm_ready_callback);
+	APP_ERROR_CHECK(err_code);
+	/* Initialize PWM2 */
+	err_code = app_pwm_init(&PWM2, &pwm2_cfg, pwm_ready_callback);
+	APP_ERROR_CHECK(err_code);
+
+	/* Enable PWM1 and PWM2 */
+	app_pwm_enable(&PWM1);
+	app_pwm_enable(&PWM2);
+
+#ifdef LED_PWM_DITHERING
+	period_ticks = app_pwm_cycle_ticks_get(&PWM1);
+#endif
+}
+
+
+/* Function to get the PWM period in ticks. Both instances have the same period */
+uint16_t led_pwm_period_ticks_get(void)
+{
+	return app_pwm_cycle_ticks_get(&PWM1);
+}
+
+
+/* Function to write the next frame of PWM ticks with PWM_TICKS_FRAC_BITS fractional bits. 
+   It never blocks: channels are committed now if the related PWM instance is ready, otherwise 
+   from the PWM ready callback at the next period */
+void led_pwm_frame_set(const uint16_t *p_frame_ticks)
+{
+	uint8_t changed_channels = 0;
+	uint16_t ticks;
+
+	CRITICAL_REGION_ENTER();
+
+	/* if previous frame is not completely committed */
+	if(pending_channels != 0)
+	{
+		/* it is going to be overwritten */
+		dropped_frames++;
+	}
+	else
+	{
+		/* do nothing */
+	}
+
+	/* copy new frame and mark changed channels only */
+	for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+	{
+		next_frame[ch] = p_frame_ticks[ch];
+		ticks = PWM_TICKS_ROUND(next_frame[ch]);
+#ifdef LED_PWM_DITHERING
+		/* dither fractional ticks rounded between 2 and (period - 2) ticks only, since the 
+		   dithered output moves by one tick around them and 0% or 100% duty are not used */
+		if((0 != (next_frame[ch] & PWM_TICKS_FRAC_MASK))
+		&& (ticks > 1)
+		&& (ticks < (period_ticks - 1)))
+		{
+			dither_channels |= (uint8_t)(1 << ch);
+			changed_channels |= (uint8_t)(1 << ch);
+		}
+		else
+		{
+			dither_channels &= (uint8_t)~(1 << ch);
+			dither_error[ch] = 0;
+			if(ticks != curr_frame[ch])
+			{
+				changed_channels |= (uint8_t)(1 << ch);
+			}
+		}
+#else
+		if(ticks != curr_frame[ch])
+		{
+			changed_channels |= (uint8_t)(1 << ch);
+		}
+#endif
+	}
+	pending_channels = changed_channels;
+
+	/* start committing on both instances */
+	pwm_commit(0);
+	pwm_commit(1);
+
+	CRITICAL_REGION_EXIT();
+}
+
+
+/* Function to get the number of dropped frames */
+uint32_t led_pwm_dropped_frames_get(void)
+{
+	return dropped_frames;
+}
+
+
+
+
+/* ------------- Local functions implementation --------------- */
+
+/* Function to commit the first pending channel of a PWM instance. An app_pwm instance 
+   accepts one channel update per period, next one is committed on ready callback */
+static void pwm_commit(uint32_t pwm_id)
+{
+	const app_pwm_t *p_instance;
+	uint8_t first_ch;
+	uint8_t ch_index;
+	uint8_t ch_mask;
+	uint16_t ticks;
+
+	if(pwm_id == 0)
+	{
+		p_instance = &PWM1;
+		first_ch = RED_CHANNEL;
+	}
+	else
+	{
+		p_instance = &PWM2;
+		first_ch = BLUE_CHANNEL;
+	}
+
+	for(uint8_t i=0; i<2; i++)
+	{
+#ifdef LED_PWM_DITHERING
+		/* serve channels of the instance in turn, so that dithered channels are updated at 
+		   the same rate */
+		ch_index = (uint8_t)((next_served[pwm_id] + i) & 1);
+		ch_mask = (uint8_t)(1 << (first_ch + ch_index));
+		if(0 != ((pending_channels | dither_channels) & ch_mask))
+#else
+		ch_index = i;
+		ch_mask = (uint8_t)(1 << (first_ch + ch_index));
+		if(0 != (pending_channels & ch_mask))
+#endif
+		{
+#ifdef LED_PWM_DITHERING
+			if(0 != (dither_channels & ch_mask))
+			{
+				ticks = dither_ticks_get(first_ch + ch_index);
+			}
+			else
+			{
+				ticks = PWM_TICKS_ROUND(next_frame[first_ch + ch_index]);
+			}
+#else
+			ticks = PWM_TICKS_ROUND(next_frame[first_ch + ch_index]);
+#endif
+			/* clear pending bit before the update since the ready callback could be called 
+			   synchronously */
+			pending_channels &= (uint8_t)~ch_mask;
+			if(NRF_SUCCESS == app_pwm_channel_duty_ticks_set(p_instance, ch_index, ticks))
+			{
+				/* channel committed */
+#ifdef LED_PWM_DITHERING
+				if(0 != (dither_channels & ch_mask))
+				{
+					/* keep the residual error for next update */
+					dither_error[first_ch + ch_index] += (int16_t)next_frame[first_ch + ch_index];
+					dither_error[first_ch + ch_index] -= (int16_t)(ticks << PWM_TICKS_FRAC_BITS);
+				}
+				next_served[pwm_id] = (uint8_t)((ch_index + 1) & 1);
+#endif
+				curr_frame[first_ch + ch_index] = ticks;
+			}
+			else
+			{
+				/* instance is busy: retry on ready callback */
+				pending_channels |= ch_mask;
+			}
+
+			/* one update per period only */
+			break;
+		}
+		else
+		{
+			/* nothing to commit on this channel */
+		}
+	}
+}
+
+
+#ifdef LED_PWM_DITHERING
+/* Function to get the next dithered PWM ticks of a channel. The residual error of previous 
+   updates is added to the fractional ticks and the result is rounded. The output is forced 
+   to move by one tick at every update, otherwise app_pwm would not call the ready callback 
+   at next period: the error accumulator compensates it, so the long-run mean output equals 
+   the fractional ticks and the error is bounded to one tick */
+static uint16_t dither_ticks_get(uint8_t ch)
+{
+	uint16_t wanted;
+	uint16_t ticks;
+
+	/* error is within one tick and dithered ticks are at least 1.5 ticks, so this is positive */
+	wanted = (uint16_t)((int32_t)next_frame[ch] + dither_error[ch]);
+
+	ticks = PWM_TICKS_ROUND(wanted);
+	if(ticks == curr_frame[ch])
+	{
+		/* move toward the wanted value */
+		if(wanted >= (uint16_t)(ticks << PWM_TICKS_FRAC_BITS))
+		{
+			ticks++;
+		}
+		else
+		{
+			ticks--;
+		}
+	}
+	else
+	{
+		/* output already changes */
+	}
+
+	return ticks;
+}
+#endif
+
+
+/* PWM ready callback function */
+static void pwm_ready_callback(uint32_t pwm_id)
+{
+	CRITICAL_REGION_ENTER();
+
+	/* commit next pending channel of this instance */
+	if(pwm_id < 2)
+	{
+		pwm_commit(pwm_id);
+	}
+	else
+	{
+		/* invalid PWM index */
+	}
+
+	CRITICAL_REGION_EXIT();
+}
+
+
+
+
+/* End of file */
+
+
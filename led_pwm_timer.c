@@ -0,0 +1,522 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* 
+	ATTENTION: 
+	This PWM backend drives the 4 light channels by a single TIMER (TIMER1). Its 4 CC registers 
+	give the falling edge of each channel, so the period is given by the QDEC sample period: the 
+	sample event clears the TIMER and raises the channels through PPI. The period would need a 
+	fifth compare: a CC register with the CLEAR short would take the place of a channel and a 
+	second TIMER is what this backend saves. The QDEC is not used by this board, its pins are not 
+	connected and it is used as a period generator only, without CPU. TIMER2 is left free. 
+*/
+
+
+/* ---------------- Inclusions --------------------- */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "nordic_common.h"
+#include "nrf.h"
+#include "nrf_gpio.h"
+#include "app_error.h"
+#include "app_util_platform.h"
+#include "nrf_drv_timer.h"
+#include "nrf_drv_gpiote.h"
+#include "nrf_drv_ppi.h"
+
+#include "config.h"
+#include "led_pwm.h"
+
+
+
+
+/* ---------------- Local defines --------------------- */   
+
+/* PWM period in TIMER ticks: QDEC sample period of 512 us with the TIMER at 1 MHz (1953 Hz) */
+#define PWM_TIMER_PERIOD_TICKS						512
+
+/* Minimum time in TIMER ticks between the falling edge of a dithered channel and the period end, 
+   so that the TIMER interrupt commits the next dithered ticks before the next period starts */
+#define PWM_DITHER_MARGIN_TICKS						32
+
+/* Maximum number of commit sequences run in a row for a channel. A sequence is repeated only if 
+   a period started while it ran, i.e. if it was preempted by the SoftDevice for most of a period */
+#define PWM_COMMIT_MAX_TRIES						3
+
+/* QDEC sample period giving the PWM period */
+#define PWM_QDEC_SAMPLEPER							QDEC_SAMPLEPER_SAMPLEPER_512us
+
+/* QDEC pin select value of a not connected pin */
+#define PWM_QDEC_PIN_NOT_CONNECTED					0xFFFFFFFF
+
+/* Half of a PWM tick in fractional ticks */
+#define PWM_TICKS_HALF								((uint16_t)1 << (PWM_TICKS_FRAC_BITS - 1))
+
+/* Mask of the fractional part of frame ticks */
+#define PWM_TICKS_FRAC_MASK							(((uint16_t)1 << PWM_TICKS_FRAC_BITS) - 1)
+
+/* Macro to round fractional frame ticks to the nearest PWM tick */
+#define PWM_TICKS_ROUND(x)							((uint16_t)(((x) + PWM_TICKS_HALF) >> PWM_TICKS_FRAC_BITS))
+
+/* Macro to get the mask of a PPI channel */
+#define PPI_CHANNEL_MASK(x)							((uint32_t)1 << (x))
+
+
+
+
+/* ---------------- Local variables --------------------- */   
+
+/* TIMER giving the falling edge of each channel by its CC registers */
+static const nrf_drv_timer_t pwm_timer = NRF_DRV_TIMER_INSTANCE(1);
+
+/* Output pin of each channel */
+static const uint8_t channel_pins[NUM_OF_LIGHT_CHANNELS] = {PWM_CH_R, PWM_CH_G, PWM_CH_B, PWM_CH_W};
+
+/* PPI channels raising each output at period start */
+static nrf_ppi_channel_t rise_ppi[NUM_OF_LIGHT_CHANNELS];
+
+/* PPI channels lowering each output at its CC register compare */
+static nrf_ppi_channel_t fall_ppi[NUM_OF_LIGHT_CHANNELS];
+
+/* PPI group of falling edge channels, enabled at every period start */
+static nrf_ppi_channel_group_t fall_group;
+
+/* Next frame of PWM ticks to commit, with PWM_TICKS_FRAC_BITS fractional bits */
+static uint16_t next_frame[NUM_OF_LIGHT_CHANNELS];
+
+/* Last committed PWM ticks */
+static uint16_t curr_frame[NUM_OF_LIGHT_CHANNELS];
+
+/* Bitmask of next frame channels still to commit */
+static volatile uint8_t pending_channels = 0;
+
+/* Bitmask of channels frozen low after too many commit sequences, committed again from the 
+   TIMER interrupt */
+static volatile uint8_t deferred_channels = 0;
+
+/* Number of frames overwritten before being completely committed */
+static volatile uint32_t dropped_frames = 0;
+
+#ifdef LED_PWM_DITHERING
+/* Bitmask of channels whose fractional ticks are dithered */
+static volatile uint8_t dither_channels = 0;
+
+/* Dithering error accumulators in fractional ticks */
+static int16_t dither_error[NUM_OF_LIGHT_CHANNELS];
+#endif
+
+
+
+
+/* ------------- Local functions prototypes --------------- */
+
+static void ppi_channel_setup		(nrf_ppi_channel_t *, uint32_t, uint32_t);
+static void pwm_commit				(uint8_t);
+static void channel_commit			(uint8_t, uint16_t);
+static void fall_int_enable		(uint8_t);
+#ifdef LED_PWM_DITHERING
+static uint16_t dither_ticks_get	(uint8_t);
+#endif
+static void pwm_timer_handler		(nrf_timer_event_t, void *);
+
+
+
+
+/* ------------- Exported functions implementations --------------- */
+
+/* Function to init PWM backend. All channels start low */
+void led_pwm_init(void)
+{
+	nrf_drv_gpiote_out_config_t out_cfg = GPIOTE_CONFIG_OUT_TASK_TOGGLE(false);
+	nrf_ppi_channel_t ppi_channel;
+	uint32_t period_event;
+	uint32_t task;
+	uint32_t err_code;
+
+	/* init GPIOTE and PPI drivers if not done yet */
+	if(false == nrf_drv_gpiote_is_init())
+	{
+		err_code = nrf_drv_gpiote_init();
+		APP_ERROR_CHECK(err_code);
+	}
+	else
+	{
+		/* already initialised */
+	}
+	err_code = nrf_drv_ppi_init();
+	if((err_code != NRF_SUCCESS)
+	&& (err_code != MODULE_ALREADY_INITIALIZED))
+	{
+		APP_ERROR_CHECK(err_code);
+	}
+	else
+	{
+		/* PPI driver ready */
+	}
+
+	/* init TIMER, 1 MHz 16 bits as configured in nrf_drv_config.h */
+	err_code = nrf_drv_timer_init(&pwm_timer, NULL, pwm_timer_handler);
+	APP_ERROR_CHECK(err_code);
+
+	period_event = (uint32_t)&NRF_QDEC->EVENTS_SAMPLERDY;
+
+	for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+	{
+		/* output toggled by a GPIOTE task, with input buffer connected to read its level back */
+		err_code = nrf_drv_gpiote_out_init(channel_pins[ch], &out_cfg);
+		APP_ERROR_CHECK(err_code);
+		NRF_GPIO->PIN_CNF[channel_pins[ch]] &= ~GPIO_PIN_CNF_INPUT_Msk;
+		nrf_drv_gpiote_out_task_enable(channel_pins[ch]);
+		task = nrf_drv_gpiote_out_task_addr_get(channel_pins[ch]);
+
+		/* edges are enabled when the channel is committed */
+		ppi_channel_setup(&rise_ppi[ch], period_event, task);
+		ppi_channel_setup(&fall_ppi[ch], nrf_drv_timer_compare_event_address_get(&pwm_timer, ch), task);
+	}
+
+	/* period start clears the TIMER and enables falling edges */
+	err_code = nrf_drv_ppi_group_alloc(&fall_group);
+	APP_ERROR_CHECK(err_code);
+	ppi_channel_setup(&ppi_channel, period_event, nrf_drv_timer_task_address_get(&pwm_timer, NRF_TIMER_TASK_CLEAR));
+	nrf_ppi_channels_enable(PPI_CHANNEL_MASK(ppi_channel));
+	ppi_channel_setup(&ppi_channel, period_event, nrf_drv_ppi_task_addr_group_enable_get(fall_group));
+	nrf_ppi_channels_enable(PPI_CHANNEL_MASK(ppi_channel));
+
+	nrf_drv_timer_enable(&pwm_timer);
+
+	/* start period generator */
+	NRF_QDEC->PSELA = PWM_QDEC_PIN_NOT_CONNECTED;
+	NRF_QDEC->PSELB = PWM_QDEC_PIN_NOT_CONNECTED;
+	NRF_QDEC->PSELLED = PWM_QDEC_PIN_NOT_CONNECTED;
+	NRF_QDEC->SAMPLEPER = (PWM_QDEC_SAMPLEPER << QDEC_SAMPLEPER_SAMPLEPER_Pos);
+	NRF_QDEC->ENABLE = (QDEC_ENABLE_ENABLE_Enabled << QDEC_ENABLE_ENABLE_Pos);
+	NRF_QDEC->TASKS_START = 1;
+}
+
+
+/* Function to get the PWM period in ticks */
+uint16_t led_pwm_period_ticks_get(void)
+{
+	return PWM_TIMER_PERIOD_TICKS;
+}
+
+
+/* Function to write the next frame of PWM ticks with PWM_TICKS_FRAC_BITS fractional bits. 
+   It never blocks: a channel with a constant output is committed now, a running one from the 
+   TIMER interrupt after its falling edge */
+void led_pwm_frame_set(const uint16_t *p_frame_ticks)
+{
+	uint8_t changed_channels = 0;
+	uint16_t ticks;
+
+	CRITICAL_REGION_ENTER();
+
+	/* if previous frame is not completely committed */
+	if(pending_channels != 0)
+	{
+		/* it is going to be overwritten */
+		dropped_frames++;
+	}
+	else
+	{
+		/* do nothing */
+	}
+
+	/* copy new frame and mark changed channels only */
+	for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+	{
+		next_frame[ch] = p_frame_ticks[ch];
+		ticks = PWM_TICKS_ROUND(next_frame[ch]);
+#ifdef LED_PWM_DITHERING
+		/* dither fractional ticks rounded from 2 ticks only, since the dithered output moves by 
+		   one tick around them and 0% duty is not used, and up to the dithering margin */
+		if((0 != (next_frame[ch] & PWM_TICKS_FRAC_MASK))
+		&& (ticks > 1)
+		&& (ticks < (PWM_TIMER_PERIOD_TICKS - PWM_DITHER_MARGIN_TICKS)))
+		{
+			dither_channels |= (uint8_t)(1 << ch);
+			changed_channels |= (uint8_t)(1 << ch);
+		}
+		else
+		{
+			dither_channels &= (uint8_t)~(1 << ch);
+			dither_error[ch] = 0;
+			if(ticks != curr_frame[ch])
+			{
+				changed_channels |= (uint8_t)(1 << ch);
+			}
+		}
+#else
+		if(ticks != curr_frame[ch])
+		{
+			changed_channels |= (uint8_t)(1 << ch);
+		}
+#endif
+	}
+	pending_channels = changed_channels;
+
+	for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+	{
+		if(0 != (changed_channels & (uint8_t)(1 << ch)))
+		{
+			if((curr_frame[ch] == 0)
+			|| (curr_frame[ch] >= PWM_TIMER_PERIOD_TICKS))
+			{
+				/* constant output: no edge to wait for */
+				pwm_commit(ch);
+			}
+			else
+			{
+				/* commit after the falling edge */
+				fall_int_enable(ch);
+			}
+		}
+		else
+		{
+			/* channel not changed */
+		}
+	}
+
+	CRITICAL_REGION_EXIT();
+}
+
+
+/* Function to get the number of dropped frames */
+uint32_t led_pwm_dropped_frames_get(void)
+{
+	return dropped_frames;
+}
+
+
+
+
+/* ------------- Local functions implementation --------------- */
+
+/* Function to allocate a PPI channel and assign an event and a task to it. It is not enabled */
+static void ppi_channel_setup(nrf_ppi_channel_t *p_channel, uint32_t event, uint32_t task)
+{
+	uint32_t err_code;
+
+	err_code = nrf_drv_ppi_channel_alloc(p_channel);
+	APP_ERROR_CHECK(err_code);
+	err_code = nrf_drv_ppi_channel_assign(*p_channel, event, task);
+	APP_ERROR_CHECK(err_code);
+}
+
+
+/* Function to commit the next frame ticks of a channel. The falling edge interrupt is kept 
+   enabled while the channel is dithered, so it is updated at every period */
+static void pwm_commit(uint8_t ch)
+{
+	uint8_t ch_mask = (uint8_t)(1 << ch);
+	uint16_t ticks;
+
+#ifdef LED_PWM_DITHERING
+	if(0 != (dither_channels & ch_mask))
+	{
+		ticks = dither_ticks_get(ch);
+	}
+	else
+	{
+		ticks = PWM_TICKS_ROUND(next_frame[ch]);
+	}
+#else
+	ticks = PWM_TICKS_ROUND(next_frame[ch]);
+#endif
+
+	pending_channels &= (uint8_t)~ch_mask;
+	deferred_channels &= (uint8_t)~ch_mask;
+	if(ticks != curr_frame[ch])
+	{
+		channel_commit(ch, ticks);
+	}
+	else
+	{
+		/* output does not change */
+	}
+
+#ifdef LED_PWM_DITHERING
+	if(0 != ((dither_channels | deferred_channels) & ch_mask))
+#else
+	if(0 != (deferred_channels & ch_mask))
+#endif
+	{
+		fall_int_enable(ch);
+	}
+	else
+	{
+		nrf_drv_timer_compare_int_disable(&pwm_timer, ch);
+	}
+}
+
+
+/* Function to commit PWM ticks to a channel. The output is frozen by disabling its PPI channels 
+   and ended if still high, then the CC register is written and the output is raised again from 
+   next period. The falling edge is enabled at next period start by the PPI group, since the 
+   CC compare could occur again in the current period. A period starting meanwhile could leave 
+   edges unbalanced, so the sequence is repeated: at most one period is shortened. SoftDevice 
+   interrupts are not masked by the critical region, so only a SoftDevice preemption for most 
+   of a period repeats the sequence, and one across a period start can make that period 
+   brighter. After PWM_COMMIT_MAX_TRIES sequences the output is 
+   frozen low and the channel is committed again from the TIMER interrupt at its CC compare */
+static void channel_commit(uint8_t ch, uint16_t ticks)
+{
+	uint32_t rise_mask = PPI_CHANNEL_MASK(rise_ppi[ch]);
+	uint32_t fall_mask = PPI_CHANNEL_MASK(fall_ppi[ch]);
+	uint8_t tries = 0;
+	bool retry;
+
+	do
+	{
+		CRITICAL_REGION_ENTER();
+
+		/* freeze output */
+		nrf_ppi_channels_remove_from_group(fall_mask, fall_group);
+		nrf_ppi_channels_disable(rise_mask | fall_mask);
+		NRF_QDEC->EVENTS_SAMPLERDY = 0;
+
+		/* end current period if output is still high */
+		if(0 != nrf_gpio_pin_read(channel_pins[ch]))
+		{
+			nrf_drv_gpiote_out_task_trigger(channel_pins[ch]);
+		}
+		else
+		{
+			/* output already low */
+		}
+
+		if(ticks == 0)
+		{
+			/* output stays low */
+			retry = false;
+		}
+		else if(ticks >= PWM_TIMER_PERIOD_TICKS)
+		{
+			/* output stays high */
+			nrf_drv_gpiote_out_task_trigger(channel_pins[ch]);
+			retry = false;
+		}
+		else
+		{
+			/* restart edges */
+			nrf_timer_cc_write(pwm_timer.p_reg, (nrf_timer_cc_channel_t)ch, ticks);
+			nrf_ppi_channels_include_in_group(fall_mask, fall_group);
+			nrf_ppi_channels_enable(rise_mask);
+
+			/* repeat if a period started meanwhile */
+			retry = (NRF_QDEC->EVENTS_SAMPLERDY != 0);
+			tries++;
+			if((true == retry)
+			&& (tries >= PWM_COMMIT_MAX_TRIES))
+			{
+				/* freeze output low until the next CC compare */
+				nrf_ppi_channels_remove_from_group(fall_mask, fall_group);
+				nrf_ppi_channels_disable(rise_mask | fall_mask);
+				if(0 != nrf_gpio_pin_read(channel_pins[ch]))
+				{
+					nrf_drv_gpiote_out_task_trigger(channel_pins[ch]);
+				}
+				else
+				{
+					/* output already low */
+				}
+				deferred_channels |= (uint8_t)(1 << ch);
+				ticks = 0;
+				retry = false;
+			}
+			else
+			{
+				/* edges restarted or sequence repeated */
+			}
+		}
+
+		CRITICAL_REGION_EXIT();
+	} while(true == retry);
+
+	curr_frame[ch] = ticks;
+}
+
+
+/* Function to enable the interrupt at the falling edge of a channel. An event left by a 
+   previous period is cleared first */
+static void fall_int_enable(uint8_t ch)
+{
+	nrf_timer_event_clear(pwm_timer.p_reg, nrf_timer_compare_event_get(ch));
+	nrf_drv_timer_compare_int_enable(&pwm_timer, ch);
+}
+
+
+#ifdef LED_PWM_DITHERING
+/* Function to get the next dithered PWM ticks of a channel. The residual error of previous 
+   periods is added to the fractional ticks and the result is rounded, so the long-run mean 
+   output equals the fractional ticks and the error is bounded to half a tick */
+static uint16_t dither_ticks_get(uint8_t ch)
+{
+	uint16_t wanted;
+	uint16_t ticks;
+
+	/* error is within half a tick and dithered ticks are at least 1.5 ticks, so this is positive */
+	wanted = (uint16_t)((int32_t)next_frame[ch] + dither_error[ch]);
+
+	ticks = PWM_TICKS_ROUND(wanted);
+	dither_error[ch] = (int16_t)(wanted - (uint16_t)(ticks << PWM_TICKS_FRAC_BITS));
+
+	return ticks;
+}
+#endif
+
+
+/* TIMER event handler, called at the falling edge of a channel whose interrupt is enabled. 
+   The output is low until next period, so the channel is committed without glitches. A CC 
+   register just written can compare again in the current period while the falling edge is 
+   still disabled: that event is not a falling edge and is ignored, unless the channel is 
+   frozen low by a deferred commit */
+static void pwm_timer_handler(nrf_timer_event_t event_type, void * p_context)
+{
+	UNUSED_PARAMETER(p_context);
+
+	CRITICAL_REGION_ENTER();
+
+	for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+	{
+		if((event_type == nrf_timer_compare_event_get(ch))
+		&& ((NRF_PPI_CHANNEL_ENABLED == nrf_ppi_channel_enable_get(fall_ppi[ch]))
+		|| (0 != (deferred_channels & (uint8_t)(1 << ch)))))
+		{
+			pwm_commit(ch);
+		}
+		else
+		{
+			/* event of another channel, or edges not started yet */
+		}
+	}
+
+	CRITICAL_REGION_EXIT();
+}
+
+
+
+
+/* End of file */
@@ -22,11 +22,6 @@
 */
 
 
-/*
-	TODO: improve fade mechanism
-*/
-
-
 /* ---------------- Inclusions --------------------- */
 #include <stdint.h>
 #include <string.h>
@@ -40,12 +35,17 @@
 #include "softdevice_handler.h"
 #include "app_timer.h"
 #include "app_util_platform.h"
-#include "app_pwm.h"
 
 #include "config.h"
 #include "memory.h"
 #include "dimmer_service.h"
+#include "led_pwm.h"
+#include "easing.h"
+#include "scheduler.h"
+#include "vtimer.h"
+#include "light_state.h"
 #include "led_strip.h"
+#include "cie_table.h"
 
 
 
@@ -54,11 +54,36 @@
 
 /* Fade timer defines */
 #define FADE_TIMER_TICK_PERIOD_MS				20		/* 20 ms */
-#define FADE_TIMER_TICK_COUNT						((uint32_t)(((uint64_t)FADE_TIMER_TICK_PERIOD_MS * 1000000)/30517))
+#define FADE_TIMER_TICK_COUNT						MS_TO_RTC_TICKS(FADE_TIMER_TICK_PERIOD_MS)
+
+/* Maximum fade duration in ms. It must be shorter than RTC counter overflow period */
+#define FADE_MAX_DURATION_MS						60000		/* 60 s */
+
+/* Number of fractional bits of fade progress value */
+#define FADE_PROGRESS_FRAC_BITS					EASING_PROGRESS_FRAC_BITS
+
+/* Natural frequency of damped retargeting multiplied by the transition duration. 
+   A critically damped channel covers about 98% of the distance in the transition duration */
+#define FADE_DAMPED_OMEGA_DURATION				6
+
+/* Distance and per fade tick variation below which a damped channel is settled: a quarter of level */
+#define FADE_DAMPED_SETTLE_THRESHOLD			((int32_t)1 << (FADE_Q_FRAC_BITS - 2))
+
+/* Step in Q16 of the exponential table */
+#define EXP_TABLE_STEP_BITS						14
+
+/* One in Q16 */
+#define EXP_Q16_ONE									((uint32_t)1 << 16)
+
+/* Number of entries of the exponential table */
+#define EXP_TABLE_LENGTH							33
 
 /* Memory position: fade percentage field */
 #define FADE_MEM_POSITION							(BLE_DIMMER_CONFIG_CHAR_POS + 0)	/* First location in memory data structure */
 
+/* Memory position: default fade curve field */
+#define CURVE_MEM_POSITION							(BLE_DIMMER_CONFIG_CHAR_POS + 1)	/* Second location in memory data structure */
+
 /* PWM fade period in ms */
 #define PWM_FADE_PERIOD_MS							500    
 
@@ -68,69 +93,165 @@
 /* Minimum PWM DC value */                                 
 #define PWM_DC_MIN_VALUE          				0                                                                 		
 
-/* PWM channel for RED */   
-#define PWM_CH_R          							28
+/* Maximum lightness level of a channel */
+#define LIGHT_LEVEL_MAX								((uint16_t)((1 << CIE_TABLE_LEVEL_BITS) - 1))
+
+/* Macro to convert a requested channel level to a lightness level. Upper bits are replicated 
+   in the lower ones when scaling up, so that LED_LEVEL_MAX gives LIGHT_LEVEL_MAX */
+#if CIE_TABLE_LEVEL_BITS >= LED_LEVEL_BITS
+#define LED_LEVEL_TO_LEVEL(x)						((uint16_t)(((x) << (CIE_TABLE_LEVEL_BITS - LED_LEVEL_BITS)) | ((x) >> (2 * LED_LEVEL_BITS - CIE_TABLE_LEVEL_BITS))))
+#else
+#define LED_LEVEL_TO_LEVEL(x)						((uint16_t)((x) >> (LED_LEVEL_BITS - CIE_TABLE_LEVEL_BITS)))
+#endif
+
+/* Macro to convert a PWM percentage to a lightness level */
+#define PWM_PERCENT_TO_LEVEL(x)					((uint16_t)((((uint32_t)(x) * LIGHT_LEVEL_MAX) + (PWM_DC_MAX_VALUE / 2)) / PWM_DC_MAX_VALUE))
+
+/* Number of fractional bits of fade fixed point values (Q16.16) */
+#define FADE_Q_FRAC_BITS							16
 
-/* PWM channel for GREEN */   
-#define PWM_CH_G          							23
+/* Half LSB of a lightness level in fixed point, used for rounding */
+#define FADE_Q_HALF									((uint32_t)1 << (FADE_Q_FRAC_BITS - 1))
 
-/* PWM channel for BLUE */   
-#define PWM_CH_B          							22
+/* Macro to convert a lightness level to fixed point */
+#define LEVEL_TO_FADE_Q(x)							((uint32_t)(x) << FADE_Q_FRAC_BITS)
 
-/* PWM channel for BLUE */   
-#define PWM_CH_W         							17
+/* Macro to convert a fixed point position to the nearest lightness level */
+#define FADE_Q_TO_LEVEL(x)							((uint16_t)(((x) + FADE_Q_HALF) >> FADE_Q_FRAC_BITS))
 
+/* RTC ticks per second */
+#define RTC_TICKS_PER_S								32768
 
+/* Macro to convert a rate in requested levels per second to a fixed point velocity per RTC tick */
+#if CIE_TABLE_LEVEL_BITS >= LED_LEVEL_BITS
+#define LED_RATE_TO_FADE_VELOCITY(x)				((int32_t)(x) * (((1 << FADE_Q_FRAC_BITS) / RTC_TICKS_PER_S) << (CIE_TABLE_LEVEL_BITS - LED_LEVEL_BITS)))
+#else
+#define LED_RATE_TO_FADE_VELOCITY(x)				((int32_t)(x) * (((1 << FADE_Q_FRAC_BITS) / RTC_TICKS_PER_S) >> (LED_LEVEL_BITS - CIE_TABLE_LEVEL_BITS)))
+#endif
 
+/* Macro to convert ms to RTC ticks (30.517 us each) */
+#define MS_TO_RTC_TICKS(ms)						((uint32_t)(((uint64_t)(ms) * 1000000)/30517))
 
-/* ---------------- Local macros --------------------- */   
+/* Number of bits to shift a CIE table entry by the PWM period to get fractional PWM ticks */
+#define CIE_TO_PWM_TICKS_SHIFT						(16 - PWM_TICKS_FRAC_BITS)
 
-/* Create the instance "PWM1" using TIMER2. */
-APP_PWM_INSTANCE(PWM1,1);  
+/* Macro to convert a CIE table entry to PWM ticks with PWM_TICKS_FRAC_BITS fractional bits, 
+   with rounding */
+#define CIE_TO_PWM_TICKS(x, period)				((uint16_t)((((uint32_t)(x) * (period)) + ((uint32_t)1 << (CIE_TO_PWM_TICKS_SHIFT - 1))) >> CIE_TO_PWM_TICKS_SHIFT))
 
-/* Create the instance "PWM2" using TIMER3. */                 
-APP_PWM_INSTANCE(PWM2,2); 
+#if CIE_TABLE_MAX_VALUE != 65535
+#error CIE table entries must be 16 bits fractions of the PWM period
+#endif
 
-/* Define timer for light fade */
-APP_TIMER_DEF(fade_timer); 
+
+
+
+/* ---------------- Local typedefs --------------------- */   
+
+/* Fade modes enum */
+typedef enum
+{
+	FADE_MODE_LINEAR,			/* linear ramp from start to target */
+	FADE_MODE_DAMPED,			/* critically damped motion to target keeping current velocity */
+	FADE_MODE_VELOCITY		/* constant velocity ramp until its end or level limits */
+} fade_mode_e;
+
+/* Fade status of a single channel. Positions are Q16.16 fixed point lightness levels */
+typedef struct
+{
+	uint32_t position;		/* current lightness position */
+	uint32_t start;			/* lightness position at transition start */
+	uint32_t target;			/* target lightness position */
+	int32_t delta;				/* lightness variation of the whole transition */
+	int32_t velocity;			/* lightness variation per RTC tick */
+} fade_channel_st;
 
 
 
 
 /* ---------------- Local variables --------------------- */   
 
-/* A flag indicating PWM1 status. */
-static volatile bool pwm1_ready_flag = false;
+/* Fade status of all channels */
+static fade_channel_st fade_channels[NUM_OF_LIGHT_CHANNELS];
+
+/* Flag indicating that a transition is in progress */
+static volatile bool fade_active = false;
+
+/* RTC counter value at transition start */
+static uint32_t fade_start_ticks;
+
+/* Transition duration in RTC ticks */
+static uint32_t fade_duration_ticks;
+
+/* Reciprocal of transition duration (2^32 / duration) to get progress without divisions */
+static uint32_t fade_progress_factor;
+
+/* Current fade mode */
+static fade_mode_e fade_mode = FADE_MODE_LINEAR;
+
+/* Easing curve of current linear transition */
+static uint8_t fade_curve = EASING_CURVE_LINEAR;
 
-/* A flag indicating PWM2 status. */		
-static volatile bool pwm2_ready_flag = false;	
+/* Default easing curve from config values */
+static uint8_t fade_default_curve;
 
-/* Variables to store target PWM values */
-static uint8_t red_pwm_target = 0;
-static uint8_t green_pwm_target = 0;
-static uint8_t blue_pwm_target = 0;
-static uint8_t white_pwm_target = 0;
+/* RTC counter value at last damped fade update */
+static uint32_t fade_last_ticks;
 
-/* Variables to store current PWM values */
-static uint8_t red_pwm_value = 0;
-static uint8_t green_pwm_value = 0;
-static uint8_t blue_pwm_value = 0;
-static uint8_t white_pwm_value = 0;
-static uint8_t fade_count = 0;
+/* Natural frequency of damped fade in radians per RTC tick, Q0.32 */
+static uint32_t fade_omega;
+
+/* exp(-x) table in Q16 for x from 0 to 8 with step 0.25 */
+static const uint16_t exp_neg_table[EXP_TABLE_LENGTH] =
+{
+	65535, 51039, 39750, 30957, 24109, 18776, 14623, 11388, 8869, 6907, 5380, 4190, 3263,
+	2541, 1979, 1541, 1200, 935, 728, 567, 442, 344, 268, 209, 162, 127, 99, 77, 60, 47,
+	36, 28, 22
+};
+
+/* Fade percentage value from config values */
 static uint8_t fade_percent_value;
 
-/* Variables to store step PWM values */
-static int8_t red_pwm_step = 0;
-static int8_t green_pwm_step = 0;
-static int8_t blue_pwm_step = 0;
-static int8_t white_pwm_step = 0;
+/* Flag indicating that new config values have been published */
+static volatile bool fade_config_changed = false;
+
+/* PWM period in ticks */
+static uint16_t pwm_period_ticks;
+
+/* Task managing light at each fade tick */
+static uint8_t fade_task = SCHED_INVALID_TASK;
+
+/* Flag indicating that PWM backend is started */
+static bool pwm_started = false;
+
+/* Light fade timer */
+static vtimer_st fade_timer;
+
+/* Flag indicating that fade timer is running */
+static bool fade_timer_running = false;
+
+/* Number of fade timer wakeups */
+static volatile uint32_t fade_wakeups = 0;
 
 
 
 
 /* ------------- Local functions prototypes --------------- */
 
-static void pwm_ready_callback	(uint32_t);
+static void fade_config_observer	(void);
+static void fade_config_update	(void);
+static void fade_config_refresh	(void);
+static uint32_t fade_default_ms	(void);
+static void fade_start				(const uint16_t *, uint32_t, uint8_t);
+static void fade_positions_update	(uint32_t);
+static void fade_linear_update	(uint32_t);
+static void fade_damped_update	(uint32_t);
+static void fade_velocity_update	(uint32_t);
+static uint32_t exp_neg_q16		(uint32_t);
+static uint16_t level_to_pwm_ticks	(uint16_t);
+static void pwm_start					(void);
+static void fade_timer_start		(void);
+static void fade_timer_stop		(void);
 static void fade_timeout_handler	(void *);
 
 
@@ -141,65 +262,77 @@ static void fade_timeout_handler	(void *);
 /* Function to init LED light module */
 void led_light_init(void)
 {
-	uint32_t err_code;
-
-	/* 2-channel PWM1, 2000Hz, output on DK LED pins. */
-	app_pwm_config_t pwm1_cfg = APP_PWM_DEFAULT_CONFIG_2CH(500, PWM_CH_R, PWM_CH_G);
-	/* 2-channel PWM2, 2000Hz, output on DK LED pins. */
-	app_pwm_config_t pwm2_cfg = APP_PWM_DEFAULT_CONFIG_2CH(500, PWM_CH_B, PWM_CH_W);
-
-	/* Set PWM R channel polarity */
-	pwm1_cfg.pin_polarity[0] = APP_PWM_POLARITY_ACTIVE_HIGH;
-	/* Set PWM G channel polarity */
-	pwm1_cfg.pin_polarity[1] = APP_PWM_POLARITY_ACTIVE_HIGH;
-	/* Set PWM B channel polarity */
-	pwm2_cfg.pin_polarity[0] = APP_PWM_POLARITY_ACTIVE_HIGH;
-	/* Set PWM W channel polarity */
-	pwm2_cfg.pin_polarity[1] = APP_PWM_POLARITY_ACTIVE_HIGH;
-
-	/* Initialize PWM1 */
-	err_code = app_pwm_init(&PWM1, &pwm1_cfg, pwm_ready_callback);
-	APP_ERROR_CHECK(err_code);
-	/* Initialize PWM2 */
-	err_code = app_pwm_init(&PWM2, &pwm2_cfg, pwm_ready_callback);
-	APP_ERROR_CHECK(err_code);
-
-	/* Enable PWM1 and PWM2 */
-	app_pwm_enable(&PWM1);
-	app_pwm_enable(&PWM2);
-
-	/* ready to do first PWM1/2 update */
-	pwm1_ready_flag = true;
-	pwm2_ready_flag = true;
-
-	/* ATTENTION: fade value is read from memory once during init */
-	/* get fade value at init only */
-	fade_percent_value = char_values[FADE_MEM_POSITION];
-
-	/* init fade trigger timer */
-	err_code = app_timer_create(&fade_timer, APP_TIMER_MODE_REPEATED, fade_timeout_handler);
-	APP_ERROR_CHECK(err_code);
-
-	/* start fade timer */
-	err_code = app_timer_start(fade_timer, FADE_TIMER_TICK_COUNT, NULL);
-	APP_ERROR_CHECK(err_code);
+	/* init PWM backend, if not started yet by led_light_restore() */
+	pwm_start();
+
+	/* create the task managing light at each fade tick */
+	fade_task = sched_task_create(led_manage_light, SCHED_PRIO_HIGH);
+	APP_ERROR_CHECK_BOOL(fade_task != SCHED_INVALID_TASK);
+
+	/* get fade config values and be notified of new ones */
+	fade_config_update();
+	APP_ERROR_CHECK_BOOL(memory_config_observer_register(fade_config_observer));
+
+	/* init fade trigger timer. It is started only while a transition is in progress */
+	vtimer_create(&fade_timer, VTIMER_MODE_REPEATED, fade_timeout_handler);
+}
+
+
+/* Function to start the light at the given channel lightness levels (0 - LIGHT_LEVEL_MAX, the 
+   CIE table resolution), as output at each fade tick and kept by the light state module, without 
+   transition. It does not need the BLE stack, so it is called at power up to restore the last 
+   light state before led_light_init() */
+void led_light_restore(const uint16_t *p_levels)
+{
+	uint16_t frame_ticks[NUM_OF_LIGHT_CHANNELS];
+	uint16_t level;
+
+	pwm_start();
+
+	for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+	{
+		level = p_levels[ch];
+		if(level > LIGHT_LEVEL_MAX)
+		{
+			level = LIGHT_LEVEL_MAX;
+		}
+		else
+		{
+			/* valid level */
+		}
+
+		fade_channels[ch].position = LEVEL_TO_FADE_Q(level);
+		fade_channels[ch].target = fade_channels[ch].position;
+		fade_channels[ch].velocity = 0;
+		frame_ticks[ch] = level_to_pwm_ticks(level);
+	}
+
+	led_pwm_frame_set(frame_ticks);
 }
 
 
-/* Function to turn OFF all LED channels */
+/* Function to turn OFF all LED channels at once. A running transition or ramp is stopped, so 
+   next fade ticks do not light the channels again, and the off state is stored */
 void led_turn_off(void)
 {
-	while(false == pwm1_ready_flag);
-	while(app_pwm_channel_duty_set(&PWM1, 0, 0) == NRF_ERROR_BUSY);
+	uint16_t frame_ticks[NUM_OF_LIGHT_CHANNELS] = {0};
+	uint16_t levels[NUM_OF_LIGHT_CHANNELS] = {0};
 
-	while(false == pwm1_ready_flag);
-	while(app_pwm_channel_duty_set(&PWM1, 1, 0) == NRF_ERROR_BUSY);
+	/* stop the transition on zero targets */
+	fade_active = false;
+	fade_timer_stop();
+	for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+	{
+		fade_channels[ch].position = 0;
+		fade_channels[ch].target = 0;
+		fade_channels[ch].velocity = 0;
+	}
 
-	while(false == pwm2_ready_flag);
-	while(app_pwm_channel_duty_set(&PWM2, 0, 0) == NRF_ERROR_BUSY);
+	led_pwm_frame_set(frame_ticks);
 
-	while(false == pwm2_ready_flag);
-	while(app_pwm_channel_duty_set(&PWM2, 1, 0) == NRF_ERROR_BUSY);
+	/* keep the off state through a warm reset and a power cycle */
+	light_state_output_set(levels);
+	light_state_commit(levels);
 }
 
 
@@ -207,27 +340,84 @@ void led_turn_off(void)
 void led_update_light( uint8_t red_value, 
 					  		  uint8_t green_value, 
 							  uint8_t blue_value, 
-							  uint8_t white_value)
+							  uint8_t white_value,
+							  uint8_t curve_id)
+{
+	uint16_t target_levels[NUM_OF_LIGHT_CHANNELS];
+	uint32_t fade_ms;
+
+	/* check values */
+	if((red_value <= PWM_DC_MAX_VALUE)
+	&& (green_value <= PWM_DC_MAX_VALUE)
+	&& (blue_value <= PWM_DC_MAX_VALUE)
+	&& (white_value <= PWM_DC_MAX_VALUE))
+	{
+		target_levels[RED_CHANNEL] = PWM_PERCENT_TO_LEVEL(red_value);
+		target_levels[GREEN_CHANNEL] = PWM_PERCENT_TO_LEVEL(green_value);
+		target_levels[BLUE_CHANNEL] = PWM_PERCENT_TO_LEVEL(blue_value);
+		target_levels[WHITE_CHANNEL] = PWM_PERCENT_TO_LEVEL(white_value);
+
+		/* get new config values if any */
+		fade_config_refresh();
+
+		/* get configured fade duration */
+		fade_ms = fade_default_ms();
+
+		/* get default curve if requested */
+		if(curve_id == EASING_CURVE_DEFAULT)
+		{
+			curve_id = fade_default_curve;
+		}
+
+		/* start transition */
+		fade_start(target_levels, fade_ms, curve_id);
+	}
+	else
+	{
+		/* do nothing */
+	}
+}
+
+
+/* Function to update LED light to absolute channel levels (0 - LED_LEVEL_MAX) with a 
+   transition of the given duration in ms, or of the configured one if LED_FADE_DEFAULT */
+void led_update_levels( uint16_t red_level, 
+								uint16_t green_level, 
+								uint16_t blue_level, 
+								uint16_t white_level,
+								uint32_t fade_ms,
+								uint8_t curve_id)
 {
+	uint16_t target_levels[NUM_OF_LIGHT_CHANNELS];
+
 	/* check values */
-	if((red_value <= 100)
-	&& (green_value <= 100)
-	&& (blue_value <= 100)
-	&& (white_value <= 100))
+	if((red_level <= LED_LEVEL_MAX)
+	&& (green_level <= LED_LEVEL_MAX)
+	&& (blue_level <= LED_LEVEL_MAX)
+	&& (white_level <= LED_LEVEL_MAX))
 	{
-		red_pwm_target = red_value;
-		green_pwm_target = green_value;
-		blue_pwm_target = blue_value;
-		white_pwm_target = white_value;
+		target_levels[RED_CHANNEL] = LED_LEVEL_TO_LEVEL(red_level);
+		target_levels[GREEN_CHANNEL] = LED_LEVEL_TO_LEVEL(green_level);
+		target_levels[BLUE_CHANNEL] = LED_LEVEL_TO_LEVEL(blue_level);
+		target_levels[WHITE_CHANNEL] = LED_LEVEL_TO_LEVEL(white_level);
+
+		/* get new config values if any */
+		fade_config_refresh();
+
+		/* get configured fade duration if requested */
+		if(fade_ms == LED_FADE_DEFAULT)
+		{
+			fade_ms = fade_default_ms();
+		}
 
-		/* calculate PWM steps for each channel */
-		red_pwm_step   = (int8_t)(((int16_t)(red_pwm_target   - red_pwm_value)   * fade_percent_value) / 100);
-		green_pwm_step = (int8_t)(((int16_t)(green_pwm_target - green_pwm_value) * fade_percent_value) / 100);
-		blue_pwm_step  = (int8_t)(((int16_t)(blue_pwm_target  - blue_pwm_value)  * fade_percent_value) / 100);
-		white_pwm_step = (int8_t)(((int16_t)(white_pwm_target - white_pwm_value) * fade_percent_value) / 100);
+		/* get default curve if requested */
+		if(curve_id == EASING_CURVE_DEFAULT)
+		{
+			curve_id = fade_default_curve;
+		}
 
-		/* re-calculate update counts for fade */
-		fade_count = (uint8_t)(100 / fade_percent_value);
+		/* start transition */
+		fade_start(target_levels, fade_ms, curve_id);
 	}
 	else
 	{
@@ -236,107 +426,579 @@ void led_update_light( uint8_t red_value,
 }
 
 
-/* Function to manage light periodically */
+/* Function to start a ramp of each channel at a constant signed rate in levels (0 - LED_LEVEL_MAX) 
+   per second. A channel stops at level limits and the ramp lasts the given duration in ms at 
+   most, or until led_ramp_stop() */
+void led_ramp_start(int16_t red_rate, int16_t green_rate, int16_t blue_rate, int16_t white_rate, uint32_t duration_ms)
+{
+	uint32_t now_ticks;
+
+	/* bring a running transition up to now, so the ramp starts from current positions and not 
+	   from those of last fade tick */
+	app_timer_cnt_get(&now_ticks);
+	if(true == fade_active)
+	{
+		fade_positions_update(now_ticks);
+	}
+	else
+	{
+		/* start from rest */
+	}
+
+	if(duration_ms > FADE_MAX_DURATION_MS)
+	{
+		duration_ms = FADE_MAX_DURATION_MS;
+	}
+
+	fade_channels[RED_CHANNEL].velocity = LED_RATE_TO_FADE_VELOCITY(red_rate);
+	fade_channels[GREEN_CHANNEL].velocity = LED_RATE_TO_FADE_VELOCITY(green_rate);
+	fade_channels[BLUE_CHANNEL].velocity = LED_RATE_TO_FADE_VELOCITY(blue_rate);
+	fade_channels[WHITE_CHANNEL].velocity = LED_RATE_TO_FADE_VELOCITY(white_rate);
+
+	/* set ramp timing */
+	fade_duration_ticks = MS_TO_RTC_TICKS(duration_ms);
+	fade_start_ticks = now_ticks;
+	fade_last_ticks = now_ticks;
+	fade_mode = FADE_MODE_VELOCITY;
+
+	fade_active = true;
+
+	/* wake up fade timer */
+	fade_timer_start();
+}
+
+
+/* Function to stop a running ramp. Channels stop at next fade tick */
+void led_ramp_stop(void)
+{
+	uint32_t now_ticks;
+
+	if((true == fade_active)
+	&& (fade_mode == FADE_MODE_VELOCITY))
+	{
+		/* ramp ends now */
+		app_timer_cnt_get(&now_ticks);
+		app_timer_cnt_diff_compute(now_ticks, fade_start_ticks, &fade_duration_ticks);
+	}
+	else
+	{
+		/* no ramp in progress */
+	}
+}
+
+
+/* Function to get the number of fade timer wakeups */
+uint32_t led_fade_wakeups_get(void)
+{
+	return fade_wakeups;
+}
+
+
+/* Task to manage light at each fade tick. It runs in the main loop, as light requests do, 
+   so a fade tick never sees a half updated transition. Position is calculated from RTC ticks 
+   elapsed since last update or transition start, so late or merged fade ticks are self-corrected. 
+   New config values are applied here, the task being also posted by the config observer */
 void led_manage_light(void)
 {
-	/* update PWM until fade count expires. Last run is set directly to target PWM value.
-	   Indeed the target value can not be a multiple of calculated step. */
-	//while(fade_count > 0)
-	if(fade_count > 0)
+	uint16_t frame_ticks[NUM_OF_LIGHT_CHANNELS];
+	uint16_t levels[NUM_OF_LIGHT_CHANNELS];
+	uint32_t now_ticks;
+
+	/* get new config values if any */
+	fade_config_refresh();
+
+	if(true == fade_active)
 	{
-		/* increment R channel PWM */
-		if(fade_count == 1)
+		/* update channels positions */
+		app_timer_cnt_get(&now_ticks);
+		fade_positions_update(now_ticks);
+
+		/* prepare the nearest lightness levels */
+		for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+		{
+			levels[ch] = FADE_Q_TO_LEVEL(fade_channels[ch].position);
+			frame_ticks[ch] = level_to_pwm_ticks(levels[ch]);
+		}
+
+		/* write next frame. It is committed by the backend at next PWM period */
+		led_pwm_frame_set(frame_ticks);
+
+		/* keep output levels through a warm reset */
+		light_state_output_set(levels);
+
+		/* if transition completed, store reached levels */
+		if(false == fade_active)
 		{
-			red_pwm_value = red_pwm_target;
+			light_state_commit(levels);
 		}
 		else
 		{
-			red_pwm_value = (uint8_t)(red_pwm_value + red_pwm_step);
+			/* do nothing */
 		}
-		while(false == pwm1_ready_flag);
-		while(app_pwm_channel_duty_set(&PWM1, 0, red_pwm_value) == NRF_ERROR_BUSY);
+	}
+
+	/* if all channels reached their targets */
+	if(false == fade_active)
+	{
+		/* no transition in progress: stop waking up */
+		fade_timer_stop();
+	}
+	else
+	{
+		/* wait for next fade tick */
+	}
+}
+
+
+
+
+/* ------------- Local functions implementation --------------- */
+
+/* Config observer function. It runs in the context of the memory update, so new values are 
+   only flagged here and read at next fade tick, which is run at once even if no transition is 
+   in progress. A light request before that tick reads them too */
+static void fade_config_observer(void)
+{
+	fade_config_changed = true;
+	sched_task_post(fade_task);
+}
+
+
+/* Function to update fade config if new config values have been published */
+static void fade_config_refresh(void)
+{
+	if(fade_config_changed == true)
+	{
+		/* clear flag first: a publication while reading sets it again */
+		fade_config_changed = false;
+		fade_config_update();
+	}
+	else
+	{
+		/* do nothing */
+	}
+}
+
+
+/* Function to update fade config from a consistent copy of config values */
+static void fade_config_update(void)
+{
+	uint8_t config_values[MEM_BUFFER_DATA_LENGTH];
+
+	memory_config_get(config_values);
+	fade_percent_value = config_values[FADE_MEM_POSITION];
+	fade_default_curve = config_values[CURVE_MEM_POSITION];
+}
+
 
-		/* increment G channel PWM */
-		if(fade_count == 1)
+/* Function to get the configured fade duration in ms from stored percentage of each fade tick 
+   rounding up. A fade value of 100% is a single fade tick, a value of 0 or greater than 100% 
+   means an immediate change */
+static uint32_t fade_default_ms(void)
+{
+	uint32_t fade_ms;
+
+	if((fade_percent_value > 0)
+	&& (fade_percent_value <= PWM_DC_MAX_VALUE))
+	{
+		fade_ms = FADE_TIMER_TICK_PERIOD_MS * ((PWM_DC_MAX_VALUE + fade_percent_value - 1) / fade_percent_value);
+	}
+	else
+	{
+		fade_ms = 0;
+	}
+
+	return fade_ms;
+}
+
+
+/* Function to start a transition from current positions to target levels in a duration in ms 
+   following an easing curve. Divisions are performed here once per transition and never in the 
+   fade timer handler */
+static void fade_start(const uint16_t *p_target_levels, uint32_t duration_ms, uint8_t curve_id)
+{
+	uint32_t duration_ticks;
+	uint32_t now_ticks;
+
+	/* bring a running transition up to now, since positions and velocities are those of last 
+	   fade tick and the new transition starts from current ones */
+	if(true == fade_active)
+	{
+		app_timer_cnt_get(&now_ticks);
+		fade_positions_update(now_ticks);
+	}
+	else
+	{
+		/* start from rest */
+	}
+
+	if(duration_ms > FADE_MAX_DURATION_MS)
+	{
+		duration_ms = FADE_MAX_DURATION_MS;
+	}
+	duration_ticks = MS_TO_RTC_TICKS(duration_ms);
+
+	/* set targets */
+	for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+	{
+		fade_channels[ch].target = LEVEL_TO_FADE_Q(p_target_levels[ch]);
+	}
+
+#ifdef FADE_SMOOTH_RETARGET
+	/* if a transition is in progress and the new one lasts at least one fade tick */
+	if((true == fade_active)
+	&& (duration_ticks >= FADE_TIMER_TICK_COUNT))
+	{
+		/* retarget keeping current positions and velocities */
+		fade_omega = (uint32_t)(((uint64_t)FADE_DAMPED_OMEGA_DURATION << 32) / duration_ticks);
+		app_timer_cnt_get(&fade_last_ticks);
+		fade_mode = FADE_MODE_DAMPED;
+	}
+	else
+#endif
+	{
+		/* set transition timing */
+		fade_duration_ticks = duration_ticks;
+		if(fade_duration_ticks > 0)
 		{
-			green_pwm_value = green_pwm_target;
+			fade_progress_factor = (uint32_t)(0xFFFFFFFFUL / fade_duration_ticks);
 		}
 		else
 		{
-			green_pwm_value = (uint8_t)(green_pwm_value + green_pwm_step);
+			/* immediate change: target is applied at first tick */
+			fade_progress_factor = 0;
 		}
-		while(false == pwm1_ready_flag);
-		while(app_pwm_channel_duty_set(&PWM1, 1, green_pwm_value) == NRF_ERROR_BUSY);
 
-		/* increment B channel PWM */
-		if(fade_count == 1)
+		/* set ramps from current positions. Velocities are updated at each tick */
+		for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
 		{
-			blue_pwm_value = blue_pwm_target;
+			fade_channels[ch].start = fade_channels[ch].position;
+			fade_channels[ch].delta = (int32_t)fade_channels[ch].target - (int32_t)fade_channels[ch].position;
+			fade_channels[ch].velocity = 0;
+		}
+
+		app_timer_cnt_get(&fade_start_ticks);
+		fade_curve = curve_id;
+		fade_mode = FADE_MODE_LINEAR;
+	}
+
+	fade_active = true;
+
+	/* wake up fade timer */
+	fade_timer_start();
+}
+
+
+/* Function to update channels positions of the running transition */
+static void fade_positions_update(uint32_t now_ticks)
+{
+	if(fade_mode == FADE_MODE_DAMPED)
+	{
+		fade_damped_update(now_ticks);
+	}
+	else if(fade_mode == FADE_MODE_VELOCITY)
+	{
+		fade_velocity_update(now_ticks);
+	}
+	else
+	{
+		fade_linear_update(now_ticks);
+	}
+}
+
+
+/* Function to update channels positions of a linear transition. Progress is shaped by the 
+   transition easing curve */
+static void fade_linear_update(uint32_t now_ticks)
+{
+	uint32_t elapsed_ticks;
+	uint32_t progress;
+	uint32_t eased_progress;
+	uint32_t speed_factor;
+
+	/* get elapsed time */
+	app_timer_cnt_diff_compute(now_ticks, fade_start_ticks, &elapsed_ticks);
+
+	/* if transition is completed */
+	if(elapsed_ticks >= fade_duration_ticks)
+	{
+		/* land exactly on target */
+		for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+		{
+			fade_channels[ch].position = fade_channels[ch].target;
+			fade_channels[ch].velocity = 0;
+		}
+		fade_active = false;
+	}
+	else
+	{
+		/* elapsed is lower than duration so the product does not overflow */
+		progress = (elapsed_ticks * fade_progress_factor) >> (32 - FADE_PROGRESS_FRAC_BITS);
+		eased_progress = easing_apply(fade_curve, progress);
+
+		/* velocity is kept for smooth retargeting. A transition shorter than a fade tick is a step */
+		if(fade_duration_ticks >= FADE_TIMER_TICK_COUNT)
+		{
+			speed_factor = (uint32_t)(((uint64_t)easing_slope(fade_curve, progress) * fade_progress_factor) >> EASING_PROGRESS_FRAC_BITS);
 		}
 		else
 		{
-			blue_pwm_value = (uint8_t)(blue_pwm_value + blue_pwm_step);
+			speed_factor = 0;
+		}
+
+		for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+		{
+			fade_channels[ch].position = (uint32_t)((int32_t)fade_channels[ch].start 
+										 + (int32_t)(((int64_t)fade_channels[ch].delta * eased_progress) >> FADE_PROGRESS_FRAC_BITS));
+			fade_channels[ch].velocity = (int32_t)(((int64_t)fade_channels[ch].delta * speed_factor) >> 32);
+		}
+	}
+}
+
+
+/* Function to update channels positions of a damped transition. Each channel follows the exact 
+   solution of a critically damped motion over the elapsed time, so the output is continuous in 
+   value and velocity whenever targets change and it is stable for any tick delay */
+static void fade_damped_update(uint32_t now_ticks)
+{
+	uint32_t elapsed_ticks;
+	uint32_t omega_dt;
+	uint32_t decay;
+	int64_t offset;
+	int64_t temp;
+	int64_t velocity;
+	int64_t position;
+	bool settled = true;
+
+	/* get elapsed time since last update */
+	app_timer_cnt_diff_compute(now_ticks, fade_last_ticks, &elapsed_ticks);
+	fade_last_ticks = now_ticks;
+
+	/* omega * dt in Q16 and related decay exp(-omega * dt) */
+	omega_dt = (uint32_t)MIN((((uint64_t)fade_omega * elapsed_ticks) >> 16), UINT32_MAX);
+	decay = exp_neg_q16(omega_dt);
+
+	for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+	{
+		/* x(t) = (x0 + (v0 + w*x0)*t) * e^(-w*t), v(t) = (v0 - w*(v0 + w*x0)*t) * e^(-w*t) */
+		offset = (int64_t)fade_channels[ch].position - (int64_t)fade_channels[ch].target;
+		temp = ((int64_t)fade_channels[ch].velocity * elapsed_ticks) + ((offset * omega_dt) >> 16);
+		offset = ((offset + temp) * decay) >> 16;
+		velocity = (((int64_t)fade_channels[ch].velocity - (((int64_t)fade_omega * temp) >> 32)) * decay) >> 16;
+
+		/* check if channel is settled on target */
+		if((offset > FADE_DAMPED_SETTLE_THRESHOLD)
+		|| (offset < -FADE_DAMPED_SETTLE_THRESHOLD)
+		|| ((velocity * FADE_TIMER_TICK_COUNT) > FADE_DAMPED_SETTLE_THRESHOLD)
+		|| ((velocity * FADE_TIMER_TICK_COUNT) < -FADE_DAMPED_SETTLE_THRESHOLD))
+		{
+			settled = false;
 		}
-		while(false == pwm2_ready_flag);
-		while(app_pwm_channel_duty_set(&PWM2, 0, blue_pwm_value) == NRF_ERROR_BUSY);
 
-		/* increment W channel PWM */
-		if(fade_count == 1)
+		/* keep position in range since a channel with initial velocity may overshoot */
+		position = (int64_t)fade_channels[ch].target + offset;
+		if(position < 0)
+		{
+			position = 0;
+		}
+		else if(position > (int64_t)LEVEL_TO_FADE_Q(LIGHT_LEVEL_MAX))
 		{
-			white_pwm_value = white_pwm_target;
+			position = (int64_t)LEVEL_TO_FADE_Q(LIGHT_LEVEL_MAX);
 		}
 		else
 		{
-			white_pwm_value = (uint8_t)(white_pwm_value + white_pwm_step);
+			/* position in range */
 		}
-		while(false == pwm2_ready_flag);
-		while(app_pwm_channel_duty_set(&PWM2, 1, white_pwm_value) == NRF_ERROR_BUSY);
 
-		/* wait for next fade increment */
-		//nrf_delay_ms(PWM_FADE_PERIOD_MS);
-		fade_count--;
+		fade_channels[ch].position = (uint32_t)position;
+		fade_channels[ch].velocity = (int32_t)velocity;
+	}
+
+	/* if all channels are settled */
+	if(true == settled)
+	{
+		/* land exactly on target */
+		for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+		{
+			fade_channels[ch].position = fade_channels[ch].target;
+			fade_channels[ch].velocity = 0;
+		}
+		fade_active = false;
 	}
 }
 
 
+/* Function to update channels positions of a constant velocity ramp. Positions are integrated 
+   over the RTC ticks elapsed since last update up to the end of the ramp and each channel stops 
+   at level limits */
+static void fade_velocity_update(uint32_t now_ticks)
+{
+	uint32_t elapsed_ticks;
+	uint32_t dt_ticks;
+	int64_t position;
+	bool moving = false;
+	bool finished = false;
+
+	/* get elapsed time since ramp start and since last update */
+	app_timer_cnt_diff_compute(now_ticks, fade_start_ticks, &elapsed_ticks);
+	app_timer_cnt_diff_compute(now_ticks, fade_last_ticks, &dt_ticks);
+	fade_last_ticks = now_ticks;
+
+	/* if ramp end is passed */
+	if(elapsed_ticks >= fade_duration_ticks)
+	{
+		/* integrate up to ramp end only */
+		dt_ticks -= MIN(dt_ticks, (elapsed_ticks - fade_duration_ticks));
+		finished = true;
+	}
+	else
+	{
+		/* ramp in progress */
+	}
 
+	for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+	{
+		position = (int64_t)fade_channels[ch].position + ((int64_t)fade_channels[ch].velocity * dt_ticks);
 
-/* ------------- Local functions implementation --------------- */
+		/* stop channel at level limits */
+		if(position <= 0)
+		{
+			position = 0;
+			fade_channels[ch].velocity = 0;
+		}
+		else if(position >= (int64_t)LEVEL_TO_FADE_Q(LIGHT_LEVEL_MAX))
+		{
+			position = (int64_t)LEVEL_TO_FADE_Q(LIGHT_LEVEL_MAX);
+			fade_channels[ch].velocity = 0;
+		}
+		else
+		{
+			/* position in range */
+		}
 
-/* Timer timeout handler for light fade management */
-static void fade_timeout_handler(void * p_context)
+		fade_channels[ch].position = (uint32_t)position;
+		if(fade_channels[ch].velocity != 0)
+		{
+			moving = true;
+		}
+	}
+
+	/* if ramp is finished or all channels reached their limits */
+	if((true == finished)
+	|| (false == moving))
+	{
+		/* stay on current positions */
+		for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+		{
+			fade_channels[ch].target = fade_channels[ch].position;
+			fade_channels[ch].velocity = 0;
+		}
+		fade_active = false;
+	}
+}
+
+
+/* Function to get exp(-x) in Q16 with x in Q16 as exp(-step) * exp(-frac): the first term comes 
+   from the related table, the second one from its series up to 4th order, whose error is below 
+   one Q16 unit for a fraction lower than a table step. A linear interpolation of the table would 
+   overestimate the decay of a fade tick by about 0.2% and push damped channels off their path */
+static uint32_t exp_neg_q16(uint32_t x)
 {
-	UNUSED_PARAMETER(p_context);
+	uint32_t index = x >> EXP_TABLE_STEP_BITS;
+	uint32_t frac = x & (((uint32_t)1 << EXP_TABLE_STEP_BITS) - 1);
+	uint32_t result;
 
-	/* manage light */
-	led_manage_light();	//TODO: avoid this call and move code here
+	if(index < (EXP_TABLE_LENGTH - 1))
+	{
+		/* 1 - f*(1 - f/2*(1 - f/3*(1 - f/4))), 21845 is 1/3 in Q16 */
+		result = EXP_Q16_ONE - (frac >> 2);
+		result = EXP_Q16_ONE - ((((frac * 21845) >> 16) * result) >> 16);
+		result = EXP_Q16_ONE - (((frac >> 1) * result) >> 16);
+		result = EXP_Q16_ONE - ((frac * result) >> 16);
+		result = (exp_neg_table[index] * result) >> 16;
+	}
+	else
+	{
+		/* negligible value */
+		result = 0;
+	}
 
-	//nrf_gpio_pin_toggle(24);
+	return result;
 }
 
 
-/* PWM ready callback function */
-static void pwm_ready_callback(uint32_t pwm_id)
+/* Function to start the fade timer if not running yet */
+static void fade_timer_start(void)
 {
-	/* set related PWM ready flag */
-	if(pwm_id == 0)
+	if(false == fade_timer_running)
+	{
+		vtimer_start(&fade_timer, FADE_TIMER_TICK_PERIOD_MS, NULL);
+		fade_timer_running = true;
+	}
+	else
 	{
-		pwm1_ready_flag = true;
+		/* already running: do nothing */
 	}
-	else if(pwm_id == 1)
+}
+
+
+/* Function to stop the fade timer if running */
+static void fade_timer_stop(void)
+{
+	if(true == fade_timer_running)
 	{
-		pwm2_ready_flag = true;
+		vtimer_stop(&fade_timer);
+		fade_timer_running = false;
 	}
 	else
 	{
-		/* invalid PWM index */
+		/* already stopped: do nothing */
 	}
 }
 
 
+/* Timer timeout handler for light fade management. Light is managed by the fade task in the 
+   main loop */
+static void fade_timeout_handler(void * p_context)
+{
+	UNUSED_PARAMETER(p_context);
 
+	/* count wakeup */
+	fade_wakeups++;
 
-/* End of file */
+	/* post fade task */
+	sched_task_post(fade_task);
+}
+
+
+/* Function to convert a lightness level to PWM ticks through the CIE 1931 table generated 
+   at build time */
+static uint16_t level_to_pwm_ticks(uint16_t level)
+{
+	return CIE_TO_PWM_TICKS(cie_table[level], pwm_period_ticks);
+}
+
+
+/* Function to init PWM backend once */
+static void pwm_start(void)
+{
+	if(false == pwm_started)
+	{
+		/* init PWM backend */
+		led_pwm_init();
 
+		/* get PWM period in ticks */
+		pwm_period_ticks = led_pwm_period_ticks_get();
 
+		pwm_started = true;
+	}
+	else
+	{
+		/* already started: do nothing */
+	}
+}
 
+
+
+
+/* End of file */
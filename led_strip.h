@@ -32,12 +32,31 @@
 #include <stddef.h>
 
 
+/* -------------- Exported defines --------------- */
+
+/* Number of bits of a channel level requested by led_update_levels() */
+#define LED_LEVEL_BITS					12
+
+/* Maximum channel level requested by led_update_levels() */
+#define LED_LEVEL_MAX					((uint16_t)((1 << LED_LEVEL_BITS) - 1))
+
+/* Fade duration requested by led_update_levels() to use the configured fade */
+#define LED_FADE_DEFAULT				0xFFFFFFFF
+
+
+
+
 /* -------------- Exported functions prototypes --------------- */
 
 extern void led_light_init(void);
+extern void led_light_restore(const uint16_t *);
 extern void led_turn_off(void);
-extern void led_update_light(uint8_t, uint8_t, uint8_t, uint8_t);
+extern void led_update_light(uint8_t, uint8_t, uint8_t, uint8_t, uint8_t);
+extern void led_update_levels(uint16_t, uint16_t, uint16_t, uint16_t, uint32_t, uint8_t);
+extern void led_ramp_start(int16_t, int16_t, int16_t, int16_t, uint32_t);
+extern void led_ramp_stop(void);
 extern void led_manage_light(void);
+extern uint32_t led_fade_wakeups_get(void);
 
 
 
@@ -0,0 +1,320 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* ------------- Inclusions --------------- */
+
+#include <string.h>
+#include "nordic_common.h"
+#include "nrf.h"
+#include "app_error.h"
+
+#include "config.h"
+#include "scheduler.h"
+#include "vtimer.h"
+#include "memory.h"
+#include "light_state.h"
+
+
+
+
+/* ------------- Local typedefs --------------- */
+
+/* Current state enum */
+typedef enum
+{
+	LS_IDLE_STATE,
+	LS_STORE_DATA
+} ls_state_e;
+
+/* Light state retained in RAM through a warm reset */
+typedef struct
+{
+	uint32_t signature;									/* retained state signature */
+	uint16_t levels[LIGHT_STATE_NUM_OF_CHANNELS];	/* output channel levels */
+	uint32_t check;										/* check of levels and signature */
+} ls_retained_st;
+
+
+
+
+/* ------------- Local defines --------------- */
+
+/* Signature of the light state retained in RAM */
+#define LS_RETAINED_SIGNATURE							0x4C535441
+
+/* Value written to GPREGRET while the light is running. Its bits do not match 
+   BOOTLOADER_DFU_START, so it never starts the bootloader */
+#define LS_GPREGRET_WARM								0x4C
+
+/* Memory record length in bytes: channel levels */
+#define LS_RECORD_LENGTH_BYTES						(LIGHT_STATE_NUM_OF_CHANNELS * sizeof(uint16_t))
+
+/* Minimum time between two stores of the light state in ms */
+#define LS_STORE_PERIOD_MS								10000		/* 10 s */
+
+
+
+
+/* ------------- Local macros --------------- */
+
+/* Macro to calculate the check of the retained light state */
+#define LS_RETAINED_CHECK(p)							((p)->signature \
+																^ ((uint32_t)(p)->levels[0] | ((uint32_t)(p)->levels[1] << 16)) \
+																^ ((uint32_t)(p)->levels[2] | ((uint32_t)(p)->levels[3] << 16)) \
+																^ 0xA5A5A5A5)
+
+
+
+
+/* ------------- Local variables --------------- */
+
+/* Light state retained in RAM. It is not initialised by the startup code */
+static ls_retained_st retained __attribute__((section(".noinit")));
+
+/* Current light state storage state */
+static volatile uint8_t curr_state = LS_IDLE_STATE;
+
+/* Levels being stored. They are read when the memory record write starts */
+static uint16_t store_levels[LIGHT_STATE_NUM_OF_CHANNELS];
+
+/* Last stored levels */
+static uint16_t stored_levels[LIGHT_STATE_NUM_OF_CHANNELS];
+
+/* Flag indicating that stored levels are valid */
+static bool stored_valid = false;
+
+/* Last committed levels, waiting to be stored */
+static uint16_t pending_levels[LIGHT_STATE_NUM_OF_CHANNELS];
+
+/* Flag indicating that committed levels have to be stored */
+static bool commit_pending = false;
+
+/* Store rate limiting timer */
+static vtimer_st store_timer;
+
+/* Task storing committed levels */
+static uint8_t store_task = SCHED_INVALID_TASK;
+
+/* Number of records stored */
+static volatile uint32_t stores_count = 0;
+
+
+
+
+/* ------------- Local functions prototypes --------------- */
+
+static void record_write_cb(uint8_t, uint8_t);
+static void pending_store(void);
+static void store_timeout_handler(void *);
+
+
+
+
+/* ------------- Exported functions --------------- */
+
+/* Function to get the light state to restore at power up. After a warm reset the output levels 
+   retained in RAM are taken, so the light does not change. Otherwise the levels stored as a memory 
+   record are taken, or all channels are off if none. Records are read directly from flash, so it 
+   can be called at the very beginning, before the BLE stack and persistent storage are initialised. 
+   ATTENTION: the records index must be already built by memory_restore() */
+void light_state_restore(uint16_t *p_levels)
+{
+	/* get the last stored levels */
+	stored_valid = memory_record_read(MEM_RECORD_LIGHT_STATE, (uint8_t *)stored_levels, LS_RECORD_LENGTH_BYTES);
+
+	/* if warm reset with a valid retained state */
+	if((NRF_POWER->GPREGRET == LS_GPREGRET_WARM)
+	&& (retained.signature == LS_RETAINED_SIGNATURE)
+	&& (retained.check == LS_RETAINED_CHECK(&retained)))
+	{
+		memcpy(p_levels, retained.levels, sizeof(retained.levels));
+	}
+	else if(true == stored_valid)
+	{
+		memcpy(p_levels, stored_levels, sizeof(stored_levels));
+	}
+	else
+	{
+		/* no light state: light is off */
+		memset(p_levels, 0, sizeof(stored_levels));
+	}
+
+	/* restored levels are the current output */
+	light_state_output_set(p_levels);
+	NRF_POWER->GPREGRET = LS_GPREGRET_WARM;
+}
+
+
+/* Function to init light state storage. 
+   ATTENTION: memory must be already initialised by memory_init() */
+bool light_state_init(void)
+{
+	/* create the task storing committed levels and its rate limiting timer */
+	store_task = sched_task_create(pending_store, SCHED_PRIO_LOW);
+	vtimer_create(&store_timer, VTIMER_MODE_SINGLE_SHOT, store_timeout_handler);
+
+	return (store_task != SCHED_INVALID_TASK);
+}
+
+
+/* Function to set the current output levels. They are retained in RAM for a warm reset. 
+   The check is written last, so a reset while writing invalidates the retained state */
+void light_state_output_set(const uint16_t *p_levels)
+{
+	retained.check = ~LS_RETAINED_CHECK(&retained);
+	retained.signature = LS_RETAINED_SIGNATURE;
+	memcpy(retained.levels, p_levels, sizeof(retained.levels));
+	retained.check = LS_RETAINED_CHECK(&retained);
+}
+
+
+/* Function to commit the levels reached at the end of a transition. They are stored at most once 
+   every LS_STORE_PERIOD_MS, the last committed ones only */
+void light_state_commit(const uint16_t *p_levels)
+{
+	memcpy(pending_levels, p_levels, sizeof(pending_levels));
+	commit_pending = true;
+
+	if(false == vtimer_is_running(&store_timer))
+	{
+		vtimer_start(&store_timer, LS_STORE_PERIOD_MS, NULL);
+	}
+	else
+	{
+		/* stored at timeout */
+	}
+}
+
+
+/* Function to store committed levels at once, without waiting for the rate limit, e.g. before a 
+   reset. It returns true if no levels are left to store: they are stored or being written */
+bool light_state_flush(void)
+{
+	vtimer_stop(&store_timer);
+	pending_store();
+
+	return (false == commit_pending);
+}
+
+
+/* Function to get light state storage status */
+bool light_state_is_busy(void)
+{
+	bool is_busy = false;
+
+	if(curr_state == LS_STORE_DATA)
+	{
+		is_busy = true;
+	}
+
+	return is_busy;
+}
+
+
+/* Function to get the number of light states stored */
+uint32_t light_state_stores_get(void)
+{
+	return stores_count;
+}
+
+
+
+
+/* ------------- Local functions --------------- */
+
+/* Task to store committed levels. It runs in the main loop */
+static void pending_store(void)
+{
+	if(false == commit_pending)
+	{
+		/* nothing to store */
+	}
+	else if(curr_state != LS_IDLE_STATE)
+	{
+		/* storage busy: try again later */
+		vtimer_start(&store_timer, LS_STORE_PERIOD_MS, NULL);
+	}
+	else if((true == stored_valid)
+	&& (0 == memcmp(pending_levels, stored_levels, sizeof(stored_levels))))
+	{
+		/* already stored */
+		commit_pending = false;
+	}
+	else
+	{
+		/* levels are kept until the write is completed */
+		memcpy(store_levels, pending_levels, sizeof(store_levels));
+		if(true == memory_record_write(MEM_RECORD_LIGHT_STATE, (const uint8_t *)store_levels, LS_RECORD_LENGTH_BYTES, record_write_cb))
+		{
+			commit_pending = false;
+			curr_state = LS_STORE_DATA;
+		}
+		else
+		{
+			/* not accepted: try again later */
+			vtimer_start(&store_timer, LS_STORE_PERIOD_MS, NULL);
+		}
+	}
+}
+
+
+/* Store timer timeout handler. Levels are stored by the related task */
+static void store_timeout_handler(void * p_context)
+{
+	UNUSED_PARAMETER(p_context);
+
+	sched_task_post(store_task);
+}
+
+
+/* Memory record write completion callback. It runs in the main loop */
+static void record_write_cb(uint8_t id, uint8_t result)
+{
+	UNUSED_PARAMETER(id);
+
+	curr_state = LS_IDLE_STATE;
+
+	if(result == MEM_RESULT_SUCCESS)
+	{
+		memcpy(stored_levels, store_levels, sizeof(stored_levels));
+		stored_valid = true;
+		stores_count++;
+	}
+	else if(false == commit_pending)
+	{
+		/* not written: store the same levels again later, unless new ones are committed */
+		memcpy(pending_levels, store_levels, sizeof(pending_levels));
+		commit_pending = true;
+		vtimer_start(&store_timer, LS_STORE_PERIOD_MS, NULL);
+	}
+	else
+	{
+		/* newer levels are stored */
+	}
+}
+
+
+
+
+/* End of file */
@@ -0,0 +1,57 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+
+
+/* ------------- Inclusions --------------- */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+
+
+/* ------------- Exported defines --------------- */
+
+/* Number of light channels of a light state. 
+   ATTENTION: it must be equal to NUM_OF_LIGHT_CHANNELS */
+#define LIGHT_STATE_NUM_OF_CHANNELS				4
+
+
+
+
+/* ------------- Exported functions --------------- */
+
+extern void 		light_state_restore			(uint16_t *);
+extern bool 		light_state_init				(void);
+extern void 		light_state_output_set		(const uint16_t *);
+extern void 		light_state_commit			(const uint16_t *);
+extern bool 		light_state_flush				(void);
+extern bool 		light_state_is_busy			(void);
+extern uint32_t 	light_state_stores_get		(void);
+
+
+
+
+/* End of file */
@@ -37,6 +37,11 @@
 #include "app_timer.h"
 
 #include "config.h"
+#include "scheduler.h"
+#include "vtimer.h"
+#include "memory.h"
+#include "light_state.h"
+#include "led_strip.h"
 #include "application.h"
 
 
@@ -44,9 +49,7 @@
 
 /* ---------------- Local defines --------------------- */
 
-// TODO: consider to unify timers management between all modules
-/* Value of the RTC1 PRESCALER register. */
-#define APP_TIMER_PRESCALER          		0
+/* Size of app_timer operations queue */
 #define APP_TIMER_OP_QUEUE_SIZE       		4  
 
 
@@ -80,8 +83,22 @@ static void power_manage(void)
 /* Application main function */
 int main(void)
 {
+	uint16_t levels[LIGHT_STATE_NUM_OF_CHANNELS];
+
+	/* Start timing boot phases */
+	application_boot_trace_start();
+
+	/* Instant-on: drive PWM with the last light state before the BLE stack comes up. Stored 
+	   records are read directly from flash */
+	memory_restore();
+	light_state_restore(levels);
+	led_light_restore(levels);
+	application_boot_phase_mark(BOOT_PHASE_FIRST_LIGHT);
+
 	/* Initialize timers */
 	APP_TIMER_INIT(APP_TIMER_PRESCALER, APP_TIMER_OP_QUEUE_SIZE, false);
+	/* Initialize virtual timers on a single app_timer */
+	vtimer_init();
 #ifdef LED_DEBUG
 	/* prototype test pin */
  	//nrf_gpio_pin_dir_set(24, NRF_GPIO_PIN_DIR_OUTPUT );
@@ -93,6 +110,9 @@ int main(void)
 	{
 		application_run();
 
+		/* run posted tasks in priority order */
+		sched_execute();
+
 		/* manage power */
 		power_manage();
 	}
@@ -1,4 +1,4 @@
-/*
+/* 
  * The MIT License (MIT)
  *
  * Copyright (c) [2015] [Marco Russi]
@@ -25,13 +25,18 @@
 /* ------------- Inclusions --------------- */
 
 #include <string.h>
+#include <stddef.h>
 #include "nordic_common.h"
 #include "nrf.h"
 #include "nrf_gpio.h"
 #include "softdevice_handler.h"
 #include "pstorage.h"
+#include "app_util_platform.h"
+#include "crc16.h"
 
 #include "config.h"
+#include "scheduler.h"
+#include "vtimer.h"
 #include "memory.h"
 
 
@@ -44,41 +49,159 @@ typedef enum
 {
 	ERROR_STATE,
 	IDLE_STATE,
-	LOAD_SIGNATURE,
-	LOAD_DATA,
-	STORE_DATA,
-	UPDATE_DATA,
-	RESTORE_DEFAULT
+	OPEN_PAGE,
+	WRITE_RECORD,
+	COPY_RECORD,
+	SEAL_PAGE,
+	ERASE_PAGE
 } curr_state_e;
 
+/* Log page state enum */
+typedef enum
+{
+	PAGE_BLANK,
+	PAGE_VALID,
+	PAGE_INVALID,
+	PAGE_LEGACY
+} page_state_e;
+
+/* Log page header. The signature is programmed last, so a header interrupted by a power loss 
+   is not valid */
+typedef struct
+{
+	uint32_t sequence;		/* page sequence, incremented at every opened or collected page */
+	uint32_t signature;		/* log page signature */
+} mem_page_header_st;
+
+/* Config slot: characteristic values with the generation they were committed with. The CRC covers 
+   generation and values */
+typedef struct
+{
+	uint32_t generation;							/* incremented at every commit */
+	uint8_t values[MEM_BUFFER_DATA_LENGTH];	/* characteristic values */
+	uint32_t crc;									/* CRC-32 of generation and values */
+} mem_config_slot_st;
+
+/* Completed record operation, waiting for its callback */
+typedef struct
+{
+	memory_op_cb_t cb;		/* completion callback */
+	uint8_t id;				/* record ID */
+	uint8_t result;			/* operation result */
+} mem_completion_st;
+
+/* Record header. Record data follow it, padded to a word */
+typedef struct
+{
+	uint16_t id;				/* record ID */
+	uint16_t length;			/* data length in bytes */
+	uint32_t sequence;		/* record sequence, incremented at every write */
+	uint16_t crc;				/* CRC16 of ID, length, sequence and data */
+	uint16_t length_check;	/* inverted length: the record is skipped only if its length is valid */
+} mem_record_header_st;
+
 
 
 
 /* ------------- Local defines --------------- */
 
-/* Validity signature for default value */
-#define MEM_DEFAULT_SIGNATURE							0x22224488
+/* Validity signature of a log page */
+#define MEM_PAGE_SIGNATURE								0x4D4C4F47
+
+/* Log page size in bytes: one nrf51 flash page */
+#define MEM_PAGE_SIZE_BYTES							1024
+
+/* Number of log pages. One page is kept erased for garbage collection, the others hold records */
+#define MEM_NUM_OF_PAGES								3
+
+/* Flash address of the first log page. Log pages are the first persistent storage pages, memory 
+   being the only registered module, so the log can be read by memory_restore() before persistent 
+   storage init */
+#define MEM_LOG_START_ADDR								PSTORAGE_DATA_START_ADDR
+
+/* Log page holding the characteristic values block of the first firmware versions, the only 
+   persistent storage page before the swap page */
+#define MEM_LEGACY_PAGE									(MEM_NUM_OF_PAGES - 1)
+
+/* Values block of the first firmware versions: size, position and value of its signature */
+#define MEM_LEGACY_BLOCK_SIZE_BYTES					16
+#define MEM_LEGACY_SIGNATURE_POS						12
+#define MEM_LEGACY_SIGNATURE							0x22224488
+
+/* Number of log pages holding records */
+#define MEM_NUM_OF_DATA_PAGES							(MEM_NUM_OF_PAGES - 1)
 
-/* Signature length in bytes */
-#define MEM_SIGNATURE_LENGTH_BYTES					4
+/* Space for records in a page in bytes */
+#define MEM_PAGE_CAPACITY_BYTES						(MEM_PAGE_SIZE_BYTES - sizeof(mem_page_header_st))
 
-/* Memory blocks size in bytes. Muat be aligned to 4. 
-TODO: implement auto-alignment and check if greater than or equal to MEM_BUFFER_DATA_LENGTH + MEM_SIGNATURE_LENGTH_BYTES */
-#define MEM_BLOCK_SIZE_BYTES							16
+/* Value of an erased flash word */
+#define MEM_BLANK_WORD									0xFFFFFFFF
 
-/* Memory validity signature position */
-#define MEM_SIGNATURE_FIELD_BYTE_POS				(MEM_BLOCK_SIZE_BYTES - MEM_SIGNATURE_LENGTH_BYTES)
+/* Delay in ms from the last characteristic update to the config record write */
+#define MEM_FLUSH_DELAY_MS								2000
 
-/* Number of blocks */
-#define NUM_OF_MEM_BLOCKS								1
+/* Delay in ms before the first retry of a flash operation refused as busy. It is doubled at 
+   every retry */
+#define MEM_RETRY_DELAY_MS								10
 
+/* Maximum number of retries of a flash operation */
+#define MEM_MAX_RETRIES									5
 
+/* Number of config slots */
+#define MEM_NUM_OF_CONFIG_SLOTS						2
 
+/* CRC-32 (IEEE 802.3) reflected polynomial and initial value */
+#define MEM_CRC32_POLY									0xEDB88320UL
+#define MEM_CRC32_INIT									0xFFFFFFFFUL
 
-/* ------------- Exported variables --------------- */
+/* Invalid page, record and config slot indexes */
+#define MEM_NO_PAGE										0xFF
+#define MEM_NO_RECORD									0xFF
+#define MEM_NO_SLOT										0xFF
 
-/* Store characteristic values */
-uint8_t char_values[MEM_BUFFER_DATA_LENGTH];
+/* Size of the write buffer in words: a record header and the longest record data */
+#define MEM_WRITE_BUFFER_WORDS						((sizeof(mem_record_header_st) + MEM_RECORD_MAX_LENGTH + 3) / 4)
+
+
+#if MEM_NUM_OF_PAGES < 2
+#error "at least 2 log pages are required"
+#endif
+
+#if PSTORAGE_NUM_OF_PAGES < MEM_NUM_OF_PAGES
+#error "persistent storage pages are not enough for log pages"
+#endif
+
+#if PSTORAGE_NUM_OF_PAGES != MEM_NUM_OF_PAGES
+#error "the values block of the first firmware versions must be in the last log page"
+#endif
+
+#if NUM_OF_MEM_RECORDS > 32
+#error "too many records for the pending records mask"
+#endif
+
+#if MEM_BUFFER_DATA_LENGTH > 32
+#error "too many characteristic bytes for the dirty fields mask"
+#endif
+
+
+
+
+/* ------------- Local macros --------------- */
+
+/* Macro to get the size in flash of a record with the given data length */
+#define MEM_RECORD_SIZE(length)						(sizeof(mem_record_header_st) + (((uint32_t)(length) + 3) & ~3UL))
+
+/* Macro to get the flash address of a log page */
+#define MEM_PAGE_ADDR(page)							(page_handles[(page)].block_id)
+
+/* Macro to get the log page of a flash address */
+#define MEM_ADDR_PAGE(addr)							((uint8_t)(((addr) - MEM_PAGE_ADDR(0)) / MEM_PAGE_SIZE_BYTES))
+
+/* Macro to get the mask of all characteristic bytes */
+#define MEM_CONFIG_FIELDS_MASK							(0xFFFFFFFFUL >> (32 - MEM_BUFFER_DATA_LENGTH))
+
+/* Macro to get the header of a record from its flash address */
+#define MEM_RECORD_HEADER(addr)						((const mem_record_header_st *)(addr))
 
 
 
@@ -86,25 +209,149 @@ uint8_t char_values[MEM_BUFFER_DATA_LENGTH];
 /* ------------- Local variables --------------- */
 
 /* Current memory state */
-static uint8_t curr_state = IDLE_STATE;
-
-/* Signature for validity check */
-static uint32_t ps_signature;
+static volatile uint8_t curr_state = IDLE_STATE;
 
 /* Persistent storage base handle */
 static pstorage_handle_t base_handle;
 
-/* Persistent storage block handle */
-static pstorage_handle_t block_handle;
+/* Persistent storage handles of log pages */
+static pstorage_handle_t page_handles[MEM_NUM_OF_PAGES];
 
-/* Pointer to temporary block data */
-static uint8_t temp_data[MEM_BLOCK_SIZE_BYTES];
+/* State of log pages */
+static uint8_t page_states[MEM_NUM_OF_PAGES];
+
+/* Sequence of valid log pages */
+static uint32_t page_sequences[MEM_NUM_OF_PAGES];
+
+/* Offset of the first free word of each log page */
+static uint32_t page_offsets[MEM_NUM_OF_PAGES];
+
+/* Next page sequence */
+static uint32_t next_page_sequence = 0;
+
+/* Next record sequence */
+static uint32_t next_record_sequence = 0;
+
+/* Page being collected and the erased page its records are copied to */
+static uint8_t gc_src_page = MEM_NO_PAGE;
+static uint8_t gc_dst_page = MEM_NO_PAGE;
+
+/* Records index: flash address of the last valid copy of each record, 0 if not stored */
+static uint32_t record_addrs[NUM_OF_MEM_RECORDS];
+
+/* Data of records to be written. They are read when the write starts */
+static const uint8_t *pending_data[NUM_OF_MEM_RECORDS];
+
+/* Data length of records to be written */
+static uint16_t pending_lengths[NUM_OF_MEM_RECORDS];
+
+/* Completion callbacks of records to be written */
+static memory_op_cb_t pending_cbs[NUM_OF_MEM_RECORDS];
+
+/* Records to be written, one bit for each record */
+static volatile uint32_t pending_records = 0;
+
+/* Page and record of the operation in progress */
+static uint8_t op_page = MEM_NO_PAGE;
+static uint8_t op_record = MEM_NO_RECORD;
+
+/* Size in flash of the record being written or copied */
+static uint32_t op_size = 0;
+
+/* Source and page offset of the store in progress */
+static const uint8_t *op_src = NULL;
+static uint32_t op_offset = 0;
+
+/* Completion callback of the record being written */
+static memory_op_cb_t op_cb = NULL;
+
+/* Number of retries of the flash operation in progress */
+static uint8_t op_retries = 0;
+
+/* Flash operation retry timer */
+static vtimer_st retry_timer;
+
+/* Flag indicating that log pages are registered: the log can be scanned again after a failure */
+static bool pages_registered = false;
+
+/* Completed record operations waiting for their callbacks, in completion order */
+static mem_completion_st completions[MEM_MAX_OP_CALLBACKS];
+
+/* Index of the first completed operation and number of completed operations */
+static uint8_t completions_head = 0;
+static uint8_t completions_count = 0;
+
+/* Number of record operations with a callback, queued or completed. Each one has a place in the 
+   completed operations list */
+static uint8_t callbacks_reserved = 0;
+
+/* Header of the page being opened or sealed */
+static mem_page_header_st page_header;
+
+/* Record being written: header and data */
+static uint32_t write_buffer[MEM_WRITE_BUFFER_WORDS];
+
+/* Characteristic values to store: RAM shadow of the config slots */
+static uint8_t temp_data[MEM_BUFFER_DATA_LENGTH];
+
+/* Records of config slots */
+static const uint8_t config_slot_records[MEM_NUM_OF_CONFIG_SLOTS] = 
+{
+	MEM_RECORD_CONFIG_A,
+	MEM_RECORD_CONFIG_B
+};
+
+/* Config slots being written. Each one is kept until its record write is completed */
+static mem_config_slot_st config_slots[MEM_NUM_OF_CONFIG_SLOTS];
+
+/* Characteristic bytes changed since the last config record write, one bit for each byte */
+static volatile uint32_t dirty_fields = 0;
+
+/* Config record write debounce timer */
+static vtimer_st flush_timer;
+
+/* Task writing the config record */
+static uint8_t config_flush_task = SCHED_INVALID_TASK;
+
+/* Number of characteristic updates requested */
+static volatile uint32_t writes_requested = 0;
+
+/* Number of flash writes completed */
+static volatile uint32_t flash_writes = 0;
 
 /* Pointer to default data values */
 static const uint8_t *p_def_values;
 
-/* Signature field value */
-static const uint32_t signature_field = MEM_DEFAULT_SIGNATURE;
+/* Published copies of characteristic values. The copy in use is selected by the config sequence: 
+   a new publication writes the other copy and then increments the sequence */
+static uint8_t config_copies[2][MEM_BUFFER_DATA_LENGTH];
+
+/* Config sequence, incremented at every publication */
+static volatile uint32_t config_seq = 0;
+
+/* Registered config observers */
+static memory_config_observer_t config_observers[MEM_MAX_CONFIG_OBSERVERS];
+
+/* Number of registered config observers */
+static uint8_t num_of_config_observers = 0;
+
+/* Task notifying config observers */
+static uint8_t config_notify_task = SCHED_INVALID_TASK;
+
+/* Init event handler */
+static memory_evt_handler_t evt_handler = NULL;
+
+/* Init events to be notified, one bit for each event */
+static volatile uint8_t pending_evts = 0;
+
+/* Task notifying init events */
+static uint8_t evt_notify_task = SCHED_INVALID_TASK;
+
+/* Flag indicating that init is in progress */
+static bool init_pending = false;
+
+/* Flag indicating that effective values have been published */
+static bool config_available = false;
 
 
 
@@ -113,53 +360,207 @@ static const uint32_t signature_field = MEM_DEFAULT_SIGNATURE;
 
 static void sys_evt_dispatch(uint32_t);
 static void ps_cb_handler(pstorage_handle_t *, uint8_t, uint32_t, uint8_t *, uint32_t);
+static void config_publish(const uint8_t *);
+static void config_notify(void);
+static void effective_config_publish(const uint8_t *);
+static void init_end(uint8_t);
+static void evt_post(uint8_t);
+static void evt_notify(void);
+static void flush_timeout_handler(void *);
+static void config_flush(void);
+static void config_flush_cb(uint8_t, uint8_t);
+static uint32_t slot_crc_get(const mem_config_slot_st *);
+static uint8_t config_slot_find(mem_config_slot_st *);
+static bool config_read(uint8_t *);
+static bool legacy_block_is_valid(uint8_t);
+static void op_complete(memory_op_cb_t, uint8_t, uint8_t);
+static void retry_timeout_handler(void *);
+static uint16_t record_crc_get(const mem_record_header_st *, const uint8_t *);
+static bool page_is_blank(uint8_t);
+static bool record_is_newer(uint32_t, uint32_t);
+static uint32_t page_scan(uint8_t);
+static void log_scan(void);
+static uint8_t pages_count(uint8_t);
+static uint8_t page_find(uint8_t);
+static bool record_is_in_page(uint8_t, uint8_t);
+static uint32_t record_size_get(uint8_t);
+static uint32_t live_size_get(uint8_t);
+static uint32_t page_live_size_get(uint8_t);
+static uint8_t page_record_find(uint8_t);
+static uint8_t write_page_find(uint32_t);
+static uint8_t gc_page_find(void);
+static void log_process(void);
+static void log_recover(void);
+static void log_fail(void);
+static bool op_issue(void);
+static bool op_retry(void);
+static bool page_header_write_start(uint8_t, uint8_t);
+static bool page_erase_start(uint8_t);
+static bool record_write_start(uint8_t, uint8_t);
+static bool record_copy_start(uint8_t);
 
 
 
 
 /* ------------- Exported functions --------------- */
 
-/* Function to get memory status */
+/* Function to get memory status: busy while a flash operation is in progress. Not busy on 
+   persistent storage failure, since no operation will complete */
 bool memory_is_busy(void)
 {
 	bool mem_is_busy = false;
-		
-	if(curr_state != IDLE_STATE)
+
+	if((curr_state != IDLE_STATE)
+	&& (curr_state != ERROR_STATE))
 	{
 		mem_is_busy = true;
 	}
+	else
+	{
+		/* do nothing */
+	}
 
 	return mem_is_busy;
 }
 
 
-/* Function to update a memory field */
+/* Function to update a memory field. The RAM shadow is updated and new values are used 
+   immediately, while the config record is written MEM_FLUSH_DELAY_MS after the last update: 
+   a burst of updates is written once, and not at all if values are not changed */
 bool memory_update_field(uint8_t mem_position, uint8_t *p_data, uint8_t length)
 {
-	uint32_t retval;
-	bool ps_success = true;
+	uint32_t changed_fields = 0;
+
+	/* values are updated with interrupts disabled: a write starting meanwhile never reads a 
+	   partial update */
+	CRITICAL_REGION_ENTER();
+	writes_requested++;
 
 	for(uint8_t i=0; i<length; i++)
 	{
-		temp_data[i+mem_position] = p_data[i];
+		if(temp_data[i+mem_position] != p_data[i])
+		{
+			temp_data[i+mem_position] = p_data[i];
+			changed_fields |= (1UL << (i+mem_position));
+		}
+		else
+		{
+			/* do nothing */
+		}
 	}
 
-	/* go to UPDATE_DATA */
-	curr_state = UPDATE_DATA;
-	/* update a field */
-	retval = pstorage_update(&base_handle, temp_data, MEM_BLOCK_SIZE_BYTES, 0);
-	if (retval != NRF_SUCCESS)
+	dirty_fields |= changed_fields;
+	CRITICAL_REGION_EXIT();
+
+	if(changed_fields != 0)
 	{
-		/* failed to update data: persistent storage failure */
-		ps_success = false;
+		/* new values are used immediately by observers */
+		config_publish(temp_data);
+
+		/* restart the debounce */
+		vtimer_start(&flush_timer, MEM_FLUSH_DELAY_MS, NULL);
+	}
+	else
+	{
+		/* values not changed: nothing to store */
+	}
+
+	return (curr_state != ERROR_STATE);
+}
+
+
+/* Function to write changed characteristic values without waiting for the debounce, e.g. on 
+   disconnection or before a reset. Flash write is not waited: memory_is_busy() is true until 
+   completed. It returns false on persistent storage failure */
+bool memory_flush(void)
+{
+	bool ps_success = (curr_state != ERROR_STATE);
+	mem_config_slot_st newest_slot;
+	mem_config_slot_st *p_slot;
+	uint8_t slot;
+
+	vtimer_stop(&flush_timer);
+
+	CRITICAL_REGION_ENTER();
+	if(dirty_fields != 0)
+	{
+		/* commit to the slot not holding the newest stored values, with the next generation. 
+		   Newest values are kept until the commit is completed */
+		slot = config_slot_find(&newest_slot);
+		if(slot == MEM_NO_SLOT)
+		{
+			slot = 0;
+			newest_slot.generation = 0;
+		}
+		else
+		{
+			slot = (slot + 1) % MEM_NUM_OF_CONFIG_SLOTS;
+			newest_slot.generation++;
+		}
+
+		p_slot = &config_slots[slot];
+		p_slot->generation = newest_slot.generation;
+		memcpy(p_slot->values, temp_data, MEM_BUFFER_DATA_LENGTH);
+		p_slot->crc = slot_crc_get(p_slot);
+
+		ps_success = memory_record_write(config_slot_records[slot], (const uint8_t *)p_slot, sizeof(mem_config_slot_st), config_flush_cb);
+		if(true == ps_success)
+		{
+			dirty_fields = 0;
+		}
+		else
+		{
+			/* kept dirty */
+		}
 	}
+	else
+	{
+		/* nothing to store */
+	}
+	CRITICAL_REGION_EXIT();
 
 	return ps_success;
 }
 
 
-/* Function to init persistent memory */
-bool memory_init(const uint8_t *p_def_val)
+/* Function to get the number of characteristic updates requested */
+uint32_t memory_writes_requested_get(void)
+{
+	return writes_requested;
+}
+
+
+/* Function to get the number of flash writes completed: records, copies and page headers */
+uint32_t memory_flash_writes_get(void)
+{
+	return flash_writes;
+}
+
+
+/* Function to build the records index at power up, before memory_init(). Log pages are read 
+   directly at their flash address, so stored records can be read by memory_record_read() at the 
+   very beginning, before the BLE stack and persistent storage are initialised. Records cannot be 
+   written until memory_init() */
+void memory_restore(void)
+{
+	for(uint8_t i=0; i<MEM_NUM_OF_PAGES; i++)
+	{
+		page_handles[i].block_id = MEM_LOG_START_ADDR + ((uint32_t)i * MEM_PAGE_SIZE_BYTES);
+	}
+
+	log_scan();
+}
+
+
+/* Function to init persistent memory. Records are kept in a log of flash pages: the index of 
+   stored records is built by reading flash directly, so the newest valid config slot is published 
+   immediately (or defaults if none). No page is erased at init: the log is recovered before the 
+   first write. Values stored by the first firmware versions (a 16 bytes block with a signature) 
+   are published if no slot is valid, and written as the first config record before their block 
+   is erased. Completion is notified to the event handler in the main loop: 
+   MEM_EVT_CONFIG_AVAILABLE once effective values are published, then MEM_EVT_INIT_DONE (or 
+   MEM_EVT_INIT_ERROR). The handler can be NULL */
+bool memory_init(const uint8_t *p_def_val, memory_evt_handler_t handler)
 {
 	uint32_t err_code;
 	uint32_t retval;
@@ -168,18 +569,40 @@ bool memory_init(const uint8_t *p_def_val)
 
 	ps_success = true;
 
+	/* create the tasks notifying config observers and init events */
+	config_notify_task = sched_task_create(config_notify, SCHED_PRIO_NORMAL);
+	APP_ERROR_CHECK_BOOL(config_notify_task != SCHED_INVALID_TASK);
+	evt_notify_task = sched_task_create(evt_notify, SCHED_PRIO_NORMAL);
+	APP_ERROR_CHECK_BOOL(evt_notify_task != SCHED_INVALID_TASK);
+
+	/* create the config record write debounce timer and the task writing it */
+	config_flush_task = sched_task_create(config_flush, SCHED_PRIO_LOW);
+	APP_ERROR_CHECK_BOOL(config_flush_task != SCHED_INVALID_TASK);
+	vtimer_create(&flush_timer, VTIMER_MODE_SINGLE_SHOT, flush_timeout_handler);
+	vtimer_create(&retry_timer, VTIMER_MODE_SINGLE_SHOT, retry_timeout_handler);
+
+	evt_handler = handler;
+	init_pending = true;
+
+	/* copy pointer to default values */
+	p_def_values = p_def_val;
+
+	/* defaults are used until stored values are read */
+	config_publish(p_def_val);
+	memcpy((void *)temp_data, (const void *)p_def_values, MEM_BUFFER_DATA_LENGTH);
+
 	err_code = softdevice_sys_evt_handler_set(sys_evt_dispatch);
     APP_ERROR_CHECK(err_code);
-	
+
 	/* init persistent storage */
 	retval = pstorage_init();
 
 	/* if module initialization successful */
 	if(retval == NRF_SUCCESS)
 	{
-		/* init parameters */
-		param.block_size  = MEM_BLOCK_SIZE_BYTES;
-		param.block_count = NUM_OF_MEM_BLOCKS;
+		/* init parameters: one block for each log page */
+		param.block_size  = MEM_PAGE_SIZE_BYTES;
+		param.block_count = MEM_NUM_OF_PAGES;
 		param.cb          = ps_cb_handler;
 
 		/* register persistent storage */
@@ -188,23 +611,45 @@ bool memory_init(const uint8_t *p_def_val)
 		/* if registration successful */
 		if (retval == NRF_SUCCESS)
 		{
-			/* request to get identifier for first block */
-			retval = pstorage_block_identifier_get(&base_handle, 0, &block_handle);
+			/* get identifiers of log pages */
+			for(uint8_t i=0; i<MEM_NUM_OF_PAGES; i++)
+			{
+				retval |= pstorage_block_identifier_get(&base_handle, i, &page_handles[i]);
+			}
+
 			/* get Block Identifier successful */
 			if (retval == NRF_SUCCESS)
 			{
-				/* copy pointer to default values */
-				p_def_values = p_def_val;
-
-				/* operation success: wait for signature value */
-				curr_state = LOAD_SIGNATURE;
-				/* load signature field */
-				retval = pstorage_load((uint8_t *)&ps_signature, &block_handle, MEM_SIGNATURE_LENGTH_BYTES, MEM_SIGNATURE_FIELD_BYTE_POS);
-				if (retval != NRF_SUCCESS)
+				/* log must be the one read by memory_restore() */
+				APP_ERROR_CHECK_BOOL(page_handles[0].block_id == MEM_LOG_START_ADDR);
+				pages_registered = true;
+
+				/* build the records index again */
+				memset(record_addrs, 0, sizeof(record_addrs));
+				log_scan();
+
+				/* publish stored values, or defaults if none */
+				if(true == config_read(temp_data))
+				{
+					effective_config_publish(temp_data);
+				}
+				else if(page_states[MEM_LEGACY_PAGE] == PAGE_LEGACY)
+				{
+					/* values of the first firmware versions: they are written as the first config 
+					   record from the main loop, then their block is erased */
+					memcpy(temp_data, (const uint8_t *)MEM_PAGE_ADDR(MEM_LEGACY_PAGE), MEM_BUFFER_DATA_LENGTH);
+					effective_config_publish(temp_data);
+					dirty_fields = MEM_CONFIG_FIELDS_MASK;
+					sched_task_post(config_flush_task);
+				}
+				else
 				{
-					/* failed to load the signature: persistent storage failure */
-					ps_success = false;
+					effective_config_publish(p_def_values);
 				}
+
+				/* no flash operation at init: pages left by a power loss are recovered before 
+				   the first write */
+				init_end(MEM_EVT_INIT_DONE);
 			}
 			else
 			{
@@ -228,17 +673,10 @@ bool memory_init(const uint8_t *p_def_val)
 	if(ps_success != true)
 	{
 		/* very bad situation... use default setting as recovery */
-		/* if success */
-		if(memcpy((void *)char_values, (const void *)&p_def_val, MEM_BUFFER_DATA_LENGTH) == ((void *)char_values))
-		{
-			/* memory initialised with default values. Return success */
-			ps_success = true;
-		}
-		else
-		{
-			/* return false. Set it again */
-			ps_success = false;
-		}
+		curr_state = ERROR_STATE;
+		init_end(MEM_EVT_INIT_ERROR);
+		/* memory initialised with default values. Return success */
+		ps_success = true;
 	}
 	else
 	{
@@ -249,160 +687,1249 @@ bool memory_init(const uint8_t *p_def_val)
 }
 
 
+/* Function to get a consistent copy of all characteristic values. It never blocks and it can 
+   be called from any interrupt context: the copy is taken again if a new publication happens 
+   while reading */
+void memory_config_get(uint8_t *p_values)
+{
+	uint32_t seq;
 
+	do
+	{
+		seq = config_seq;
+		memcpy((void *)p_values, (const void *)config_copies[seq & 1], MEM_BUFFER_DATA_LENGTH);
+		/* read the copy before checking the sequence again */
+		__DMB();
+	} while(seq != config_seq);
+}
 
-/* ------------- Local functions --------------- */
 
-/* Function for dispatching a system event to interested modules */
-static void sys_evt_dispatch(uint32_t sys_evt)
+/* Function to register a config observer */
+bool memory_config_observer_register(memory_config_observer_t observer)
 {
-    pstorage_sys_event_handler(sys_evt);
+	bool success = false;
+
+	if((observer != NULL)
+	&& (num_of_config_observers < MEM_MAX_CONFIG_OBSERVERS))
+	{
+		config_observers[num_of_config_observers] = observer;
+		num_of_config_observers++;
+		success = true;
+	}
+	else
+	{
+		/* no room for a new observer */
+	}
+
+	return success;
 }
 
 
-/* PS event notification handler */
-static void ps_cb_handler(pstorage_handle_t *handle, uint8_t op_code, uint32_t result, uint8_t *p_data, uint32_t data_len)
+/* Function to read a stored record from the index. Flash is read directly, so it can be called 
+   as soon as memory_restore() or memory_init() returns. It returns false if the record is not 
+   stored or if its length is different (e.g. stored by a different firmware version) */
+bool memory_record_read(uint8_t id, uint8_t *p_data, uint16_t length)
 {
-	uint32_t retval;
+	uint32_t addr = 0;
+	bool found = false;
+
+	if(id < NUM_OF_MEM_RECORDS)
+	{
+		addr = record_addrs[id];
+	}
+	else
+	{
+		/* invalid record */
+	}
+
+	if((addr != 0)
+	&& (MEM_RECORD_HEADER(addr)->length == length))
+	{
+		memcpy(p_data, (const uint8_t *)(addr + sizeof(mem_record_header_st)), length);
+		found = true;
+	}
+	else
+	{
+		/* not stored */
+	}
+
+	return found;
+}
+
+
+/* Function to write a record. It is appended to the log, so the last written copy replaces the 
+   previous one without erasing flash. Writes are queued by record and they never block: data are 
+   read when the write starts, in the flash callback context, so the buffer must be kept until the 
+   write is completed and a new write of the same record before starting replaces the queued one. 
+   The previous copy is kept until the new one is written, so a record is accepted only if log 
+   pages can hold both of them even when fragmented. The callback (it can be NULL) is called in the 
+   main loop with the result of an accepted write. It returns false if the record is not accepted 
+   (it does not fit, too many callbacks are queued) or on persistent storage failure. After a 
+   failure the log is scanned again from flash at the next write */
+bool memory_record_write(uint8_t id, const uint8_t *p_data, uint16_t length, memory_op_cb_t cb)
+{
+	bool ps_success = false;
+
+	CRITICAL_REGION_ENTER();
+	if(curr_state == ERROR_STATE)
+	{
+		log_recover();
+	}
+	else
+	{
+		/* do nothing */
+	}
 
-	/* manage received operation code */
-	switch(op_code)
+	if((id < NUM_OF_MEM_RECORDS)
+	&& (length <= MEM_RECORD_MAX_LENGTH)
+	&& ((live_size_get(id) + record_size_get(id) + (MEM_NUM_OF_DATA_PAGES * MEM_RECORD_SIZE(length))) <= (MEM_NUM_OF_DATA_PAGES * MEM_PAGE_CAPACITY_BYTES))
+	&& ((cb == NULL) || (callbacks_reserved < MEM_MAX_OP_CALLBACKS))
+	&& (curr_state != ERROR_STATE))
 	{
-		case PSTORAGE_STORE_OP_CODE:
+		/* a queued write of the same record is merged: only the last data are written */
+		if((pending_records & (1UL << id)) != 0)
 		{
-			if (result == NRF_SUCCESS)
-			{
-				/* if store data state */
-				if(curr_state == STORE_DATA)
-				{
-					/* store success: go to IDLE */
-					curr_state = IDLE_STATE; 
-				}
-				else
-				{
-					/* do nothing */
-				}
-			}
-			else
-			{
-				curr_state = ERROR_STATE;
-			}
-			break;
+			op_complete(pending_cbs[id], id, MEM_RESULT_REPLACED);
 		}
-		case PSTORAGE_LOAD_OP_CODE:
+		else
 		{
-			if (result == NRF_SUCCESS)
-			{
-				/* if load signature state */
-				if(curr_state == LOAD_SIGNATURE)
-				{
-					/* if data are valid */
-					if(ps_signature == MEM_DEFAULT_SIGNATURE)
-					{
-						/* operation success: wait for data */
-						curr_state = LOAD_DATA;
-						/* use stored data: load entire block with signature field */
-						retval = pstorage_load(temp_data, &block_handle, MEM_BLOCK_SIZE_BYTES, 0);
-						if (retval != NRF_SUCCESS)
-						{
-							/* failed to load the signature: persistent storage failure */
-							curr_state = ERROR_STATE;
-						}
-					}
-					else
-					{
-						/* copy default data to values */
-						memcpy((void *)char_values, (const void *)p_def_values, MEM_BUFFER_DATA_LENGTH);
-
-						/* go to RESTORE DEFAULT state */
-						curr_state = RESTORE_DEFAULT;
-						/* invalid data: use the default values. Clear the entire block first */
-						retval = pstorage_clear(&base_handle, MEM_BLOCK_SIZE_BYTES);	
-						if (retval != NRF_SUCCESS)
-						{
-							/* failed to clear memory: persistent storage failure */
-							curr_state = ERROR_STATE;
-						}
-					}
-				}
-				/* if load data state */
-				else if(curr_state == LOAD_DATA)
-				{
-					/* copy loaded data to values */
-					memcpy((void *)char_values, (const void *)temp_data, MEM_BUFFER_DATA_LENGTH);
-	
-					/* data loaded successfully */
-					/* go to IDLE state */
-					curr_state = IDLE_STATE;
-				}
-				else
-				{
-					/* do nothing */
-				}
-			}
-			else
-			{
-				curr_state = ERROR_STATE;
-			}
-			break;
+			/* do nothing */
 		}
-		case PSTORAGE_UPDATE_OP_CODE:
+
+		if(cb != NULL)
 		{
-			if (result == NRF_SUCCESS)
-			{
-				/* if update data state */
-				if(curr_state == UPDATE_DATA)
-				{
-					/* store success: go to IDLE */
-					curr_state = IDLE_STATE; 
-				}
-				else
-				{
-					/* do nothing */
-				}
-			}
-			else
-			{
-				curr_state = ERROR_STATE;
-			}
-			break;
+			callbacks_reserved++;
 		}
-		case PSTORAGE_CLEAR_OP_CODE:
+		else
 		{
-			if (result == NRF_SUCCESS)
-			{
-				/* if restore default state */
-				if(curr_state == RESTORE_DEFAULT)
-				{
-					/* prepare data to be stored */
-					memcpy((void *)temp_data, (const void *)p_def_values, MEM_BUFFER_DATA_LENGTH); 
-					memcpy((void *)&temp_data[MEM_SIGNATURE_FIELD_BYTE_POS], (const void *)&signature_field, MEM_SIGNATURE_LENGTH_BYTES); 
-
-					/* go to STORE_DATA state */
-					curr_state = STORE_DATA; 
-					/* store default data with signature */
-					retval = pstorage_store(&block_handle, temp_data, MEM_BLOCK_SIZE_BYTES, 0);
-					if (retval != NRF_SUCCESS)
-					{
-						/* failed to store data: persistent storage failure */
-						curr_state = ERROR_STATE;
-					}
-				}
-				else
-				{
-					/* do nothing */
-				}
-			}
-			else
-			{
-				curr_state = ERROR_STATE;
-			}
-			break;
+			/* do nothing */
 		}
-		default:
+
+		pending_data[id] = p_data;
+		pending_lengths[id] = length;
+		pending_cbs[id] = cb;
+		pending_records |= (1UL << id);
+
+		/* if idle write it now, otherwise at the end of current operation */
+		if(curr_state == IDLE_STATE)
 		{
-			break;
+			log_process();
 		}
+		else
+		{
+			/* do nothing */
+		}
+
+		ps_success = (curr_state != ERROR_STATE);
+	}
+	else
+	{
+		/* invalid record or storage failed */
+	}
+	CRITICAL_REGION_EXIT();
+
+	return ps_success;
+}
+
+
+/* Function to clear a record: an empty copy is written, so the record is not stored anymore. 
+   The callback is called as for memory_record_write() */
+bool memory_record_clear(uint8_t id, memory_op_cb_t cb)
+{
+	return memory_record_write(id, NULL, 0, cb);
+}
+
+
+
+
+/* ------------- Local functions --------------- */
+
+/* Function to publish new characteristic values. Observers are notified by the related task */
+static void config_publish(const uint8_t *p_values)
+{
+	uint32_t next_seq = config_seq + 1;
+
+	/* write the copy not in use */
+	memcpy((void *)config_copies[next_seq & 1], (const void *)p_values, MEM_BUFFER_DATA_LENGTH);
+	/* write the copy before switching to it */
+	__DMB();
+	config_seq = next_seq;
+
+	sched_task_post(config_notify_task);
+}
+
+
+/* Task to notify config observers. Several publications before it runs are notified once */
+static void config_notify(void)
+{
+	for(uint8_t i=0; i<num_of_config_observers; i++)
+	{
+		config_observers[i]();
+	}
+}
+
+
+/* Function to publish the values to be used after init: stored ones or defaults */
+static void effective_config_publish(const uint8_t *p_values)
+{
+	config_publish(p_values);
+
+	config_available = true;
+	evt_post(MEM_EVT_CONFIG_AVAILABLE);
+}
+
+
+/* Function to end init with the given event. Defaults are the effective values if init ends 
+   before stored ones are published. It does nothing after init */
+static void init_end(uint8_t evt)
+{
+	if(true == init_pending)
+	{
+		init_pending = false;
+
+		if(false == config_available)
+		{
+			effective_config_publish(p_def_values);
+		}
+		else
+		{
+			/* do nothing */
+		}
+
+		evt_post(evt);
+	}
+	else
+	{
+		/* do nothing */
+	}
+}
+
+
+/* Function to post an init event. It runs in the flash callback context or in memory_init() */
+static void evt_post(uint8_t evt)
+{
+	CRITICAL_REGION_ENTER();
+	pending_evts |= (1 << evt);
+	CRITICAL_REGION_EXIT();
+
+	sched_task_post(evt_notify_task);
+}
+
+
+/* Task to notify init events in the order they are defined, then completed record operations 
+   in completion order */
+static void evt_notify(void)
+{
+	uint8_t evts;
+	mem_completion_st completion;
+
+	CRITICAL_REGION_ENTER();
+	evts = pending_evts;
+	pending_evts = 0;
+	CRITICAL_REGION_EXIT();
+
+	for(uint8_t i=0; i<NUM_OF_MEM_EVTS; i++)
+	{
+		if(((evts & (1 << i)) != 0)
+		&& (evt_handler != NULL))
+		{
+			evt_handler(i);
+		}
+		else
+		{
+			/* do nothing */
+		}
+	}
+
+	do
+	{
+		completion.cb = NULL;
+
+		CRITICAL_REGION_ENTER();
+		if(completions_count != 0)
+		{
+			completion = completions[completions_head];
+			completions_head = (completions_head + 1) % MEM_MAX_OP_CALLBACKS;
+			completions_count--;
+			callbacks_reserved--;
+		}
+		else
+		{
+			/* do nothing */
+		}
+		CRITICAL_REGION_EXIT();
+
+		/* callbacks can queue new operations */
+		if(completion.cb != NULL)
+		{
+			completion.cb(completion.id, completion.result);
+		}
+		else
+		{
+			/* do nothing */
+		}
+	} while(completion.cb != NULL);
+}
+
+
+/* Flush timer timeout handler. The config record is written by the related task */
+static void flush_timeout_handler(void * p_context)
+{
+	UNUSED_PARAMETER(p_context);
+
+	sched_task_post(config_flush_task);
+}
+
+
+/* Task to write changed characteristic values once the debounce is elapsed */
+static void config_flush(void)
+{
+	memory_flush();
+}
+
+
+/* Config record write completion callback. Values not stored are written again after the flush 
+   debounce */
+static void config_flush_cb(uint8_t id, uint8_t result)
+{
+	UNUSED_PARAMETER(id);
+
+	if(result == MEM_RESULT_ERROR)
+	{
+		CRITICAL_REGION_ENTER();
+		dirty_fields |= MEM_CONFIG_FIELDS_MASK;
+		CRITICAL_REGION_EXIT();
+
+		/* write them again after the debounce */
+		vtimer_start(&flush_timer, MEM_FLUSH_DELAY_MS, NULL);
+	}
+	else
+	{
+		/* stored or replaced by a later write */
+	}
+}
+
+
+/* Function to calculate the CRC-32 of a config slot */
+static uint32_t slot_crc_get(const mem_config_slot_st *p_slot)
+{
+	const uint8_t *p_data = (const uint8_t *)p_slot;
+	uint32_t crc = MEM_CRC32_INIT;
+
+	for(uint32_t i=0; i<offsetof(mem_config_slot_st, crc); i++)
+	{
+		crc ^= p_data[i];
+
+		for(uint8_t j=0; j<8; j++)
+		{
+			crc = (crc >> 1) ^ (MEM_CRC32_POLY & (0UL - (crc & 1)));
+		}
+	}
+
+	return ~crc;
+}
+
+
+/* Function to find the config slot holding the newest values: the valid slot with the highest 
+   generation. Slots are read in one pass and the newest one is copied. It returns MEM_NO_SLOT if 
+   no slot is valid */
+static uint8_t config_slot_find(mem_config_slot_st *p_newest)
+{
+	mem_config_slot_st slot;
+	uint8_t newest = MEM_NO_SLOT;
+
+	for(uint8_t i=0; i<MEM_NUM_OF_CONFIG_SLOTS; i++)
+	{
+		if((true == memory_record_read(config_slot_records[i], (uint8_t *)&slot, sizeof(slot)))
+		&& (slot.crc == slot_crc_get(&slot))
+		&& ((newest == MEM_NO_SLOT)
+		 || (slot.generation > p_newest->generation)))
+		{
+			*p_newest = slot;
+			newest = i;
+		}
+		else
+		{
+			/* not stored, corrupted or older */
+		}
+	}
+
+	return newest;
+}
+
+
+/* Function to read stored characteristic values from the newest config slot. It returns false 
+   if no slot is valid */
+static bool config_read(uint8_t *p_values)
+{
+	mem_config_slot_st slot;
+	bool found = false;
+
+	if(MEM_NO_SLOT != config_slot_find(&slot))
+	{
+		memcpy(p_values, slot.values, MEM_BUFFER_DATA_LENGTH);
+		found = true;
+	}
+	else
+	{
+		/* no values stored yet: defaults are used */
+	}
+
+	return found;
+}
+
+
+/* Function to know if a page holds the values block of the first firmware versions: the block 
+   signature is found and the rest of the page is erased */
+static bool legacy_block_is_valid(uint8_t page)
+{
+	const uint32_t *p_words = (const uint32_t *)MEM_PAGE_ADDR(page);
+	bool is_valid = false;
+
+	if((page == MEM_LEGACY_PAGE)
+	&& (p_words[MEM_LEGACY_SIGNATURE_POS / sizeof(uint32_t)] == MEM_LEGACY_SIGNATURE))
+	{
+		is_valid = true;
+		for(uint32_t i=(MEM_LEGACY_BLOCK_SIZE_BYTES / sizeof(uint32_t)); i<(MEM_PAGE_SIZE_BYTES / sizeof(uint32_t)); i++)
+		{
+			if(p_words[i] != MEM_BLANK_WORD)
+			{
+				is_valid = false;
+				break;
+			}
+		}
+	}
+	else
+	{
+		/* not the block page or no signature */
+	}
+
+	return is_valid;
+}
+
+
+/* Function to add a completed record operation to the list notified by the related task. A place 
+   is reserved when the operation is queued */
+static void op_complete(memory_op_cb_t cb, uint8_t id, uint8_t result)
+{
+	mem_completion_st *p_completion;
+
+	if(cb != NULL)
+	{
+		CRITICAL_REGION_ENTER();
+		p_completion = &completions[(completions_head + completions_count) % MEM_MAX_OP_CALLBACKS];
+		p_completion->cb = cb;
+		p_completion->id = id;
+		p_completion->result = result;
+		completions_count++;
+		CRITICAL_REGION_EXIT();
+
+		sched_task_post(evt_notify_task);
+	}
+	else
+	{
+		/* nothing to notify */
+	}
+}
+
+
+/* Retry timer timeout handler. The flash operation is issued again */
+static void retry_timeout_handler(void * p_context)
+{
+	UNUSED_PARAMETER(p_context);
+
+	CRITICAL_REGION_ENTER();
+	if(false == op_issue())
+	{
+		log_fail();
+	}
+	else
+	{
+		/* do nothing */
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+
+/* Function for dispatching a system event to interested modules */
+static void sys_evt_dispatch(uint32_t sys_evt)
+{
+    pstorage_sys_event_handler(sys_evt);
+}
+
+
+
+
+/* Function to calculate the CRC of a record */
+static uint16_t record_crc_get(const mem_record_header_st *p_header, const uint8_t *p_data)
+{
+	uint16_t crc;
+
+	crc = crc16_compute((const uint8_t *)p_header, offsetof(mem_record_header_st, crc), NULL);
+	crc = crc16_compute(p_data, p_header->length, &crc);
+
+	return crc;
+}
+
+
+/* Function to know if a log page is erased */
+static bool page_is_blank(uint8_t page)
+{
+	const uint32_t *p_words = (const uint32_t *)MEM_PAGE_ADDR(page);
+	bool is_blank = true;
+
+	for(uint32_t i=0; i<(MEM_PAGE_SIZE_BYTES / sizeof(uint32_t)); i++)
+	{
+		if(p_words[i] != MEM_BLANK_WORD)
+		{
+			is_blank = false;
+			break;
+		}
+	}
+
+	return is_blank;
+}
+
+
+/* Function to know if a stored record is newer than the indexed copy. Copies made by garbage 
+   collection have the same record sequence: the one in the newer page is taken */
+static bool record_is_newer(uint32_t addr, uint32_t curr_addr)
+{
+	bool is_newer;
+
+	if(curr_addr == 0)
+	{
+		is_newer = true;
+	}
+	else if(MEM_RECORD_HEADER(addr)->sequence != MEM_RECORD_HEADER(curr_addr)->sequence)
+	{
+		is_newer = (MEM_RECORD_HEADER(addr)->sequence > MEM_RECORD_HEADER(curr_addr)->sequence);
+	}
+	else
+	{
+		is_newer = (page_sequences[MEM_ADDR_PAGE(addr)] > page_sequences[MEM_ADDR_PAGE(curr_addr)]);
+	}
+
+	return is_newer;
+}
+
+
+/* Function to add the valid records of a log page to the index. It returns the offset of the 
+   first free word, or the page size if the page cannot be written anymore */
+static uint32_t page_scan(uint8_t page)
+{
+	const mem_record_header_st *p_header;
+	const uint32_t *p_words;
+	uint32_t addr;
+	uint32_t offset = sizeof(mem_page_header_st);
+
+	while((offset + sizeof(mem_record_header_st)) <= MEM_PAGE_SIZE_BYTES)
+	{
+		addr = MEM_PAGE_ADDR(page) + offset;
+		p_header = MEM_RECORD_HEADER(addr);
+		p_words = (const uint32_t *)p_header;
+
+		if((p_words[0] == MEM_BLANK_WORD)
+		&& (p_words[1] == MEM_BLANK_WORD)
+		&& (p_words[2] == MEM_BLANK_WORD))
+		{
+			/* end of the log in this page */
+			break;
+		}
+		else if((p_header->length_check != (uint16_t)~p_header->length)
+		|| ((offset + MEM_RECORD_SIZE(p_header->length)) > MEM_PAGE_SIZE_BYTES))
+		{
+			/* interrupted header write: next records cannot be found, page is full */
+			offset = MEM_PAGE_SIZE_BYTES;
+		}
+		else
+		{
+			if((p_header->id < NUM_OF_MEM_RECORDS)
+			&& (p_header->crc == record_crc_get(p_header, (const uint8_t *)&p_header[1])))
+			{
+				if(true == record_is_newer(addr, record_addrs[p_header->id]))
+				{
+					record_addrs[p_header->id] = addr;
+				}
+				else
+				{
+					/* replaced by a newer copy */
+				}
+				next_record_sequence = MAX(next_record_sequence, p_header->sequence + 1);
+			}
+			else
+			{
+				/* interrupted data write or unknown record: skip it */
+			}
+			offset += MEM_RECORD_SIZE(p_header->length);
+		}
+	}
+
+	return offset;
+}
+
+
+/* Function to build the records index at init. Flash is read directly */
+static void log_scan(void)
+{
+	const mem_page_header_st *p_page_header;
+
+	/* get state of log pages */
+	for(uint8_t i=0; i<MEM_NUM_OF_PAGES; i++)
+	{
+		p_page_header = (const mem_page_header_st *)MEM_PAGE_ADDR(i);
+		page_offsets[i] = sizeof(mem_page_header_st);
+
+		if(true == page_is_blank(i))
+		{
+			page_states[i] = PAGE_BLANK;
+		}
+		else if((p_page_header->signature == MEM_PAGE_SIGNATURE)
+		&& (p_page_header->sequence != MEM_BLANK_WORD))
+		{
+			page_states[i] = PAGE_VALID;
+			page_sequences[i] = p_page_header->sequence;
+			next_page_sequence = MAX(next_page_sequence, page_sequences[i] + 1);
+		}
+		else if(true == legacy_block_is_valid(i))
+		{
+			/* values block of the first firmware versions: kept until values are stored */
+			page_states[i] = PAGE_LEGACY;
+		}
+		else
+		{
+			/* interrupted page open, collection or erase, or a different content: it is erased */
+			page_states[i] = PAGE_INVALID;
+		}
+	}
+
+	/* index records of valid pages */
+	for(uint8_t i=0; i<MEM_NUM_OF_PAGES; i++)
+	{
+		if(page_states[i] == PAGE_VALID)
+		{
+			page_offsets[i] = page_scan(i);
+		}
+		else
+		{
+			/* do nothing */
+		}
+	}
+}
+
+
+/* Function to count log pages in the given state */
+static uint8_t pages_count(uint8_t state)
+{
+	uint8_t count = 0;
+
+	for(uint8_t i=0; i<MEM_NUM_OF_PAGES; i++)
+	{
+		if(page_states[i] == state)
+		{
+			count++;
+		}
+		else
+		{
+			/* do nothing */
+		}
+	}
+
+	return count;
+}
+
+
+/* Function to find the first log page in the given state */
+static uint8_t page_find(uint8_t state)
+{
+	uint8_t page = MEM_NO_PAGE;
+
+	for(uint8_t i=0; i<MEM_NUM_OF_PAGES; i++)
+	{
+		if(page_states[i] == state)
+		{
+			page = i;
+			break;
+		}
+	}
+
+	return page;
+}
+
+
+/* Function to know if the indexed copy of a record is in the given page */
+static bool record_is_in_page(uint8_t id, uint8_t page)
+{
+	return ((record_addrs[id] >= MEM_PAGE_ADDR(page))
+		  && (record_addrs[id] < (MEM_PAGE_ADDR(page) + MEM_PAGE_SIZE_BYTES)));
+}
+
+
+/* Function to get the size in flash of the indexed copy of a record, 0 if not stored */
+static uint32_t record_size_get(uint8_t id)
+{
+	uint32_t size = 0;
+
+	if(record_addrs[id] != 0)
+	{
+		size = MEM_RECORD_SIZE(MEM_RECORD_HEADER(record_addrs[id])->length);
+	}
+	else
+	{
+		/* not stored */
+	}
+
+	return size;
+}
+
+
+/* Function to get the size in flash of all records but the given one, stored or to be written */
+static uint32_t live_size_get(uint8_t exclude_id)
+{
+	uint32_t size = 0;
+
+	for(uint8_t i=0; i<NUM_OF_MEM_RECORDS; i++)
+	{
+		if(i == exclude_id)
+		{
+			/* do nothing */
+		}
+		else if((pending_records & (1UL << i)) != 0)
+		{
+			size += MAX(record_size_get(i), MEM_RECORD_SIZE(pending_lengths[i]));
+		}
+		else
+		{
+			size += record_size_get(i);
+		}
+	}
+
+	return size;
+}
+
+
+/* Function to get the size in flash of the records indexed in a page */
+static uint32_t page_live_size_get(uint8_t page)
+{
+	uint32_t size = 0;
+
+	for(uint8_t i=0; i<NUM_OF_MEM_RECORDS; i++)
+	{
+		if(true == record_is_in_page(i, page))
+		{
+			size += record_size_get(i);
+		}
+		else
+		{
+			/* do nothing */
+		}
+	}
+
+	return size;
+}
+
+
+/* Function to find the first record indexed in a page */
+static uint8_t page_record_find(uint8_t page)
+{
+	uint8_t id = MEM_NO_RECORD;
+
+	for(uint8_t i=0; i<NUM_OF_MEM_RECORDS; i++)
+	{
+		if(true == record_is_in_page(i, page))
+		{
+			id = i;
+			break;
+		}
+	}
+
+	return id;
+}
+
+
+/* Function to find the valid page with the least free space that fits a record of the given size */
+static uint8_t write_page_find(uint32_t size)
+{
+	uint8_t page = MEM_NO_PAGE;
+
+	for(uint8_t i=0; i<MEM_NUM_OF_PAGES; i++)
+	{
+		if((page_states[i] == PAGE_VALID)
+		&& ((page_offsets[i] + size) <= MEM_PAGE_SIZE_BYTES)
+		&& ((page == MEM_NO_PAGE) || (page_offsets[i] > page_offsets[page])))
+		{
+			page = i;
+		}
+		else
+		{
+			/* do nothing */
+		}
+	}
+
+	return page;
+}
+
+
+/* Function to find the valid page with the most space taken by replaced or interrupted records */
+static uint8_t gc_page_find(void)
+{
+	uint8_t page = MEM_NO_PAGE;
+	uint32_t dead_size;
+	uint32_t max_dead_size = 0;
+
+	for(uint8_t i=0; i<MEM_NUM_OF_PAGES; i++)
+	{
+		if(page_states[i] == PAGE_VALID)
+		{
+			dead_size = page_offsets[i] - sizeof(mem_page_header_st) - page_live_size_get(i);
+			if(dead_size > max_dead_size)
+			{
+				max_dead_size = dead_size;
+				page = i;
+			}
+			else
+			{
+				/* do nothing */
+			}
+		}
+		else
+		{
+			/* do nothing */
+		}
+	}
+
+	return page;
+}
+
+
+/* Function to start the next log operation. It runs in the flash callback context or with 
+   interrupts disabled, when memory is idle. Records are appended to valid pages and one page is 
+   always kept erased. If a record does not fit, an erased page is opened if there is another one, 
+   otherwise the page with the most replaced records is garbage collected: its records are copied 
+   to the erased page, which is sealed by writing its header, and then it is erased. An interrupted 
+   collection leaves a page without header, so it is erased at init and collection starts again */
+static void log_process(void)
+{
+	mem_config_slot_st slot;
+	uint8_t page;
+	uint8_t id = MEM_NO_RECORD;
+	bool ps_success = true;
+
+	if(pending_records != 0)
+	{
+		id = (uint8_t)__builtin_ctz(pending_records);
+	}
+	else
+	{
+		/* nothing to write */
+	}
+
+	page = page_find(PAGE_INVALID);
+
+	/* the values block of the first firmware versions is erased once values are stored */
+	if((page == MEM_NO_PAGE)
+	&& (page_states[MEM_LEGACY_PAGE] == PAGE_LEGACY)
+	&& (MEM_NO_SLOT != config_slot_find(&slot)))
+	{
+		page = MEM_LEGACY_PAGE;
+	}
+	else
+	{
+		/* do nothing */
+	}
+
+	/* an invalid page holds no record: erase it first */
+	if(page != MEM_NO_PAGE)
+	{
+		ps_success = page_erase_start(page);
+	}
+	else
+	{
+		/* if no collection in progress */
+		if(gc_src_page == MEM_NO_PAGE)
+		{
+			/* if no page is erased, a collection was interrupted after sealing: the collected page 
+			   holds no record and it is erased */
+			if(pages_count(PAGE_BLANK) == 0)
+			{
+				for(uint8_t i=0; i<MEM_NUM_OF_PAGES; i++)
+				{
+					if((page_states[i] == PAGE_VALID)
+					&& (page_record_find(i) == MEM_NO_RECORD))
+					{
+						gc_src_page = i;
+						break;
+					}
+				}
+			}
+			/* if the pending record does not fit and there is one erased page only, collect */
+			else if((id != MEM_NO_RECORD)
+			&& (write_page_find(MEM_RECORD_SIZE(pending_lengths[id])) == MEM_NO_PAGE)
+			&& (pages_count(PAGE_BLANK) < 2))
+			{
+				gc_src_page = gc_page_find();
+				gc_dst_page = page_find(PAGE_BLANK);
+			}
+			else
+			{
+				/* do nothing */
+			}
+		}
+		else
+		{
+			/* collection in progress */
+		}
+
+		if(gc_src_page != MEM_NO_PAGE)
+		{
+			id = page_record_find(gc_src_page);
+
+			/* copy records of the collected page, then seal the page they are copied to and 
+			   erase the collected one */
+			if(id != MEM_NO_RECORD)
+			{
+				ps_success = record_copy_start(id);
+			}
+			else if((gc_dst_page != MEM_NO_PAGE)
+			&& (page_states[gc_dst_page] == PAGE_BLANK))
+			{
+				ps_success = page_header_write_start(gc_dst_page, SEAL_PAGE);
+			}
+			else
+			{
+				ps_success = page_erase_start(gc_src_page);
+			}
+		}
+		else if(pages_count(PAGE_BLANK) == 0)
+		{
+			/* no erased page */
+			ps_success = false;
+		}
+		else if(id != MEM_NO_RECORD)
+		{
+			page = write_page_find(MEM_RECORD_SIZE(pending_lengths[id]));
+
+			if(page != MEM_NO_PAGE)
+			{
+				ps_success = record_write_start(id, page);
+			}
+			else if(pages_count(PAGE_BLANK) >= 2)
+			{
+				/* open an erased page, another one is kept */
+				ps_success = page_header_write_start(page_find(PAGE_BLANK), OPEN_PAGE);
+			}
+			else
+			{
+				/* no space to collect: records in use do not fit */
+				ps_success = false;
+			}
+		}
+		else
+		{
+			/* nothing to do */
+			curr_state = IDLE_STATE;
+			init_end(MEM_EVT_INIT_DONE);
+		}
+	}
+
+	if(false == ps_success)
+	{
+		/* persistent storage failure */
+		log_fail();
+	}
+	else
+	{
+		/* do nothing */
+	}
+}
+
+
+/* Function to scan the log again from flash after a persistent storage failure. The outcome of 
+   the failed operation is not known, so the index is built again */
+static void log_recover(void)
+{
+	if(true == pages_registered)
+	{
+		memset(record_addrs, 0, sizeof(record_addrs));
+		gc_src_page = MEM_NO_PAGE;
+		gc_dst_page = MEM_NO_PAGE;
+		log_scan();
+		curr_state = IDLE_STATE;
+	}
+	else
+	{
+		/* storage not available */
+	}
+}
+
+
+/* Function to manage a persistent storage failure: the record being written and the queued ones 
+   are completed with an error */
+static void log_fail(void)
+{
+	uint8_t id;
+
+	CRITICAL_REGION_ENTER();
+	curr_state = ERROR_STATE;
+
+	op_complete(op_cb, op_record, MEM_RESULT_ERROR);
+	op_cb = NULL;
+
+	while(pending_records != 0)
+	{
+		id = (uint8_t)__builtin_ctz(pending_records);
+		pending_records &= ~(1UL << id);
+		op_complete(pending_cbs[id], id, MEM_RESULT_ERROR);
+	}
+	CRITICAL_REGION_EXIT();
+
+	init_end(MEM_EVT_INIT_ERROR);
+}
+
+
+/* Function to issue the flash operation in progress. If pstorage is busy it is issued again 
+   later */
+static bool op_issue(void)
+{
+	uint32_t retval;
+	bool ps_success = true;
+
+	if(curr_state == ERASE_PAGE)
+	{
+		retval = pstorage_clear(&page_handles[op_page], MEM_PAGE_SIZE_BYTES);
+	}
+	else
+	{
+		retval = pstorage_store(&page_handles[op_page], (uint8_t *)op_src, op_size, op_offset);
+	}
+
+	if((retval == NRF_ERROR_BUSY)
+	|| (retval == NRF_ERROR_NO_MEM))
+	{
+		/* pstorage queue full or flash busy */
+		ps_success = op_retry();
+	}
+	else if(retval != NRF_SUCCESS)
+	{
+		ps_success = false;
+	}
+	else
+	{
+		/* do nothing */
+	}
+
+	return ps_success;
+}
+
+
+/* Function to retry the flash operation in progress with a back-off: the delay is doubled at 
+   every retry. It returns false once retries are exhausted */
+static bool op_retry(void)
+{
+	bool retried = false;
+
+	if(op_retries < MEM_MAX_RETRIES)
+	{
+		vtimer_start(&retry_timer, (MEM_RETRY_DELAY_MS << op_retries), NULL);
+		op_retries++;
+		retried = true;
+	}
+	else
+	{
+		/* give up */
+	}
+
+	return retried;
+}
+
+
+/* Function to write the header of a page: to open an erased page or to seal the page records 
+   of a collected page are copied to */
+static bool page_header_write_start(uint8_t page, uint8_t state)
+{
+	page_header.signature = MEM_PAGE_SIGNATURE;
+	page_header.sequence = next_page_sequence;
+
+	op_page = page;
+	op_src = (const uint8_t *)&page_header;
+	op_size = sizeof(page_header);
+	op_offset = 0;
+	op_retries = 0;
+	curr_state = state;
+
+	return op_issue();
+}
+
+
+/* Function to erase a page */
+static bool page_erase_start(uint8_t page)
+{
+	op_page = page;
+	op_retries = 0;
+	curr_state = ERASE_PAGE;
+
+	return op_issue();
+}
+
+
+/* Function to append a pending record to a page. Data are copied to the write buffer, so the 
+   record can be written again meanwhile */
+static bool record_write_start(uint8_t id, uint8_t page)
+{
+	mem_record_header_st *p_header = (mem_record_header_st *)write_buffer;
+	uint8_t *p_buffer_data = (uint8_t *)&p_header[1];
+
+	CRITICAL_REGION_ENTER();
+	pending_records &= ~(1UL << id);
+	op_cb = pending_cbs[id];
+	pending_cbs[id] = NULL;
+	p_header->id = id;
+	p_header->length = pending_lengths[id];
+	op_size = MEM_RECORD_SIZE(p_header->length);
+	memset(p_buffer_data, 0xFF, op_size - sizeof(mem_record_header_st));
+	if(p_header->length != 0)
+	{
+		memcpy(p_buffer_data, pending_data[id], p_header->length);
+	}
+	else
+	{
+		/* cleared record */
+	}
+	CRITICAL_REGION_EXIT();
+
+	p_header->sequence = next_record_sequence;
+	next_record_sequence++;
+	p_header->crc = record_crc_get(p_header, p_buffer_data);
+	p_header->length_check = (uint16_t)~p_header->length;
+
+	op_page = page;
+	op_record = id;
+	op_src = (const uint8_t *)write_buffer;
+	op_offset = page_offsets[page];
+	op_retries = 0;
+	curr_state = WRITE_RECORD;
+
+	return op_issue();
+}
+
+
+/* Function to copy a record of the collected page to the page being filled. It is copied from 
+   flash as it is, with its record sequence */
+static bool record_copy_start(uint8_t id)
+{
+	op_page = gc_dst_page;
+	op_record = id;
+	op_size = record_size_get(id);
+	op_src = (const uint8_t *)record_addrs[id];
+	op_offset = page_offsets[gc_dst_page];
+	op_retries = 0;
+	curr_state = COPY_RECORD;
+
+	return op_issue();
+}
+
+
+/* PS event notification handler. A failed operation is retried if flash was busy */
+static void ps_cb_handler(pstorage_handle_t *handle, uint8_t op_code, uint32_t result, uint8_t *p_data, uint32_t data_len)
+{
+	bool ps_success = true;
+
+	if(result == NRF_SUCCESS)
+	{
+		/* manage received operation code */
+		switch(op_code)
+		{
+			case PSTORAGE_STORE_OP_CODE:
+			{
+				flash_writes++;
+
+				/* if page opened or sealed */
+				if((curr_state == OPEN_PAGE)
+				|| (curr_state == SEAL_PAGE))
+				{
+					page_states[op_page] = PAGE_VALID;
+					page_sequences[op_page] = page_header.sequence;
+					next_page_sequence = page_header.sequence + 1;
+				}
+				/* if record written or copied */
+				else if((curr_state == WRITE_RECORD)
+				|| (curr_state == COPY_RECORD))
+				{
+					/* new copy replaces the previous one */
+					record_addrs[op_record] = MEM_PAGE_ADDR(op_page) + page_offsets[op_page];
+					page_offsets[op_page] += op_size;
+
+					if(curr_state == WRITE_RECORD)
+					{
+						op_complete(op_cb, op_record, MEM_RESULT_SUCCESS);
+						op_cb = NULL;
+					}
+					else
+					{
+						/* do nothing */
+					}
+				}
+				else
+				{
+					/* do nothing */
+				}
+
+				log_process();
+				break;
+			}
+			case PSTORAGE_CLEAR_OP_CODE:
+			{
+				/* if page erased */
+				if(curr_state == ERASE_PAGE)
+				{
+					page_states[op_page] = PAGE_BLANK;
+					page_offsets[op_page] = sizeof(mem_page_header_st);
+
+					/* if collected page erased, collection is completed */
+					if(op_page == gc_src_page)
+					{
+						gc_src_page = MEM_NO_PAGE;
+						gc_dst_page = MEM_NO_PAGE;
+					}
+					else
+					{
+						/* do nothing */
+					}
+				}
+				else
+				{
+					/* do nothing */
+				}
+
+				log_process();
+				break;
+			}
+			default:
+			{
+				break;
+			}
+		}
+	}
+	else if((result == NRF_ERROR_BUSY)
+	|| (result == NRF_ERROR_TIMEOUT))
+	{
+		/* flash not available: the same operation is issued again, flash bits already written 
+		   are written again with the same value */
+		ps_success = op_retry();
+	}
+	else
+	{
+		ps_success = false;
+	}
+
+	/* persistent storage failure */
+	if(false == ps_success)
+	{
+		log_fail();
+	}
+	else
+	{
+		/* do nothing */
 	}
 }
 
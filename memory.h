@@ -39,19 +39,81 @@
 
 
 
-/* ------------- Exported variables --------------- */
+/* Maximum number of config observers */
+#define MEM_MAX_CONFIG_OBSERVERS				4
 
-/* Store characteristic values */
-extern uint8_t char_values[MEM_BUFFER_DATA_LENGTH];
+/* Maximum number of queued record operations with a completion callback */
+#define MEM_MAX_OP_CALLBACKS					8
+
+/* Maximum length of a record in bytes */
+/* ATTENTION: this value must be equal of or greater than the length of each record */
+#define MEM_RECORD_MAX_LENGTH					520
+
+
+
+
+/* ------------- Exported typedefs --------------- */
+
+/* Config observer function type. It is called once new characteristic values are published. 
+   ATTENTION: it runs in the main loop, values have to be read by memory_config_get() */
+typedef void (*memory_config_observer_t)(void);
+
+/* Stored records enum. A record is stored only once written, its owner uses default values 
+   until then. New records (e.g. calibration data) are added before NUM_OF_MEM_RECORDS, IDs of 
+   stored records are not changed */
+typedef enum
+{
+	MEM_RECORD_CONFIG_A,			/* characteristic values, slot A (memory.c) */
+	MEM_RECORD_PRESETS,				/* presets table (presets.c) */
+	MEM_RECORD_CONFIG_B,			/* characteristic values, slot B (memory.c) */
+	MEM_RECORD_WHITELIST,			/* trusted controller addresses (whitelist.c) */
+	MEM_RECORD_LIGHT_STATE,			/* last light state (light_state.c) */
+	NUM_OF_MEM_RECORDS
+} memory_record_e;
+
+/* Record operation results enum */
+typedef enum
+{
+	MEM_RESULT_SUCCESS,				/* record written */
+	MEM_RESULT_REPLACED,			/* replaced by a later write of the same record before starting */
+	MEM_RESULT_ERROR,				/* persistent storage failure, record not written */
+	NUM_OF_MEM_RESULTS
+} memory_result_e;
+
+/* Record operation completion callback type. Parameters are the record ID and the result. 
+   ATTENTION: it runs in the main loop */
+typedef void (*memory_op_cb_t)(uint8_t, uint8_t);
+
+/* Memory init events enum */
+typedef enum
+{
+	MEM_EVT_CONFIG_AVAILABLE,		/* effective values published: stored ones or defaults if none */
+	MEM_EVT_INIT_DONE,				/* init completed, storage is ready */
+	MEM_EVT_INIT_ERROR,				/* persistent storage failure, defaults are used */
+	NUM_OF_MEM_EVTS
+} memory_evt_e;
+
+/* Memory init event handler type. 
+   ATTENTION: it runs in the main loop */
+typedef void (*memory_evt_handler_t)(uint8_t);
 
 
 
 
 /* ------------- Exported functions --------------- */
 
-extern bool memory_is_busy			(void);
-extern bool memory_update_field	(uint8_t, uint8_t *, uint8_t);
-extern bool memory_init				(const uint8_t *);
+extern bool memory_is_busy							(void);
+extern bool memory_update_field					(uint8_t, uint8_t *, uint8_t);
+extern void memory_restore							(void);
+extern bool memory_init								(const uint8_t *, memory_evt_handler_t);
+extern void memory_config_get						(uint8_t *);
+extern bool memory_config_observer_register	(memory_config_observer_t);
+extern bool memory_record_read					(uint8_t, uint8_t *, uint16_t);
+extern bool memory_record_write					(uint8_t, const uint8_t *, uint16_t, memory_op_cb_t);
+extern bool memory_record_clear					(uint8_t, memory_op_cb_t);
+extern bool memory_flush							(void);
+extern uint32_t memory_writes_requested_get	(void);
+extern uint32_t memory_flash_writes_get		(void);
 
 
 
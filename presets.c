@@ -0,0 +1,393 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* ------------- Inclusions --------------- */
+
+#include <string.h>
+#include "nordic_common.h"
+#include "nrf.h"
+#include "app_util_platform.h"
+#include "app_error.h"
+
+#include "config.h"
+#include "memory.h"
+#include "scheduler.h"
+#include "vtimer.h"
+#include "presets.h"
+
+
+
+
+/* ------------- Local defines --------------- */
+
+/* Length of a presets table in bytes */
+#define PS_TABLE_LENGTH_BYTES							(PRESETS_MAX_NUM * PRESETS_ENTRY_LENGTH)
+
+/* Position of the number of presets field in the record */
+#define PS_COUNT_FIELD_BYTE_POS						0
+
+/* Position of the first preset entry in the record */
+#define PS_ENTRIES_BYTE_POS							4
+
+/* Record length in bytes */
+#define PS_RECORD_LENGTH_BYTES						(PS_ENTRIES_BYTE_POS + PS_TABLE_LENGTH_BYTES)
+
+/* Positions of preset entry fields */
+#define PS_ENTRY_LEVELS_POS							0
+#define PS_ENTRY_FADE_POS								6
+#define PS_ENTRY_CURVE_POS								7
+
+/* Position of the first preset index in an upload write */
+#define PS_UPLOAD_INDEX_POS							0
+
+/* Position of the first preset entry in an upload write */
+#define PS_UPLOAD_ENTRIES_POS							1
+
+/* Delay before storing the presets again when the record is refused or its write fails, in ms */
+#define PS_STORE_RETRY_MS								1000	/* 1 s */
+
+
+#if PS_RECORD_LENGTH_BYTES > MEM_RECORD_MAX_LENGTH
+#error "presets record does not fit in a memory record"
+#endif
+
+
+
+
+/* ------------- Local macros --------------- */
+
+/* Macros to get a 12 bits level from a packed preset entry. 2 levels every 3 bytes, the first 
+   one in the lower 12 bits */
+#define PS_LEVEL_LOW(p)									((uint16_t)((p)[0] | (((p)[1] & 0x0F) << 8)))
+#define PS_LEVEL_HIGH(p)								((uint16_t)(((p)[1] >> 4) | ((p)[2] << 4)))
+
+
+
+
+/* ------------- Local variables --------------- */
+
+/* Record data to read or write */
+static uint8_t record_data[PS_RECORD_LENGTH_BYTES];
+
+/* Presets tables. The table in use is selected by the presets sequence, the other one is the 
+   staging table of an upload in progress */
+static uint8_t tables[2][PS_TABLE_LENGTH_BYTES];
+
+/* Number of presets of each table */
+static uint8_t counts[2];
+
+/* Presets sequence, incremented at every swap of tables */
+static volatile uint32_t presets_seq = 0;
+
+/* Flag indicating that the staging table has been initialised by an upload */
+static bool staging_open = false;
+
+/* Store retry timer */
+static vtimer_st store_timer;
+
+/* Task storing the presets in use again */
+static uint8_t store_task = SCHED_INVALID_TASK;
+
+
+
+
+/* ------------- Local functions prototypes --------------- */
+
+static void tables_swap(void);
+static void record_data_parse(void);
+static bool record_data_store(void);
+static void record_write_cb(uint8_t, uint8_t);
+static void store_timeout_handler(void *);
+static void store_retry(void);
+
+
+
+
+/* ------------- Exported functions --------------- */
+
+/* Function to init presets with default ones and get stored presets. It returns false if no 
+   presets are stored. 
+   ATTENTION: memory must be already initialised by memory_init() */
+bool presets_init(const uint8_t *p_def_presets, uint8_t def_count)
+{
+	bool found;
+
+	if(def_count > PRESETS_MAX_NUM)
+	{
+		def_count = PRESETS_MAX_NUM;
+	}
+
+	/* use default presets */
+	memcpy(tables[presets_seq & 1], p_def_presets, (uint32_t)def_count * PRESETS_ENTRY_LENGTH);
+	counts[presets_seq & 1] = def_count;
+
+	/* create store retry task, then init its timer */
+	store_task = sched_task_create(store_retry, SCHED_PRIO_NORMAL);
+	APP_ERROR_CHECK_BOOL(store_task != SCHED_INVALID_TASK);
+	vtimer_create(&store_timer, VTIMER_MODE_SINGLE_SHOT, store_timeout_handler);
+
+	/* stored presets replace default ones */
+	found = memory_record_read(MEM_RECORD_PRESETS, record_data, PS_RECORD_LENGTH_BYTES);
+	if(true == found)
+	{
+		record_data_parse();
+	}
+	else
+	{
+		/* no presets stored yet: keep default ones */
+	}
+
+	return found;
+}
+
+
+/* Function to get a preset by index. It never blocks and it can be called from any interrupt 
+   context: the entry is read again if tables are swapped while reading. It returns false if 
+   the preset is not defined */
+bool presets_get(uint8_t index, preset_st *p_preset)
+{
+	uint32_t seq;
+	uint8_t count;
+	uint8_t entry[PRESETS_ENTRY_LENGTH];
+	bool found = false;
+
+	if(index < PRESETS_MAX_NUM)
+	{
+		do
+		{
+			seq = presets_seq;
+			count = counts[seq & 1];
+			memcpy(entry, &tables[seq & 1][(uint32_t)index * PRESETS_ENTRY_LENGTH], PRESETS_ENTRY_LENGTH);
+			/* read the entry before checking the sequence again */
+			__DMB();
+		} while(seq != presets_seq);
+
+		if(index < count)
+		{
+			p_preset->levels[0] = PS_LEVEL_LOW(&entry[PS_ENTRY_LEVELS_POS]);
+			p_preset->levels[1] = PS_LEVEL_HIGH(&entry[PS_ENTRY_LEVELS_POS]);
+			p_preset->levels[2] = PS_LEVEL_LOW(&entry[PS_ENTRY_LEVELS_POS + 3]);
+			p_preset->levels[3] = PS_LEVEL_HIGH(&entry[PS_ENTRY_LEVELS_POS + 3]);
+			p_preset->fade_code = entry[PS_ENTRY_FADE_POS];
+			p_preset->curve_id = entry[PS_ENTRY_CURVE_POS];
+			found = true;
+		}
+		else
+		{
+			/* preset not defined */
+		}
+	}
+	else
+	{
+		/* invalid index */
+	}
+
+	return found;
+}
+
+
+/* Function to upload presets to the staging table: the first byte is the index of the first 
+   preset and it is followed by packed preset entries. A write of the index byte only sets the 
+   number of presets to it. The first upload after a commit starts from a copy of the presets 
+   in use. Presets in use are not affected until presets_commit() */
+bool presets_upload(const uint8_t *p_data, uint8_t length)
+{
+	uint32_t staging = (presets_seq + 1) & 1;
+	uint8_t index;
+	uint8_t num;
+	bool success = false;
+
+	if((length >= PS_UPLOAD_ENTRIES_POS)
+	&& (((length - PS_UPLOAD_ENTRIES_POS) % PRESETS_ENTRY_LENGTH) == 0))
+	{
+		index = p_data[PS_UPLOAD_INDEX_POS];
+		num = (uint8_t)((length - PS_UPLOAD_ENTRIES_POS) / PRESETS_ENTRY_LENGTH);
+
+		if(((uint32_t)index + num) <= PRESETS_MAX_NUM)
+		{
+			/* if first upload: start from presets in use */
+			if(staging_open == false)
+			{
+				memcpy(tables[staging], tables[presets_seq & 1], PS_TABLE_LENGTH_BYTES);
+				counts[staging] = counts[presets_seq & 1];
+				staging_open = true;
+			}
+			else
+			{
+				/* upload in progress */
+			}
+
+			if(num > 0)
+			{
+				memcpy(&tables[staging][(uint32_t)index * PRESETS_ENTRY_LENGTH], &p_data[PS_UPLOAD_ENTRIES_POS], (uint32_t)num * PRESETS_ENTRY_LENGTH);
+				counts[staging] = MAX(counts[staging], (uint8_t)(index + num));
+			}
+			else
+			{
+				/* set number of presets */
+				counts[staging] = index;
+			}
+			success = true;
+		}
+		else
+		{
+			/* out of table */
+		}
+	}
+	else
+	{
+		/* invalid length */
+	}
+
+	return success;
+}
+
+
+/* Function to commit uploaded presets. The staging table is swapped with the one in use, so a 
+   lookup never sees a partially uploaded table, and it is stored as a single record */
+bool presets_commit(void)
+{
+	bool success = false;
+
+	if(staging_open == true)
+	{
+		tables_swap();
+
+		/* if storage is refused or fails, it is retried later and new presets are used meanwhile */
+		success = record_data_store();
+	}
+	else
+	{
+		/* nothing uploaded */
+	}
+
+	return success;
+}
+
+
+/* Function to get the number of presets in use */
+uint8_t presets_count_get(void)
+{
+	return counts[presets_seq & 1];
+}
+
+
+
+
+/* ------------- Local functions --------------- */
+
+/* Function to swap the staging table with the one in use */
+static void tables_swap(void)
+{
+	/* write the staging table before switching to it */
+	__DMB();
+	presets_seq++;
+	staging_open = false;
+}
+
+
+/* Function to get stored presets from record data */
+static void record_data_parse(void)
+{
+	uint32_t staging = (presets_seq + 1) & 1;
+	uint32_t count;
+
+	memcpy(&count, &record_data[PS_COUNT_FIELD_BYTE_POS], sizeof(count));
+
+	if(count <= PRESETS_MAX_NUM)
+	{
+		memcpy(tables[staging], &record_data[PS_ENTRIES_BYTE_POS], PS_TABLE_LENGTH_BYTES);
+		counts[staging] = (uint8_t)count;
+		tables_swap();
+	}
+	else
+	{
+		/* invalid record: keep default ones */
+	}
+}
+
+
+/* Function to store the presets in use. Record data are read by memory when the write starts, in 
+   the flash callback context, so they are prepared with interrupts disabled. If the memory module 
+   does not accept the record, e.g. while all its write callbacks are in use, the store is retried */
+static bool record_data_store(void)
+{
+	bool ps_success;
+	const uint32_t count = counts[presets_seq & 1];
+
+	CRITICAL_REGION_ENTER();
+	memcpy(&record_data[PS_COUNT_FIELD_BYTE_POS], &count, sizeof(count));
+	memcpy(&record_data[PS_ENTRIES_BYTE_POS], tables[presets_seq & 1], PS_TABLE_LENGTH_BYTES);
+	ps_success = memory_record_write(MEM_RECORD_PRESETS, record_data, PS_RECORD_LENGTH_BYTES, record_write_cb);
+	CRITICAL_REGION_EXIT();
+
+	if(false == ps_success)
+	{
+		vtimer_start(&store_timer, PS_STORE_RETRY_MS, NULL);
+	}
+	else
+	{
+		/* completion notified by record_write_cb() */
+	}
+
+	return ps_success;
+}
+
+
+/* Memory record write completion callback. It runs in the main loop */
+static void record_write_cb(uint8_t id, uint8_t result)
+{
+	UNUSED_PARAMETER(id);
+
+	if(result == MEM_RESULT_ERROR)
+	{
+		/* stored presets are the previous ones: store the presets in use again */
+		vtimer_start(&store_timer, PS_STORE_RETRY_MS, NULL);
+	}
+	else
+	{
+		/* stored, or replaced by a later store */
+	}
+}
+
+
+/* Store retry timeout handler. The presets in use are stored by the related task */
+static void store_timeout_handler(void *p_context)
+{
+	UNUSED_PARAMETER(p_context);
+
+	sched_task_post(store_task);
+}
+
+
+/* Task to store the presets in use again */
+static void store_retry(void)
+{
+	record_data_store();
+}
+
+
+
+
+/* End of file */
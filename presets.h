@@ -0,0 +1,89 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+
+
+/* ------------- Inclusions --------------- */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+
+
+/* ------------- Exported defines --------------- */
+
+/* Maximum number of presets */
+#define PRESETS_MAX_NUM							64
+
+/* Length of a packed preset entry in bytes: 4 channel levels of 12 bits, fade time code and 
+   curve ID */
+#define PRESETS_ENTRY_LENGTH						8
+
+/* Fade time code meaning "use the configured fade" */
+#define PRESETS_FADE_CODE_DEFAULT				0xFF
+
+/* Maximum length of a presets upload write: first preset index and 2 entries */
+#define PRESETS_UPLOAD_MAX_LENGTH				(1 + (2 * PRESETS_ENTRY_LENGTH))
+
+
+
+
+/* ------------- Exported macros --------------- */
+
+/* Macro to define a packed preset entry. Levels are 12 bits (0 - LED_LEVEL_MAX) packed in little 
+   endian as in payload v2: 2 levels every 3 bytes, the first one in the lower 12 bits */
+#define PRESETS_ENTRY(r, g, b, w, fade, curve)		\
+	(uint8_t)(r), (uint8_t)((((r) >> 8) & 0x0F) | (((g) & 0x0F) << 4)), (uint8_t)((g) >> 4),	\
+	(uint8_t)(b), (uint8_t)((((b) >> 8) & 0x0F) | (((w) & 0x0F) << 4)), (uint8_t)((w) >> 4),	\
+	(uint8_t)(fade), (uint8_t)(curve)
+
+
+
+
+/* ------------- Exported typedefs --------------- */
+
+/* Preset structure */
+typedef struct
+{
+	uint16_t levels[4];		/* red, green, blue and white levels (0 - LED_LEVEL_MAX) */
+	uint8_t fade_code;		/* fade time code as in payload v2, or PRESETS_FADE_CODE_DEFAULT */
+	uint8_t curve_id;			/* easing curve ID */
+} preset_st;
+
+
+
+
+/* ------------- Exported functions --------------- */
+
+extern bool 		presets_init			(const uint8_t *, uint8_t);
+extern bool 		presets_get				(uint8_t, preset_st *);
+extern bool 		presets_upload			(const uint8_t *, uint8_t);
+extern bool 		presets_commit			(void);
+extern uint8_t 	presets_count_get		(void);
+
+
+
+
+/* End of file */
@@ -0,0 +1,263 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* ------------- Inclusions --------------- */
+
+#include <string.h>
+#include "nordic_common.h"
+#include "nrf.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+
+#include "config.h"
+#include "scheduler.h"
+
+
+
+
+/* ------------- Local defines --------------- */
+
+/* Length of a priority queue. Each task is queued once at most, so a queue never overflows. 
+   Must be a power of 2 */
+#define SCHED_QUEUE_LENGTH						SCHED_MAX_TASKS
+
+/* Mask to get a queue index */
+#define SCHED_QUEUE_INDEX_MASK				(SCHED_QUEUE_LENGTH - 1)
+
+#if (SCHED_QUEUE_LENGTH & SCHED_QUEUE_INDEX_MASK) != 0
+#error SCHED_MAX_TASKS must be a power of 2
+#endif
+
+
+
+
+/* ------------- Local typedefs --------------- */
+
+/* Task structure */
+typedef struct
+{
+	sched_task_handler_t handler;	/* task handler */
+	uint8_t prio;						/* task priority */
+	volatile bool queued;			/* task is waiting in its priority queue */
+	sched_task_stats_st stats;		/* execution statistics */
+} sched_task_st;
+
+/* Priority queue structure */
+typedef struct
+{
+	uint8_t ids[SCHED_QUEUE_LENGTH];	/* queued task IDs */
+	uint8_t read_pos;						/* position of next task to run */
+	uint8_t write_pos;					/* position of next task to queue */
+	uint8_t hwm;							/* highest number of queued tasks */
+} sched_queue_st;
+
+
+
+
+/* ------------- Local variables --------------- */
+
+/* Tasks */
+static sched_task_st tasks[SCHED_MAX_TASKS];
+
+/* Number of created tasks */
+static uint8_t num_of_tasks = 0;
+
+/* Priority queues */
+static sched_queue_st queues[NUM_OF_SCHED_PRIOS];
+
+
+
+
+/* ------------- Local functions prototypes --------------- */
+
+static uint8_t queue_pop(void);
+
+
+
+
+/* ------------- Exported functions --------------- */
+
+/* Function to create a task of the given priority. It returns the task ID or SCHED_INVALID_TASK 
+   if there is no room for it */
+uint8_t sched_task_create(sched_task_handler_t handler, uint8_t prio)
+{
+	uint8_t id = SCHED_INVALID_TASK;
+
+	if((handler != NULL)
+	&& (prio < NUM_OF_SCHED_PRIOS)
+	&& (num_of_tasks < SCHED_MAX_TASKS))
+	{
+		id = num_of_tasks;
+		memset(&tasks[id], 0, sizeof(sched_task_st));
+		tasks[id].handler = handler;
+		tasks[id].prio = prio;
+		num_of_tasks++;
+	}
+	else
+	{
+		/* invalid task or no room for it */
+	}
+
+	return id;
+}
+
+
+/* Function to post a task. It can be called from any interrupt context. A task already waiting 
+   is not queued again: it runs once for all the posts since its last execution */
+void sched_task_post(uint8_t id)
+{
+	sched_queue_st *p_queue;
+	uint8_t depth;
+
+	if(id < num_of_tasks)
+	{
+		CRITICAL_REGION_ENTER();
+
+		if(tasks[id].queued == false)
+		{
+			tasks[id].queued = true;
+
+			p_queue = &queues[tasks[id].prio];
+			p_queue->ids[p_queue->write_pos & SCHED_QUEUE_INDEX_MASK] = id;
+			p_queue->write_pos++;
+
+			/* update high-water mark */
+			depth = (uint8_t)(p_queue->write_pos - p_queue->read_pos);
+			if(depth > p_queue->hwm)
+			{
+				p_queue->hwm = depth;
+			}
+		}
+		else
+		{
+			/* task is already waiting */
+		}
+
+		CRITICAL_REGION_EXIT();
+	}
+	else
+	{
+		/* invalid task */
+	}
+}
+
+
+/* Function to run all posted tasks in priority order. It runs in the main loop before sleeping. 
+   After each task the highest priority queue is checked again, so a task posted meanwhile by an 
+   interrupt does not wait for lower priority ones */
+void sched_execute(void)
+{
+	uint8_t id;
+	uint32_t start_ticks;
+	uint32_t end_ticks;
+	uint32_t exec_ticks;
+
+	for(id = queue_pop(); id != SCHED_INVALID_TASK; id = queue_pop())
+	{
+		app_timer_cnt_get(&start_ticks);
+		tasks[id].handler();
+		app_timer_cnt_get(&end_ticks);
+
+		/* update execution statistics */
+		app_timer_cnt_diff_compute(end_ticks, start_ticks, &exec_ticks);
+		tasks[id].stats.runs++;
+		tasks[id].stats.total_ticks += exec_ticks;
+		if(exec_ticks > tasks[id].stats.max_ticks)
+		{
+			tasks[id].stats.max_ticks = exec_ticks;
+		}
+	}
+}
+
+
+/* Function to get the highest number of tasks queued at the same time with the given priority */
+uint8_t sched_queue_hwm_get(uint8_t prio)
+{
+	uint8_t hwm = 0;
+
+	if(prio < NUM_OF_SCHED_PRIOS)
+	{
+		hwm = queues[prio].hwm;
+	}
+
+	return hwm;
+}
+
+
+/* Function to get execution statistics of a task. It returns false if the task does not exist */
+bool sched_task_stats_get(uint8_t id, sched_task_stats_st *p_stats)
+{
+	bool success = false;
+
+	if(id < num_of_tasks)
+	{
+		CRITICAL_REGION_ENTER();
+		*p_stats = tasks[id].stats;
+		CRITICAL_REGION_EXIT();
+		success = true;
+	}
+	else
+	{
+		/* invalid task */
+	}
+
+	return success;
+}
+
+
+
+
+/* ------------- Local functions --------------- */
+
+/* Function to get the next task to run from the highest priority queue not empty. The task is 
+   marked as not queued before running, so a post during its execution queues it again. It 
+   returns SCHED_INVALID_TASK if no task is queued */
+static uint8_t queue_pop(void)
+{
+	sched_queue_st *p_queue;
+	uint8_t id = SCHED_INVALID_TASK;
+
+	CRITICAL_REGION_ENTER();
+
+	for(uint8_t prio=0; prio<NUM_OF_SCHED_PRIOS; prio++)
+	{
+		p_queue = &queues[prio];
+		if(p_queue->read_pos != p_queue->write_pos)
+		{
+			id = p_queue->ids[p_queue->read_pos & SCHED_QUEUE_INDEX_MASK];
+			p_queue->read_pos++;
+			tasks[id].queued = false;
+			break;
+		}
+	}
+
+	CRITICAL_REGION_EXIT();
+
+	return id;
+}
+
+
+
+
+/* End of file */
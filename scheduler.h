@@ -0,0 +1,84 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+
+
+/* ------------- Inclusions --------------- */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+
+
+/* ------------- Exported defines --------------- */
+
+/* Maximum number of tasks. 13 are created at init: 3 application ones, LED, light state, presets 
+   and whitelist ones, 3 BLE manager ones and 3 memory ones. A task that can not be created is an error at init. 
+   ATTENTION: it must be a power of 2 */
+#define SCHED_MAX_TASKS							16
+
+/* Task ID returned when a task can not be created */
+#define SCHED_INVALID_TASK						0xFF
+
+
+
+
+/* ------------- Exported typedefs --------------- */
+
+/* Task priorities enum. Lower values run first */
+typedef enum
+{
+	SCHED_PRIO_HIGH,			/* light commands and fade ticks */
+	SCHED_PRIO_NORMAL,		/* flash completions and config updates */
+	SCHED_PRIO_LOW,			/* telemetry */
+	NUM_OF_SCHED_PRIOS
+} sched_prio_e;
+
+/* Task handler function type. It runs to completion in the main loop */
+typedef void (*sched_task_handler_t)(void);
+
+/* Task execution statistics structure. Times are in RTC ticks (30.517 us) */
+typedef struct
+{
+	uint32_t runs;				/* number of executions */
+	uint32_t total_ticks;	/* total execution time */
+	uint32_t max_ticks;		/* longest execution time */
+} sched_task_stats_st;
+
+
+
+
+/* ------------- Exported functions --------------- */
+
+extern uint8_t 	sched_task_create			(sched_task_handler_t, uint8_t);
+extern void 		sched_task_post			(uint8_t);
+extern void 		sched_execute				(void);
+extern uint8_t 	sched_queue_hwm_get		(uint8_t);
+extern bool 		sched_task_stats_get		(uint8_t, sched_task_stats_st *);
+
+
+
+
+/* End of file */
@@ -0,0 +1,102 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* 
+	ATTENTION: 
+	Host mock of the PWM backend: frames are recorded instead of being actuated, so the light 
+	module can be tested without PWM peripherals. 
+*/
+
+
+/* ---------------- Inclusions --------------------- */
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "led_pwm.h"
+#include "led_pwm_mock.h"
+
+
+
+
+/* ---------------- Local variables --------------------- */   
+
+/* Number of frames written */
+static uint32_t frames = 0;
+
+/* Last frame written, with PWM_TICKS_FRAC_BITS fractional bits */
+static uint16_t last_frame[NUM_OF_LIGHT_CHANNELS];
+
+
+
+
+/* ------------- Exported functions implementations --------------- */
+
+/* Function to init PWM backend: the last frame is kept, as by a module initialised again */
+void led_pwm_init(void)
+{
+}
+
+
+/* Function to get the PWM period in ticks */
+uint16_t led_pwm_period_ticks_get(void)
+{
+	return LED_PWM_MOCK_PERIOD_TICKS;
+}
+
+
+/* Function to write the next frame of PWM ticks */
+void led_pwm_frame_set(const uint16_t *p_frame_ticks)
+{
+	for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+	{
+		last_frame[ch] = p_frame_ticks[ch];
+	}
+	frames++;
+}
+
+
+/* Function to get the number of dropped frames: frames are never dropped */
+uint32_t led_pwm_dropped_frames_get(void)
+{
+	return 0;
+}
+
+
+/* Function to get the number of frames written */
+uint32_t led_pwm_mock_frames_get(void)
+{
+	return frames;
+}
+
+
+/* Function to get the last ticks written to a channel, with PWM_TICKS_FRAC_BITS fractional bits */
+uint16_t led_pwm_mock_ticks_get(uint8_t ch)
+{
+	return last_frame[ch];
+}
+
+
+
+
+/* End of file */
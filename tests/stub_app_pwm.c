@@ -0,0 +1,202 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* 
+	ATTENTION: 
+	Period model of app_pwm instances, as used by the app PWM backend (led_pwm_app.c). 
+	A TIMER tick is 1 us, so the period in ticks equals the period in us. A changed duty 
+	cycle is applied at the next period start and the instance is busy up to then: a further 
+	update returns NRF_ERROR_BUSY. Once the change is applied the ready callback is called, 
+	with the driver index of the TIMER (TIMER0 is used by the SoftDevice, so TIMER1 is 0). 
+	An unchanged duty cycle is accepted without calling the ready callback. 
+*/
+
+
+/* ---------------- Inclusions --------------------- */
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdk_stub.h"
+#include "stub_app_pwm.h"
+
+
+
+
+/* ---------------- Local defines --------------------- */   
+
+/* Number of app_pwm instances */
+#define MODEL_INSTANCES								3
+
+/* Number of GPIO pins */
+#define MODEL_GPIO_PINS								32
+
+
+
+
+/* ---------------- Local typedefs --------------------- */   
+
+/* Instance structure */
+typedef struct
+{
+	uint32_t pins[2];
+	uint16_t period_ticks;
+	uint16_t duty_ticks[2];
+	uint16_t next_duty_ticks[2];
+	bool busy;
+	bool enabled;
+	app_pwm_callback_t ready_callback;
+} model_instance_st;
+
+
+
+
+/* ---------------- Local variables --------------------- */   
+
+/* Instances by TIMER number */
+static model_instance_st instances[MODEL_INSTANCES];
+
+/* High time of each pin in the last complete period */
+static uint16_t last_high_ticks[MODEL_GPIO_PINS];
+
+/* Number of ready callbacks */
+static uint32_t callbacks = 0;
+
+
+
+
+/* ------------- Exported functions implementations --------------- */
+
+/* Function to run the given number of periods of all enabled instances */
+void stub_app_pwm_run_periods(uint32_t periods)
+{
+	model_instance_st *p_inst;
+
+	for(uint32_t p=0; p<periods; p++)
+	{
+		for(uint32_t i=0; i<MODEL_INSTANCES; i++)
+		{
+			p_inst = &instances[i];
+			if(true == p_inst->enabled)
+			{
+				/* output the period */
+				last_high_ticks[p_inst->pins[0]] = p_inst->duty_ticks[0];
+				last_high_ticks[p_inst->pins[1]] = p_inst->duty_ticks[1];
+
+				/* apply a changed duty cycle at the next period start */
+				if(true == p_inst->busy)
+				{
+					p_inst->duty_ticks[0] = p_inst->next_duty_ticks[0];
+					p_inst->duty_ticks[1] = p_inst->next_duty_ticks[1];
+					p_inst->busy = false;
+					callbacks++;
+					p_inst->ready_callback(i - 1);
+				}
+				else
+				{
+					/* nothing to apply */
+				}
+			}
+			else
+			{
+				/* instance not running */
+			}
+		}
+	}
+}
+
+
+/* Function to get the high time in ticks of a pin in the last complete period */
+uint16_t stub_app_pwm_high_ticks_get(uint32_t pin)
+{
+	return last_high_ticks[pin];
+}
+
+
+/* Function to get the number of ready callbacks */
+uint32_t stub_app_pwm_callbacks_get(void)
+{
+	return callbacks;
+}
+
+
+/* app_pwm driver */
+uint32_t app_pwm_init(app_pwm_t const * const p_instance, app_pwm_config_t const * const p_config, app_pwm_callback_t callback)
+{
+	model_instance_st *p_inst = &instances[p_instance->timer_id];
+
+	p_inst->pins[0] = p_config->pins[0];
+	p_inst->pins[1] = p_config->pins[1];
+	p_inst->period_ticks = (uint16_t)p_config->period_us;
+	p_inst->duty_ticks[0] = 0;
+	p_inst->duty_ticks[1] = 0;
+	p_inst->busy = false;
+	p_inst->enabled = false;
+	p_inst->ready_callback = callback;
+
+	return NRF_SUCCESS;
+}
+
+
+void app_pwm_enable(app_pwm_t const * const p_instance)
+{
+	instances[p_instance->timer_id].enabled = true;
+}
+
+
+uint16_t app_pwm_cycle_ticks_get(app_pwm_t const * const p_instance)
+{
+	return instances[p_instance->timer_id].period_ticks;
+}
+
+
+uint32_t app_pwm_channel_duty_ticks_set(app_pwm_t const * const p_instance, uint8_t channel, uint16_t ticks)
+{
+	model_instance_st *p_inst = &instances[p_instance->timer_id];
+	uint32_t err_code;
+
+	if(true == p_inst->busy)
+	{
+		err_code = NRF_ERROR_BUSY;
+	}
+	else if(ticks == p_inst->duty_ticks[channel])
+	{
+		/* unchanged: no ready callback */
+		err_code = NRF_SUCCESS;
+	}
+	else
+	{
+		p_inst->next_duty_ticks[0] = p_inst->duty_ticks[0];
+		p_inst->next_duty_ticks[1] = p_inst->duty_ticks[1];
+		p_inst->next_duty_ticks[channel] = MIN(ticks, p_inst->period_ticks);
+		p_inst->busy = true;
+		err_code = NRF_SUCCESS;
+	}
+
+	return err_code;
+}
+
+
+
+
+/* End of file */
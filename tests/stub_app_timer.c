@@ -0,0 +1,354 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* 
+	ATTENTION: 
+	Host stub of app_timer on a simulated 24 bits RTC counter. Time advances only by 
+	stub_app_timer_run(): timers expire in order, each expiry interrupt being delivered after a 
+	random delay as the SoftDevice may hold RTC1 interrupts, then the main loop function runs. 
+	Operations requested by a timeout handler are queued as app_timer does until the handler 
+	returns, so their high-water mark can be checked against the op queue size. 
+*/
+
+
+/* ---------------- Inclusions --------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sdk_stub.h"
+#include "stub_app_timer.h"
+#include "test.h"
+
+
+
+
+/* ---------------- Local defines --------------------- */   
+
+/* Mask of the 24 bits RTC counter */
+#define STUB_RTC_MASK								0x00FFFFFF
+
+/* Maximum number of created timers */
+#define STUB_MAX_TIMERS							8
+
+
+
+
+/* ---------------- Local variables --------------------- */   
+
+/* Created timers */
+static app_timer_t *timers[STUB_MAX_TIMERS];
+
+/* Number of created timers */
+static uint8_t num_of_timers = 0;
+
+/* Simulated time in RTC ticks, not wrapped */
+static uint32_t now_ticks = 0;
+
+/* Size of the operations queue */
+static uint32_t op_queue_size = 0;
+
+/* Operations requested by the running timeout handler */
+static uint32_t queued_ops = 0;
+
+/* Highest number of operations requested by a timeout handler */
+static uint32_t queued_ops_hwm = 0;
+
+/* Flag indicating that a timeout handler is running */
+static bool in_handler = false;
+
+/* Number of start and stop operations */
+static uint32_t ops = 0;
+
+/* Number of delivered expiry interrupts */
+static uint32_t irqs = 0;
+
+/* Delivery delay model: up to short_ticks, up to long_ticks once in a thousand per_mille times */
+static uint32_t short_ticks = 0;
+static uint32_t long_per_mille = 0;
+static uint32_t long_ticks = 0;
+
+
+
+
+/* ------------- Local functions prototypes --------------- */
+
+static bool op_queue						(void);
+static uint32_t delivery_delay		(void);
+static app_timer_t *next_timer_get	(uint32_t);
+
+
+
+
+/* ------------- Exported functions implementations --------------- */
+
+/* Function to init the stub with the size of the operations queue */
+void stub_app_timer_init(uint32_t size)
+{
+	op_queue_size = size;
+}
+
+
+/* Function to create a timer */
+uint32_t app_timer_create(app_timer_id_t const *p_timer_id, app_timer_mode_t mode, app_timer_timeout_handler_t handler)
+{
+	uint32_t err_code = NRF_ERROR_NO_MEM;
+
+	if(num_of_timers < STUB_MAX_TIMERS)
+	{
+		(*p_timer_id)->handler = handler;
+		(*p_timer_id)->mode = mode;
+		(*p_timer_id)->running = false;
+		timers[num_of_timers] = *p_timer_id;
+		num_of_timers++;
+		err_code = NRF_SUCCESS;
+	}
+	else
+	{
+		/* no room */
+	}
+
+	return err_code;
+}
+
+
+/* Function to start a timer. A running timer is restarted */
+uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void *p_context)
+{
+	uint32_t err_code = NRF_ERROR_INVALID_PARAM;
+
+	if(timeout_ticks >= APP_TIMER_MIN_TIMEOUT_TICKS)
+	{
+		if(true == op_queue())
+		{
+			timer_id->expiry = now_ticks + timeout_ticks;
+			timer_id->delivery = timer_id->expiry + delivery_delay();
+			timer_id->period = timeout_ticks;
+			timer_id->p_context = p_context;
+			timer_id->running = true;
+			err_code = NRF_SUCCESS;
+		}
+		else
+		{
+			err_code = NRF_ERROR_NO_MEM;
+		}
+	}
+	else
+	{
+		/* too short */
+	}
+
+	return err_code;
+}
+
+
+/* Function to stop a timer */
+uint32_t app_timer_stop(app_timer_id_t timer_id)
+{
+	uint32_t err_code = NRF_ERROR_NO_MEM;
+
+	if(true == op_queue())
+	{
+		timer_id->running = false;
+		err_code = NRF_SUCCESS;
+	}
+	else
+	{
+		/* queue full */
+	}
+
+	return err_code;
+}
+
+
+/* Function to get the RTC counter */
+uint32_t app_timer_cnt_get(uint32_t *p_ticks)
+{
+	*p_ticks = now_ticks & STUB_RTC_MASK;
+
+	return NRF_SUCCESS;
+}
+
+
+/* Function to get the difference between two RTC counter values */
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from, uint32_t *p_ticks_diff)
+{
+	*p_ticks_diff = (ticks_to - ticks_from) & STUB_RTC_MASK;
+
+	return NRF_SUCCESS;
+}
+
+
+/* Function to get the simulated time in RTC ticks, not wrapped */
+uint32_t stub_app_timer_now_get(void)
+{
+	return now_ticks;
+}
+
+
+/* Function to advance the simulated time by the given RTC ticks. Expiry interrupts are 
+   delivered in order and the main loop function, if any, runs after each one */
+void stub_app_timer_run(uint32_t ticks, stub_main_loop_t main_loop)
+{
+	uint32_t end_ticks = now_ticks + ticks;
+	app_timer_t *p_timer;
+
+	for(p_timer = next_timer_get(end_ticks); p_timer != NULL; p_timer = next_timer_get(end_ticks))
+	{
+		now_ticks = p_timer->delivery;
+		irqs++;
+
+		if(p_timer->mode == APP_TIMER_MODE_REPEATED)
+		{
+			p_timer->expiry += p_timer->period;
+			p_timer->delivery = MAX(p_timer->expiry, now_ticks) + delivery_delay();
+		}
+		else
+		{
+			p_timer->running = false;
+		}
+
+		in_handler = true;
+		queued_ops = 0;
+		p_timer->handler(p_timer->p_context);
+		in_handler = false;
+
+		if(main_loop != NULL)
+		{
+			main_loop();
+		}
+		else
+		{
+			/* no main loop */
+		}
+	}
+
+	now_ticks = end_ticks;
+}
+
+
+/* Function to set the delivery delay model of expiry interrupts in RTC ticks */
+void stub_app_timer_jitter_set(uint32_t short_delay, uint32_t per_mille, uint32_t long_delay)
+{
+	short_ticks = short_delay;
+	long_per_mille = per_mille;
+	long_ticks = long_delay;
+}
+
+
+/* Function to get the number of delivered expiry interrupts */
+uint32_t stub_app_timer_irqs_get(void)
+{
+	return irqs;
+}
+
+
+/* Function to get the number of start and stop operations */
+uint32_t stub_app_timer_ops_get(void)
+{
+	return ops;
+}
+
+
+/* Function to get the highest number of operations requested by a timeout handler */
+uint32_t stub_app_timer_queued_ops_hwm_get(void)
+{
+	return queued_ops_hwm;
+}
+
+
+
+
+/* ------------- Local functions implementation --------------- */
+
+/* Function to count an operation. Inside a timeout handler it is queued and it fails if the 
+   queue is full */
+static bool op_queue(void)
+{
+	bool success = true;
+
+	ops++;
+	if(true == in_handler)
+	{
+		queued_ops++;
+		queued_ops_hwm = MAX(queued_ops_hwm, queued_ops);
+		success = (queued_ops <= op_queue_size);
+	}
+	else
+	{
+		/* executed at once */
+	}
+
+	return success;
+}
+
+
+/* Function to get a random delivery delay following the delay model */
+static uint32_t delivery_delay(void)
+{
+	uint32_t delay = 0;
+
+	if((long_per_mille != 0)
+	&& ((test_rand() % 1000) < long_per_mille))
+	{
+		delay = test_rand() % (long_ticks + 1);
+	}
+	else if(short_ticks != 0)
+	{
+		delay = test_rand() % (short_ticks + 1);
+	}
+	else
+	{
+		/* no delay */
+	}
+
+	return delay;
+}
+
+
+/* Function to get the running timer delivered first up to the given time, NULL if none */
+static app_timer_t *next_timer_get(uint32_t end_ticks)
+{
+	app_timer_t *p_next = NULL;
+
+	for(uint8_t i=0; i<num_of_timers; i++)
+	{
+		if((true == timers[i]->running)
+		&& ((int32_t)(end_ticks - timers[i]->delivery) >= 0)
+		&& ((p_next == NULL) || ((int32_t)(timers[i]->delivery - p_next->delivery) < 0)))
+		{
+			p_next = timers[i];
+		}
+		else
+		{
+			/* do nothing */
+		}
+	}
+
+	return p_next;
+}
+
+
+
+
+/* End of file */
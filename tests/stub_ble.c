@@ -0,0 +1,160 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* 
+	ATTENTION: 
+	Host stubs of the SoftDevice BLE calls and of the BLE libraries used by ble_manager.c. 
+	They accept every request and do nothing: the radio is replaced by the adv reports a 
+	test passes to the BLE event handler. 
+*/
+
+
+/* ---------------- Inclusions --------------------- */
+#include <stdint.h>
+#include <string.h>
+
+#include "sdk_stub.h"
+
+
+
+
+/* ------------- Exported functions implementations --------------- */
+
+/* SoftDevice GAP and GATTS calls */
+uint32_t sd_ble_gap_scan_start(ble_gap_scan_params_t const *p_scan_params)
+{
+	return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gap_scan_stop(void)
+{
+	return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gap_adv_start(ble_gap_adv_params_t const *p_adv_params)
+{
+	return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gap_adv_stop(void)
+{
+	return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gap_disconnect(uint16_t conn_handle, uint8_t hci_status_code)
+{
+	return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gap_device_name_set(ble_gap_conn_sec_mode_t const *p_write_perm, uint8_t const *p_dev_name, uint16_t len)
+{
+	return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gap_appearance_set(uint16_t appearance)
+{
+	return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gap_ppcp_set(ble_gap_conn_params_t const *p_conn_params)
+{
+	return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gap_sec_params_reply(uint16_t conn_handle, uint8_t sec_status, void const *p_sec_params, void const *p_sec_keyset)
+{
+	return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gatts_sys_attr_set(uint16_t conn_handle, uint8_t const *p_sys_attr_data, uint16_t len, uint32_t flags)
+{
+	return NRF_SUCCESS;
+}
+
+
+/* BLE libraries */
+void ble_srv_ascii_to_utf8(ble_srv_utf8_str_t *p_utf8, char *p_ascii)
+{
+	p_utf8->p_str = (uint8_t *)p_ascii;
+	p_utf8->length = (uint16_t)strlen(p_ascii);
+}
+
+
+uint32_t ble_dis_init(ble_dis_init_t const *p_dis_init)
+{
+	return NRF_SUCCESS;
+}
+
+
+uint32_t ble_advdata_set(ble_advdata_t const *p_advdata, ble_advdata_t const *p_srdata)
+{
+	return NRF_SUCCESS;
+}
+
+
+uint32_t ble_conn_params_init(ble_conn_params_init_t const *p_init)
+{
+	return NRF_SUCCESS;
+}
+
+
+void ble_conn_params_on_ble_evt(ble_evt_t *p_ble_evt)
+{
+}
+
+
+/* SoftDevice handler */
+uint32_t softdevice_enable_get_default_config(uint8_t central_links, uint8_t periph_links, ble_enable_params_t *p_ble_enable_params)
+{
+	p_ble_enable_params->central_links = central_links;
+	p_ble_enable_params->periph_links = periph_links;
+
+	return NRF_SUCCESS;
+}
+
+
+uint32_t softdevice_enable(ble_enable_params_t *p_ble_enable_params)
+{
+	return NRF_SUCCESS;
+}
+
+
+uint32_t softdevice_ble_evt_handler_set(void (*ble_evt_handler)(ble_evt_t *))
+{
+	return NRF_SUCCESS;
+}
+
+
+
+
+/* End of file */
@@ -0,0 +1,127 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* 
+	ATTENTION: 
+	Common parts of the host stubs: error checks, critical regions, masked interrupts and 
+	debug pins. 
+*/
+
+
+/* ---------------- Inclusions --------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sdk_stub.h"
+
+
+
+
+/* ---------------- Local variables --------------------- */   
+
+/* Nesting depth of critical regions */
+static uint32_t critical_depth = 0;
+
+/* Interrupts masked globally, SoftDevice ones included */
+static bool irq_masked = false;
+
+
+
+
+/* ------------- Exported functions implementations --------------- */
+
+/* Function to abort the test at a failed error check */
+void stub_error_check(uint32_t err_code, const char *p_file, int line)
+{
+	if(err_code != NRF_SUCCESS)
+	{
+		fprintf(stderr, "%s:%d: error check failed (%u)\n", p_file, line, (unsigned int)err_code);
+		abort();
+	}
+	else
+	{
+		/* success */
+	}
+}
+
+
+/* Function to enter a critical region */
+void stub_critical_enter(void)
+{
+	critical_depth++;
+}
+
+
+/* Function to exit a critical region */
+void stub_critical_exit(void)
+{
+	if(critical_depth == 0)
+	{
+		fprintf(stderr, "critical region exited without entering it\n");
+		abort();
+	}
+	else
+	{
+		critical_depth--;
+	}
+}
+
+
+/* Function to get if a critical region is active */
+bool stub_critical_is_active(void)
+{
+	return (critical_depth != 0);
+}
+
+
+/* Function to mask all interrupts */
+void stub_irq_disable(void)
+{
+	irq_masked = true;
+}
+
+
+/* Function to unmask all interrupts */
+void stub_irq_enable(void)
+{
+	irq_masked = false;
+}
+
+
+/* Function to get if all interrupts are masked */
+bool stub_irq_is_masked(void)
+{
+	return irq_masked;
+}
+
+
+/* Function to toggle a debug pin: it is ignored */
+void nrf_gpio_pin_toggle(uint32_t pin)
+{
+}
+
+
+
+
+/* End of file */
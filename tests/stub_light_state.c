@@ -0,0 +1,74 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* 
+	ATTENTION: 
+	Host stub of the light state module: committed light states are counted, so the light 
+	module tests can check a transition is stored once, when it ends. 
+*/
+
+
+/* ---------------- Inclusions --------------------- */
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "light_state.h"
+#include "stub_light_state.h"
+
+
+
+
+/* ---------------- Local variables --------------------- */   
+
+/* Number of committed light states */
+static uint32_t commits = 0;
+
+
+
+
+/* ------------- Exported functions implementations --------------- */
+
+/* Function to set the output levels: they are actuated by the mock PWM backend already */
+void light_state_output_set(const uint16_t *p_levels)
+{
+}
+
+
+/* Function to commit a reached light state */
+void light_state_commit(const uint16_t *p_levels)
+{
+	commits++;
+}
+
+
+/* Function to get the number of committed light states */
+uint32_t stub_light_state_commits_get(void)
+{
+	return commits;
+}
+
+
+
+
+/* End of file */
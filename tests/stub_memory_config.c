@@ -0,0 +1,100 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* 
+	ATTENTION: 
+	Host stub of the config values of the memory module: values are set by the test and 
+	published to the registered observers at once, as memory.c does from the main loop. 
+*/
+
+
+/* ---------------- Inclusions --------------------- */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "memory.h"
+#include "stub_memory_config.h"
+
+
+
+
+/* ---------------- Local variables --------------------- */   
+
+/* Config values */
+static uint8_t config_values[MEM_BUFFER_DATA_LENGTH];
+
+/* Registered observers */
+static memory_config_observer_t observers[MEM_MAX_CONFIG_OBSERVERS];
+
+/* Number of registered observers */
+static uint8_t num_of_observers = 0;
+
+
+
+
+/* ------------- Exported functions implementations --------------- */
+
+/* Function to get a copy of config values */
+void memory_config_get(uint8_t *p_values)
+{
+	memcpy(p_values, config_values, MEM_BUFFER_DATA_LENGTH);
+}
+
+
+/* Function to register a config observer */
+bool memory_config_observer_register(memory_config_observer_t observer)
+{
+	bool success = false;
+
+	if(num_of_observers < MEM_MAX_CONFIG_OBSERVERS)
+	{
+		observers[num_of_observers] = observer;
+		num_of_observers++;
+		success = true;
+	}
+	else
+	{
+		/* no room */
+	}
+
+	return success;
+}
+
+
+/* Function to set config values and publish them to observers */
+void stub_memory_config_set(const uint8_t *p_values)
+{
+	memcpy(config_values, p_values, MEM_BUFFER_DATA_LENGTH);
+
+	for(uint8_t i=0; i<num_of_observers; i++)
+	{
+		observers[i]();
+	}
+}
+
+
+
+
+/* End of file */
@@ -0,0 +1,617 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* 
+	ATTENTION: 
+	Cycle model of the nrf51 peripherals used by the timer PWM backend: a 16 bits TIMER at 
+	1 MHz with 4 CC registers, the QDEC sample event every 512 us, 16 PPI channels with 4 
+	groups and 4 GPIOTE toggle tasks. Time advances by 1 us ticks. All PPI channels triggered 
+	by an event are taken as enabled before the event, so a channel enabled by a group at an 
+	event does not run the task of that event. 
+	Every driver call may advance time, to model interrupts of higher priority (SoftDevice) 
+	preempting the backend at any point, and the TIMER interrupt is delivered with a latency. 
+	Both are set by stub_pwm_latency_set(). Critical regions hold the TIMER interrupt but not 
+	SoftDevice preemptions, as sd_nvic_critical_region_enter() does. 
+*/
+
+
+/* ---------------- Inclusions --------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sdk_stub.h"
+#include "test.h"
+#include "stub_nrf_pwm.h"
+
+
+
+
+/* ---------------- Local defines --------------------- */   
+
+/* Period of the QDEC sample event in us */
+#define MODEL_QDEC_PERIOD_US						512
+
+/* Number of PPI channels and groups */
+#define MODEL_PPI_CHANNELS							16
+#define MODEL_PPI_GROUPS							4
+
+/* Number of GPIOTE channels */
+#define MODEL_GPIOTE_CHANNELS						4
+
+/* Number of TIMER CC registers */
+#define MODEL_TIMER_CC								4
+
+/* Number of GPIO pins */
+#define MODEL_GPIO_PINS								32
+
+/* PIN_CNF value of an output with input buffer disconnected */
+#define MODEL_PIN_CNF_OUTPUT						0x00000003
+
+
+
+
+/* ---------------- Local typedefs --------------------- */   
+
+/* PPI channel structure */
+typedef struct
+{
+	uint32_t eep;
+	uint32_t tep;
+	bool allocated;
+} model_ppi_st;
+
+
+
+
+/* ---------------- Local variables --------------------- */   
+
+/* Peripheral registers */
+static NRF_QDEC_Type qdec_regs;
+static NRF_GPIO_Type gpio_regs;
+NRF_QDEC_Type *NRF_QDEC = &qdec_regs;
+NRF_GPIO_Type *NRF_GPIO = &gpio_regs;
+NRF_TIMER_Type stub_timer_regs;
+
+/* Fake task registers, whose addresses are the PPI task endpoints */
+static uint32_t gpiote_tasks[MODEL_GPIOTE_CHANNELS];
+static uint32_t timer_clear_task;
+static uint32_t group_enable_tasks[MODEL_PPI_GROUPS];
+
+/* PPI state */
+static model_ppi_st ppi[MODEL_PPI_CHANNELS];
+static uint32_t ppi_chen = 0;
+static uint32_t ppi_groups[MODEL_PPI_GROUPS];
+static uint8_t ppi_groups_allocated = 0;
+
+/* GPIOTE state: pin of each channel and pin levels */
+static uint32_t gpiote_pins[MODEL_GPIOTE_CHANNELS];
+static uint8_t gpiote_channels = 0;
+static uint32_t pin_levels = 0;
+
+/* TIMER state */
+static uint32_t timer_counter = 0;
+static bool timer_enabled = false;
+static nrf_timer_event_handler_t timer_handler = NULL;
+
+/* Current time in us */
+static uint32_t now_us = 0;
+
+/* High time of each pin in the current and in the last complete period */
+static uint16_t high_ticks[MODEL_GPIO_PINS];
+static uint16_t last_high_ticks[MODEL_GPIO_PINS];
+
+/* Interrupt delivery */
+static bool irq_pending = false;
+static uint32_t irq_time_us = 0;
+static bool in_irq = false;
+static uint32_t irqs = 0;
+
+/* Number of driver accesses in a critical region preempted longer than a short latency */
+static uint32_t critical_preemptions = 0;
+
+/* Latency model: maximum delay of a driver call or of an interrupt, probability in per 
+   mille of a long preemption and its maximum length */
+static uint32_t short_latency_us = 0;
+static uint32_t long_per_mille = 0;
+static uint32_t long_latency_us = 0;
+
+
+
+
+/* ------------- Local functions prototypes --------------- */
+
+static void model_tick				(void);
+static void model_event			(uint32_t);
+static void model_task				(uint32_t);
+static void model_irq_check		(void);
+static void model_access			(void);
+static uint32_t model_latency		(void);
+
+
+
+
+/* ------------- Exported functions implementations --------------- */
+
+/* Function to run the model for the given time in us */
+void stub_pwm_run(uint32_t us)
+{
+	for(uint32_t i=0; i<us; i++)
+	{
+		model_tick();
+	}
+}
+
+
+/* Function to run the model up to the end of the given number of periods */
+void stub_pwm_run_periods(uint32_t periods)
+{
+	uint32_t left;
+
+	for(uint32_t p=0; p<periods; p++)
+	{
+		left = MODEL_QDEC_PERIOD_US - (now_us % MODEL_QDEC_PERIOD_US);
+		stub_pwm_run(left);
+	}
+}
+
+
+/* Function to get the high time in us of a pin in the last complete period */
+uint16_t stub_pwm_high_ticks_get(uint32_t pin)
+{
+	return last_high_ticks[pin];
+}
+
+
+/* Function to set the latency model */
+void stub_pwm_latency_set(uint32_t short_us, uint32_t per_mille, uint32_t long_us)
+{
+	short_latency_us = short_us;
+	long_per_mille = per_mille;
+	long_latency_us = long_us;
+}
+
+
+/* Function to get the number of delivered TIMER interrupts */
+uint32_t stub_pwm_irqs_get(void)
+{
+	return irqs;
+}
+
+
+/* Function to get the number of driver accesses in a critical region preempted longer than a 
+   short latency */
+uint32_t stub_pwm_critical_preemptions_get(void)
+{
+	return critical_preemptions;
+}
+
+
+/* TIMER driver */
+uint32_t nrf_drv_timer_init(nrf_drv_timer_t const * const p_instance, nrf_drv_timer_config_t const * p_config, nrf_timer_event_handler_t handler)
+{
+	UNUSED_PARAMETER(p_instance);
+	UNUSED_PARAMETER(p_config);
+
+	timer_handler = handler;
+	model_access();
+
+	return NRF_SUCCESS;
+}
+
+void nrf_drv_timer_enable(nrf_drv_timer_t const * const p_instance)
+{
+	UNUSED_PARAMETER(p_instance);
+	timer_enabled = true;
+	model_access();
+}
+
+uint32_t nrf_drv_timer_compare_event_address_get(nrf_drv_timer_t const * const p_instance, uint32_t channel)
+{
+	return (uint32_t)(uintptr_t)&p_instance->p_reg->EVENTS_COMPARE[channel];
+}
+
+uint32_t nrf_drv_timer_task_address_get(nrf_drv_timer_t const * const p_instance, nrf_timer_task_t task)
+{
+	UNUSED_PARAMETER(p_instance);
+	TEST_CHECK(task == NRF_TIMER_TASK_CLEAR);
+
+	return (uint32_t)(uintptr_t)&timer_clear_task;
+}
+
+void nrf_drv_timer_compare_int_enable(nrf_drv_timer_t const * const p_instance, uint32_t channel)
+{
+	p_instance->p_reg->INTEN |= ((uint32_t)1 << channel);
+	model_access();
+}
+
+void nrf_drv_timer_compare_int_disable(nrf_drv_timer_t const * const p_instance, uint32_t channel)
+{
+	p_instance->p_reg->INTEN &= ~((uint32_t)1 << channel);
+	model_access();
+}
+
+nrf_timer_event_t nrf_timer_compare_event_get(uint32_t channel)
+{
+	return (nrf_timer_event_t)(NRF_TIMER_EVENT_COMPARE0 + (channel * sizeof(uint32_t)));
+}
+
+void nrf_timer_event_clear(NRF_TIMER_Type *p_reg, nrf_timer_event_t event)
+{
+	p_reg->EVENTS_COMPARE[(event - NRF_TIMER_EVENT_COMPARE0) / sizeof(uint32_t)] = 0;
+	model_access();
+}
+
+void nrf_timer_cc_write(NRF_TIMER_Type *p_reg, nrf_timer_cc_channel_t channel, uint32_t value)
+{
+	p_reg->CC[channel] = value;
+	model_access();
+}
+
+
+/* GPIOTE driver */
+bool nrf_drv_gpiote_is_init(void)
+{
+	return false;
+}
+
+uint32_t nrf_drv_gpiote_init(void)
+{
+	return NRF_SUCCESS;
+}
+
+uint32_t nrf_drv_gpiote_out_init(uint32_t pin, nrf_drv_gpiote_out_config_t const *p_config)
+{
+	TEST_CHECK(gpiote_channels < MODEL_GPIOTE_CHANNELS);
+	gpiote_pins[gpiote_channels] = pin;
+	gpiote_channels++;
+	NRF_GPIO->PIN_CNF[pin] = MODEL_PIN_CNF_OUTPUT;
+	if(true == p_config->init_state)
+	{
+		pin_levels |= ((uint32_t)1 << pin);
+	}
+	else
+	{
+		pin_levels &= ~((uint32_t)1 << pin);
+	}
+
+	return NRF_SUCCESS;
+}
+
+void nrf_drv_gpiote_out_task_enable(uint32_t pin)
+{
+	UNUSED_PARAMETER(pin);
+}
+
+uint32_t nrf_drv_gpiote_out_task_addr_get(uint32_t pin)
+{
+	uint32_t addr = 0;
+
+	for(uint8_t i=0; i<gpiote_channels; i++)
+	{
+		if(gpiote_pins[i] == pin)
+		{
+			addr = (uint32_t)(uintptr_t)&gpiote_tasks[i];
+		}
+	}
+
+	return addr;
+}
+
+void nrf_drv_gpiote_out_task_trigger(uint32_t pin)
+{
+	pin_levels ^= ((uint32_t)1 << pin);
+	model_access();
+}
+
+
+/* GPIO: the level is read back only if the input buffer is connected */
+uint32_t nrf_gpio_pin_read(uint32_t pin)
+{
+	uint32_t level = 0;
+
+	model_access();
+	if(0 == (NRF_GPIO->PIN_CNF[pin] & GPIO_PIN_CNF_INPUT_Msk))
+	{
+		level = (pin_levels >> pin) & 1;
+	}
+
+	return level;
+}
+
+
+/* PPI driver and HAL */
+uint32_t nrf_drv_ppi_init(void)
+{
+	return NRF_SUCCESS;
+}
+
+uint32_t nrf_drv_ppi_channel_alloc(nrf_ppi_channel_t *p_channel)
+{
+	uint32_t err_code = NRF_ERROR_NO_MEM;
+
+	for(uint8_t ch=0; ch<MODEL_PPI_CHANNELS; ch++)
+	{
+		if(false == ppi[ch].allocated)
+		{
+			ppi[ch].allocated = true;
+			*p_channel = ch;
+			err_code = NRF_SUCCESS;
+			break;
+		}
+	}
+
+	return err_code;
+}
+
+uint32_t nrf_drv_ppi_channel_assign(nrf_ppi_channel_t channel, uint32_t eep, uint32_t tep)
+{
+	ppi[channel].eep = eep;
+	ppi[channel].tep = tep;
+
+	return NRF_SUCCESS;
+}
+
+uint32_t nrf_drv_ppi_group_alloc(nrf_ppi_channel_group_t *p_group)
+{
+	uint32_t err_code = NRF_ERROR_NO_MEM;
+
+	if(ppi_groups_allocated < MODEL_PPI_GROUPS)
+	{
+		*p_group = ppi_groups_allocated;
+		ppi_groups_allocated++;
+		err_code = NRF_SUCCESS;
+	}
+
+	return err_code;
+}
+
+uint32_t nrf_drv_ppi_task_addr_group_enable_get(nrf_ppi_channel_group_t group)
+{
+	return (uint32_t)(uintptr_t)&group_enable_tasks[group];
+}
+
+void nrf_ppi_channels_enable(uint32_t mask)
+{
+	ppi_chen |= mask;
+	model_access();
+}
+
+void nrf_ppi_channels_disable(uint32_t mask)
+{
+	ppi_chen &= ~mask;
+	model_access();
+}
+
+nrf_ppi_channel_enable_t nrf_ppi_channel_enable_get(nrf_ppi_channel_t channel)
+{
+	model_access();
+	return (0 != (ppi_chen & ((uint32_t)1 << channel))) ? NRF_PPI_CHANNEL_ENABLED : NRF_PPI_CHANNEL_DISABLED;
+}
+
+void nrf_ppi_channels_include_in_group(uint32_t mask, nrf_ppi_channel_group_t group)
+{
+	ppi_groups[group] |= mask;
+	model_access();
+}
+
+void nrf_ppi_channels_remove_from_group(uint32_t mask, nrf_ppi_channel_group_t group)
+{
+	ppi_groups[group] &= ~mask;
+	model_access();
+}
+
+
+
+
+/* ------------- Local functions implementation --------------- */
+
+/* Function to advance the model by 1 us */
+static void model_tick(void)
+{
+	now_us++;
+
+	if(true == timer_enabled)
+	{
+		timer_counter = (timer_counter + 1) & 0xFFFF;
+	}
+
+	/* period event of the started QDEC */
+	if((NRF_QDEC->TASKS_START != 0)
+	&& (0 == (now_us % MODEL_QDEC_PERIOD_US)))
+	{
+		for(uint32_t pin=0; pin<MODEL_GPIO_PINS; pin++)
+		{
+			last_high_ticks[pin] = high_ticks[pin];
+			high_ticks[pin] = 0;
+		}
+		NRF_QDEC->EVENTS_SAMPLERDY = 1;
+		model_event((uint32_t)(uintptr_t)&NRF_QDEC->EVENTS_SAMPLERDY);
+	}
+
+	/* compare events */
+	if(true == timer_enabled)
+	{
+		for(uint8_t cc=0; cc<MODEL_TIMER_CC; cc++)
+		{
+			if(timer_counter == stub_timer_regs.CC[cc])
+			{
+				stub_timer_regs.EVENTS_COMPARE[cc] = 1;
+				model_event((uint32_t)(uintptr_t)&stub_timer_regs.EVENTS_COMPARE[cc]);
+				if((0 != (stub_timer_regs.INTEN & ((uint32_t)1 << cc)))
+				&& (false == irq_pending))
+				{
+					irq_pending = true;
+					irq_time_us = now_us + model_latency();
+				}
+			}
+		}
+	}
+
+	/* outputs in this tick */
+	for(uint8_t i=0; i<gpiote_channels; i++)
+	{
+		if(0 != (pin_levels & ((uint32_t)1 << gpiote_pins[i])))
+		{
+			high_ticks[gpiote_pins[i]]++;
+		}
+	}
+
+	model_irq_check();
+}
+
+
+/* Function to run the tasks of the PPI channels enabled before an event */
+static void model_event(uint32_t event)
+{
+	uint32_t chen = ppi_chen;
+
+	for(uint8_t ch=0; ch<MODEL_PPI_CHANNELS; ch++)
+	{
+		if((0 != (chen & ((uint32_t)1 << ch)))
+		&& (ppi[ch].eep == event))
+		{
+			model_task(ppi[ch].tep);
+		}
+	}
+}
+
+
+/* Function to run a task */
+static void model_task(uint32_t task)
+{
+	for(uint8_t i=0; i<gpiote_channels; i++)
+	{
+		if(task == (uint32_t)(uintptr_t)&gpiote_tasks[i])
+		{
+			pin_levels ^= ((uint32_t)1 << gpiote_pins[i]);
+		}
+	}
+	if(task == (uint32_t)(uintptr_t)&timer_clear_task)
+	{
+		timer_counter = 0;
+	}
+	for(uint8_t g=0; g<MODEL_PPI_GROUPS; g++)
+	{
+		if(task == (uint32_t)(uintptr_t)&group_enable_tasks[g])
+		{
+			ppi_chen |= ppi_groups[g];
+		}
+	}
+}
+
+
+/* Function to deliver a pending TIMER interrupt, out of critical regions and of the 
+   interrupt itself. Events are cleared by the driver before calling the handler */
+static void model_irq_check(void)
+{
+	if((true == irq_pending)
+	&& (now_us >= irq_time_us)
+	&& (false == in_irq)
+	&& (false == stub_critical_is_active())
+	&& (false == stub_irq_is_masked()))
+	{
+		in_irq = true;
+		irq_pending = false;
+		irqs++;
+		for(uint8_t cc=0; cc<MODEL_TIMER_CC; cc++)
+		{
+			if((0 != stub_timer_regs.EVENTS_COMPARE[cc])
+			&& (0 != (stub_timer_regs.INTEN & ((uint32_t)1 << cc))))
+			{
+				stub_timer_regs.EVENTS_COMPARE[cc] = 0;
+				timer_handler(nrf_timer_compare_event_get(cc), NULL);
+			}
+		}
+		in_irq = false;
+	}
+	else if((true == irq_pending)
+	|| (true == in_irq))
+	{
+		/* wait */
+	}
+	else
+	{
+		/* an event may have been left pending while interrupts were held */
+		for(uint8_t cc=0; cc<MODEL_TIMER_CC; cc++)
+		{
+			if((0 != stub_timer_regs.EVENTS_COMPARE[cc])
+			&& (0 != (stub_timer_regs.INTEN & ((uint32_t)1 << cc))))
+			{
+				irq_pending = true;
+				irq_time_us = now_us;
+			}
+		}
+	}
+}
+
+
+/* Function called at every driver access: time may advance meanwhile, unless interrupts are 
+   masked and nothing can preempt the caller */
+static void model_access(void)
+{
+	uint32_t latency = (true == stub_irq_is_masked()) ? 0 : model_latency();
+
+	if((latency > short_latency_us)
+	&& (true == stub_critical_is_active()))
+	{
+		critical_preemptions++;
+	}
+	else
+	{
+		/* short or no preemption */
+	}
+
+	for(uint32_t i=0; i<latency; i++)
+	{
+		model_tick();
+	}
+}
+
+
+/* Function to get a random latency following the latency model */
+static uint32_t model_latency(void)
+{
+	uint32_t latency = 0;
+
+	if((long_per_mille != 0)
+	&& ((test_rand() % 1000) < long_per_mille))
+	{
+		latency = test_rand() % (long_latency_us + 1);
+	}
+	else if(short_latency_us != 0)
+	{
+		latency = test_rand() % (short_latency_us + 1);
+	}
+	else
+	{
+		/* no latency */
+	}
+
+	return latency;
+}
+
+
+
+
+/* End of file */
@@ -0,0 +1,475 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+
+
+/* 
+	ATTENTION: 
+	Host stub of pstorage on a simulated flash. Data pages and the swap page are mapped at 
+	PSTORAGE_DATA_START_ADDR, shared with forked processes, so a test can cut the power by 
+	ending a process and boot again on the same flash. Operations are queued and executed one 
+	by one by stub_pstorage_run(), as the flash interrupt: stored words are programmed as flash 
+	bits (they can only be cleared) and completion is notified through the system event 
+	handler. A power budget in words cuts the power in the middle of an operation: a word being 
+	programmed gets part of its bits, an erase leaves part of the page erased. Faults can be 
+	injected: operations refused because the queue is full and operations timed out by the 
+	SoftDevice after a partial execution. 
+*/
+
+
+/* ---------------- Inclusions --------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "sdk_stub.h"
+#include "stub_pstorage.h"
+#include "test.h"
+
+
+
+
+/* ---------------- Local defines --------------------- */   
+
+/* Size of the simulated flash: data pages and swap page */
+#define STUB_FLASH_SIZE_BYTES						((PSTORAGE_NUM_OF_PAGES + 1) * PSTORAGE_FLASH_PAGE_SIZE)
+
+/* Power budget taken by a page erase, in programmed words (about 20 ms against 45 us) */
+#define STUB_ERASE_COST_WORDS						448
+
+/* Maximum number of registered modules */
+#define STUB_MAX_MODULES							4
+
+/* Value of an erased flash word */
+#define STUB_BLANK_WORD								0xFFFFFFFF
+
+
+
+
+/* ---------------- Local typedefs --------------------- */   
+
+/* Queued flash operation */
+typedef struct
+{
+	pstorage_handle_t handle;		/* handle of the block */
+	uint8_t op_code;				/* store or clear */
+	uint8_t *p_src;					/* data to store */
+	uint32_t size;					/* size in bytes */
+	uint32_t offset;				/* offset in the block */
+} stub_ps_op_st;
+
+
+
+
+/* ---------------- Local variables --------------------- */   
+
+/* Registered modules */
+static pstorage_module_param_t modules[STUB_MAX_MODULES];
+static uint32_t num_of_modules = 0;
+
+/* Next free flash address */
+static uint32_t next_block_addr = PSTORAGE_DATA_START_ADDR;
+
+/* Queued operations, the first one is in progress */
+static stub_ps_op_st ops[PSTORAGE_CMD_QUEUE_SIZE];
+static uint32_t num_of_ops = 0;
+
+/* System event handler */
+static void (*sys_evt_handler)(uint32_t) = NULL;
+
+/* Result of the last executed operation */
+static uint32_t op_result = NRF_SUCCESS;
+
+/* Words programmed before the power loss, and its handler */
+static uint32_t power_budget = 0;
+static stub_power_loss_handler_t power_loss_handler = NULL;
+
+/* One in fault_rate operations is faulty, none if 0 */
+static uint32_t fault_rate = 0;
+
+/* Number of completed erases and of injected faults */
+static uint32_t erases = 0;
+static uint32_t faults = 0;
+
+
+
+
+/* ------------- Local functions prototypes --------------- */
+
+static bool power_take					(uint32_t);
+static bool fault_is_injected			(void);
+static void op_store_execute			(const stub_ps_op_st *, uint32_t);
+static void op_clear_execute			(const stub_ps_op_st *, uint32_t);
+
+
+
+
+/* ------------- Exported functions implementations --------------- */
+
+/* Function to map the simulated flash, erased. Mapping is kept by forked processes */
+void stub_pstorage_flash_init(void)
+{
+	void *p_flash;
+
+	p_flash = mmap((void *)PSTORAGE_DATA_START_ADDR, STUB_FLASH_SIZE_BYTES, PROT_READ | PROT_WRITE, 
+				   MAP_SHARED | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if(p_flash != (void *)PSTORAGE_DATA_START_ADDR)
+	{
+		fprintf(stderr, "simulated flash cannot be mapped at 0x%lX\n", PSTORAGE_DATA_START_ADDR);
+		abort();
+	}
+	else
+	{
+		memset(p_flash, 0xFF, STUB_FLASH_SIZE_BYTES);
+	}
+}
+
+
+/* Function to erase the whole simulated flash, as on a new device */
+void stub_pstorage_flash_erase(void)
+{
+	memset((void *)PSTORAGE_DATA_START_ADDR, 0xFF, STUB_FLASH_SIZE_BYTES);
+}
+
+
+/* Function to run the flash operation in progress, if any. It returns false if none */
+bool stub_pstorage_run(void)
+{
+	bool executed = false;
+
+	if(num_of_ops > 0)
+	{
+		if(true == fault_is_injected())
+		{
+			/* timed out by the SoftDevice after a partial execution */
+			op_result = NRF_ERROR_TIMEOUT;
+			if(ops[0].op_code == PSTORAGE_STORE_OP_CODE)
+			{
+				op_store_execute(&ops[0], test_rand() % ((ops[0].size / sizeof(uint32_t)) + 1));
+			}
+			else
+			{
+				op_clear_execute(&ops[0], 1 + (test_rand() % (PSTORAGE_FLASH_PAGE_SIZE / sizeof(uint32_t))));
+			}
+			sys_evt_handler(NRF_EVT_FLASH_OPERATION_ERROR);
+		}
+		else
+		{
+			op_result = NRF_SUCCESS;
+			if(ops[0].op_code == PSTORAGE_STORE_OP_CODE)
+			{
+				op_store_execute(&ops[0], ops[0].size / sizeof(uint32_t));
+			}
+			else
+			{
+				op_clear_execute(&ops[0], PSTORAGE_FLASH_PAGE_SIZE / sizeof(uint32_t));
+				erases++;
+			}
+			sys_evt_handler(NRF_EVT_FLASH_OPERATION_SUCCESS);
+		}
+		executed = true;
+	}
+	else
+	{
+		/* flash idle */
+	}
+
+	return executed;
+}
+
+
+/* Function to set the power budget in programmed words and the power loss handler. No power 
+   loss if the handler is NULL */
+void stub_pstorage_power_loss_set(uint32_t words, stub_power_loss_handler_t handler)
+{
+	power_budget = words;
+	power_loss_handler = handler;
+}
+
+
+/* Function to set the rate of faulty operations: one in the given number, none if 0 */
+void stub_pstorage_faults_set(uint32_t rate)
+{
+	fault_rate = rate;
+}
+
+
+/* Function to get the number of completed page erases */
+uint32_t stub_pstorage_erases_get(void)
+{
+	return erases;
+}
+
+
+/* Function to get the number of injected faults */
+uint32_t stub_pstorage_faults_get(void)
+{
+	return faults;
+}
+
+
+/* Function to set the system event handler */
+uint32_t softdevice_sys_evt_handler_set(void (*handler)(uint32_t))
+{
+	sys_evt_handler = handler;
+
+	return NRF_SUCCESS;
+}
+
+
+/* Function to init pstorage */
+uint32_t pstorage_init(void)
+{
+	num_of_modules = 0;
+	num_of_ops = 0;
+	next_block_addr = PSTORAGE_DATA_START_ADDR;
+
+	return NRF_SUCCESS;
+}
+
+
+/* Function to register a module. Blocks are assigned in registration order */
+uint32_t pstorage_register(pstorage_module_param_t *p_param, pstorage_handle_t *p_handle)
+{
+	uint32_t err_code = NRF_ERROR_NO_MEM;
+	uint32_t size = p_param->block_size * p_param->block_count;
+
+	if((num_of_modules < STUB_MAX_MODULES)
+	&& ((next_block_addr + size) <= (PSTORAGE_DATA_START_ADDR + (PSTORAGE_NUM_OF_PAGES * PSTORAGE_FLASH_PAGE_SIZE))))
+	{
+		modules[num_of_modules] = *p_param;
+		p_handle->module_id = num_of_modules;
+		p_handle->block_id = next_block_addr;
+		next_block_addr += size;
+		num_of_modules++;
+		err_code = NRF_SUCCESS;
+	}
+	else
+	{
+		/* no room */
+	}
+
+	return err_code;
+}
+
+
+/* Function to get the handle of a block of a module */
+uint32_t pstorage_block_identifier_get(pstorage_handle_t *p_base, pstorage_size_t index, pstorage_handle_t *p_block)
+{
+	p_block->module_id = p_base->module_id;
+	p_block->block_id = p_base->block_id + (index * modules[p_base->module_id].block_size);
+
+	return NRF_SUCCESS;
+}
+
+
+/* Function to queue a store. Data must be kept until completion */
+uint32_t pstorage_store(pstorage_handle_t *p_dest, uint8_t *p_src, pstorage_size_t size, pstorage_size_t offset)
+{
+	uint32_t err_code = NRF_ERROR_NO_MEM;
+
+	TEST_CHECK(((size % sizeof(uint32_t)) == 0) && ((offset % sizeof(uint32_t)) == 0));
+	TEST_CHECK(((uintptr_t)p_src % sizeof(uint32_t)) == 0);
+	TEST_CHECK((offset + size) <= modules[p_dest->module_id].block_size);
+
+	if((num_of_ops < PSTORAGE_CMD_QUEUE_SIZE)
+	&& (false == fault_is_injected()))
+	{
+		ops[num_of_ops] = (stub_ps_op_st){*p_dest, PSTORAGE_STORE_OP_CODE, p_src, size, offset};
+		num_of_ops++;
+		err_code = NRF_SUCCESS;
+	}
+	else
+	{
+		/* queue full */
+	}
+
+	return err_code;
+}
+
+
+/* Function to queue a block erase */
+uint32_t pstorage_clear(pstorage_handle_t *p_dest, pstorage_size_t size)
+{
+	uint32_t err_code = NRF_ERROR_NO_MEM;
+
+	TEST_CHECK(size == PSTORAGE_FLASH_PAGE_SIZE);
+
+	if((num_of_ops < PSTORAGE_CMD_QUEUE_SIZE)
+	&& (false == fault_is_injected()))
+	{
+		ops[num_of_ops] = (stub_ps_op_st){*p_dest, PSTORAGE_CLEAR_OP_CODE, NULL, size, 0};
+		num_of_ops++;
+		err_code = NRF_SUCCESS;
+	}
+	else
+	{
+		/* queue full */
+	}
+
+	return err_code;
+}
+
+
+/* Function to manage a system event: the operation in progress is completed and notified */
+void pstorage_sys_event_handler(uint32_t sys_evt)
+{
+	stub_ps_op_st op;
+
+	if(num_of_ops > 0)
+	{
+		op = ops[0];
+		num_of_ops--;
+		memmove(&ops[0], &ops[1], num_of_ops * sizeof(stub_ps_op_st));
+		modules[op.handle.module_id].cb(&op.handle, op.op_code, op_result, op.p_src, op.size);
+	}
+	else
+	{
+		/* no operation in progress */
+	}
+}
+
+
+/* Function to calculate a CRC16-CCITT, as crc16.c of the SDK */
+uint16_t crc16_compute(uint8_t const *p_data, uint32_t size, uint16_t const *p_crc)
+{
+	uint16_t crc = (p_crc == NULL) ? 0xFFFF : *p_crc;
+
+	for(uint32_t i=0; i<size; i++)
+	{
+		crc = (uint8_t)(crc >> 8) | (crc << 8);
+		crc ^= p_data[i];
+		crc ^= (uint8_t)(crc & 0xFF) >> 4;
+		crc ^= (crc << 8) << 4;
+		crc ^= ((crc & 0xFF) << 4) << 1;
+	}
+
+	return crc;
+}
+
+
+
+
+/* ------------- Local functions implementation --------------- */
+
+/* Function to take power for the given words. The power loss handler is called if not enough */
+static bool power_take(uint32_t words)
+{
+	bool taken = true;
+
+	if(power_loss_handler == NULL)
+	{
+		/* no power loss */
+	}
+	else if(power_budget >= words)
+	{
+		power_budget -= words;
+	}
+	else
+	{
+		taken = false;
+	}
+
+	return taken;
+}
+
+
+/* Function to know if the next operation is faulty */
+static bool fault_is_injected(void)
+{
+	bool injected = false;
+
+	if((fault_rate != 0)
+	&& ((test_rand() % fault_rate) == 0))
+	{
+		faults++;
+		injected = true;
+	}
+	else
+	{
+		/* do nothing */
+	}
+
+	return injected;
+}
+
+
+/* Function to program the first words of a store. At power loss a word gets part of its bits */
+static void op_store_execute(const stub_ps_op_st *p_op, uint32_t words)
+{
+	uint32_t *p_flash = (uint32_t *)(uintptr_t)(p_op->handle.block_id + p_op->offset);
+	const uint32_t *p_words = (const uint32_t *)p_op->p_src;
+
+	for(uint32_t i=0; i<words; i++)
+	{
+		if(true == power_take(1))
+		{
+			p_flash[i] &= p_words[i];
+		}
+		else
+		{
+			p_flash[i] &= (p_words[i] | test_rand());
+			power_loss_handler();
+		}
+	}
+}
+
+
+/* Function to erase the first words of a page. At power loss part of the page is erased and a 
+   word is left with random bits */
+static void op_clear_execute(const stub_ps_op_st *p_op, uint32_t words)
+{
+	uint32_t *p_flash = (uint32_t *)(uintptr_t)p_op->handle.block_id;
+	bool powered = power_take(STUB_ERASE_COST_WORDS);
+
+	if(false == powered)
+	{
+		words = test_rand() % words;
+		p_flash[words] = test_rand();
+	}
+	else
+	{
+		/* do nothing */
+	}
+
+	for(uint32_t i=0; i<words; i++)
+	{
+		p_flash[i] = STUB_BLANK_WORD;
+	}
+
+	if(false == powered)
+	{
+		power_loss_handler();
+	}
+	else
+	{
+		/* do nothing */
+	}
+}
+
+
+
+
+/* End of file */
@@ -0,0 +1,56 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+
+
+/* ------------ Inclusions --------------- */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+
+
+/* ------------- Exported typedefs --------------- */
+
+/* Power loss handler type. It is called when the power budget runs out and it must not return */
+typedef void (*stub_power_loss_handler_t)(void);
+
+
+
+
+/* ------------- Exported functions --------------- */
+
+extern void 		stub_pstorage_flash_init		(void);
+extern void 		stub_pstorage_flash_erase		(void);
+extern bool 		stub_pstorage_run				(void);
+extern void 		stub_pstorage_power_loss_set	(uint32_t, stub_power_loss_handler_t);
+extern void 		stub_pstorage_faults_set		(uint32_t);
+extern uint32_t 	stub_pstorage_erases_get		(void);
+extern uint32_t 	stub_pstorage_faults_get		(void);
+
+
+
+
+/* End of file */
@@ -0,0 +1,2 @@
+/* Host stub, see sdk_stub.h */
+#include "sdk_stub.h"
@@ -0,0 +1,612 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* 
+	ATTENTION: 
+	Host stubs of the nRF5 SDK 11 parts used by the modules under test. Every SDK header 
+	included by a module is a one line file including this one. Only the used declarations 
+	are present, implemented by the stub_*.c files. 
+*/
+
+
+#ifndef SDK_STUB_H
+#define SDK_STUB_H
+
+
+/* ------------ Inclusions --------------- */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+
+
+/* ------------- Common defines --------------- */
+
+#define NRF_SUCCESS									0
+#define NRF_ERROR_NO_MEM							4
+#define NRF_ERROR_NOT_FOUND						5
+#define NRF_ERROR_INVALID_PARAM					7
+#define NRF_ERROR_INVALID_STATE					8
+#define NRF_ERROR_TIMEOUT							13
+#define NRF_ERROR_NULL								14
+#define NRF_ERROR_BUSY								17
+#define MODULE_ALREADY_INITIALIZED				NRF_ERROR_INVALID_STATE
+
+#ifndef MIN
+#define MIN(a, b)									(((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b)									(((a) > (b)) ? (a) : (b))
+#endif
+#define UNUSED_PARAMETER(x)						((void)(x))
+#define UNUSED_VARIABLE(x)							((void)(x))
+#define STATIC_ASSERT(x)							_Static_assert((x), #x)
+#define __INLINE										inline
+#define __STATIC_INLINE								static inline
+#define __DMB()										__sync_synchronize()
+#define __WFE()										do {} while(0)
+#define __SEV()										do {} while(0)
+
+#define APP_IRQ_PRIORITY_HIGH						1
+#define APP_IRQ_PRIORITY_LOW						3
+
+/* UICR is addressed but never read by the tested paths */
+#define NRF_UICR_BASE								0x10001000UL
+#define UICR_CUSTOMER_RESERVED_OFFSET			0x80
+
+/* errors abort the test with the location of the failed check */
+#define APP_ERROR_CHECK(x)							stub_error_check((uint32_t)(x), __FILE__, __LINE__)
+#define APP_ERROR_CHECK_BOOL(x)					stub_error_check((x) ? NRF_SUCCESS : 1, __FILE__, __LINE__)
+#define APP_ERROR_HANDLER(x)						stub_error_check(((x) != NRF_SUCCESS) ? (uint32_t)(x) : 1, __FILE__, __LINE__)
+
+/* critical regions are counted, so simulated interrupts are held while in one */
+#define CRITICAL_REGION_ENTER()					{ stub_critical_enter();
+#define CRITICAL_REGION_EXIT()					stub_critical_exit(); }
+
+/* masked interrupts hold simulated preemptions too */
+#define __disable_irq()							stub_irq_disable()
+#define __enable_irq()							stub_irq_enable()
+
+
+
+
+/* ------------- app_timer --------------- */
+
+#define APP_TIMER_MIN_TIMEOUT_TICKS				5
+#define APP_TIMER_TICKS(ms, prescaler)			((uint32_t)(((uint64_t)(ms) * 32768) / (1000 * ((prescaler) + 1))))
+#define APP_TIMER_DEF(id)							static app_timer_t id##_data; static app_timer_id_t id = &id##_data
+#define APP_TIMER_INIT(prescaler, op_queue_size, scheduler_func)		stub_app_timer_init(op_queue_size)
+
+typedef void (*app_timer_timeout_handler_t)(void *);
+
+typedef enum
+{
+	APP_TIMER_MODE_SINGLE_SHOT,
+	APP_TIMER_MODE_REPEATED
+} app_timer_mode_t;
+
+typedef struct
+{
+	app_timer_timeout_handler_t handler;
+	app_timer_mode_t mode;
+	uint32_t expiry;
+	uint32_t period;
+	uint32_t delivery;
+	void *p_context;
+	bool running;
+} app_timer_t;
+
+typedef app_timer_t *app_timer_id_t;
+
+extern uint32_t app_timer_create				(app_timer_id_t const *, app_timer_mode_t, app_timer_timeout_handler_t);
+extern uint32_t app_timer_start				(app_timer_id_t, uint32_t, void *);
+extern uint32_t app_timer_stop					(app_timer_id_t);
+extern uint32_t app_timer_cnt_get				(uint32_t *);
+extern uint32_t app_timer_cnt_diff_compute	(uint32_t, uint32_t, uint32_t *);
+
+
+
+
+/* ------------- app_pwm --------------- */
+
+#define APP_PWM_NOIRQ								0
+#define APP_PWM_INSTANCE(name, num)				static const app_pwm_t name = {(num)}
+#define APP_PWM_DEFAULT_CONFIG_2CH(period_in_us, pin0, pin1)		{{(pin0), (pin1)}, {0, 0}, (period_in_us)}
+
+typedef enum
+{
+	APP_PWM_POLARITY_ACTIVE_LOW,
+	APP_PWM_POLARITY_ACTIVE_HIGH
+} app_pwm_polarity_t;
+
+typedef struct
+{
+	uint32_t timer_id;
+} app_pwm_t;
+
+typedef struct
+{
+	uint32_t pins[2];
+	app_pwm_polarity_t pin_polarity[2];
+	uint32_t period_us;
+} app_pwm_config_t;
+
+typedef void (*app_pwm_callback_t)(uint32_t);
+
+extern uint32_t app_pwm_init						(app_pwm_t const * const, app_pwm_config_t const * const, app_pwm_callback_t);
+extern void app_pwm_enable						(app_pwm_t const * const);
+extern uint16_t app_pwm_cycle_ticks_get		(app_pwm_t const * const);
+extern uint32_t app_pwm_channel_duty_ticks_set	(app_pwm_t const * const, uint8_t, uint16_t);
+
+
+
+
+/* ------------- Peripherals used by the timer PWM backend --------------- */
+
+#define QDEC_SAMPLEPER_SAMPLEPER_Pos			0
+#define QDEC_SAMPLEPER_SAMPLEPER_512us			2
+#define QDEC_ENABLE_ENABLE_Pos					0
+#define QDEC_ENABLE_ENABLE_Enabled				1
+#define GPIO_PIN_CNF_INPUT_Msk					((uint32_t)1 << 1)
+
+typedef struct
+{
+	volatile uint32_t TASKS_START;
+	volatile uint32_t EVENTS_SAMPLERDY;
+	volatile uint32_t ENABLE;
+	volatile uint32_t SAMPLEPER;
+	volatile uint32_t PSELLED;
+	volatile uint32_t PSELA;
+	volatile uint32_t PSELB;
+} NRF_QDEC_Type;
+
+typedef struct
+{
+	volatile uint32_t PIN_CNF[32];
+} NRF_GPIO_Type;
+
+typedef struct
+{
+	volatile uint32_t EVENTS_COMPARE[4];
+	volatile uint32_t INTEN;
+	volatile uint32_t CC[4];
+} NRF_TIMER_Type;
+
+extern NRF_TIMER_Type stub_timer_regs;
+extern NRF_QDEC_Type *NRF_QDEC;
+extern NRF_GPIO_Type *NRF_GPIO;
+
+typedef enum
+{
+	NRF_TIMER_CC_CHANNEL0,
+	NRF_TIMER_CC_CHANNEL1,
+	NRF_TIMER_CC_CHANNEL2,
+	NRF_TIMER_CC_CHANNEL3
+} nrf_timer_cc_channel_t;
+
+typedef enum
+{
+	NRF_TIMER_EVENT_COMPARE0 = 0x140,
+	NRF_TIMER_EVENT_COMPARE1 = 0x144,
+	NRF_TIMER_EVENT_COMPARE2 = 0x148,
+	NRF_TIMER_EVENT_COMPARE3 = 0x14C
+} nrf_timer_event_t;
+
+typedef enum
+{
+	NRF_TIMER_TASK_START,
+	NRF_TIMER_TASK_STOP,
+	NRF_TIMER_TASK_CLEAR
+} nrf_timer_task_t;
+
+typedef void (*nrf_timer_event_handler_t)(nrf_timer_event_t, void *);
+
+typedef struct
+{
+	NRF_TIMER_Type *p_reg;
+	uint8_t instance_id;
+} nrf_drv_timer_t;
+
+typedef struct
+{
+	uint32_t frequency;
+} nrf_drv_timer_config_t;
+
+#define NRF_DRV_TIMER_INSTANCE(id)				{&stub_timer_regs, (id)}
+
+typedef uint8_t nrf_ppi_channel_t;
+typedef uint8_t nrf_ppi_channel_group_t;
+
+typedef enum
+{
+	NRF_PPI_CHANNEL_DISABLED = 0,
+	NRF_PPI_CHANNEL_ENABLED = 1
+} nrf_ppi_channel_enable_t;
+
+typedef struct
+{
+	bool init_state;
+} nrf_drv_gpiote_out_config_t;
+
+#define GPIOTE_CONFIG_OUT_TASK_TOGGLE(init_high)		{(init_high)}
+
+extern uint32_t nrf_drv_timer_init				(nrf_drv_timer_t const * const, nrf_drv_timer_config_t const *, nrf_timer_event_handler_t);
+extern void nrf_drv_timer_enable					(nrf_drv_timer_t const * const);
+extern uint32_t nrf_drv_timer_compare_event_address_get	(nrf_drv_timer_t const * const, uint32_t);
+extern uint32_t nrf_drv_timer_task_address_get	(nrf_drv_timer_t const * const, nrf_timer_task_t);
+extern void nrf_drv_timer_compare_int_enable	(nrf_drv_timer_t const * const, uint32_t);
+extern void nrf_drv_timer_compare_int_disable	(nrf_drv_timer_t const * const, uint32_t);
+extern nrf_timer_event_t nrf_timer_compare_event_get	(uint32_t);
+extern void nrf_timer_event_clear				(NRF_TIMER_Type *, nrf_timer_event_t);
+extern void nrf_timer_cc_write					(NRF_TIMER_Type *, nrf_timer_cc_channel_t, uint32_t);
+extern bool nrf_drv_gpiote_is_init				(void);
+extern uint32_t nrf_drv_gpiote_init				(void);
+extern uint32_t nrf_drv_gpiote_out_init		(uint32_t, nrf_drv_gpiote_out_config_t const *);
+extern void nrf_drv_gpiote_out_task_enable	(uint32_t);
+extern uint32_t nrf_drv_gpiote_out_task_addr_get	(uint32_t);
+extern void nrf_drv_gpiote_out_task_trigger	(uint32_t);
+extern uint32_t nrf_gpio_pin_read				(uint32_t);
+extern void nrf_gpio_pin_toggle					(uint32_t);
+extern uint32_t nrf_drv_ppi_init					(void);
+extern uint32_t nrf_drv_ppi_channel_alloc		(nrf_ppi_channel_t *);
+extern uint32_t nrf_drv_ppi_channel_assign		(nrf_ppi_channel_t, uint32_t, uint32_t);
+extern uint32_t nrf_drv_ppi_group_alloc		(nrf_ppi_channel_group_t *);
+extern uint32_t nrf_drv_ppi_task_addr_group_enable_get	(nrf_ppi_channel_group_t);
+extern void nrf_ppi_channels_enable				(uint32_t);
+extern void nrf_ppi_channels_disable			(uint32_t);
+extern nrf_ppi_channel_enable_t nrf_ppi_channel_enable_get	(nrf_ppi_channel_t);
+extern void nrf_ppi_channels_include_in_group	(uint32_t, nrf_ppi_channel_group_t);
+extern void nrf_ppi_channels_remove_from_group	(uint32_t, nrf_ppi_channel_group_t);
+
+
+
+
+/* ------------- BLE --------------- */
+
+#define BLE_UUID_TYPE_VENDOR_BEGIN				2
+#define BLE_CONN_HANDLE_INVALID					0xFFFF
+#define BLE_GATT_HANDLE_INVALID					0x0000
+#define BLE_GAP_ADDR_LEN							6
+#define BLE_GAP_ADV_MAX_SIZE						31
+#define BLE_GAP_AD_TYPE_FLAGS						0x01
+#define BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME		0x09
+#define BLE_GAP_AD_TYPE_TX_POWER_LEVEL			0x0A
+#define BLE_GAP_AD_TYPE_SERVICE_DATA				0x16
+#define BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA		0xFF
+#define BLE_GAP_ADV_FLAGS_LE_ONLY_LIMITED_DISC_MODE		0x05
+#define BLE_GAP_ADV_TYPE_ADV_IND					0x00
+#define BLE_GAP_ADV_FP_ANY							0x00
+#define BLE_GAP_SEC_STATUS_PAIRING_NOT_SUPP		0x85
+#define BLE_GAP_TIMEOUT_SRC_ADVERTISING			0x00
+#define BLE_GAP_TIMEOUT_SRC_SCAN					0x02
+#define BLE_GAP_TIMEOUT_SRC_CONN					0x03
+#define BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION		0x13
+#define BLE_HCI_CONN_INTERVAL_UNACCEPTABLE		0x3B
+#define BLE_APPEARANCE_GENERIC_REMOTE_CONTROL	384
+#define BLE_ADVDATA_FULL_NAME						2
+#define UNIT_1_25_MS								1250
+#define UNIT_10_MS									10000
+#define MSEC_TO_UNITS(time, resolution)			(((time) * 1000) / (resolution))
+#define BLE_GAP_CONN_SEC_MODE_SET_OPEN(ptr)		do { (ptr)->sm = 1; (ptr)->lv = 1; } while(0)
+#define BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(ptr)	do { (ptr)->sm = 0; (ptr)->lv = 0; } while(0)
+
+enum
+{
+	BLE_GAP_EVT_CONNECTED = 0x10,
+	BLE_GAP_EVT_DISCONNECTED,
+	BLE_GAP_EVT_CONN_PARAM_UPDATE_REQUEST,
+	BLE_GAP_EVT_SEC_PARAMS_REQUEST,
+	BLE_GAP_EVT_TIMEOUT,
+	BLE_GAP_EVT_ADV_REPORT,
+	BLE_GATTC_EVT_TIMEOUT,
+	BLE_GATTS_EVT_SYS_ATTR_MISSING,
+	BLE_GATTS_EVT_TIMEOUT
+};
+
+typedef struct
+{
+	uint16_t uuid;
+	uint8_t type;
+} ble_uuid_t;
+
+typedef struct
+{
+	uint16_t value_handle;
+	uint16_t user_desc_handle;
+	uint16_t cccd_handle;
+	uint16_t sccd_handle;
+} ble_gatts_char_handles_t;
+
+typedef struct
+{
+	uint8_t addr_type;
+	uint8_t addr[BLE_GAP_ADDR_LEN];
+} ble_gap_addr_t;
+
+typedef struct
+{
+	ble_gap_addr_t **pp_addrs;
+	uint8_t addr_count;
+	void **pp_irks;
+	uint8_t irk_count;
+} ble_gap_whitelist_t;
+
+typedef struct
+{
+	uint8_t active;
+	uint8_t selective;
+	ble_gap_whitelist_t *p_whitelist;
+	uint16_t interval;
+	uint16_t window;
+	uint16_t timeout;
+} ble_gap_scan_params_t;
+
+typedef struct
+{
+	uint8_t type;
+	ble_gap_addr_t *p_peer_addr;
+	uint8_t fp;
+	ble_gap_whitelist_t *p_whitelist;
+	uint16_t interval;
+	uint16_t timeout;
+} ble_gap_adv_params_t;
+
+typedef struct
+{
+	uint16_t min_conn_interval;
+	uint16_t max_conn_interval;
+	uint16_t slave_latency;
+	uint16_t conn_sup_timeout;
+} ble_gap_conn_params_t;
+
+typedef struct
+{
+	uint8_t sm : 4;
+	uint8_t lv : 4;
+} ble_gap_conn_sec_mode_t;
+
+typedef struct
+{
+	ble_gap_addr_t peer_addr;
+	int8_t rssi;
+	uint8_t scan_rsp : 1;
+	uint8_t type : 2;
+	uint8_t dlen : 5;
+	uint8_t data[BLE_GAP_ADV_MAX_SIZE];
+} ble_gap_evt_adv_report_t;
+
+typedef struct
+{
+	uint8_t src;
+} ble_gap_evt_timeout_t;
+
+typedef struct
+{
+	uint16_t conn_handle;
+	union
+	{
+		ble_gap_evt_adv_report_t adv_report;
+		ble_gap_evt_timeout_t timeout;
+	} params;
+} ble_gap_evt_t;
+
+typedef struct
+{
+	struct
+	{
+		uint16_t evt_id;
+		uint16_t evt_len;
+	} header;
+	union
+	{
+		ble_gap_evt_t gap_evt;
+	} evt;
+} ble_evt_t;
+
+extern uint32_t sd_ble_gap_scan_start			(ble_gap_scan_params_t const *);
+extern uint32_t sd_ble_gap_scan_stop			(void);
+extern uint32_t sd_ble_gap_adv_start			(ble_gap_adv_params_t const *);
+extern uint32_t sd_ble_gap_adv_stop			(void);
+extern uint32_t sd_ble_gap_disconnect			(uint16_t, uint8_t);
+extern uint32_t sd_ble_gap_device_name_set	(ble_gap_conn_sec_mode_t const *, uint8_t const *, uint16_t);
+extern uint32_t sd_ble_gap_appearance_set		(uint16_t);
+extern uint32_t sd_ble_gap_ppcp_set			(ble_gap_conn_params_t const *);
+extern uint32_t sd_ble_gap_sec_params_reply	(uint16_t, uint8_t, void const *, void const *);
+extern uint32_t sd_ble_gatts_sys_attr_set		(uint16_t, uint8_t const *, uint16_t, uint32_t);
+
+
+
+
+/* ------------- BLE libraries --------------- */
+
+typedef struct
+{
+	uint8_t *p_str;
+	uint16_t length;
+} ble_srv_utf8_str_t;
+
+typedef struct
+{
+	ble_gap_conn_sec_mode_t read_perm;
+	ble_gap_conn_sec_mode_t write_perm;
+} ble_srv_security_mode_t;
+
+typedef struct
+{
+	ble_srv_utf8_str_t manufact_name_str;
+	ble_srv_utf8_str_t serial_num_str;
+	ble_srv_utf8_str_t hw_rev_str;
+	ble_srv_utf8_str_t fw_rev_str;
+	ble_srv_security_mode_t dis_attr_md;
+} ble_dis_init_t;
+
+typedef struct
+{
+	uint16_t uuid_cnt;
+	ble_uuid_t *p_uuids;
+} ble_advdata_uuid_list_t;
+
+typedef struct
+{
+	uint8_t name_type;
+	bool include_appearance;
+	uint8_t flags;
+	int8_t *p_tx_power_level;
+	void *p_manuf_specific_data;
+	ble_advdata_uuid_list_t uuids_complete;
+} ble_advdata_t;
+
+typedef enum
+{
+	BLE_CONN_PARAMS_EVT_FAILED,
+	BLE_CONN_PARAMS_EVT_SUCCEEDED
+} ble_conn_params_evt_type_t;
+
+typedef struct
+{
+	ble_conn_params_evt_type_t evt_type;
+} ble_conn_params_evt_t;
+
+typedef struct
+{
+	ble_gap_conn_params_t *p_conn_params;
+	uint32_t first_conn_params_update_delay;
+	uint32_t next_conn_params_update_delay;
+	uint8_t max_conn_params_update_count;
+	uint16_t start_on_notify_cccd_handle;
+	bool disconnect_on_fail;
+	void (*evt_handler)(ble_conn_params_evt_t *);
+	void (*error_handler)(uint32_t);
+} ble_conn_params_init_t;
+
+extern void ble_srv_ascii_to_utf8				(ble_srv_utf8_str_t *, char *);
+extern uint32_t ble_dis_init					(ble_dis_init_t const *);
+extern uint32_t ble_advdata_set				(ble_advdata_t const *, ble_advdata_t const *);
+extern uint32_t ble_conn_params_init			(ble_conn_params_init_t const *);
+extern void ble_conn_params_on_ble_evt		(ble_evt_t *);
+
+
+
+
+/* ------------- SoftDevice handler --------------- */
+
+#define NRF_CLOCK_LF_SRC_RC						0
+#define SOFTDEVICE_HANDLER_INIT(p_clock_lf_cfg, evt_handler)	UNUSED_VARIABLE(p_clock_lf_cfg)
+#define CHECK_RAM_START_ADDR(central_links, periph_links)		do {} while(0)
+
+typedef struct
+{
+	uint8_t source;
+	uint8_t rc_ctiv;
+	uint8_t rc_temp_ctiv;
+	uint8_t xtal_accuracy;
+} nrf_clock_lf_cfg_t;
+
+typedef struct
+{
+	uint8_t central_links;
+	uint8_t periph_links;
+} ble_enable_params_t;
+
+extern uint32_t softdevice_enable_get_default_config	(uint8_t, uint8_t, ble_enable_params_t *);
+extern uint32_t softdevice_enable				(ble_enable_params_t *);
+extern uint32_t softdevice_ble_evt_handler_set	(void (*)(ble_evt_t *));
+extern uint32_t softdevice_sys_evt_handler_set	(void (*)(uint32_t));
+
+
+
+
+/* ------------- pstorage --------------- */
+
+/* persistent storage area of the records log on a 256 kB nrf51 without bootloader: log pages 
+   and the swap page. Other pstorage users of config/pstorage_platform.h are not simulated. It is 
+   mapped at this 32 bits address by tests/stub_pstorage.c, aligned to host pages */
+#define PSTORAGE_FLASH_PAGE_SIZE					1024
+#define PSTORAGE_NUM_OF_PAGES						3
+#define PSTORAGE_DATA_START_ADDR					0x3F000UL
+#define PSTORAGE_CMD_QUEUE_SIZE					10
+
+#define PSTORAGE_STORE_OP_CODE					0x01
+#define PSTORAGE_LOAD_OP_CODE						0x02
+#define PSTORAGE_CLEAR_OP_CODE					0x03
+#define PSTORAGE_UPDATE_OP_CODE					0x04
+
+#define NRF_EVT_FLASH_OPERATION_SUCCESS		2
+#define NRF_EVT_FLASH_OPERATION_ERROR			3
+
+typedef uint32_t pstorage_block_t;
+typedef uint32_t pstorage_size_t;
+
+typedef struct
+{
+	uint32_t module_id;
+	pstorage_block_t block_id;
+} pstorage_handle_t;
+
+typedef void (*pstorage_ntf_cb_t)(pstorage_handle_t *, uint8_t, uint32_t, uint8_t *, uint32_t);
+
+typedef struct
+{
+	pstorage_ntf_cb_t cb;
+	pstorage_size_t block_size;
+	pstorage_size_t block_count;
+} pstorage_module_param_t;
+
+extern uint32_t pstorage_init					(void);
+extern uint32_t pstorage_register				(pstorage_module_param_t *, pstorage_handle_t *);
+extern uint32_t pstorage_block_identifier_get	(pstorage_handle_t *, pstorage_size_t, pstorage_handle_t *);
+extern uint32_t pstorage_store					(pstorage_handle_t *, uint8_t *, pstorage_size_t, pstorage_size_t);
+extern uint32_t pstorage_clear					(pstorage_handle_t *, pstorage_size_t);
+extern void pstorage_sys_event_handler		(uint32_t);
+
+
+
+
+/* ------------- crc16 --------------- */
+
+extern uint16_t crc16_compute					(uint8_t const *, uint32_t, uint16_t const *);
+
+
+
+
+/* ------------- Stub control --------------- */
+
+extern void stub_error_check					(uint32_t, const char *, int);
+extern void stub_critical_enter				(void);
+extern void stub_critical_exit					(void);
+extern bool stub_critical_is_active			(void);
+extern void stub_irq_disable					(void);
+extern void stub_irq_enable					(void);
+extern bool stub_irq_is_masked					(void);
+extern void stub_app_timer_init				(uint32_t);
+
+
+#endif
+
+
+
+
+/* End of file */
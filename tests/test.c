@@ -0,0 +1,109 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* ---------------- Inclusions --------------------- */
+#include <stdio.h>
+#include <stdint.h>
+
+#include "test.h"
+
+
+
+
+/* ---------------- Local variables --------------------- */   
+
+/* Number of checks */
+static uint32_t checks = 0;
+
+/* Number of failed checks */
+static uint32_t failures = 0;
+
+/* State of the pseudo random generator */
+static uint32_t rand_state = 1;
+
+
+
+
+/* ------------- Exported functions implementations --------------- */
+
+/* Function to check a condition. Only the first failures are printed */
+void test_check(int cond, const char *p_cond, const char *p_file, int line)
+{
+	checks++;
+	if(0 == cond)
+	{
+		failures++;
+		if(failures <= 20)
+		{
+			printf("%s:%d: check failed: %s\n", p_file, line, p_cond);
+		}
+		else
+		{
+			/* too many failures to print */
+		}
+	}
+	else
+	{
+		/* check passed */
+	}
+}
+
+
+/* Function to print the test result and get the exit code */
+int test_end(const char *p_name)
+{
+	printf("%s: %u checks, %u failed\n", p_name, (unsigned int)checks, (unsigned int)failures);
+
+	return (failures == 0) ? 0 : 1;
+}
+
+
+/* Function to get the number of failed checks */
+uint32_t test_failures_get(void)
+{
+	return failures;
+}
+
+
+/* Function to get a pseudo random number (xorshift32), repeatable across hosts */
+uint32_t test_rand(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+
+	return rand_state;
+}
+
+
+/* Function to set the seed of the pseudo random generator */
+void test_srand(uint32_t seed)
+{
+	rand_state = (seed != 0) ? seed : 1;
+}
+
+
+
+
+/* End of file */
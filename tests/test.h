@@ -0,0 +1,59 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* 
+	ATTENTION: 
+	Minimal test helpers. A failed check is reported with its location and the test goes on, 
+	the exit code of test_end() is not zero if a check failed. 
+*/
+
+
+/* ------------ Inclusions --------------- */
+
+#include <stdio.h>
+#include <stdint.h>
+
+
+
+
+/* ------------- Exported defines --------------- */
+
+/* Macro to check a condition */
+#define TEST_CHECK(cond)							test_check((cond), #cond, __FILE__, __LINE__)
+
+
+
+
+/* ------------- Exported functions --------------- */
+
+extern void test_check			(int, const char *, const char *, int);
+extern int test_end				(const char *);
+extern uint32_t test_rand		(void);
+extern void test_srand			(uint32_t);
+extern uint32_t test_failures_get	(void);
+
+
+
+
+/* End of file */
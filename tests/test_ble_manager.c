@@ -0,0 +1,458 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* 
+	ATTENTION: 
+	Test and benchmark of the scan path of ble_manager.c, which is included here to reach 
+	its static BLE event handler, with the real controllers table. A capture of adv reports 
+	mixes few dimmer commands in several field layouts with many foreign ones (beacons, names, 
+	other manufacturers, malformed packets). Each report is first checked alone: a dimmer 
+	command must reach the application once with its payload, any other report never. 
+	Then the capture is replayed many times and the handled reports per second are printed. 
+*/
+
+
+/* ---------------- Inclusions --------------------- */
+#include <stdio.h>
+#include <time.h>
+
+#include "ble_manager.c"
+
+#include "stub_app_timer.h"
+#include "test.h"
+
+
+
+
+/* ---------------- Local defines --------------------- */   
+
+/* Number of reports of the capture */
+#define CAPTURE_REPORTS							1024
+
+/* Number of replays of the capture in the benchmark */
+#define BENCH_ROUNDS								20000
+
+/* Number of controllers sending dimmer commands */
+#define CAPTURE_CONTROLLERS						4
+
+/* Number of app_timer operations queued in an interrupt */
+#define TEST_OP_QUEUE_SIZE							4
+
+/* Time to wait after a report for commands coalescing, in RTC ticks (25 ms) */
+#define TEST_COALESCE_WAIT_TICKS				820
+
+/* Length of a dimmer manufacturer specific data field after its length byte */
+#define DIMMER_FIELD_LENGTH						(1 + MANUF_FIELD_MIN_LENGTH)
+
+
+
+
+/* ---------------- Local typedefs --------------------- */   
+
+/* Kinds of captured reports */
+typedef enum
+{
+	REPORT_V1,					/* dimmer state command after flags */
+	REPORT_V1_NAME_FIRST,		/* dimmer state command after a name */
+	REPORT_V2_MANUF_FIRST,	/* dimmer levels command before flags */
+	REPORT_V1_FOREIGN_FIRST,	/* dimmer state command after another manufacturer field */
+	REPORT_SCAN_RSP,			/* dimmer command in a scan response */
+	REPORT_IBEACON,			/* Apple iBeacon */
+	REPORT_EDDYSTONE,			/* Eddystone URL in service data */
+	REPORT_NAME_ONLY,			/* flags and a name */
+	REPORT_OTHER_MANUF,		/* dimmer layout with another manufacturer ID */
+	REPORT_UNKNOWN_SERVICE,	/* dimmer manufacturer ID with unknown service ID */
+	REPORT_SHORT_MANUF,		/* dimmer manufacturer ID with a short field */
+	REPORT_MALFORMED,			/* field length exceeding the packet */
+	NUM_OF_REPORT_KINDS
+} report_kind_e;
+
+
+
+
+/* ---------------- Local variables --------------------- */   
+
+/* Capture of BLE events, expected command type, or 0xFF if none, and position of the dimmer 
+   field data */
+static ble_evt_t capture[CAPTURE_REPORTS];
+static uint8_t capture_cmd_types[CAPTURE_REPORTS];
+static uint8_t capture_field_pos[CAPTURE_REPORTS];
+
+/* Sequence number of each controller */
+static uint8_t controller_seqs[CAPTURE_CONTROLLERS];
+
+/* Commands received by the application and last payload */
+static uint32_t app_scans = 0;
+static uint32_t app_levels = 0;
+static uint8_t app_payload[CTRL_CMD_PAYLOAD_MAX_LENGTH];
+
+/* Number of controllers added to the whitelist */
+static uint32_t whitelist_adds = 0;
+
+
+
+
+/* ------------- Local functions prototypes --------------- */
+
+static void capture_build				(void);
+static uint8_t report_build			(ble_gap_evt_adv_report_t *, report_kind_e, uint8_t *);
+static uint8_t dimmer_field_add		(uint8_t *, uint16_t, uint16_t, uint8_t);
+static void check_test					(void);
+static void bench_test					(void);
+
+
+
+
+/* ------------- Exported functions implementations --------------- */
+
+/* Test entry point */
+int main(void)
+{
+	test_srand(1);
+	stub_app_timer_init(TEST_OP_QUEUE_SIZE);
+	vtimer_init();
+	ctrl_init();
+
+	capture_build();
+	check_test();
+	bench_test();
+
+	return test_end("test_ble_manager");
+}
+
+
+/* Stubs of the modules around the scan path */
+bool whitelist_add(const ble_gap_addr_t *p_addr)
+{
+	whitelist_adds++;
+	return true;
+}
+
+
+void whitelist_clear(void)
+{
+}
+
+
+bool whitelist_store(void)
+{
+	return true;
+}
+
+
+uint8_t whitelist_count_get(void)
+{
+	return 0;
+}
+
+
+ble_gap_whitelist_t * whitelist_get(void)
+{
+	return NULL;
+}
+
+
+void application_on_new_scan(const uint8_t *p_payload)
+{
+	app_scans++;
+	memcpy(app_payload, p_payload, PAYLOAD_V1_LENGTH);
+}
+
+
+void application_on_new_levels(const uint8_t *p_payload)
+{
+	app_levels++;
+	memcpy(app_payload, p_payload, PAYLOAD_V2_LENGTH);
+}
+
+
+void application_on_conn(void)
+{
+}
+
+
+void application_on_disconn(void)
+{
+}
+
+
+void app_on_adv_timeout(void)
+{
+}
+
+
+uint32_t ble_dimmer_init(ble_dimmer_st *p_dimmer, const ble_dimmer_init_st *p_dimmer_init)
+{
+	return NRF_SUCCESS;
+}
+
+
+void ble_dimmer_on_ble_evt(ble_dimmer_st *p_dimmer, ble_evt_t *p_ble_evt)
+{
+}
+
+
+
+
+/* ------------- Local functions implementation --------------- */
+
+/* Function to build the capture: one report in 16 is a dimmer command, one in 16 is a dimmer 
+   command in a scan response, the others are foreign */
+static void capture_build(void)
+{
+	ble_gap_evt_adv_report_t *p_report;
+	report_kind_e kind;
+	uint32_t pick;
+
+	for(uint32_t i=0; i<CAPTURE_REPORTS; i++)
+	{
+		pick = test_rand() % 16;
+		if(pick == 0)
+		{
+			kind = (report_kind_e)(REPORT_V1 + (test_rand() % 4));
+		}
+		else if(pick == 1)
+		{
+			kind = REPORT_SCAN_RSP;
+		}
+		else
+		{
+			kind = (report_kind_e)(REPORT_IBEACON + (test_rand() % (NUM_OF_REPORT_KINDS - REPORT_IBEACON)));
+		}
+
+		memset(&capture[i], 0, sizeof(capture[i]));
+		capture[i].header.evt_id = BLE_GAP_EVT_ADV_REPORT;
+		p_report = &capture[i].evt.gap_evt.params.adv_report;
+		p_report->rssi = (int8_t)(-40 - (int8_t)(test_rand() % 50));
+		capture_cmd_types[i] = report_build(p_report, kind, &capture_field_pos[i]);
+	}
+}
+
+
+/* Function to build a report of a kind. It returns the expected command type or 0xFF and the 
+   position of the dimmer field data */
+static uint8_t report_build(ble_gap_evt_adv_report_t *p_report, report_kind_e kind, uint8_t *p_field_pos)
+{
+	static const uint8_t flags[] = {0x02, BLE_GAP_AD_TYPE_FLAGS, 0x06};
+	static const uint8_t name[] = {0x07, BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME, 'r', 'e', 'm', 'o', 't', 'e'};
+	static const uint8_t ibeacon[] = {0x1A, BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA, 0x4C, 0x00, 0x02, 0x15, 
+									  0xE2, 0xC5, 0x6D, 0xB5, 0xDF, 0xFB, 0x48, 0xD2, 0xB0, 0x60, 0xD0, 0xF5, 
+									  0xA7, 0x10, 0x96, 0xE0, 0x00, 0x01, 0x00, 0x02, 0xC5};
+	static const uint8_t eddystone[] = {0x03, 0x03, 0xAA, 0xFE, 0x0E, BLE_GAP_AD_TYPE_SERVICE_DATA, 0xAA, 0xFE, 
+										0x10, 0xEB, 0x03, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0x07};
+	static const uint8_t foreign[] = {0x05, BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA, 0x59, 0x00, 0x01, 0x02};
+	uint8_t *p_data = p_report->data;
+	uint8_t length = 0;
+	uint8_t cmd_type = 0xFF;
+	uint8_t ctrl = (uint8_t)(test_rand() % CAPTURE_CONTROLLERS);
+
+	/* dimmer commands come from the controllers, foreign reports from random addresses */
+	if(kind <= REPORT_SCAN_RSP)
+	{
+		memset(p_report->peer_addr.addr, 0xC0 + ctrl, BLE_GAP_ADDR_LEN);
+	}
+	else
+	{
+		for(uint8_t i=0; i<BLE_GAP_ADDR_LEN; i++)
+		{
+			p_report->peer_addr.addr[i] = (uint8_t)test_rand();
+		}
+	}
+
+	*p_field_pos = 0;
+	switch(kind)
+	{
+		case REPORT_V1:
+		case REPORT_SCAN_RSP:
+			memcpy(p_data, flags, sizeof(flags));
+			length = sizeof(flags);
+			*p_field_pos = length + AD_HEADER_LENGTH;
+			length += dimmer_field_add(&p_data[length], MANUFACTURER_ID, MANUF_SERVICE_ID, ++controller_seqs[ctrl]);
+			cmd_type = CTRL_CMD_STATE;
+			break;
+		case REPORT_V1_NAME_FIRST:
+			memcpy(p_data, name, sizeof(name));
+			length = sizeof(name);
+			*p_field_pos = length + AD_HEADER_LENGTH;
+			length += dimmer_field_add(&p_data[length], MANUFACTURER_ID, MANUF_SERVICE_ID, ++controller_seqs[ctrl]);
+			cmd_type = CTRL_CMD_STATE;
+			break;
+		case REPORT_V2_MANUF_FIRST:
+			*p_field_pos = AD_HEADER_LENGTH;
+			length = dimmer_field_add(p_data, MANUFACTURER_ID, MANUF_SERVICE_ID_V2, ++controller_seqs[ctrl]);
+			memcpy(&p_data[length], flags, sizeof(flags));
+			length += sizeof(flags);
+			cmd_type = CTRL_CMD_LEVELS;
+			break;
+		case REPORT_V1_FOREIGN_FIRST:
+			memcpy(p_data, foreign, sizeof(foreign));
+			length = sizeof(foreign);
+			*p_field_pos = length + AD_HEADER_LENGTH;
+			length += dimmer_field_add(&p_data[length], MANUFACTURER_ID, MANUF_SERVICE_ID, ++controller_seqs[ctrl]);
+			cmd_type = CTRL_CMD_STATE;
+			break;
+		case REPORT_IBEACON:
+			memcpy(p_data, flags, sizeof(flags));
+			memcpy(&p_data[sizeof(flags)], ibeacon, sizeof(ibeacon));
+			length = sizeof(flags) + sizeof(ibeacon);
+			break;
+		case REPORT_EDDYSTONE:
+			memcpy(p_data, flags, sizeof(flags));
+			memcpy(&p_data[sizeof(flags)], eddystone, sizeof(eddystone));
+			length = sizeof(flags) + sizeof(eddystone);
+			break;
+		case REPORT_NAME_ONLY:
+			memcpy(p_data, flags, sizeof(flags));
+			memcpy(&p_data[sizeof(flags)], name, sizeof(name));
+			length = sizeof(flags) + sizeof(name);
+			break;
+		case REPORT_OTHER_MANUF:
+			memcpy(p_data, flags, sizeof(flags));
+			length = sizeof(flags);
+			length += dimmer_field_add(&p_data[length], 0x0059, MANUF_SERVICE_ID, (uint8_t)test_rand());
+			break;
+		case REPORT_UNKNOWN_SERVICE:
+			memcpy(p_data, flags, sizeof(flags));
+			length = sizeof(flags);
+			length += dimmer_field_add(&p_data[length], MANUFACTURER_ID, 0x0200, (uint8_t)test_rand());
+			break;
+		case REPORT_SHORT_MANUF:
+			memcpy(p_data, flags, sizeof(flags));
+			length = sizeof(flags);
+			length += dimmer_field_add(&p_data[length], MANUFACTURER_ID, MANUF_SERVICE_ID, (uint8_t)test_rand());
+			/* drop the last data byte */
+			p_data[sizeof(flags) + AD_LENGTH_POS]--;
+			length--;
+			break;
+		case REPORT_MALFORMED:
+		default:
+			memcpy(p_data, flags, sizeof(flags));
+			length = sizeof(flags);
+			length += dimmer_field_add(&p_data[length], MANUFACTURER_ID, MANUF_SERVICE_ID, (uint8_t)test_rand());
+			/* field length exceeds the packet */
+			p_data[sizeof(flags) + AD_LENGTH_POS] += 4;
+			break;
+	}
+
+	p_report->scan_rsp = (kind == REPORT_SCAN_RSP) ? 1 : 0;
+	p_report->dlen = length;
+
+	return (kind == REPORT_SCAN_RSP) ? 0xFF : cmd_type;
+}
+
+
+/* Function to write a manufacturer specific data field in the dimmer layout. The sequence 
+   number is written where the service expects it. It returns the field length */
+static uint8_t dimmer_field_add(uint8_t *p_data, uint16_t manuf_id, uint16_t service_id, uint8_t seq)
+{
+	uint8_t *p_field = &p_data[AD_HEADER_LENGTH];
+
+	p_data[AD_LENGTH_POS] = DIMMER_FIELD_LENGTH;
+	p_data[AD_TYPE_POS] = BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA;
+	p_field[MANUF_ID_BYTE_0_POS] = (uint8_t)manuf_id;
+	p_field[MANUF_ID_BYTE_1_POS] = (uint8_t)(manuf_id >> 8);
+	p_field[MANUF_DATA_LENGTH_POS] = MANUF_FIELD_MIN_LENGTH - SERVICE_ID_BYTE_0_POS;
+	p_field[SERVICE_ID_BYTE_0_POS] = (uint8_t)service_id;
+	p_field[SERVICE_ID_BYTE_1_POS] = (uint8_t)(service_id >> 8);
+	for(uint8_t i=DATA_BYTE_0_POS; i<MANUF_FIELD_MIN_LENGTH; i++)
+	{
+		p_field[i] = (uint8_t)test_rand();
+	}
+	p_field[(service_id == MANUF_SERVICE_ID_V2) ? DATA_BYTE_7_POS : DATA_BYTE_1_POS] = seq;
+
+	return (uint8_t)(DIMMER_FIELD_LENGTH + 1);
+}
+
+
+/* Function to pass each report alone and check the commands received by the application */
+static void check_test(void)
+{
+	const uint8_t *p_field;
+	uint32_t scans;
+	uint32_t levels;
+	uint32_t commands = 0;
+
+	for(uint32_t i=0; i<CAPTURE_REPORTS; i++)
+	{
+		scans = app_scans;
+		levels = app_levels;
+		p_field = &capture[i].evt.gap_evt.params.adv_report.data[capture_field_pos[i]];
+
+		on_ble_evt(&capture[i]);
+		stub_app_timer_run(TEST_COALESCE_WAIT_TICKS, NULL);
+
+		if(capture_cmd_types[i] == CTRL_CMD_STATE)
+		{
+			TEST_CHECK((app_scans == (scans + 1)) && (app_levels == levels));
+			TEST_CHECK(0 == memcmp(app_payload, &p_field[DATA_BYTE_0_POS], PAYLOAD_V1_LENGTH));
+			commands++;
+		}
+		else if(capture_cmd_types[i] == CTRL_CMD_LEVELS)
+		{
+			TEST_CHECK((app_levels == (levels + 1)) && (app_scans == scans));
+			TEST_CHECK(0 == memcmp(app_payload, &p_field[DATA_BYTE_0_POS], PAYLOAD_V2_LENGTH));
+			commands++;
+		}
+		else
+		{
+			TEST_CHECK((app_scans == scans) && (app_levels == levels));
+		}
+	}
+
+	TEST_CHECK(commands > 0);
+	TEST_CHECK(whitelist_adds == 0);
+	printf("capture of %u reports: %u dimmer commands\n", (unsigned int)CAPTURE_REPORTS, (unsigned int)commands);
+}
+
+
+/* Function to replay the capture and measure the handled reports per second */
+static void bench_test(void)
+{
+	struct timespec start;
+	struct timespec end;
+	uint32_t reports = adv_reports_count;
+	double seconds;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(uint32_t r=0; r<BENCH_ROUNDS; r++)
+	{
+		for(uint32_t i=0; i<CAPTURE_REPORTS; i++)
+		{
+			on_ble_evt(&capture[i]);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	reports = adv_reports_count - reports;
+	TEST_CHECK(reports == (BENCH_ROUNDS * CAPTURE_REPORTS));
+
+	seconds = (double)(end.tv_sec - start.tv_sec) + ((double)(end.tv_nsec - start.tv_nsec) / 1e9);
+	printf("scan path on host: %u reports in %.3f s, %.0f reports/s, %.1f ns per report\n", 
+		   (unsigned int)reports, seconds, (double)reports / seconds, (seconds * 1e9) / reports);
+}
+
+
+
+
+/* End of file */
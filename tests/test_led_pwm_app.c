@@ -0,0 +1,227 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* 
+	ATTENTION: 
+	Test of the app PWM backend (led_pwm_app.c) on the period model of stub_app_pwm.c. 
+	Integer frames must be output exactly once committed. Random fractional frames are held 
+	for thousands of periods: a dithered output stays within two ticks of the fractional ticks, 
+	since it has to change at every update, its cumulative error stays bounded at every period 
+	and its long-run mean equals the fractional ticks. 
+*/
+
+
+/* ---------------- Inclusions --------------------- */
+#include <stdint.h>
+#include <stdbool.h>
+#include "nordic_common.h"
+
+#include "led_pwm.h"
+#include "stub_app_pwm.h"
+#include "test.h"
+
+
+
+
+/* ---------------- Local defines --------------------- */   
+
+/* PWM period in ticks */
+#define PERIOD_TICKS								PWM_PERIOD_US
+
+/* Number of periods to commit and output a frame: an update in progress, then one channel per 
+   instance and period */
+#define COMMIT_PERIODS								4
+
+/* Number of random fractional frames and periods of each one */
+#define DITHER_FRAMES								64
+#define DITHER_PERIODS								4000
+
+/* Largest distance of a dithered output from the fractional ticks: the output of an update is 
+   the wanted value, within one tick of error, less the new error, within one tick too */
+#define DITHER_MAX_OUTPUT_ERROR					(2 << PWM_TICKS_FRAC_BITS)
+
+/* Largest cumulative error of a dithered output in fractional ticks: the error accumulator 
+   is within one tick and each output is held for 2 periods, as the instances update their 
+   2 channels in turn */
+#define DITHER_MAX_CUMULATIVE_ERROR				(4 << PWM_TICKS_FRAC_BITS)
+
+/* Absolute value */
+#define ABS(x)										(((x) < 0) ? -(x) : (x))
+
+
+
+
+/* ---------------- Local variables --------------------- */   
+
+/* Output pin of each channel */
+static const uint8_t channel_pins[NUM_OF_LIGHT_CHANNELS] = {PWM_CH_R, PWM_CH_G, PWM_CH_B, PWM_CH_W};
+
+
+
+
+/* ------------- Local functions prototypes --------------- */
+
+static void frame_output_check		(const uint16_t *);
+static void dither_mean_test			(void);
+
+
+
+
+/* ------------- Exported functions implementations --------------- */
+
+/* Test entry point */
+int main(void)
+{
+	uint16_t frame[NUM_OF_LIGHT_CHANNELS] = {0};
+
+	test_srand(1);
+	led_pwm_init();
+	TEST_CHECK(led_pwm_period_ticks_get() == PERIOD_TICKS);
+
+	/* outputs start low */
+	stub_app_pwm_run_periods(COMMIT_PERIODS);
+	frame_output_check(frame);
+
+	/* integer frames */
+	frame[RED_CHANNEL] = 100 << PWM_TICKS_FRAC_BITS;
+	frame[GREEN_CHANNEL] = 0;
+	frame[BLUE_CHANNEL] = (PERIOD_TICKS - 1) << PWM_TICKS_FRAC_BITS;
+	frame[WHITE_CHANNEL] = PERIOD_TICKS << PWM_TICKS_FRAC_BITS;
+	led_pwm_frame_set(frame);
+	stub_app_pwm_run_periods(COMMIT_PERIODS);
+	frame_output_check(frame);
+
+	frame[RED_CHANNEL] = 1 << PWM_TICKS_FRAC_BITS;
+	frame[GREEN_CHANNEL] = 250 << PWM_TICKS_FRAC_BITS;
+	frame[BLUE_CHANNEL] = 0;
+	frame[WHITE_CHANNEL] = 300 << PWM_TICKS_FRAC_BITS;
+	led_pwm_frame_set(frame);
+	stub_app_pwm_run_periods(COMMIT_PERIODS);
+	frame_output_check(frame);
+
+	/* random fractional frames */
+	dither_mean_test();
+
+	/* fractional ticks out of the dithered range are rounded */
+	frame[RED_CHANNEL] = 4;
+	frame[GREEN_CHANNEL] = 11;
+	frame[BLUE_CHANNEL] = ((PERIOD_TICKS - 1) << PWM_TICKS_FRAC_BITS) - 3;
+	frame[WHITE_CHANNEL] = (PERIOD_TICKS << PWM_TICKS_FRAC_BITS) - 1;
+	led_pwm_frame_set(frame);
+	stub_app_pwm_run_periods(COMMIT_PERIODS);
+	TEST_CHECK(stub_app_pwm_high_ticks_get(PWM_CH_R) == 1);
+	TEST_CHECK(stub_app_pwm_high_ticks_get(PWM_CH_G) == 1);
+	TEST_CHECK(stub_app_pwm_high_ticks_get(PWM_CH_B) == (PERIOD_TICKS - 1));
+	TEST_CHECK(stub_app_pwm_high_ticks_get(PWM_CH_W) == PERIOD_TICKS);
+
+	TEST_CHECK(led_pwm_dropped_frames_get() == 0);
+
+	return test_end("test_led_pwm_app");
+}
+
+
+
+
+/* ------------- Local functions implementation --------------- */
+
+/* Function to check that the last period outputs a frame of integer ticks */
+static void frame_output_check(const uint16_t *p_frame)
+{
+	for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+	{
+		TEST_CHECK(stub_app_pwm_high_ticks_get(channel_pins[ch]) == (p_frame[ch] >> PWM_TICKS_FRAC_BITS));
+	}
+}
+
+
+/* Function to check the output of random fractional frames held for a long run. Their 
+   rounded ticks are in the dithered range, from 2 to (period - 2) ticks */
+static void dither_mean_test(void)
+{
+	uint16_t frame[NUM_OF_LIGHT_CHANNELS];
+	int32_t errors[NUM_OF_LIGHT_CHANNELS];
+	int32_t error;
+	int32_t max_error = 0;
+	int32_t max_mean_error = 0;
+	uint16_t high;
+
+	for(uint32_t f=0; f<DITHER_FRAMES; f++)
+	{
+		for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+		{
+			/* from 1.5 to (period - 1.5) ticks excluded, with a fractional part */
+			frame[ch] = (uint16_t)(13 + (test_rand() % (((PERIOD_TICKS - 3) << PWM_TICKS_FRAC_BITS) - 1)));
+			if(0 == (frame[ch] & ((1 << PWM_TICKS_FRAC_BITS) - 1)))
+			{
+				frame[ch]++;
+			}
+			else
+			{
+				/* already fractional */
+			}
+		}
+		led_pwm_frame_set(frame);
+		stub_app_pwm_run_periods(COMMIT_PERIODS);
+
+		for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+		{
+			errors[ch] = 0;
+		}
+
+		for(uint32_t p=0; p<DITHER_PERIODS; p++)
+		{
+			stub_app_pwm_run_periods(1);
+			for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+			{
+				high = stub_app_pwm_high_ticks_get(channel_pins[ch]);
+
+				/* within two ticks, never 0% or 100% duty */
+				error = ((int32_t)high << PWM_TICKS_FRAC_BITS) - (int32_t)frame[ch];
+				TEST_CHECK(ABS(error) < DITHER_MAX_OUTPUT_ERROR);
+				TEST_CHECK((high > 0) && (high < PERIOD_TICKS));
+
+				/* bounded cumulative error */
+				errors[ch] += error;
+				max_error = MAX(max_error, ABS(errors[ch]));
+				TEST_CHECK(ABS(errors[ch]) <= DITHER_MAX_CUMULATIVE_ERROR);
+			}
+		}
+
+		/* mean output in fractional ticks is within 1/64 of tick */
+		for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+		{
+			error = (int32_t)((((int64_t)errors[ch] << 3) / DITHER_PERIODS));
+			max_mean_error = MAX(max_mean_error, ABS(error));
+			TEST_CHECK(ABS(error) <= 1);
+		}
+	}
+
+	printf("dithering over %u periods: largest cumulative error %d/8 ticks, largest mean error %d/64 ticks\n", 
+		   (unsigned int)DITHER_PERIODS, (int)max_error, (int)max_mean_error);
+}
+
+
+
+
+/* End of file */
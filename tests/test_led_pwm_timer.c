@@ -0,0 +1,277 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* 
+	ATTENTION: 
+	Test of the timer PWM backend (led_pwm_timer.c) on the cycle model of stub_nrf_pwm.c. 
+	Output high times are measured for every period while frames are written with random 
+	driver and interrupt latencies: a committed frame must be output exactly, a period being 
+	updated must never be brighter than both the old and the new duty (an output inverted by 
+	unbalanced edges would be) and dithered fractional ticks must give their mean output. 
+	SoftDevice preemptions are not masked while a channel is committed: a period may be brighter 
+	only if a commit sequence was preempted for a long time, and the output must be exact by the 
+	end of the frame. 
+*/
+
+
+/* ---------------- Inclusions --------------------- */
+#include <stdint.h>
+#include <stdbool.h>
+#include "nordic_common.h"
+
+#include "led_pwm.h"
+#include "stub_nrf_pwm.h"
+#include "test.h"
+
+
+
+
+/* ---------------- Local defines --------------------- */   
+
+/* Number of random frames */
+#define RANDOM_FRAMES								3000
+
+/* Number of periods measured after each random frame */
+#define PERIODS_PER_FRAME							6
+
+/* Number of random frames written with long preemptions at almost every access */
+#define DEFERRED_FRAMES							200
+
+/* Number of periods of the dithering test */
+#define DITHER_PERIODS								8000
+
+
+
+
+/* ---------------- Local variables --------------------- */   
+
+/* Output pin of each channel */
+static const uint8_t channel_pins[NUM_OF_LIGHT_CHANNELS] = {PWM_CH_R, PWM_CH_G, PWM_CH_B, PWM_CH_W};
+
+
+
+
+/* ------------- Local functions prototypes --------------- */
+
+static void frame_output_check		(const uint16_t *);
+static void random_frames_test		(void);
+static void dither_mean_test			(void);
+
+
+
+
+/* ------------- Exported functions implementations --------------- */
+
+/* Test entry point */
+int main(void)
+{
+	uint16_t frame[NUM_OF_LIGHT_CHANNELS] = {0};
+
+	test_srand(1);
+	led_pwm_init();
+	TEST_CHECK(led_pwm_period_ticks_get() == 512);
+
+	/* outputs start low */
+	stub_pwm_run_periods(3);
+	frame_output_check(frame);
+
+	/* constant and running outputs without latencies */
+	frame[RED_CHANNEL] = 100 << PWM_TICKS_FRAC_BITS;
+	frame[GREEN_CHANNEL] = 0;
+	frame[BLUE_CHANNEL] = 511 << PWM_TICKS_FRAC_BITS;
+	frame[WHITE_CHANNEL] = 512 << PWM_TICKS_FRAC_BITS;
+	led_pwm_frame_set(frame);
+	stub_pwm_run_periods(3);
+	frame_output_check(frame);
+
+	frame[RED_CHANNEL] = 1 << PWM_TICKS_FRAC_BITS;
+	frame[GREEN_CHANNEL] = 256 << PWM_TICKS_FRAC_BITS;
+	frame[BLUE_CHANNEL] = 0;
+	frame[WHITE_CHANNEL] = 300 << PWM_TICKS_FRAC_BITS;
+	led_pwm_frame_set(frame);
+	stub_pwm_run_periods(3);
+	frame_output_check(frame);
+
+	/* random frames with a SoftDevice like latency: a few us at every access and up to 
+	   800 us twice in a thousand */
+	stub_pwm_latency_set(3, 2, 800);
+	random_frames_test();
+
+	/* commits preempted at almost every access are deferred to the TIMER interrupt, then the 
+	   last frame is output exactly */
+	stub_pwm_latency_set(3, 500, 800);
+	for(uint32_t i=0; i<DEFERRED_FRAMES; i++)
+	{
+		for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+		{
+			frame[ch] = (uint16_t)((1 + (test_rand() % 511)) << PWM_TICKS_FRAC_BITS);
+		}
+		stub_pwm_run(test_rand() % 512);
+		led_pwm_frame_set(frame);
+		stub_pwm_run_periods(2);
+	}
+	stub_pwm_latency_set(3, 0, 0);
+	stub_pwm_run_periods(PERIODS_PER_FRAME);
+	frame_output_check(frame);
+
+	/* dithering with short latencies */
+	stub_pwm_latency_set(3, 0, 0);
+	dither_mean_test();
+
+	/* fractional ticks too close to the period end are rounded */
+	frame[RED_CHANNEL] = 4079;
+	frame[GREEN_CHANNEL] = 4077;
+	frame[BLUE_CHANNEL] = 4;
+	frame[WHITE_CHANNEL] = 11;
+	led_pwm_frame_set(frame);
+	stub_pwm_run_periods(PERIODS_PER_FRAME);
+	TEST_CHECK(stub_pwm_high_ticks_get(PWM_CH_R) == 510);
+	TEST_CHECK(stub_pwm_high_ticks_get(PWM_CH_G) == 510);
+	TEST_CHECK(stub_pwm_high_ticks_get(PWM_CH_B) == 1);
+	TEST_CHECK(stub_pwm_high_ticks_get(PWM_CH_W) == 1);
+
+	return test_end("test_led_pwm_timer");
+}
+
+
+
+
+/* ------------- Local functions implementation --------------- */
+
+/* Function to check that the last period outputs a frame of integer ticks */
+static void frame_output_check(const uint16_t *p_frame)
+{
+	for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+	{
+		TEST_CHECK(stub_pwm_high_ticks_get(channel_pins[ch]) == (p_frame[ch] >> PWM_TICKS_FRAC_BITS));
+	}
+}
+
+
+/* Function to write random frames and check every period after them */
+static void random_frames_test(void)
+{
+	uint16_t frame[NUM_OF_LIGHT_CHANNELS] = {0};
+	uint16_t prev_ticks[NUM_OF_LIGHT_CHANNELS] = {0};
+	uint16_t ticks;
+	uint16_t high;
+	uint32_t preemptions;
+	uint32_t glitches = 0;
+
+	led_pwm_frame_set(frame);
+	stub_pwm_run_periods(PERIODS_PER_FRAME);
+
+	for(uint32_t i=0; i<RANDOM_FRAMES; i++)
+	{
+		for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+		{
+			/* constant outputs once in eight */
+			switch(test_rand() % 16)
+			{
+				case 0:
+					ticks = 0;
+					break;
+				case 1:
+					ticks = 512;
+					break;
+				default:
+					ticks = (uint16_t)(1 + (test_rand() % 511));
+					break;
+			}
+			prev_ticks[ch] = (uint16_t)(frame[ch] >> PWM_TICKS_FRAC_BITS);
+			frame[ch] = (uint16_t)(ticks << PWM_TICKS_FRAC_BITS);
+		}
+
+		/* write the frame at a random point of the period */
+		stub_pwm_run(test_rand() % 512);
+		preemptions = stub_pwm_critical_preemptions_get();
+		led_pwm_frame_set(frame);
+
+		for(uint32_t p=0; p<PERIODS_PER_FRAME; p++)
+		{
+			stub_pwm_run_periods(1);
+			for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+			{
+				high = stub_pwm_high_ticks_get(channel_pins[ch]);
+				if(high > MAX(prev_ticks[ch], (frame[ch] >> PWM_TICKS_FRAC_BITS)))
+				{
+					glitches++;
+				}
+				else
+				{
+					/* not brighter than both duties */
+				}
+				TEST_CHECK((high <= MAX(prev_ticks[ch], (frame[ch] >> PWM_TICKS_FRAC_BITS)))
+						|| (stub_pwm_critical_preemptions_get() != preemptions));
+			}
+		}
+
+		/* the frame is output exactly once committed */
+		frame_output_check(frame);
+	}
+
+	printf("random frames: %u commit sequences preempted for long, %u brighter periods\n", 
+		   (unsigned int)stub_pwm_critical_preemptions_get(), (unsigned int)glitches);
+	TEST_CHECK(led_pwm_dropped_frames_get() == 0);
+}
+
+
+/* Function to check the long-run mean output of dithered fractional ticks */
+static void dither_mean_test(void)
+{
+	/* fractional ticks: 2.125, 100.375, 255.5 and 470.875 */
+	const uint16_t frame[NUM_OF_LIGHT_CHANNELS] = {17, 803, 2044, 3767};
+	uint32_t sums[NUM_OF_LIGHT_CHANNELS] = {0};
+	uint16_t high;
+
+	led_pwm_frame_set(frame);
+	stub_pwm_run_periods(PERIODS_PER_FRAME);
+
+	for(uint32_t p=0; p<DITHER_PERIODS; p++)
+	{
+		stub_pwm_run_periods(1);
+		for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+		{
+			high = stub_pwm_high_ticks_get(channel_pins[ch]);
+
+			/* output moves by one tick around the rounded value */
+			TEST_CHECK((high == (frame[ch] >> PWM_TICKS_FRAC_BITS)) || (high == ((frame[ch] >> PWM_TICKS_FRAC_BITS) + 1)));
+			sums[ch] += high;
+		}
+	}
+
+	/* mean output in fractional ticks is within 1/64 of tick */
+	for(uint8_t ch=0; ch<NUM_OF_LIGHT_CHANNELS; ch++)
+	{
+		int32_t mean_error = (int32_t)((((uint64_t)sums[ch] << (PWM_TICKS_FRAC_BITS + 3)) / DITHER_PERIODS)) - ((int32_t)frame[ch] << 3);
+
+		printf("channel %u: %u/8 ticks, mean %.4f ticks\n", ch, frame[ch], (double)sums[ch] / DITHER_PERIODS);
+		TEST_CHECK((mean_error >= -1) && (mean_error <= 1));
+	}
+}
+
+
+
+
+/* End of file */
@@ -0,0 +1,651 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* 
+	ATTENTION: 
+	Test of the fade engine of the light module (led_strip.c) with the real scheduler, virtual 
+	timers and easing curves, on the app_timer stub and the mock PWM backend. Lightness levels of 
+	every fade tick of the linear curve are compared with an ideal linear reference computed from 
+	the simulated time, from the start level to the target one in the duration given by the 
+	stored fade percentage, so truncated steps or a jump at the last tick are detected. Levels 
+	are checked on the PWM ticks they are actuated with, through the CIE table. Ramps are 
+	repeated with fade ticks delayed and merged as by radio activity: positions follow the 
+	elapsed RTC time, so they stay on the reference and ramps end on time. A burst of commands 
+	retargeting a running fade is sampled every millisecond: steps and step variations stay 
+	bounded along the S-curve, so the output is continuous in value and first derivative. A ramp 
+	started while fade ticks of a running fade are held must start from the fade position at 
+	that time, not from the one of the last fade tick. Turning the light off during a fade must 
+	stop it: the channels stay off and the fade timer does not wake up anymore. Fade 
+	percentages are published to the light module as CONFIG writes are, through its config 
+	observer. A day of command traffic on random curves counts the fade timer wakeups, which 
+	happen only during transitions. 
+*/
+
+
+/* ---------------- Inclusions --------------------- */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "nordic_common.h"
+
+#include "led_strip.h"
+#include "scheduler.h"
+#include "vtimer.h"
+#include "easing.h"
+#include "memory.h"
+#include "led_pwm.h"
+#include "led_pwm_mock.h"
+#include "stub_app_timer.h"
+#include "stub_memory_config.h"
+#include "stub_light_state.h"
+#include "test.h"
+#include "cie_table.h"
+
+
+
+
+/* ---------------- Local defines --------------------- */   
+
+/* app_timer operations queue size */
+#define TEST_OP_QUEUE_SIZE							4
+
+/* Macro to convert ms to RTC ticks as the light module does */
+#define TEST_MS_TO_RTC_TICKS(ms)					((uint32_t)(((uint64_t)(ms) * 1000000) / 30517))
+
+/* Fade tick period in RTC ticks */
+#define TEST_FADE_TICK_TICKS						TEST_MS_TO_RTC_TICKS(20)
+
+/* Largest delay of a virtual timer expiry in RTC ticks: one wheel tick of 32 RTC ticks lost 
+   to rounding and one more to arm the RTC compare in time */
+#define TEST_VTIMER_LATE_TICKS					64
+
+/* Config fade percentage position */
+#define TEST_FADE_POS								0
+
+/* Fade tick delays: up to 5 ms, and up to 60 ms (merging fade ticks) 20 times in a thousand */
+#define TEST_JITTER_SHORT_TICKS					TEST_MS_TO_RTC_TICKS(5)
+#define TEST_JITTER_LONG_PER_MILLE				20
+#define TEST_JITTER_LONG_TICKS					TEST_MS_TO_RTC_TICKS(60)
+
+/* Stored fade percentage of the fade interrupted by a ramp (200 ms) and time of the ramp start 
+   from the fade start in ms: fade ticks are held after the first one */
+#define TEST_RAMP_FADE_PERCENT					10
+#define TEST_RAMP_START_MS						80
+
+/* Number of commands of a burst and their stored fade percentage (400 ms) */
+#define TEST_BURST_COMMANDS						10
+#define TEST_BURST_FADE_PERCENT					5
+
+/* Sampling period of the burst test in RTC ticks (0.977 ms) and number of samples */
+#define TEST_BURST_SAMPLE_TICKS					32
+#define TEST_BURST_SAMPLES							3000
+
+/* Largest output step between samples of the burst test in PWM ticks: a linear ramp over the 
+   full range in the fade duration moves about 10 levels per sample and a damped retarget about 
+   twice as much, the steepest part of the CIE curve giving about 6 PWM ticks per level */
+#define TEST_BURST_MAX_STEP						128
+
+/* Largest variation of the output step between samples of the burst test in PWM ticks: a 
+   critically damped channel accelerates up to about 1.5 levels per sample squared over the full 
+   range, i.e. 9 PWM ticks, 2 more ticks come from rounding outputs to PWM ticks */
+#define TEST_BURST_MAX_STEP_CHANGE				12
+
+/* RTC ticks of a day */
+#define TEST_DAY_TICKS								((uint32_t)24 * 3600 * 32768)
+
+/* Number of light commands in a day */
+#define TEST_DAY_COMMANDS							300
+
+/* Minimum time between light commands in RTC ticks, so each transition ends before the next */
+#define TEST_DAY_COMMAND_GAP						TEST_MS_TO_RTC_TICKS(4000)
+
+/* Fade timer wakeups of a day with a fade timer always running at 20 ms */
+#define TEST_DAY_ALWAYS_ON_WAKEUPS				((uint32_t)24 * 3600 * 50)
+
+/* Number of light channels */
+#define TEST_CHANNELS								4
+
+/* Maximum lightness level */
+#define TEST_LEVEL_MAX								((1 << CIE_TABLE_LEVEL_BITS) - 1)
+
+/* Macro to convert a PWM percentage to a lightness level as the light module does */
+#define TEST_PERCENT_TO_LEVEL(x)					((int32_t)((((uint32_t)(x) * TEST_LEVEL_MAX) + 50) / 100))
+
+
+
+
+/* ---------------- Local typedefs --------------------- */   
+
+/* Ramp test case structure */
+typedef struct
+{
+	uint8_t start;						/* start duty cycle of all channels */
+	uint8_t target[TEST_CHANNELS];	/* target duty cycles */
+	uint8_t fade_percent;			/* stored fade percentage */
+} ramp_case_st;
+
+
+
+
+/* ---------------- Local variables --------------------- */   
+
+/* Ramp cases: full range, small deltas that truncated to zero steps and mixed directions */
+static const ramp_case_st ramp_cases[] =
+{
+	{0, 	{100, 100, 100, 100}, 	10},
+	{100, 	{0, 1, 2, 3}, 			5},
+	{10, 	{13, 11, 9, 7}, 		1},
+	{50, 	{49, 51, 50, 80}, 		2},
+	{3, 	{97, 2, 3, 51}, 		1},
+	{0, 	{1, 2, 3, 4}, 			60},
+};
+
+/* Reference ramp checked at each fade tick, in lightness levels and RTC ticks */
+static bool ref_active = false;
+static int32_t ref_start[TEST_CHANNELS];
+static int32_t ref_target[TEST_CHANNELS];
+static uint32_t ref_start_ticks;
+static uint32_t ref_duration_ticks;
+
+/* RTC ticks of the first output on the reference targets */
+static bool ref_ended = false;
+static uint32_t ref_end_ticks;
+
+/* Frames already checked */
+static uint32_t checked_frames = 0;
+
+/* Largest PWM ticks error from the reference */
+static int32_t ref_max_error = 0;
+
+/* Largest delay of fade ticks in RTC ticks */
+static uint32_t jitter_max_ticks = 0;
+
+
+
+
+/* ------------- Local functions prototypes --------------- */
+
+static void main_loop					(void);
+static void fade_percent_set				(uint8_t);
+static void duties_set					(uint8_t);
+static uint16_t level_ticks_get			(int32_t);
+static uint16_t output_ticks_get			(uint8_t);
+static bool level_is_output			(uint8_t, int32_t);
+static int32_t ref_level_get			(uint8_t, uint32_t);
+static void ramp_test					(const ramp_case_st *);
+static void burst_test					(void);
+static void ramp_start_test				(void);
+static void turn_off_test				(void);
+static void default_fade_test			(void);
+static void day_wakeups_test			(void);
+
+
+
+
+/* ------------- Exported functions implementations --------------- */
+
+/* Test entry point */
+int main(void)
+{
+	stub_app_timer_init(TEST_OP_QUEUE_SIZE);
+	vtimer_init();
+	led_light_init();
+
+	/* linear ramps against the reference */
+	for(uint8_t i=0; i<(sizeof(ramp_cases) / sizeof(ramp_cases[0])); i++)
+	{
+		ramp_test(&ramp_cases[i]);
+	}
+	printf("largest error from linear reference: %d PWM ticks\n", (int)ref_max_error);
+
+	/* same ramps with a jittered clock */
+	stub_app_timer_jitter_set(TEST_JITTER_SHORT_TICKS, TEST_JITTER_LONG_PER_MILLE, TEST_JITTER_LONG_TICKS);
+	jitter_max_ticks = TEST_JITTER_LONG_TICKS;
+	ref_max_error = 0;
+	for(uint8_t i=0; i<(sizeof(ramp_cases) / sizeof(ramp_cases[0])); i++)
+	{
+		ramp_test(&ramp_cases[i]);
+	}
+	printf("largest error from linear reference with jitter: %d PWM ticks\n", (int)ref_max_error);
+	stub_app_timer_jitter_set(0, 0, 0);
+	jitter_max_ticks = 0;
+
+	/* burst of commands retargeting a running fade */
+	burst_test();
+
+	/* ramp started while fade ticks are held */
+	ramp_start_test();
+
+	/* light turned off during a fade */
+	turn_off_test();
+
+	/* stored fade percentage, a fade of 0 is immediate */
+	default_fade_test();
+
+	/* wakeups of a day of command traffic */
+	day_wakeups_test();
+
+	return test_end("test_led_strip");
+}
+
+
+
+
+/* ------------- Local functions implementation --------------- */
+
+/* Main loop function: it runs the scheduled tasks, as the application main loop does, and 
+   checks the PWM ticks of each new frame against the reference ramp at the current time, if 
+   any. Ticks must be those of the reference level within one level. Wheel ticks of other 
+   virtual timers run the main loop too, with no new frame to check */
+static void main_loop(void)
+{
+	uint32_t elapsed_ticks = stub_app_timer_now_get() - ref_start_ticks;
+	int32_t ticks;
+	int32_t ref_level;
+	int32_t error;
+	bool on_targets = true;
+
+	sched_execute();
+
+	if((true == ref_active)
+	&& (led_pwm_mock_frames_get() != checked_frames))
+	{
+		checked_frames = led_pwm_mock_frames_get();
+		for(uint8_t ch=0; ch<TEST_CHANNELS; ch++)
+		{
+			ticks = (int32_t)output_ticks_get(ch);
+			ref_level = ref_level_get(ch, elapsed_ticks);
+			error = ticks - (int32_t)level_ticks_get(ref_level);
+			error = (error < 0) ? -error : error;
+			ref_max_error = MAX(ref_max_error, error);
+			TEST_CHECK(ticks >= level_ticks_get(ref_level - 1));
+			TEST_CHECK(ticks <= level_ticks_get(ref_level + 1));
+
+			if(false == level_is_output(ch, ref_target[ch]))
+			{
+				on_targets = false;
+			}
+		}
+
+		if((true == on_targets)
+		&& (false == ref_ended))
+		{
+			ref_end_ticks = stub_app_timer_now_get();
+			ref_ended = true;
+		}
+	}
+	else
+	{
+		/* nothing to check */
+	}
+}
+
+
+/* Function to publish the given fade percentage. It is used from the next light request */
+static void fade_percent_set(uint8_t fade_percent)
+{
+	uint8_t config_values[MEM_BUFFER_DATA_LENGTH] = {0};
+
+	config_values[TEST_FADE_POS] = fade_percent;
+	stub_memory_config_set(config_values);
+}
+
+
+/* Function to set all channels to a duty cycle at once */
+static void duties_set(uint8_t duty)
+{
+	fade_percent_set(0);
+	led_update_light(duty, duty, duty, duty, EASING_CURVE_LINEAR);
+	stub_app_timer_run((TEST_FADE_TICK_TICKS * 2) + jitter_max_ticks, main_loop);
+	for(uint8_t ch=0; ch<TEST_CHANNELS; ch++)
+	{
+		TEST_CHECK(true == level_is_output(ch, TEST_PERCENT_TO_LEVEL(duty)));
+	}
+}
+
+
+/* Function to get the PWM ticks of a lightness level as the light module does, rounded to the 
+   nearest tick as by a backend without dithering. Levels out of range are limited */
+static uint16_t level_ticks_get(int32_t level)
+{
+	uint32_t frac_ticks;
+
+	level = MIN(MAX(level, 0), TEST_LEVEL_MAX);
+	frac_ticks = (((uint32_t)cie_table[level] * LED_PWM_MOCK_PERIOD_TICKS) 
+				  + ((uint32_t)1 << (15 - PWM_TICKS_FRAC_BITS))) >> (16 - PWM_TICKS_FRAC_BITS);
+
+	return (uint16_t)((frac_ticks + ((uint32_t)1 << (PWM_TICKS_FRAC_BITS - 1))) >> PWM_TICKS_FRAC_BITS);
+}
+
+
+/* Function to get the PWM ticks output by a channel, rounded to the nearest tick as by a backend 
+   without dithering */
+static uint16_t output_ticks_get(uint8_t ch)
+{
+	uint32_t frac_ticks = led_pwm_mock_ticks_get(ch);
+
+	return (uint16_t)((frac_ticks + ((uint32_t)1 << (PWM_TICKS_FRAC_BITS - 1))) >> PWM_TICKS_FRAC_BITS);
+}
+
+
+/* Function to get if a channel outputs the PWM ticks of a lightness level */
+static bool level_is_output(uint8_t ch, int32_t level)
+{
+	return (output_ticks_get(ch) == level_ticks_get(level));
+}
+
+
+/* Function to get the reference level of a channel at the given RTC ticks from the ramp start: 
+   linear from the start level to the target one in the ramp duration */
+static int32_t ref_level_get(uint8_t ch, uint32_t ticks)
+{
+	uint32_t elapsed = MIN(ticks, ref_duration_ticks);
+	double delta = (double)ref_target[ch] - (double)ref_start[ch];
+
+	return (int32_t)((double)ref_start[ch] + ((delta * elapsed) / ref_duration_ticks) + 0.5);
+}
+
+
+/* Function to run a ramp and check every fade tick: it follows the reference and it lands on 
+   the target at the ramp end, without a jump at the last tick and no later than the first fade 
+   tick after the ramp end */
+static void ramp_test(const ramp_case_st *p_case)
+{
+	uint32_t commits;
+
+	duties_set(p_case->start);
+	fade_percent_set(p_case->fade_percent);
+
+	for(uint8_t ch=0; ch<TEST_CHANNELS; ch++)
+	{
+		ref_start[ch] = TEST_PERCENT_TO_LEVEL(p_case->start);
+		ref_target[ch] = TEST_PERCENT_TO_LEVEL(p_case->target[ch]);
+	}
+	ref_duration_ticks = TEST_MS_TO_RTC_TICKS(20 * ((100 + p_case->fade_percent - 1) / p_case->fade_percent));
+	ref_start_ticks = stub_app_timer_now_get();
+	checked_frames = led_pwm_mock_frames_get();
+	commits = stub_light_state_commits_get();
+	ref_ended = false;
+	ref_active = true;
+
+	led_update_light(p_case->target[0], p_case->target[1], p_case->target[2], p_case->target[3], 
+					 EASING_CURVE_LINEAR);
+	stub_app_timer_run(ref_duration_ticks + (TEST_FADE_TICK_TICKS * 2) + jitter_max_ticks, main_loop);
+	ref_active = false;
+
+	/* target reached on time and stored once */
+	TEST_CHECK(true == ref_ended);
+	TEST_CHECK((ref_end_ticks - ref_start_ticks) <= (ref_duration_ticks + TEST_FADE_TICK_TICKS + jitter_max_ticks));
+	TEST_CHECK((stub_light_state_commits_get() - commits) == 1);
+	for(uint8_t ch=0; ch<TEST_CHANNELS; ch++)
+	{
+		TEST_CHECK(true == level_is_output(ch, ref_target[ch]));
+	}
+}
+
+
+/* Function to replay a burst of commands at random intervals of 60 - 120 ms, as a controller 
+   gesture does, and to sample the output every millisecond. The first command starts from rest, 
+   the next ones retarget the running fade */
+static void burst_test(void)
+{
+	uint8_t targets[TEST_CHANNELS];
+	int32_t outputs[TEST_CHANNELS];
+	int32_t steps[TEST_CHANNELS];
+	int32_t step;
+	int32_t step_change;
+	int32_t max_step = 0;
+	int32_t max_step_change = 0;
+	uint32_t next_command_ticks;
+	uint8_t commands = 0;
+
+	duties_set(25);
+	fade_percent_set(TEST_BURST_FADE_PERCENT);
+	next_command_ticks = stub_app_timer_now_get();
+	for(uint8_t ch=0; ch<TEST_CHANNELS; ch++)
+	{
+		outputs[ch] = (int32_t)output_ticks_get(ch);
+		steps[ch] = 0;
+	}
+
+	for(uint32_t i=0; i<TEST_BURST_SAMPLES; i++)
+	{
+		if((commands < TEST_BURST_COMMANDS)
+		&& ((int32_t)(stub_app_timer_now_get() - next_command_ticks) >= 0))
+		{
+			for(uint8_t ch=0; ch<TEST_CHANNELS; ch++)
+			{
+				targets[ch] = (uint8_t)(test_rand() % 101);
+			}
+			led_update_light(targets[0], targets[1], targets[2], targets[3], EASING_CURVE_IN_OUT);
+			next_command_ticks += TEST_MS_TO_RTC_TICKS(60 + (test_rand() % 61));
+			commands++;
+		}
+		else
+		{
+			/* no command now */
+		}
+
+		/* sample the output at the current time */
+		stub_app_timer_run(TEST_BURST_SAMPLE_TICKS, main_loop);
+		led_manage_light();
+
+		for(uint8_t ch=0; ch<TEST_CHANNELS; ch++)
+		{
+			step = (int32_t)output_ticks_get(ch) - outputs[ch];
+			step_change = step - steps[ch];
+			outputs[ch] += step;
+			steps[ch] = step;
+
+			step = (step < 0) ? -step : step;
+			step_change = (step_change < 0) ? -step_change : step_change;
+			max_step = MAX(max_step, step);
+			max_step_change = MAX(max_step_change, step_change);
+			TEST_CHECK(step <= TEST_BURST_MAX_STEP);
+			TEST_CHECK(step_change <= TEST_BURST_MAX_STEP_CHANGE);
+		}
+	}
+	printf("burst of %u commands: largest step %d PWM ticks, largest step variation %d PWM ticks\n", 
+		   (unsigned int)commands, (int)max_step, (int)max_step_change);
+
+	/* last targets reached */
+	for(uint8_t ch=0; ch<TEST_CHANNELS; ch++)
+	{
+		TEST_CHECK(true == level_is_output(ch, TEST_PERCENT_TO_LEVEL(targets[ch])));
+	}
+}
+
+
+/* Function to start a ramp of zero rates while a linear fade is running and its fade ticks are 
+   held, as by radio activity: channels must hold the fade position at the ramp start */
+static void ramp_start_test(void)
+{
+	uint32_t ramp_ticks;
+	int32_t level;
+
+	duties_set(0);
+	fade_percent_set(TEST_RAMP_FADE_PERCENT);
+	for(uint8_t ch=0; ch<TEST_CHANNELS; ch++)
+	{
+		ref_start[ch] = 0;
+		ref_target[ch] = TEST_LEVEL_MAX;
+	}
+	ref_duration_ticks = TEST_MS_TO_RTC_TICKS(20 * (100 / TEST_RAMP_FADE_PERCENT));
+	ref_start_ticks = stub_app_timer_now_get();
+
+	/* first fade tick runs, the next ones are held */
+	led_update_light(100, 100, 100, 100, EASING_CURVE_LINEAR);
+	stub_app_timer_run(TEST_FADE_TICK_TICKS, main_loop);
+	stub_app_timer_run(TEST_MS_TO_RTC_TICKS(TEST_RAMP_START_MS) - TEST_FADE_TICK_TICKS, NULL);
+
+	ramp_ticks = stub_app_timer_now_get() - ref_start_ticks;
+	led_ramp_start(0, 0, 0, 0, 1000);
+	stub_app_timer_run(TEST_FADE_TICK_TICKS * 2, main_loop);
+
+	for(uint8_t ch=0; ch<TEST_CHANNELS; ch++)
+	{
+		level = ref_level_get(ch, ramp_ticks);
+		TEST_CHECK(output_ticks_get(ch) >= level_ticks_get(level - 1));
+		TEST_CHECK(output_ticks_get(ch) <= level_ticks_get(level + 1));
+	}
+
+	led_ramp_stop();
+	stub_app_timer_run(TEST_FADE_TICK_TICKS * 2, main_loop);
+}
+
+
+/* Function to turn the light off during a fade to full level: channels must stay off, the off 
+   state must be stored once and the fade timer must not wake up anymore */
+static void turn_off_test(void)
+{
+	uint32_t commits;
+	uint32_t wakeups;
+
+	duties_set(0);
+	fade_percent_set(TEST_RAMP_FADE_PERCENT);
+	led_update_light(100, 100, 100, 100, EASING_CURVE_LINEAR);
+	stub_app_timer_run(TEST_FADE_TICK_TICKS * 3, main_loop);
+
+	commits = stub_light_state_commits_get();
+	led_turn_off();
+	wakeups = led_fade_wakeups_get();
+	stub_app_timer_run(TEST_MS_TO_RTC_TICKS(20 * (100 / TEST_RAMP_FADE_PERCENT)), main_loop);
+
+	for(uint8_t ch=0; ch<TEST_CHANNELS; ch++)
+	{
+		TEST_CHECK(true == level_is_output(ch, 0));
+	}
+	TEST_CHECK((stub_light_state_commits_get() - commits) == 1);
+	TEST_CHECK(led_fade_wakeups_get() == wakeups);
+}
+
+
+/* Function to check the stored fade percentage */
+static void default_fade_test(void)
+{
+	/* a stored fade of 0 is an immediate change, at first fade tick */
+	duties_set(0);
+	fade_percent_set(0);
+	led_update_light(50, 100, 0, 1, EASING_CURVE_LINEAR);
+	stub_app_timer_run(TEST_FADE_TICK_TICKS + TEST_VTIMER_LATE_TICKS, main_loop);
+	TEST_CHECK(true == level_is_output(0, 2048));
+	TEST_CHECK(true == level_is_output(1, 4095));
+	TEST_CHECK(true == level_is_output(2, 0));
+	TEST_CHECK(true == level_is_output(3, 41));
+
+	/* a stored fade of 100% is one fade step: a running fade retargeted between two fade ticks 
+	   is not on the new target at the next one, as it would be with an immediate change */
+	duties_set(0);
+	fade_percent_set(3);
+	led_update_light(100, 100, 100, 100, EASING_CURVE_LINEAR);
+	stub_app_timer_run((TEST_FADE_TICK_TICKS * 5) / 2, main_loop);
+	fade_percent_set(100);
+	led_update_light(0, 0, 0, 0, EASING_CURVE_LINEAR);
+	stub_app_timer_run((TEST_FADE_TICK_TICKS / 2) + TEST_VTIMER_LATE_TICKS, main_loop);
+	TEST_CHECK(false == level_is_output(0, 0));
+	stub_app_timer_run(TEST_MS_TO_RTC_TICKS(200), main_loop);
+	TEST_CHECK(true == level_is_output(0, 0));
+
+	/* a stored fade of more than 100% is immediate too */
+	duties_set(0);
+	fade_percent_set(150);
+	led_update_light(100, 100, 100, 100, EASING_CURVE_LINEAR);
+	stub_app_timer_run(TEST_FADE_TICK_TICKS + TEST_VTIMER_LATE_TICKS, main_loop);
+	TEST_CHECK(true == level_is_output(0, 4095));
+
+	/* 3% of each fade tick: 34 fade steps of 20 ms, i.e. 680 ms */
+	duties_set(0);
+	fade_percent_set(3);
+	led_update_light(100, 100, 100, 100, EASING_CURVE_LINEAR);
+	stub_app_timer_run(TEST_MS_TO_RTC_TICKS(680) - TEST_FADE_TICK_TICKS, main_loop);
+	TEST_CHECK(false == level_is_output(0, 4095));
+	stub_app_timer_run(TEST_FADE_TICK_TICKS * 2, main_loop);
+	TEST_CHECK(true == level_is_output(0, 4095));
+}
+
+
+/* Function to simulate a day of light commands at random times, with random levels and stored 
+   fades up to 2 s, and to count fade timer wakeups. A transition costs one wakeup per fade tick 
+   plus the last one stopping the timer, a static light costs none */
+static void day_wakeups_test(void)
+{
+	uint32_t start_ticks = stub_app_timer_now_get();
+	uint32_t start_wakeups = led_fade_wakeups_get();
+	uint32_t start_irqs = stub_app_timer_irqs_get();
+	uint32_t command_ticks[TEST_DAY_COMMANDS];
+	uint32_t max_wakeups = 0;
+	uint8_t fade_percent;
+	uint32_t wakeups;
+	uint32_t irqs;
+	uint32_t temp;
+
+	/* sorted random command times, then spaced by the minimum gap */
+	for(uint32_t i=0; i<TEST_DAY_COMMANDS; i++)
+	{
+		command_ticks[i] = test_rand() % (TEST_DAY_TICKS - (TEST_DAY_COMMANDS * TEST_DAY_COMMAND_GAP));
+	}
+	for(uint32_t i=1; i<TEST_DAY_COMMANDS; i++)
+	{
+		for(uint32_t j=i; (j > 0) && (command_ticks[j - 1] > command_ticks[j]); j--)
+		{
+			temp = command_ticks[j];
+			command_ticks[j] = command_ticks[j - 1];
+			command_ticks[j - 1] = temp;
+		}
+	}
+
+	for(uint32_t i=0; i<TEST_DAY_COMMANDS; i++)
+	{
+		stub_app_timer_run((start_ticks + command_ticks[i] + (i * TEST_DAY_COMMAND_GAP)) - stub_app_timer_now_get(), main_loop);
+
+		/* a new fade percentage is published while the light is static */
+		fade_percent = (uint8_t)(1 + (test_rand() % 20));
+		fade_percent_set(fade_percent);
+		max_wakeups += ((100 + fade_percent - 1) / fade_percent) + 1;
+		led_update_light((uint8_t)(test_rand() % 101), (uint8_t)(test_rand() % 101), 
+						 (uint8_t)(test_rand() % 101), (uint8_t)(test_rand() % 101), 
+						 (uint8_t)(test_rand() % NUM_OF_EASING_CURVES));
+	}
+	stub_app_timer_run((start_ticks + TEST_DAY_TICKS) - stub_app_timer_now_get(), main_loop);
+
+	wakeups = led_fade_wakeups_get() - start_wakeups;
+	irqs = stub_app_timer_irqs_get() - start_irqs;
+	printf("day of traffic: %u commands, %u fade timer wakeups, %u RTC interrupts (%u with a fade timer always running)\n", 
+		   TEST_DAY_COMMANDS, (unsigned int)wakeups, (unsigned int)irqs, (unsigned int)TEST_DAY_ALWAYS_ON_WAKEUPS);
+	TEST_CHECK(wakeups <= max_wakeups);
+	TEST_CHECK(irqs <= max_wakeups);
+
+	/* timers started by timeout handlers take one rearm at most: a single start */
+	TEST_CHECK(stub_app_timer_queued_ops_hwm_get() <= 1);
+
+	/* a static light does not wake up */
+	stub_app_timer_run(TEST_MS_TO_RTC_TICKS(3600000), main_loop);
+	TEST_CHECK(led_fade_wakeups_get() == (start_wakeups + wakeups));
+	TEST_CHECK(stub_app_timer_irqs_get() == (start_irqs + irqs));
+}
+
+
+
+
+/* End of file */
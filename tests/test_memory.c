@@ -0,0 +1,700 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+
+
+/* 
+	ATTENTION: 
+	Power loss test of the records log of memory.c on the simulated flash of 
+	tests/stub_pstorage.c. Each boot runs in a forked process: the index is built by 
+	memory_restore() and memory_init(), then the presets, whitelist and light state records and 
+	the CONFIG values are written with random data 
+	until the power budget runs out in the middle of a flash operation (a word write or a page 
+	erase). CONFIG values are flushed at random times, as at a disconnection, and once memory 
+	is not busy the flushed ones are durable. At the next boot every record must be read back intact, not 
+	older than its last completed write and not newer than its last requested one. The same is 
+	done with flash operations refused or timed out by the SoftDevice. Page erases per flash 
+	write (records, copies and page headers) are printed. 
+	The upgrade from the first firmware versions is checked first: their values block is 
+	imported as the first config record and then erased, with the power cut at every few words 
+	until it is done, and the imported values must be published at every boot. 
+	Then a CONFIG commit failed by persistent storage must be written again after the flush 
+	debounce, with no further update or flush. 
+*/
+
+
+/* ---------------- Inclusions --------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "sdk_stub.h"
+#include "scheduler.h"
+#include "vtimer.h"
+#include "memory.h"
+
+#include "stub_app_timer.h"
+#include "stub_pstorage.h"
+#include "test.h"
+
+
+
+
+/* ---------------- Local defines --------------------- */   
+
+/* Number of boots without and with faulty flash operations, and with the CONFIG values 
+   written only */
+#define TEST_BOOTS									2000
+#define TEST_FAULTY_BOOTS							1000
+#define TEST_SMALL_BOOTS							500
+
+/* One in TEST_FAULT_RATE flash operations is refused or timed out in faulty boots */
+#define TEST_FAULT_RATE							8
+
+/* Power budget of a boot in programmed words: short budgets cut the power soon after a 
+   boot, long ones once in TEST_LONG_BOOT_RATE boots let pages be collected many times */
+#define TEST_SHORT_BUDGET_WORDS					3000
+#define TEST_LONG_BUDGET_WORDS					30000
+#define TEST_LONG_BOOT_RATE						10
+
+/* Maximum number of steps of a boot */
+#define TEST_BOOT_STEPS							100000
+
+/* Number of app_timer operations queued in an interrupt */
+#define TEST_OP_QUEUE_SIZE							4
+
+/* Time waited by a step with flash idle, in RTC ticks (1 ms) */
+#define TEST_IDLE_TICKS							33
+
+/* One in TEST_FLUSH_RATE steps with flash idle flushes CONFIG values */
+#define TEST_FLUSH_RATE							64
+
+/* Time waited for the CONFIG commit retry, in steps with flash idle (3 s) */
+#define TEST_RETRY_IDLE_STEPS					3000
+
+/* Power budget added at every boot of the upgrade test, in programmed words, and maximum number 
+   of its boots */
+#define TEST_LEGACY_BUDGET_STEP					3
+#define TEST_LEGACY_BOOTS							1000
+
+/* Values block of the first firmware versions: flash address (last persistent storage page), 
+   size, position and value of its signature */
+#define TEST_LEGACY_BLOCK_ADDR					(PSTORAGE_DATA_START_ADDR + ((PSTORAGE_NUM_OF_PAGES - 1) * PSTORAGE_FLASH_PAGE_SIZE))
+#define TEST_LEGACY_BLOCK_SIZE					16
+#define TEST_LEGACY_SIGNATURE_POS				12
+#define TEST_LEGACY_SIGNATURE					0x22224488
+
+/* Number of written records */
+#define TEST_NUM_OF_RECORDS						4
+
+/* Index of the CONFIG values, written by memory_update_field() */
+#define TEST_CONFIG_INDEX							(TEST_NUM_OF_RECORDS - 1)
+
+/* Length of the longest written record */
+#define TEST_MAX_RECORD_LENGTH					516
+
+
+
+
+/* ---------------- Local typedefs --------------------- */   
+
+/* State shared by the boots. A sequence number is written at the start of record data */
+typedef struct
+{
+	uint32_t requested[TEST_NUM_OF_RECORDS];	/* last requested sequence of each record */
+	uint32_t completed[TEST_NUM_OF_RECORDS];	/* last durable sequence of each record */
+	uint32_t writes;								/* completed flash writes */
+	uint32_t erases;								/* completed page erases */
+	uint32_t faults;								/* injected faults */
+} test_shared_st;
+
+
+
+
+/* ---------------- Local variables --------------------- */   
+
+/* Written records: IDs and lengths, as the presets, whitelist, light state and CONFIG ones. 
+   CONFIG values are committed to slots and read back as published by memory init */
+static const uint8_t test_ids[TEST_NUM_OF_RECORDS] = 
+{
+	MEM_RECORD_PRESETS,
+	MEM_RECORD_WHITELIST,
+	MEM_RECORD_LIGHT_STATE,
+	MEM_RECORD_CONFIG_A
+};
+static const uint16_t test_lengths[TEST_NUM_OF_RECORDS] = 
+{
+	516,
+	72,
+	8,
+	MEM_BUFFER_DATA_LENGTH
+};
+
+/* Data of written records. They are read by memory.c when a write starts */
+static uint32_t record_buffers[TEST_NUM_OF_RECORDS][TEST_MAX_RECORD_LENGTH / sizeof(uint32_t)];
+
+/* Default characteristic values */
+static const uint8_t default_values[MEM_BUFFER_DATA_LENGTH] = {0};
+
+/* Characteristic values stored by the first firmware versions */
+static const uint8_t legacy_values[MEM_BUFFER_DATA_LENGTH] = {0x51, 0x0A, 0x1E, 0x02, 0x33, 0xC4, 0x07, 0x90};
+
+/* State shared by the boots */
+static test_shared_st *p_shared;
+
+/* Sequence of flushed CONFIG values, stored once memory is not busy without faults, and 
+   sequence of the last updated ones */
+static uint32_t config_flushed = 0;
+static uint32_t config_updated = 0;
+
+
+
+
+/* ------------- Local functions prototypes --------------- */
+
+static void legacy_test				(void);
+static void legacy_boot_run			(uint32_t);
+static bool legacy_block_is_stored	(void);
+static void config_retry_test		(void);
+static void config_retry_boot_run	(void);
+static void boots_run					(uint32_t, uint32_t, uint32_t, bool);
+static void boot_run					(uint32_t, uint32_t, bool);
+static void records_check				(uint8_t);
+static void records_complete			(void);
+static bool record_get				(uint8_t, uint32_t *);
+static void record_fill				(uint8_t, uint32_t, uint8_t *);
+static void record_write_cb			(uint8_t, uint8_t);
+static void power_loss				(void);
+static void main_loop					(void);
+
+
+
+
+/* ------------- Exported functions implementations --------------- */
+
+/* Test entry point */
+int main(void)
+{
+	stub_pstorage_flash_init();
+	p_shared = mmap(NULL, sizeof(test_shared_st), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	TEST_CHECK(p_shared != MAP_FAILED);
+	memset(p_shared, 0, sizeof(test_shared_st));
+
+	legacy_test();
+	stub_pstorage_flash_erase();
+	memset(p_shared, 0, sizeof(test_shared_st));
+
+	config_retry_test();
+	stub_pstorage_flash_erase();
+	memset(p_shared, 0, sizeof(test_shared_st));
+
+	boots_run(0, TEST_BOOTS, 0, false);
+	printf("power loss: %u boots, %u flash writes, %u page erases (one every %u writes)\n", 
+		   TEST_BOOTS, (unsigned int)p_shared->writes, (unsigned int)p_shared->erases, 
+		   (unsigned int)(p_shared->writes / MAX(p_shared->erases, 1)));
+
+	boots_run(TEST_BOOTS, TEST_FAULTY_BOOTS, TEST_FAULT_RATE, false);
+	printf("power loss with faulty flash operations: %u boots, %u faults\n", 
+		   TEST_FAULTY_BOOTS, (unsigned int)p_shared->faults);
+
+	p_shared->writes = 0;
+	p_shared->erases = 0;
+	boots_run(TEST_BOOTS + TEST_FAULTY_BOOTS, TEST_SMALL_BOOTS, 0, true);
+	printf("power loss with CONFIG writes only: %u flash writes, %u page erases (one every %u writes)\n", 
+		   (unsigned int)p_shared->writes, (unsigned int)p_shared->erases, 
+		   (unsigned int)(p_shared->writes / MAX(p_shared->erases, 1)));
+
+	return test_end("test_memory");
+}
+
+
+
+
+/* ------------- Local functions implementation --------------- */
+
+/* Function to check the upgrade from the first firmware versions: boots with a growing power 
+   budget run until their values block is erased, then values must still be the imported ones */
+static void legacy_test(void)
+{
+	uint8_t block[TEST_LEGACY_BLOCK_SIZE] = {0};
+	uint32_t signature = TEST_LEGACY_SIGNATURE;
+	uint32_t boots = 0;
+	pid_t pid;
+	int status;
+
+	/* values block as stored by the first firmware versions in an erased page */
+	memcpy(block, legacy_values, MEM_BUFFER_DATA_LENGTH);
+	memcpy(&block[TEST_LEGACY_SIGNATURE_POS], &signature, sizeof(signature));
+	memcpy((void *)TEST_LEGACY_BLOCK_ADDR, block, TEST_LEGACY_BLOCK_SIZE);
+	TEST_CHECK(true == legacy_block_is_stored());
+
+	do
+	{
+		fflush(stdout);
+		pid = fork();
+		if(pid == 0)
+		{
+			legacy_boot_run((boots + 1) * TEST_LEGACY_BUDGET_STEP);
+		}
+		else
+		{
+			waitpid(pid, &status, 0);
+			TEST_CHECK(WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+		}
+		boots++;
+	} while((true == legacy_block_is_stored())
+		 && (boots < TEST_LEGACY_BOOTS));
+
+	TEST_CHECK(false == legacy_block_is_stored());
+	printf("upgrade: values block erased after %u boots\n", (unsigned int)boots);
+
+	/* imported values are read from the log */
+	fflush(stdout);
+	pid = fork();
+	if(pid == 0)
+	{
+		legacy_boot_run(0);
+	}
+	else
+	{
+		waitpid(pid, &status, 0);
+		TEST_CHECK(WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+	}
+}
+
+
+/* Function to run a boot of the upgrade test until the power loss, or until memory is idle with 
+   no budget. It never returns */
+static void legacy_boot_run(uint32_t budget)
+{
+	uint8_t values[MEM_BUFFER_DATA_LENGTH];
+
+	stub_pstorage_power_loss_set(budget, (budget != 0) ? power_loss : NULL);
+	stub_pstorage_faults_set(0);
+	stub_app_timer_init(TEST_OP_QUEUE_SIZE);
+	vtimer_init();
+	TEST_CHECK(true == memory_init(default_values, NULL));
+
+	/* imported values are published at every boot */
+	memory_config_get(values);
+	TEST_CHECK(0 == memcmp(values, legacy_values, MEM_BUFFER_DATA_LENGTH));
+
+	/* the main loop writes them */
+	main_loop();
+	for(uint32_t step=0; step<TEST_BOOT_STEPS; step++)
+	{
+		if(true == stub_pstorage_run())
+		{
+			sched_execute();
+		}
+		else
+		{
+			stub_app_timer_run(TEST_IDLE_TICKS, main_loop);
+		}
+	}
+
+	/* no power loss: the block must be erased */
+	TEST_CHECK(false == memory_is_busy());
+	TEST_CHECK(false == legacy_block_is_stored());
+	fflush(stdout);
+	_exit((test_failures_get() == 0) ? 0 : 1);
+}
+
+
+/* Function to know if the values block of the first firmware versions is still stored: its 
+   signature is found and the rest of its page is erased */
+static bool legacy_block_is_stored(void)
+{
+	const uint32_t *p_words = (const uint32_t *)TEST_LEGACY_BLOCK_ADDR;
+	bool is_stored = (p_words[TEST_LEGACY_SIGNATURE_POS / sizeof(uint32_t)] == TEST_LEGACY_SIGNATURE);
+
+	for(uint32_t i=(TEST_LEGACY_BLOCK_SIZE / sizeof(uint32_t)); i<(PSTORAGE_FLASH_PAGE_SIZE / sizeof(uint32_t)); i++)
+	{
+		if(p_words[i] != 0xFFFFFFFF)
+		{
+			is_stored = false;
+		}
+		else
+		{
+			/* do nothing */
+		}
+	}
+
+	return is_stored;
+}
+
+
+/* Function to check that a failed CONFIG commit is written again after the flush debounce: the 
+   values must be read back at the next boot */
+static void config_retry_test(void)
+{
+	uint8_t values[MEM_BUFFER_DATA_LENGTH];
+	pid_t pid;
+	int status;
+
+	fflush(stdout);
+	pid = fork();
+	if(pid == 0)
+	{
+		config_retry_boot_run();
+	}
+	else
+	{
+		waitpid(pid, &status, 0);
+		TEST_CHECK(WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+	}
+
+	fflush(stdout);
+	pid = fork();
+	if(pid == 0)
+	{
+		stub_pstorage_power_loss_set(0, NULL);
+		memory_restore();
+		TEST_CHECK(true == memory_init(default_values, NULL));
+		record_fill(TEST_CONFIG_INDEX, 1, values);
+		memory_config_get((uint8_t *)record_buffers[TEST_CONFIG_INDEX]);
+		TEST_CHECK(0 == memcmp(record_buffers[TEST_CONFIG_INDEX], values, MEM_BUFFER_DATA_LENGTH));
+		fflush(stdout);
+		_exit((test_failures_get() == 0) ? 0 : 1);
+	}
+	else
+	{
+		waitpid(pid, &status, 0);
+		TEST_CHECK(WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+	}
+}
+
+
+/* Function to run the boot of the CONFIG commit retry test: the commit fails at every flash 
+   operation until memory gives up, then flash works again. It never returns */
+static void config_retry_boot_run(void)
+{
+	stub_pstorage_power_loss_set(0, NULL);
+	stub_pstorage_faults_set(1);
+	memory_restore();
+	stub_app_timer_init(TEST_OP_QUEUE_SIZE);
+	vtimer_init();
+	TEST_CHECK(true == memory_init(default_values, NULL));
+
+	/* every flash operation of the commit fails */
+	record_fill(TEST_CONFIG_INDEX, 1, (uint8_t *)record_buffers[TEST_CONFIG_INDEX]);
+	TEST_CHECK(true == memory_update_field(0, (uint8_t *)record_buffers[TEST_CONFIG_INDEX], MEM_BUFFER_DATA_LENGTH));
+	TEST_CHECK(true == memory_flush());
+	while(true == memory_is_busy())
+	{
+		if(true == stub_pstorage_run())
+		{
+			sched_execute();
+		}
+		else
+		{
+			stub_app_timer_run(TEST_IDLE_TICKS, main_loop);
+		}
+	}
+	TEST_CHECK(stub_pstorage_faults_get() > 0);
+
+	/* the commit is retried by the debounce */
+	stub_pstorage_faults_set(0);
+	for(uint32_t step=0; step<TEST_RETRY_IDLE_STEPS; step++)
+	{
+		if(true == stub_pstorage_run())
+		{
+			sched_execute();
+		}
+		else
+		{
+			stub_app_timer_run(TEST_IDLE_TICKS, main_loop);
+		}
+	}
+
+	TEST_CHECK(false == memory_is_busy());
+	fflush(stdout);
+	_exit((test_failures_get() == 0) ? 0 : 1);
+}
+
+
+/* Function to run boots on the same flash, each one in a forked process */
+static void boots_run(uint32_t first, uint32_t count, uint32_t fault_rate, bool small_only)
+{
+	pid_t pid;
+	int status;
+
+	for(uint32_t boot=first; boot<(first + count); boot++)
+	{
+		fflush(stdout);
+		pid = fork();
+		if(pid == 0)
+		{
+			boot_run(boot, fault_rate, small_only);
+		}
+		else
+		{
+			waitpid(pid, &status, 0);
+			TEST_CHECK(WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+		}
+	}
+
+	/* records written by the last boot are read back */
+	fflush(stdout);
+	pid = fork();
+	if(pid == 0)
+	{
+		stub_pstorage_power_loss_set(0, NULL);
+		memory_restore();
+		records_check(TEST_CONFIG_INDEX);
+		TEST_CHECK(true == memory_init(default_values, NULL));
+		records_check(TEST_NUM_OF_RECORDS);
+		fflush(stdout);
+		_exit((test_failures_get() == 0) ? 0 : 1);
+	}
+	else
+	{
+		waitpid(pid, &status, 0);
+		TEST_CHECK(WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+	}
+}
+
+
+/* Function to run a boot until the power loss. It never returns */
+static void boot_run(uint32_t boot, uint32_t fault_rate, bool small_only)
+{
+	uint32_t budget;
+	uint32_t seq;
+	uint8_t index;
+	bool accepted;
+
+	test_srand(boot + 1);
+	budget = test_rand() % (((boot % TEST_LONG_BOOT_RATE) == 0) ? TEST_LONG_BUDGET_WORDS : TEST_SHORT_BUDGET_WORDS);
+	stub_pstorage_power_loss_set(budget, power_loss);
+	stub_pstorage_faults_set(fault_rate);
+
+	/* records are read before persistent storage init, CONFIG values once published by memory 
+	   init */
+	memory_restore();
+	records_check(TEST_CONFIG_INDEX);
+	stub_app_timer_init(TEST_OP_QUEUE_SIZE);
+	vtimer_init();
+	TEST_CHECK(true == memory_init(default_values, NULL));
+	records_check(TEST_NUM_OF_RECORDS);
+
+	for(uint32_t step=0; step<TEST_BOOT_STEPS; step++)
+	{
+		if((test_rand() % 4) == 0)
+		{
+			/* write a record: CONFIG values 1 in 2 writes, one of the others 1 in 2 */
+			index = (uint8_t)(test_rand() % (2 * TEST_CONFIG_INDEX));
+			index = ((true == small_only) || (index >= TEST_CONFIG_INDEX)) ? TEST_CONFIG_INDEX : index;
+			p_shared->requested[index]++;
+			seq = p_shared->requested[index];
+			record_fill(index, seq, (uint8_t *)record_buffers[index]);
+			if(index == TEST_CONFIG_INDEX)
+			{
+				/* written after the debounce or at the next flush */
+				accepted = memory_update_field(0, (uint8_t *)record_buffers[index], test_lengths[index]);
+				config_updated = seq;
+			}
+			else
+			{
+				accepted = memory_record_write(test_ids[index], (const uint8_t *)record_buffers[index], test_lengths[index], record_write_cb);
+			}
+
+			/* refused only after a persistent storage failure */
+			TEST_CHECK((true == accepted) || (fault_rate != 0));
+			sched_execute();
+		}
+		else if(true == stub_pstorage_run())
+		{
+			sched_execute();
+		}
+		else if(true == memory_is_busy())
+		{
+			/* flash idle: retries are issued by timers */
+			stub_app_timer_run(TEST_IDLE_TICKS, main_loop);
+		}
+		else
+		{
+			/* memory idle: flushes are completed */
+			records_complete();
+
+			if((test_rand() % TEST_FLUSH_RATE) == 0)
+			{
+				accepted = memory_flush();
+				TEST_CHECK((true == accepted) || (fault_rate != 0));
+				config_flushed = (fault_rate == 0) ? config_updated : 0;
+			}
+			else
+			{
+				/* the debounce may expire */
+				stub_app_timer_run(TEST_IDLE_TICKS, main_loop);
+			}
+		}
+	}
+
+	power_loss();
+}
+
+
+/* Function to check the first count stored records against completed and requested writes. 
+   Records read are durable: a later boot must not read older ones */
+static void records_check(uint8_t count)
+{
+	uint32_t seq;
+
+	for(uint8_t i=0; i<count; i++)
+	{
+		if(true == record_get(i, &seq))
+		{
+			TEST_CHECK(seq >= p_shared->completed[i]);
+			TEST_CHECK(seq <= p_shared->requested[i]);
+			p_shared->completed[i] = seq;
+		}
+		else
+		{
+			/* never written */
+			TEST_CHECK(p_shared->completed[i] == 0);
+		}
+	}
+}
+
+
+/* Function to complete flushes once memory is not busy: stored records are durable, and so are 
+   the flushed CONFIG values */
+static void records_complete(void)
+{
+	uint32_t seq;
+
+	for(uint8_t i=0; i<TEST_CONFIG_INDEX; i++)
+	{
+		if((true == record_get(i, &seq))
+		&& (seq != p_shared->completed[i]))
+		{
+			TEST_CHECK(seq > p_shared->completed[i]);
+			TEST_CHECK(seq <= p_shared->requested[i]);
+			p_shared->completed[i] = seq;
+		}
+		else
+		{
+			/* nothing new */
+		}
+	}
+	p_shared->completed[TEST_CONFIG_INDEX] = MAX(p_shared->completed[TEST_CONFIG_INDEX], config_flushed);
+}
+
+
+/* Function to read a stored record and get its sequence. Data must match the sequence. CONFIG 
+   values are the published ones, stored only if not the defaults (sequence 0) */
+static bool record_get(uint8_t index, uint32_t *p_seq)
+{
+	uint8_t data[TEST_MAX_RECORD_LENGTH];
+	uint8_t expected[TEST_MAX_RECORD_LENGTH];
+	bool found;
+
+	if(index == TEST_CONFIG_INDEX)
+	{
+		memory_config_get(data);
+		found = (0 != memcmp(data, default_values, MEM_BUFFER_DATA_LENGTH));
+	}
+	else
+	{
+		found = memory_record_read(test_ids[index], data, test_lengths[index]);
+	}
+
+	if(true == found)
+	{
+		memcpy(p_seq, data, sizeof(uint32_t));
+		record_fill(index, *p_seq, expected);
+		TEST_CHECK(0 == memcmp(data, expected, test_lengths[index]));
+	}
+	else
+	{
+		/* not stored */
+	}
+
+	return found;
+}
+
+
+/* Function to fill record data for a sequence */
+static void record_fill(uint8_t index, uint32_t seq, uint8_t *p_data)
+{
+	memcpy(p_data, &seq, sizeof(seq));
+	for(uint16_t i=sizeof(seq); i<test_lengths[index]; i++)
+	{
+		p_data[i] = (uint8_t)((seq * 7) + i + index);
+	}
+}
+
+
+/* Record write completion callback: the written sequence is durable */
+static void record_write_cb(uint8_t id, uint8_t result)
+{
+	uint32_t seq;
+
+	if(result == MEM_RESULT_SUCCESS)
+	{
+		for(uint8_t i=0; i<TEST_NUM_OF_RECORDS; i++)
+		{
+			if((test_ids[i] == id)
+			&& (true == record_get(i, &seq)))
+			{
+				TEST_CHECK(seq >= p_shared->completed[i]);
+				p_shared->completed[i] = seq;
+			}
+			else
+			{
+				/* another record */
+			}
+		}
+	}
+	else
+	{
+		/* replaced or failed */
+	}
+}
+
+
+/* Power loss handler: the boot ends with the result of its checks */
+static void power_loss(void)
+{
+	p_shared->writes += memory_flash_writes_get();
+	p_shared->erases += stub_pstorage_erases_get();
+	p_shared->faults += stub_pstorage_faults_get();
+	fflush(stdout);
+	_exit((test_failures_get() == 0) ? 0 : 1);
+}
+
+
+/* Main loop function: it runs the posted tasks */
+static void main_loop(void)
+{
+	sched_execute();
+}
+
+
+
+
+/* End of file */
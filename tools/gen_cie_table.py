@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+
+# The MIT License (MIT)
+#
+# Copyright (c) 2015 Marco Russi
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+# Generate the CIE 1931 lightness lookup table used by led_strip.c.
+# Each entry maps a lightness level (0 .. 2^bits - 1) to the related linear
+# luminance as a fraction of the full PWM period (0 .. 65535).
+#
+# usage: gen_cie_table.py <output_header> [level_bits]
+
+import sys
+
+LEVEL_BITS_DEFAULT = 12
+OUTPUT_MAX_VALUE = 65535
+VALUES_PER_LINE = 12
+
+
+def cie_luminance(lightness):
+    # lightness is in range 0 .. 100, luminance is returned in range 0 .. 1
+    if lightness <= 8.0:
+        return lightness / 903.3
+    return ((lightness + 16.0) / 116.0) ** 3
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.stderr.write("usage: gen_cie_table.py <output_header> [level_bits]\n")
+        return 1
+
+    level_bits = LEVEL_BITS_DEFAULT
+    if len(sys.argv) > 2:
+        level_bits = int(sys.argv[2])
+
+    num_of_levels = 1 << level_bits
+    max_level = num_of_levels - 1
+
+    values = []
+    for level in range(num_of_levels):
+        luminance = cie_luminance((100.0 * level) / max_level)
+        values.append(int(round(luminance * OUTPUT_MAX_VALUE)))
+
+    lines = []
+    lines.append("/* ATTENTION: this file is generated by tools/gen_cie_table.py. Do not edit it */")
+    lines.append("")
+    lines.append("/* Number of bits of a lightness level */")
+    lines.append("#define CIE_TABLE_LEVEL_BITS\t\t\t%d" % level_bits)
+    lines.append("")
+    lines.append("/* Maximum value of a table entry, corresponding to the full PWM period */")
+    lines.append("#define CIE_TABLE_MAX_VALUE\t\t\t%d" % OUTPUT_MAX_VALUE)
+    lines.append("")
+    lines.append("/* CIE 1931 lightness to luminance table */")
+    lines.append("static const uint16_t cie_table[%d] =" % num_of_levels)
+    lines.append("{")
+    for i in range(0, num_of_levels, VALUES_PER_LINE):
+        chunk = ", ".join("%5d" % v for v in values[i:i + VALUES_PER_LINE])
+        lines.append("\t%s," % chunk)
+    lines.append("};")
+    lines.append("")
+
+    with open(sys.argv[1], "w") as out_file:
+        out_file.write("\n".join(lines))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
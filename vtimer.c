@@ -0,0 +1,627 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* ------------- Inclusions --------------- */
+
+#include <string.h>
+#include "nordic_common.h"
+#include "nrf.h"
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+
+#include "config.h"
+#include "vtimer.h"
+
+
+
+
+/* ------------- Local defines --------------- */
+
+/* Number of RTC ticks of a wheel tick, as a power of 2: a wheel tick is 32 RTC ticks (0.977 ms) */
+#define VTIMER_TICK_RTC_BITS					5
+
+/* Number of index bits of a wheel level */
+#define VTIMER_LEVEL_BITS						5
+
+/* Number of slots of a wheel level */
+#define VTIMER_LEVEL_SLOTS						(1UL << VTIMER_LEVEL_BITS)
+
+/* Mask to get a slot index */
+#define VTIMER_SLOT_MASK						(VTIMER_LEVEL_SLOTS - 1)
+
+/* Number of wheel levels. Level n slots are 32^n wheel ticks long */
+#define VTIMER_NUM_OF_LEVELS					4
+
+/* Maximum timeout in wheel ticks covered by the wheel */
+#define VTIMER_MAX_TICKS						((1UL << (VTIMER_LEVEL_BITS * VTIMER_NUM_OF_LEVELS)) - 1)
+
+/* Mask of the 24 bit RTC counter */
+#define VTIMER_RTC_MASK							0x00FFFFFF
+
+/* Minimum timeout accepted by app_timer in RTC ticks */
+#define VTIMER_MIN_ARM_RTC_TICKS				5
+
+/* Maximum hardware timeout in RTC ticks (128 s), so wheel time is synced before RTC wraps */
+#define VTIMER_MAX_ARM_RTC_TICKS				(1UL << 22)
+
+/* Macro to convert ms to wheel ticks, rounding up: a wheel tick is 1000 / 1024 ms */
+#define MS_TO_VTIMER_TICKS(MS)				((((MS) * 1024UL) + 999) / 1000)
+
+#if MS_TO_VTIMER_TICKS(VTIMER_MAX_TIMEOUT_MS) > VTIMER_MAX_TICKS
+#error VTIMER_MAX_TIMEOUT_MS exceeds the wheel range
+#endif
+
+
+
+
+/* ------------- Local variables --------------- */
+
+/* Hardware timer driving the wheel */
+APP_TIMER_DEF(hw_timer);
+
+/* Wheel slots. Each slot is a list of timers */
+static vtimer_st *slots[VTIMER_NUM_OF_LEVELS][VTIMER_LEVEL_SLOTS];
+
+/* Bitmaps of non empty slots, one for each level */
+static uint32_t slot_bitmaps[VTIMER_NUM_OF_LEVELS];
+
+/* Next wheel tick to be processed */
+static uint32_t wheel_now = 0;
+
+/* Current wheel time in wheel ticks, synced from RTC */
+static uint32_t ref_ticks = 0;
+
+/* RTC counter value at the start of current wheel tick */
+static uint32_t ref_rtc = 0;
+
+/* Flag indicating that hardware timer is armed */
+static bool hw_armed = false;
+
+/* Wheel tick the hardware timer is armed to */
+static uint32_t hw_deadline = 0;
+
+/* Flag indicating that wheel events are being processed */
+static bool wheel_processing = false;
+
+/* Number of hardware timer wakeups */
+static volatile uint32_t hw_wakeups = 0;
+
+
+
+
+/* ------------- Local functions prototypes --------------- */
+
+static void time_sync				(void);
+static uint32_t first_slot_get	(uint32_t, uint32_t);
+static bool next_event_get			(uint32_t *);
+static void wheel_catch_up			(void);
+static void slot_insert				(vtimer_st *);
+static void slot_remove				(vtimer_st *);
+static void slot_cascade			(uint8_t);
+static void slot_expire				(void);
+static void hw_timer_arm			(void);
+static void hw_timeout_handler	(void *);
+
+
+
+
+/* ------------- Exported functions --------------- */
+
+/* Function to init virtual timers. app_timer must be initialized before */
+void vtimer_init(void)
+{
+	uint32_t err_code;
+
+	memset(slots, 0, sizeof(slots));
+	memset(slot_bitmaps, 0, sizeof(slot_bitmaps));
+
+	app_timer_cnt_get(&ref_rtc);
+	ref_ticks = 0;
+	wheel_now = 0;
+
+	err_code = app_timer_create(&hw_timer, APP_TIMER_MODE_SINGLE_SHOT, hw_timeout_handler);
+	APP_ERROR_CHECK(err_code);
+}
+
+
+/* Function to create a virtual timer */
+void vtimer_create(vtimer_st *p_timer, uint8_t mode, vtimer_handler_t handler)
+{
+	memset(p_timer, 0, sizeof(vtimer_st));
+	p_timer->mode = mode;
+	p_timer->handler = handler;
+}
+
+
+/* Function to start a virtual timer. A running timer is restarted. Timeout is in ms, it is 
+   rounded up to wheel ticks and limited to VTIMER_MAX_TIMEOUT_MS */
+void vtimer_start(vtimer_st *p_timer, uint32_t timeout_ms, void *p_context)
+{
+	uint32_t ticks;
+
+	if(timeout_ms > VTIMER_MAX_TIMEOUT_MS)
+	{
+		timeout_ms = VTIMER_MAX_TIMEOUT_MS;
+	}
+	else
+	{
+		/* valid timeout */
+	}
+
+	ticks = MS_TO_VTIMER_TICKS(timeout_ms);
+	if(ticks == 0)
+	{
+		ticks = 1;
+	}
+	else
+	{
+		/* do nothing */
+	}
+
+	CRITICAL_REGION_ENTER();
+
+	if(true == p_timer->running)
+	{
+		slot_remove(p_timer);
+	}
+	else
+	{
+		/* do nothing */
+	}
+
+	time_sync();
+	wheel_catch_up();
+
+	p_timer->period = ticks;
+	p_timer->p_context = p_context;
+	p_timer->expiry = ref_ticks + ticks;
+	p_timer->running = true;
+	slot_insert(p_timer);
+
+	hw_timer_arm();
+
+	CRITICAL_REGION_EXIT();
+}
+
+
+/* Function to stop a virtual timer. The hardware timer is not rearmed: a wakeup for a stopped 
+   timer just finds nothing to expire */
+void vtimer_stop(vtimer_st *p_timer)
+{
+	CRITICAL_REGION_ENTER();
+
+	if(true == p_timer->running)
+	{
+		slot_remove(p_timer);
+		p_timer->running = false;
+	}
+	else
+	{
+		/* already stopped: do nothing */
+	}
+
+	CRITICAL_REGION_EXIT();
+}
+
+
+/* Function to know if a virtual timer is running */
+bool vtimer_is_running(const vtimer_st *p_timer)
+{
+	return p_timer->running;
+}
+
+
+/* Function to get the number of hardware timer wakeups */
+uint32_t vtimer_wakeups_get(void)
+{
+	return hw_wakeups;
+}
+
+
+
+
+/* ------------- Local functions --------------- */
+
+/* Function to sync current wheel time with RTC counter. 
+   ATTENTION: it must be called in a critical region */
+static void time_sync(void)
+{
+	uint32_t rtc;
+	uint32_t ticks;
+
+	app_timer_cnt_get(&rtc);
+	ticks = ((rtc - ref_rtc) & VTIMER_RTC_MASK) >> VTIMER_TICK_RTC_BITS;
+	ref_ticks += ticks;
+	ref_rtc = (ref_rtc + (ticks << VTIMER_TICK_RTC_BITS)) & VTIMER_RTC_MASK;
+}
+
+
+/* Function to get the distance from start slot to the first non empty slot of a bitmap. 
+   Bitmap must not be empty */
+static uint32_t first_slot_get(uint32_t bitmap, uint32_t start)
+{
+	uint32_t rotated;
+
+	if(start == 0)
+	{
+		rotated = bitmap;
+	}
+	else
+	{
+		rotated = (bitmap >> start) | (bitmap << (VTIMER_LEVEL_SLOTS - start));
+	}
+
+	return (uint32_t)__builtin_ctz(rotated);
+}
+
+
+/* Function to get the next wheel tick with some work: a level 0 slot to expire or a higher 
+   level slot to cascade. Empty slots are skipped with bitmaps, so it does not depend on the 
+   number of timers. It returns false if the wheel is empty. 
+   ATTENTION: it must be called in a critical region */
+static bool next_event_get(uint32_t *p_tick)
+{
+	uint8_t level;
+	uint32_t shift;
+	uint32_t cursor;
+	uint32_t distance;
+	uint32_t tick;
+	uint32_t best_distance = 0;
+	bool found = false;
+
+	for(level = 0; level < VTIMER_NUM_OF_LEVELS; level++)
+	{
+		if(slot_bitmaps[level] != 0)
+		{
+			shift = level * VTIMER_LEVEL_BITS;
+			cursor = (wheel_now >> shift) & VTIMER_SLOT_MASK;
+
+			if(level == 0)
+			{
+				/* level 0 timers expire within a turn */
+				tick = wheel_now + first_slot_get(slot_bitmaps[0], cursor);
+			}
+			else if(((wheel_now & ((1UL << shift) - 1)) == 0) 
+				&& ((slot_bitmaps[level] & (1UL << cursor)) != 0))
+			{
+				/* current slot is cascaded now */
+				tick = wheel_now;
+			}
+			else
+			{
+				/* first non empty slot after current one, up to current one at next turn */
+				tick = ((wheel_now >> shift) + 1 + first_slot_get(slot_bitmaps[level], (cursor + 1) & VTIMER_SLOT_MASK)) << shift;
+			}
+
+			distance = tick - wheel_now;
+			if((false == found) || (distance < best_distance))
+			{
+				best_distance = distance;
+				*p_tick = tick;
+				found = true;
+			}
+			else
+			{
+				/* do nothing */
+			}
+		}
+		else
+		{
+			/* empty level */
+		}
+	}
+
+	return found;
+}
+
+
+/* Function to move the wheel to current time when nothing is due before it. It keeps the 
+   distance between wheel and new expiries in the wheel range after long idle periods. 
+   ATTENTION: it must be called in a critical region after time_sync */
+static void wheel_catch_up(void)
+{
+	uint32_t next;
+
+	if((true == wheel_processing) || ((true == next_event_get(&next)) && ((int32_t)(next - ref_ticks) <= 0)))
+	{
+		/* the wheel is moved by the hardware timeout handler: new expiries must not fall in the 
+		   slot being expired */
+	}
+	else
+	{
+		wheel_now = ref_ticks + 1;
+	}
+}
+
+
+/* Function to insert a timer into its wheel slot. The level is chosen by the distance to the 
+   expiry, the slot by the expiry bits of the level. 
+   ATTENTION: it must be called in a critical region */
+static void slot_insert(vtimer_st *p_timer)
+{
+	uint32_t delta;
+	uint8_t level;
+
+	if((int32_t)(p_timer->expiry - wheel_now) < 0)
+	{
+		/* expired yet: run at next wheel tick */
+		p_timer->expiry = wheel_now;
+	}
+	else
+	{
+		/* do nothing */
+	}
+
+	delta = p_timer->expiry - wheel_now;
+	level = 0;
+	while((level < (VTIMER_NUM_OF_LEVELS - 1)) && (delta >= (1UL << ((level + 1) * VTIMER_LEVEL_BITS))))
+	{
+		level++;
+	}
+
+	p_timer->level = level;
+	p_timer->slot = (p_timer->expiry >> (level * VTIMER_LEVEL_BITS)) & VTIMER_SLOT_MASK;
+
+	/* push timer in front of slot list */
+	p_timer->p_next = slots[level][p_timer->slot];
+	if(p_timer->p_next != NULL)
+	{
+		p_timer->p_next->pp_prev = &p_timer->p_next;
+	}
+	else
+	{
+		/* first timer in the slot */
+	}
+	p_timer->pp_prev = &slots[level][p_timer->slot];
+	slots[level][p_timer->slot] = p_timer;
+	slot_bitmaps[level] |= (1UL << p_timer->slot);
+}
+
+
+/* Function to remove a timer from its wheel slot. 
+   ATTENTION: it must be called in a critical region */
+static void slot_remove(vtimer_st *p_timer)
+{
+	*p_timer->pp_prev = p_timer->p_next;
+	if(p_timer->p_next != NULL)
+	{
+		p_timer->p_next->pp_prev = p_timer->pp_prev;
+	}
+	else
+	{
+		/* last timer in the slot */
+	}
+
+	if(slots[p_timer->level][p_timer->slot] == NULL)
+	{
+		slot_bitmaps[p_timer->level] &= ~(1UL << p_timer->slot);
+	}
+	else
+	{
+		/* slot still used */
+	}
+
+	p_timer->p_next = NULL;
+	p_timer->pp_prev = NULL;
+}
+
+
+/* Function to move the timers of current slot of a level into lower levels. 
+   ATTENTION: it must be called in a critical region */
+static void slot_cascade(uint8_t level)
+{
+	uint32_t slot;
+	vtimer_st *p_timer;
+
+	slot = (wheel_now >> (level * VTIMER_LEVEL_BITS)) & VTIMER_SLOT_MASK;
+	p_timer = slots[level][slot];
+	while(p_timer != NULL)
+	{
+		slot_remove(p_timer);
+		slot_insert(p_timer);
+		p_timer = slots[level][slot];
+	}
+}
+
+
+/* Function to expire the timers of current level 0 slot. Handlers run out of critical region, 
+   so they can start and stop timers */
+static void slot_expire(void)
+{
+	uint32_t slot;
+	vtimer_st *p_timer;
+	vtimer_handler_t handler = NULL;
+	void *p_context = NULL;
+
+	slot = wheel_now & VTIMER_SLOT_MASK;
+	do
+	{
+		CRITICAL_REGION_ENTER();
+
+		p_timer = slots[0][slot];
+		if(p_timer != NULL)
+		{
+			slot_remove(p_timer);
+			handler = p_timer->handler;
+			p_context = p_timer->p_context;
+
+			if(p_timer->mode == VTIMER_MODE_REPEATED)
+			{
+				/* keep period without drift, but never in current slot */
+				p_timer->expiry += p_timer->period;
+				if((int32_t)(p_timer->expiry - wheel_now) <= 0)
+				{
+					p_timer->expiry = wheel_now + 1;
+				}
+				else
+				{
+					/* do nothing */
+				}
+				slot_insert(p_timer);
+			}
+			else
+			{
+				p_timer->running = false;
+			}
+		}
+		else
+		{
+			/* slot empty */
+		}
+
+		CRITICAL_REGION_EXIT();
+
+		if(p_timer != NULL)
+		{
+			handler(p_context);
+		}
+		else
+		{
+			/* do nothing */
+		}
+	}
+	while(p_timer != NULL);
+}
+
+
+/* Function to arm the hardware timer to next wheel event, if not armed or if the event is 
+   earlier than the armed one. An arm is a single app_timer start, which restarts the running 
+   timer with the new timeout. While wheel events are processed it is armed by the hardware 
+   timeout handler at the end, so timers started by handlers take no app_timer operation. 
+   ATTENTION: it must be called in a critical region after time_sync */
+static void hw_timer_arm(void)
+{
+	uint32_t err_code;
+	uint32_t next;
+	uint32_t rtc;
+	uint32_t rtc_ticks;
+	uint32_t partial_ticks;
+
+	if((false == wheel_processing)
+		&& (true == next_event_get(&next)) 
+		&& ((false == hw_armed) || ((int32_t)(next - hw_deadline) < 0)))
+	{
+		app_timer_cnt_get(&rtc);
+		partial_ticks = (rtc - ref_rtc) & VTIMER_RTC_MASK;
+
+		if((int32_t)(next - ref_ticks) <= 0)
+		{
+			rtc_ticks = VTIMER_MIN_ARM_RTC_TICKS;
+		}
+		else if((next - ref_ticks) >= (VTIMER_MAX_ARM_RTC_TICKS >> VTIMER_TICK_RTC_BITS))
+		{
+			/* wake up before RTC wraps and arm again */
+			next = ref_ticks + (VTIMER_MAX_ARM_RTC_TICKS >> VTIMER_TICK_RTC_BITS);
+			rtc_ticks = VTIMER_MAX_ARM_RTC_TICKS - partial_ticks;
+		}
+		else
+		{
+			rtc_ticks = ((next - ref_ticks) << VTIMER_TICK_RTC_BITS) - partial_ticks;
+			if(rtc_ticks < VTIMER_MIN_ARM_RTC_TICKS)
+			{
+				rtc_ticks = VTIMER_MIN_ARM_RTC_TICKS;
+			}
+			else
+			{
+				/* valid timeout */
+			}
+		}
+
+		err_code = app_timer_start(hw_timer, rtc_ticks, NULL);
+		APP_ERROR_CHECK(err_code);
+
+		hw_armed = true;
+		hw_deadline = next;
+	}
+	else
+	{
+		/* wheel empty, armed yet to an earlier event, or armed at the end of processing */
+	}
+}
+
+
+/* Hardware timer timeout handler. It processes all wheel events up to current time, skipping 
+   empty slots, then arms the hardware timer to the next event */
+static void hw_timeout_handler(void * p_context)
+{
+	uint8_t level;
+	uint32_t next;
+	bool done = false;
+
+	UNUSED_PARAMETER(p_context);
+
+	hw_wakeups++;
+	wheel_processing = true;
+
+	while(false == done)
+	{
+		CRITICAL_REGION_ENTER();
+
+		hw_armed = false;
+		time_sync();
+
+		if((false == next_event_get(&next)) || ((int32_t)(next - ref_ticks) > 0))
+		{
+			/* nothing else due: move the wheel to current time */
+			wheel_now = ref_ticks + 1;
+			wheel_processing = false;
+			hw_timer_arm();
+			done = true;
+		}
+		else
+		{
+			wheel_now = next;
+
+			/* cascade higher levels whose lower index bits wrapped */
+			level = 1;
+			while((level < VTIMER_NUM_OF_LEVELS) 
+				&& ((wheel_now & ((1UL << (level * VTIMER_LEVEL_BITS)) - 1)) == 0))
+			{
+				slot_cascade(level);
+				level++;
+			}
+		}
+
+		CRITICAL_REGION_EXIT();
+
+		if(false == done)
+		{
+			slot_expire();
+
+			CRITICAL_REGION_ENTER();
+			wheel_now++;
+			CRITICAL_REGION_EXIT();
+		}
+		else
+		{
+			/* do nothing */
+		}
+	}
+}
+
+
+
+
+/* End of file */
@@ -0,0 +1,86 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+
+
+/* ------------- Inclusions --------------- */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+
+
+/* ------------- Exported defines --------------- */
+
+/* Maximum timeout of a virtual timer in ms (about 17 min) */
+#define VTIMER_MAX_TIMEOUT_MS					1000000
+
+
+
+
+/* ------------- Exported typedefs --------------- */
+
+/* Virtual timer modes enum */
+typedef enum
+{
+	VTIMER_MODE_SINGLE_SHOT,
+	VTIMER_MODE_REPEATED
+} vtimer_mode_e;
+
+/* Virtual timer timeout handler type. It runs in the app_timer interrupt context */
+typedef void (*vtimer_handler_t)(void *);
+
+/* Virtual timer structure. 
+   ATTENTION: fields are managed by the vtimer module only, they are exported for static allocation */
+typedef struct vtimer_s
+{
+	struct vtimer_s *p_next;		/* next timer in the same slot */
+	struct vtimer_s **pp_prev;		/* pointer to the link to this timer */
+	uint32_t expiry;					/* expiry time in wheel ticks */
+	uint32_t period;					/* period in wheel ticks */
+	vtimer_handler_t handler;		/* timeout handler */
+	void *p_context;					/* timeout handler context */
+	uint8_t mode;						/* single shot or repeated */
+	uint8_t level;						/* wheel level of the timer */
+	uint8_t slot;						/* slot of the timer in its level */
+	bool running;						/* timer is running */
+} vtimer_st;
+
+
+
+
+/* ------------- Exported functions --------------- */
+
+extern void 		vtimer_init				(void);
+extern void 		vtimer_create			(vtimer_st *, uint8_t, vtimer_handler_t);
+extern void 		vtimer_start			(vtimer_st *, uint32_t, void *);
+extern void 		vtimer_stop				(vtimer_st *);
+extern bool 		vtimer_is_running		(const vtimer_st *);
+extern uint32_t 	vtimer_wakeups_get	(void);
+
+
+
+
+/* End of file */
@@ -0,0 +1,396 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/* ------------- Inclusions --------------- */
+
+#include <string.h>
+#include "nordic_common.h"
+#include "nrf.h"
+#include "app_util_platform.h"
+#include "app_error.h"
+
+#include "config.h"
+#include "memory.h"
+#include "scheduler.h"
+#include "vtimer.h"
+#include "whitelist.h"
+
+
+
+
+/* ------------- Local typedefs --------------- */
+
+/* Current state enum */
+typedef enum
+{
+	WL_ERROR_STATE,
+	WL_IDLE_STATE,
+	WL_UPDATE_DATA
+} wl_state_e;
+
+
+
+
+/* ------------- Local defines --------------- */
+
+/* Validity signature of stored addresses */
+#define WL_SIGNATURE										0x57484C31
+
+/* Length of a stored address record in bytes: address type, 6 address bytes and a padding byte */
+#define WL_RECORD_LENGTH_BYTES							8
+
+/* Position of the address type in a record */
+#define WL_RECORD_TYPE_POS								0
+
+/* Position of the first address byte in a record */
+#define WL_RECORD_ADDR_POS								1
+
+/* Position of the signature field in the memory record */
+#define WL_SIGNATURE_FIELD_BYTE_POS					0
+
+/* Position of the number of addresses field in the memory record */
+#define WL_COUNT_FIELD_BYTE_POS						4
+
+/* Position of the first address record in the memory record */
+#define WL_RECORDS_BYTE_POS							8
+
+/* Memory record length in bytes */
+#define WL_BLOCK_SIZE_BYTES							(WL_RECORDS_BYTE_POS + (WHITELIST_MAX_ADDRS * WL_RECORD_LENGTH_BYTES))
+
+/* Delay before storing the addresses again when the record write fails, in ms */
+#define WL_STORE_RETRY_MS								1000	/* 1 s */
+
+/* Number of store retries after a failed record write */
+#define WL_STORE_MAX_RETRIES							3
+
+
+#if WL_BLOCK_SIZE_BYTES > MEM_RECORD_MAX_LENGTH
+#error "whitelist record is too long"
+#endif
+
+
+
+
+/* ------------- Local variables --------------- */
+
+/* Current whitelist storage state */
+static volatile uint8_t curr_state = WL_IDLE_STATE;
+
+/* Memory record data to load or store. They are read when the write starts */
+static uint8_t block_data[WL_BLOCK_SIZE_BYTES];
+
+/* Trusted controller addresses */
+static ble_gap_addr_t addrs[WHITELIST_MAX_ADDRS];
+
+/* Pointers to trusted controller addresses as requested by the SoftDevice */
+static ble_gap_addr_t *p_addrs[WHITELIST_MAX_ADDRS];
+
+/* Number of store retries done since the last requested store */
+static uint8_t store_retries = 0;
+
+/* Store retry timer */
+static vtimer_st store_timer;
+
+/* Task storing the addresses again */
+static uint8_t store_task = SCHED_INVALID_TASK;
+
+/* SoftDevice whitelist */
+static ble_gap_whitelist_t whitelist = 
+{
+	.pp_addrs = p_addrs,
+	.addr_count = 0,
+	.pp_irks = NULL,
+	.irk_count = 0
+};
+
+
+
+
+/* ------------- Local functions prototypes --------------- */
+
+static bool block_data_store(void);
+static void record_write_cb(uint8_t, uint8_t);
+static void store_timeout_handler(void *);
+static void store_retry(void);
+static void block_data_parse(void);
+
+
+
+
+/* ------------- Exported functions --------------- */
+
+/* Function to init whitelist and load stored addresses. It returns true if trusted controllers 
+   are stored. 
+   ATTENTION: memory must be already initialised by memory_init() */
+bool whitelist_init(void)
+{
+	for(uint8_t i=0; i<WHITELIST_MAX_ADDRS; i++)
+	{
+		p_addrs[i] = &addrs[i];
+	}
+
+	/* create store retry task, then init its timer */
+	store_task = sched_task_create(store_retry, SCHED_PRIO_NORMAL);
+	APP_ERROR_CHECK_BOOL(store_task != SCHED_INVALID_TASK);
+	vtimer_create(&store_timer, VTIMER_MODE_SINGLE_SHOT, store_timeout_handler);
+
+	/* get stored addresses. None if not stored yet */
+	if(true == memory_record_read(MEM_RECORD_WHITELIST, block_data, WL_BLOCK_SIZE_BYTES))
+	{
+		block_data_parse();
+	}
+	else
+	{
+		whitelist.addr_count = 0;
+	}
+
+	return (whitelist.addr_count > 0);
+}
+
+
+/* Function to get whitelist storage status: busy until the last store is written */
+bool whitelist_is_busy(void)
+{
+	bool is_busy = false;
+
+	if(curr_state == WL_UPDATE_DATA)
+	{
+		is_busy = true;
+	}
+
+	return is_busy;
+}
+
+
+/* Function to add a trusted controller address. It returns true if the address has been added */
+bool whitelist_add(const ble_gap_addr_t *p_addr)
+{
+	bool added = false;
+	bool found = false;
+
+	for(uint8_t i=0; i<whitelist.addr_count; i++)
+	{
+		if((addrs[i].addr_type == p_addr->addr_type)
+		&& (0 == memcmp(addrs[i].addr, p_addr->addr, BLE_GAP_ADDR_LEN)))
+		{
+			found = true;
+			break;
+		}
+	}
+
+	/* if new address and there is room for it */
+	if((found == false)
+	&& (whitelist.addr_count < WHITELIST_MAX_ADDRS))
+	{
+		addrs[whitelist.addr_count] = *p_addr;
+		whitelist.addr_count++;
+		added = true;
+	}
+	else
+	{
+		/* already trusted or whitelist full */
+	}
+
+	return added;
+}
+
+
+/* Function to remove all trusted controller addresses. Call whitelist_store() to make it persistent */
+void whitelist_clear(void)
+{
+	whitelist.addr_count = 0;
+}
+
+
+/* Function to store trusted controller addresses in persistent memory. They are written as a 
+   memory record: a store requested while the previous one is waiting replaces it. A failed write 
+   is retried up to WL_STORE_MAX_RETRIES times. It returns false if the record is not accepted by 
+   the memory module */
+bool whitelist_store(void)
+{
+	bool ps_success;
+
+	/* new addresses: retries start again */
+	vtimer_stop(&store_timer);
+	store_retries = 0;
+
+	ps_success = block_data_store();
+	if(false == ps_success)
+	{
+		/* not accepted: persistent storage failure */
+		curr_state = WL_ERROR_STATE;
+	}
+	else
+	{
+		/* wait for completion */
+	}
+
+	return ps_success;
+}
+
+
+/* Function to get the number of trusted controller addresses */
+uint8_t whitelist_count_get(void)
+{
+	return whitelist.addr_count;
+}
+
+
+/* Function to get the SoftDevice whitelist of trusted controllers */
+ble_gap_whitelist_t * whitelist_get(void)
+{
+	return &whitelist;
+}
+
+
+
+
+/* ------------- Local functions --------------- */
+
+/* Function to write the current addresses as a memory record. It returns false if the record is 
+   not accepted by the memory module, the storage state is left to the caller then */
+static bool block_data_store(void)
+{
+	bool ps_success;
+	const uint32_t signature = WL_SIGNATURE;
+	const uint32_t count = whitelist.addr_count;
+
+	/* data are read by the flash callback when the write starts */
+	CRITICAL_REGION_ENTER();
+	memset(block_data, 0xFF, WL_BLOCK_SIZE_BYTES);
+	memcpy(&block_data[WL_SIGNATURE_FIELD_BYTE_POS], &signature, sizeof(signature));
+	memcpy(&block_data[WL_COUNT_FIELD_BYTE_POS], &count, sizeof(count));
+	for(uint8_t i=0; i<whitelist.addr_count; i++)
+	{
+		block_data[WL_RECORDS_BYTE_POS + (i * WL_RECORD_LENGTH_BYTES) + WL_RECORD_TYPE_POS] = addrs[i].addr_type;
+		memcpy(&block_data[WL_RECORDS_BYTE_POS + (i * WL_RECORD_LENGTH_BYTES) + WL_RECORD_ADDR_POS], addrs[i].addr, BLE_GAP_ADDR_LEN);
+	}
+	CRITICAL_REGION_EXIT();
+
+	ps_success = memory_record_write(MEM_RECORD_WHITELIST, block_data, WL_BLOCK_SIZE_BYTES, record_write_cb);
+	if(true == ps_success)
+	{
+		/* wait for completion */
+		curr_state = WL_UPDATE_DATA;
+	}
+	else
+	{
+		/* not accepted */
+	}
+
+	return ps_success;
+}
+
+/* Function to get trusted controller addresses from loaded block data */
+static void block_data_parse(void)
+{
+	uint32_t signature;
+	uint32_t count;
+
+	memcpy(&signature, &block_data[WL_SIGNATURE_FIELD_BYTE_POS], sizeof(signature));
+	memcpy(&count, &block_data[WL_COUNT_FIELD_BYTE_POS], sizeof(count));
+
+	/* if data are valid */
+	if((signature == WL_SIGNATURE)
+	&& (count <= WHITELIST_MAX_ADDRS))
+	{
+		for(uint8_t i=0; i<count; i++)
+		{
+			addrs[i].addr_type = block_data[WL_RECORDS_BYTE_POS + (i * WL_RECORD_LENGTH_BYTES) + WL_RECORD_TYPE_POS];
+			memcpy(addrs[i].addr, &block_data[WL_RECORDS_BYTE_POS + (i * WL_RECORD_LENGTH_BYTES) + WL_RECORD_ADDR_POS], BLE_GAP_ADDR_LEN);
+		}
+		whitelist.addr_count = (uint8_t)count;
+	}
+	else
+	{
+		/* no trusted controllers stored yet */
+		whitelist.addr_count = 0;
+	}
+}
+
+
+/* Memory record write completion callback. It runs in the main loop */
+static void record_write_cb(uint8_t id, uint8_t result)
+{
+	UNUSED_PARAMETER(id);
+
+	if(result == MEM_RESULT_SUCCESS)
+	{
+		/* store success: go to IDLE */
+		curr_state = WL_IDLE_STATE;
+	}
+	else if((result == MEM_RESULT_ERROR)
+	&& (store_retries < WL_STORE_MAX_RETRIES))
+	{
+		/* stored addresses are the previous ones: store the current ones again later */
+		store_retries++;
+		vtimer_start(&store_timer, WL_STORE_RETRY_MS, NULL);
+	}
+	else if(result == MEM_RESULT_ERROR)
+	{
+		/* retries are over: stored addresses are the previous ones */
+		curr_state = WL_ERROR_STATE;
+	}
+	else
+	{
+		/* replaced by a later store: wait for it */
+	}
+}
+
+
+/* Store retry timeout handler. The current addresses are stored by the related task */
+static void store_timeout_handler(void *p_context)
+{
+	UNUSED_PARAMETER(p_context);
+
+	sched_task_post(store_task);
+}
+
+
+/* Task to store the current addresses again after a failed write. A record not accepted by the 
+   memory module takes a retry as well */
+static void store_retry(void)
+{
+	if(true == block_data_store())
+	{
+		/* completion notified by record_write_cb() */
+	}
+	else if(store_retries < WL_STORE_MAX_RETRIES)
+	{
+		store_retries++;
+		vtimer_start(&store_timer, WL_STORE_RETRY_MS, NULL);
+	}
+	else
+	{
+		/* retries are over: stored addresses are the previous ones */
+		curr_state = WL_ERROR_STATE;
+	}
+}
+
+
+
+
+/* End of file */
+
+
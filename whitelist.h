@@ -0,0 +1,58 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+
+
+/* ------------- Inclusions --------------- */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble_gap.h"
+
+
+
+
+/* ------------- Exported defines --------------- */
+
+/* Maximum number of trusted controller addresses */
+#define WHITELIST_MAX_ADDRS						BLE_GAP_WHITELIST_ADDR_MAX_COUNT
+
+
+
+
+/* ------------- Exported functions --------------- */
+
+extern bool 						whitelist_init			(void);
+extern bool 						whitelist_is_busy		(void);
+extern bool 						whitelist_add			(const ble_gap_addr_t *);
+extern void 						whitelist_clear		(void);
+extern bool 						whitelist_store		(void);
+extern uint8_t 					whitelist_count_get	(void);
+extern ble_gap_whitelist_t *	whitelist_get			(void);
+
+
+
+
+/* End of file */
+